@@ -6,14 +6,21 @@
 #include <QtConcurrent>
 #include <QMultiHash>
 #include <QHash>
+#include <QSet>
 
 #include "color/HeatMap.h"
-#include "math/RInterface.h"
+#include "math/PCA.h"
+#include "math/Embedding.h"
+#include "math/Clustering.h"
 
 #include "ui_analysisClustering.h"
 
+// the nearest spots added for every selected spot when selecting similar spots
+static const uword SIMILAR_SPOTS = 10;
+
 AnalysisClustering::AnalysisClustering(QWidget *parent, Qt::WindowFlags f)
     : QWidget(parent, f)
+    , m_canceled(false)
     , m_ui(new Ui::analysisClustering)
 {
     // setup UI
@@ -22,22 +29,32 @@ AnalysisClustering::AnalysisClustering(QWidget *parent, Qt::WindowFlags f)
 
     connect(m_ui->runClustering, &QPushButton::clicked,
             this, &AnalysisClustering::slotRun);
+    connect(m_ui->cancelClustering, &QPushButton::clicked,
+            this, &AnalysisClustering::slotCancel);
     connect(m_ui->exportPlot, &QPushButton::clicked,
             this, &AnalysisClustering::slotExportPlot);
     connect(m_ui->computeClusters, &QPushButton::clicked,
             this, &AnalysisClustering::slotComputeClusters);
     connect(m_ui->createSelections, &QPushButton::clicked,
             this, &AnalysisClustering::signalClusteringExportSelections);
+    connect(m_ui->computeMarkers, &QPushButton::clicked,
+            this, &AnalysisClustering::signalClusteringMarkers);
+    connect(m_ui->selectSimilar, &QPushButton::clicked,
+            this, &AnalysisClustering::slotSelectSimilar);
     connect(&m_watcher_colors, &QFutureWatcher<void>::finished,
             this, &AnalysisClustering::colorsComputed);
     connect(&m_watcher_classes, &QFutureWatcher<void>::finished,
             this, &AnalysisClustering::classesComputed);
+    connect(this, &AnalysisClustering::signalEmbeddingProgress,
+            this, &AnalysisClustering::slotEmbeddingProgress, Qt::QueuedConnection);
     connect(m_ui->plot, &ChartView::signalLassoSelection,
             this, &AnalysisClustering::slotLassoSelection);
 }
 
 AnalysisClustering::~AnalysisClustering()
 {
+    m_canceled = true;
+    m_watcher_colors.waitForFinished();
 }
 
 void AnalysisClustering::clear()
@@ -49,10 +66,16 @@ void AnalysisClustering::clear()
     m_ui->perplexity->setValue(30);
     m_ui->max_iter->setValue(1000);
     m_ui->init_dims->setValue(50);
+    m_ui->n_neighbors->setValue(15);
+    m_ui->min_dist->setValue(0.1);
+    m_ui->epochs->setValue(500);
     m_ui->progressBar->setTextVisible(true);
     m_ui->exportPlot->setEnabled(false);
     m_ui->runClustering->setEnabled(true);
+    m_ui->cancelClustering->setEnabled(false);
     m_ui->createSelections->setEnabled(false);
+    m_ui->computeMarkers->setEnabled(false);
+    m_ui->selectSimilar->setEnabled(false);
     m_ui->tab->setCurrentIndex(0);
     m_ui->kmeans->setChecked(true);
     m_ui->individual_reads_threshold->setValue(0);
@@ -65,6 +88,10 @@ void AnalysisClustering::clear()
     m_colors.clear();
     m_selected_spots.clear();
     m_reduced_coordinates.clear();
+    m_pca = PCA::Result();
+    m_pca_spots.clear();
+    m_pca_settings.clear();
+    m_index = Neighbors::Index();
 }
 
 QMultiHash<unsigned, QString> AnalysisClustering::getClustersSpot() const
@@ -96,18 +123,31 @@ void AnalysisClustering::loadData(const STData::STDataFrame &data)
 {
     // store the data
     m_data = data;
+    // the cached principal components are not valid anymore
+    m_pca_settings.clear();
 }
 
 void AnalysisClustering::slotRun()
 {
     qDebug() << "Computing spot colors asynchronously";
-    // initialize progress bar
-    m_ui->progressBar->setRange(0,0);
+    // initialize progress bar (with the iterations of the embeddings)
+    int iterations = 0;
+    if (m_ui->tab->currentWidget() == m_ui->tab_tsne) {
+        iterations = m_ui->max_iter->value();
+    } else if (m_ui->tab->currentWidget() == m_ui->tab_umap) {
+        iterations = m_ui->epochs->value();
+    }
+    m_ui->progressBar->setRange(0, iterations);
+    m_ui->progressBar->setValue(0);
+    m_canceled = false;
+    m_ui->cancelClustering->setEnabled(iterations > 0);
     // disable controls
     m_ui->runClustering->setEnabled(false);
     m_ui->computeClusters->setEnabled(false);
     m_ui->exportPlot->setEnabled(false);
     m_ui->createSelections->setEnabled(false);
+    m_ui->computeMarkers->setEnabled(false);
+    m_ui->selectSimilar->setEnabled(false);
     // clear the selected spots
     m_selected_spots.clear();
     // make the call
@@ -125,6 +165,8 @@ void AnalysisClustering::slotComputeClusters()
     m_ui->computeClusters->setEnabled(false);
     m_ui->exportPlot->setEnabled(false);
     m_ui->createSelections->setEnabled(false);
+    m_ui->computeMarkers->setEnabled(false);
+    m_ui->selectSimilar->setEnabled(false);
     // make the call
     QFuture<unsigned> future = QtConcurrent::run(this, &AnalysisClustering::computeClustersAsync);
     m_watcher_classes.setFuture(future);
@@ -135,7 +177,7 @@ void AnalysisClustering::slotExportPlot()
     m_ui->plot->slotExportPlot(tr("Clustering plot"));
 }
 
-mat AnalysisClustering::filterMatrix()
+STData::STDataFrame AnalysisClustering::filterData()
 {
     // filter the data with the thresholds
     STData::STDataFrame data = STData::filterDataFrame(m_data,
@@ -148,8 +190,6 @@ mat AnalysisClustering::filterMatrix()
     m_spots = data.spots;
 
     // compute normalization factors
-    rowvec m_deseq_size_factors;
-    rowvec m_scran_size_factors;
     SettingsWidget::NormalizationMode normalization = SettingsWidget::RAW;
     if (m_ui->normalization_rel->isChecked()) {
         normalization = SettingsWidget::REL;
@@ -162,24 +202,64 @@ mat AnalysisClustering::filterMatrix()
     }
 
     // Normalize and log matrix of counts
-    mat A = STData::normalizeCounts(data, normalization).counts;
+    data = STData::normalizeCounts(data, normalization);
     if (m_ui->logScale->isChecked()) {
-        A = log(A + 1.0);
+        STData::logCounts(data);
     }
 
-    return A;
+    return data;
+}
+
+QString AnalysisClustering::pcaSettings(const bool center, const bool scale) const
+{
+    QStringList settings;
+    settings << QString::number(m_ui->individual_reads_threshold->value())
+             << QString::number(m_ui->reads_threshold->value())
+             << QString::number(m_ui->genes_threshold->value())
+             << QString::number(m_ui->spots_threshold->value())
+             << QString::number(m_ui->normalization_rel->isChecked())
+             << QString::number(m_ui->normalization_tpm->isChecked())
+             << QString::number(m_ui->normalization_deseq->isChecked())
+             << QString::number(m_ui->normalization_scran->isChecked())
+             << QString::number(m_ui->logScale->isChecked())
+             << QString::number(center)
+             << QString::number(scale);
+    return settings.join(" ");
+}
+
+mat AnalysisClustering::principalComponents(const uword components,
+                                            const bool center,
+                                            const bool scale)
+{
+    // the principal components are only computed when the data or the settings change
+    // (or more components are needed)
+    const QString settings = pcaSettings(center, scale);
+    if (settings != m_pca_settings || m_pca.scores.n_cols < components) {
+        const STData::STDataFrame data = filterData();
+        m_pca = data.is_sparse ? PCA::compute(data.sp_counts, components, center, scale)
+                               : PCA::compute(data.counts, components, center, scale);
+        m_pca_spots = m_spots;
+        m_pca_settings = settings;
+        // the index of the previous principal components is not valid anymore
+        m_index = Neighbors::Index();
+    } else {
+        m_spots = m_pca_spots;
+    }
+    return m_pca.scores.cols(0, components - 1);
 }
 
 unsigned AnalysisClustering::computeClustersAsync()
 {
-    const mat &A = filterMatrix();
-    return RInterface::computeSpotClasses(A);
+    // the communities of the neighbors graph of the principal components
+    const uword components = m_ui->init_dims->value();
+    return Clustering::estimateClusters(principalComponents(components, true, false));
 }
 
 void AnalysisClustering::computeColorsAsync()
 {
 
     QWidget *tsne_tab = m_ui->tab->findChild<QWidget *>("tab_tsne");
+    QWidget *umap_tab = m_ui->tab->findChild<QWidget *>("tab_umap");
     QWidget *pca_tab = m_ui->tab->findChild<QWidget *>("tab_pca");
 
     const int no_dims = 2;
@@ -187,28 +267,136 @@ void AnalysisClustering::computeColorsAsync()
     const double theta = tsne_tab->findChild<QDoubleSpinBox *>("theta")->value();
     const int max_iter = tsne_tab->findChild<QSpinBox *>("max_iter")->value();
     const int init_dim = tsne_tab->findChild<QSpinBox *>("init_dims")->value();
+    const int n_neighbors = umap_tab->findChild<QSpinBox *>("n_neighbors")->value();
+    const double min_dist = umap_tab->findChild<QDoubleSpinBox *>("min_dist")->value();
+    const int epochs = umap_tab->findChild<QSpinBox *>("epochs")->value();
     const bool kmeans = m_ui->kmeans->isChecked();
+    const bool louvain = m_ui->louvain->isChecked();
     const int num_clusters = m_ui->clusters->value();
     const bool scale = pca_tab->findChild<QCheckBox *>("scale")->isChecked();
     const bool center = pca_tab->findChild<QCheckBox *>("center")->isChecked();
-    const bool tsne = m_ui->tab->currentIndex() == 0;
+    const bool tsne = m_ui->tab->currentWidget() == tsne_tab;
+    const bool umap = m_ui->tab->currentWidget() == umap_tab;
+
+    // t-SNE and UMAP start with the first components of the centered data
+    // (the initial dimensions)
+    const bool pca_center = tsne || umap || center;
+    const bool pca_scale = !tsne && !umap && scale;
+    const uword components = tsne || umap ? std::max(init_dim, no_dims) : no_dims;
+
+    const mat pcs = principalComponents(components, pca_center, pca_scale);
+
+    // the embeddings send their coordinates to the GUI thread every few iterations
+    // and stop when the user cancels
+    const Embedding::Progress progress = [this](const int iteration, const mat &coordinates) {
+        {
+            QMutexLocker locker(&m_progress_mutex);
+            m_progress_coordinates = coordinates;
+        }
+        emit signalEmbeddingProgress(iteration);
+        return !m_canceled;
+    };
+    if (tsne) {
+        m_reduced_coordinates =
+                Embedding::computeTSNE(pcs, no_dims, perplexity, theta, max_iter, progress);
+    } else if (umap) {
+        m_reduced_coordinates =
+                Embedding::computeUMAP(pcs, no_dims, n_neighbors, min_dist, epochs, progress);
+    } else {
+        m_reduced_coordinates = pcs;
+    }
+
+    // the reduced coordinates are clustered with k-means or Ward and the principal
+    // components with the neighbors graph
+    m_colors.clear();
+    if (!m_canceled && !m_reduced_coordinates.empty()) {
+        uvec clusters;
+        if (kmeans) {
+            clusters = Clustering::kmeans(m_reduced_coordinates, num_clusters);
+        } else if (louvain) {
+            clusters = Clustering::graphClusters(pcs, num_clusters);
+        } else {
+            clusters = Clustering::ward(m_reduced_coordinates, num_clusters);
+        }
+        m_colors.assign(clusters.begin(), clusters.end());
+    }
+}
+
+void AnalysisClustering::slotCancel()
+{
+    qDebug() << "Canceling the dimensionality reduction";
+    m_canceled = true;
+    m_ui->cancelClustering->setEnabled(false);
+}
+
+void AnalysisClustering::slotEmbeddingProgress(const int iteration)
+{
+    mat coordinates;
+    {
+        QMutexLocker locker(&m_progress_mutex);
+        coordinates = m_progress_coordinates;
+    }
+    m_ui->progressBar->setValue(iteration);
+    if (coordinates.n_cols < 2) {
+        return;
+    }
 
-    const mat &A = filterMatrix();
-    // Surprisingly it is much faster to call R's tsne/pca than to use C++ implementation....
-    RInterface::spotClassification(A, tsne, kmeans, num_clusters, init_dim, no_dims, perplexity,
-                                   max_iter, theta, scale, center, m_colors, m_reduced_coordinates);
+    // the spots are not clustered yet
+    QScatterSeries *series = new QScatterSeries(this);
+    series->setMarkerShape(QScatterSeries::MarkerShapeCircle);
+    series->setMarkerSize(10.0);
+    series->setColor(Qt::gray);
+    series->setUseOpenGL(false);
+    for (uword i = 0; i < coordinates.n_rows; ++i) {
+        series->append(coordinates.at(i, 0), coordinates.at(i, 1));
+    }
+    m_series_vector.clear();
+    m_ui->plot->chart()->removeAllSeries();
+    m_ui->plot->chart()->addSeries(series);
+    m_ui->plot->chart()->setTitle(tr("Iteration %1").arg(iteration));
+    updatePlotAxes(coordinates);
+}
+
+void AnalysisClustering::updatePlotAxes(const mat &coordinates)
+{
+    const int min_x = coordinates.col(0).min();
+    const int max_x = coordinates.col(0).max();
+    const int min_y = coordinates.col(1).min();
+    const int max_y = coordinates.col(1).max();
+    m_ui->plot->chart()->setDropShadowEnabled(false);
+    m_ui->plot->chart()->createDefaultAxes();
+    m_ui->plot->chart()->axisX()->setGridLineVisible(false);
+    m_ui->plot->chart()->axisX()->setLabelsVisible(true);
+    m_ui->plot->chart()->axisX()->setRange(min_x - 1, max_x + 1);
+    m_ui->plot->chart()->axisX()->setTitleText(tr("TSNE/UMAP/PCA 1"));
+    m_ui->plot->chart()->axisY()->setGridLineVisible(false);
+    m_ui->plot->chart()->axisY()->setLabelsVisible(true);
+    m_ui->plot->chart()->axisY()->setRange(min_y - 1, max_y + 1);
+    m_ui->plot->chart()->axisY()->setTitleText(tr("TSNE/UMAP/PCA 2"));
 }
 
 void AnalysisClustering::colorsComputed()
 {
     // stop progress bar
-    m_ui->progressBar->setMaximum(10);
+    m_ui->progressBar->setRange(0, 10);
+    m_ui->progressBar->setValue(10);
     // enable run button
     m_ui->runClustering->setEnabled(true);
+    m_ui->cancelClustering->setEnabled(false);
     // enable the estimate button
     m_ui->computeClusters->setEnabled(true);
+
+    // the user stopped the dimensionality reduction
+    if (m_canceled) {
+        m_ui->plot->chart()->removeAllSeries();
+        m_series_vector.clear();
+        return;
+    }
+
     // enable the save clusters buttton
     m_ui->createSelections->setEnabled(true);
+    m_ui->computeMarkers->setEnabled(true);
+    m_ui->selectSimilar->setEnabled(true);
 
     if (m_colors.empty() || m_reduced_coordinates.empty()) {
         QMessageBox::critical(this,
@@ -218,9 +406,10 @@ void AnalysisClustering::colorsComputed()
         return;
     }
 
-    const int num_clusters = m_ui->clusters->value();
+    // the clusters are numbered from 0 (the graph clustering can find less clusters)
+    const int num_clusters = *std::max_element(std::begin(m_colors), std::end(m_colors)) + 1;
     Q_ASSERT(*std::min_element(std::begin(m_colors), std::end(m_colors)) == 0
-             && *std::max_element(std::begin(m_colors), std::end(m_colors)) == (num_clusters - 1));
+             && num_clusters <= m_ui->clusters->value());
     Q_ASSERT(m_colors.size() == m_spots.size());
 
     // Create one serie for each different cluster (color)
@@ -249,22 +438,9 @@ void AnalysisClustering::colorsComputed()
         m_ui->plot->chart()->addSeries(series);
     }
 
-    const int min_x = m_reduced_coordinates.col(0).min();
-    const int max_x = m_reduced_coordinates.col(0).max();
-    const int min_y = m_reduced_coordinates.col(1).min();
-    const int max_y = m_reduced_coordinates.col(1).max();
     m_ui->plot->chart()->setTitle("Spots colored by cluster");
-    m_ui->plot->chart()->setDropShadowEnabled(false);
     m_ui->plot->chart()->legend()->show();
-    m_ui->plot->chart()->createDefaultAxes();
-    m_ui->plot->chart()->axisX()->setGridLineVisible(false);
-    m_ui->plot->chart()->axisX()->setLabelsVisible(true);
-    m_ui->plot->chart()->axisX()->setRange(min_x - 1, max_x + 1);
-    m_ui->plot->chart()->axisX()->setTitleText(tr("TSNE/PCA 1"));
-    m_ui->plot->chart()->axisY()->setGridLineVisible(false);
-    m_ui->plot->chart()->axisY()->setLabelsVisible(true);
-    m_ui->plot->chart()->axisY()->setRange(min_y - 1, max_y + 1);
-    m_ui->plot->chart()->axisY()->setTitleText(tr("TSNE/PCA 2"));
+    updatePlotAxes(m_reduced_coordinates);
 
     // enable export controls
     m_ui->exportPlot->setEnabled(true);
@@ -283,6 +459,8 @@ void AnalysisClustering::classesComputed()
     m_ui->computeClusters->setEnabled(true);
     // enable the save clusters buttton
     m_ui->createSelections->setEnabled(true);
+    m_ui->computeMarkers->setEnabled(true);
+    m_ui->selectSimilar->setEnabled(true);
 
     const unsigned n_clusters = m_watcher_classes.result();
     if (n_clusters == 0) {
@@ -294,6 +472,50 @@ void AnalysisClustering::classesComputed()
     }
 }
 
+QList<QString> AnalysisClustering::similarSpots(const QList<QString> &spots, const uword k)
+{
+    // the index of the spots in the principal components is built the first time
+    if (m_index.size() != m_pca.scores.n_rows) {
+        m_index = Neighbors::Index(m_pca.scores);
+    }
+    QHash<QString, uword> rows;
+    for (int i = 0; i < m_pca_spots.size(); ++i) {
+        rows.insert(m_pca_spots.at(i), i);
+    }
+
+    // the spots and their k nearest spots (the spot is its own nearest spot)
+    QList<QString> similar;
+    QSet<uword> added;
+    for (const QString &spot : spots) {
+        if (!rows.contains(spot)) {
+            continue;
+        }
+        const rowvec point = m_pca.scores.row(rows.value(spot));
+        uvec indices;
+        vec distances;
+        m_index.query(point, k + 1, indices, distances);
+        for (const uword index : indices) {
+            if (!added.contains(index)) {
+                added.insert(index);
+                similar.append(m_pca_spots.at(index));
+            }
+        }
+    }
+    return similar;
+}
+
+void AnalysisClustering::slotSelectSimilar()
+{
+    if (m_selected_spots.empty()) {
+        QMessageBox::information(this,
+                                 tr("Similar spots"),
+                                 tr("Select some spots in the scatter plot first"));
+        return;
+    }
+    m_selected_spots = similarSpots(m_selected_spots, SIMILAR_SPOTS);
+    emit signalClusteringSpotsSelected();
+}
+
 void AnalysisClustering::slotLassoSelection(const QPainterPath &path)
 {
     QList<QPointF> selected_points;
@@ -4,8 +4,13 @@
 #include <QDialog>
 #include <QFutureWatcher>
 #include <QScatterSeries>
+#include <QMutex>
+
+#include <atomic>
 
 #include "data/STData.h"
+#include "math/PCA.h"
+#include "math/Neighbors.h"
 
 namespace Ui {
 class analysisClustering;
@@ -40,6 +45,10 @@ public:
     // the user selected spots if any
     QList<QString> selectedSpots() const;
 
+    // the given spots and their k most similar spots (the nearest spots in the
+    // principal components of the last run)
+    QList<QString> similarSpots(const QList<QString> &spots, const uword k);
+
 public slots:
 
 signals:
@@ -47,14 +56,24 @@ signals:
     void signalClusteringUpdated();
     void signalClusteringSpotsSelected();
     void signalClusteringExportSelections();
+    void signalClusteringMarkers();
+
+    // emitted from the worker thread when the embedding has new coordinates
+    void signalEmbeddingProgress(const int iteration);
 
 private slots:
 
-    // Performs a dimensionality reduction (t-SNE or PCA) on the data matrix and then
-    // cluster the reduced coordinates (2D) using KMeans or HClust so to compute classes/colors
-    // for each spot
+    // Performs a dimensionality reduction (t-SNE, UMAP or PCA) on the data matrix and then
+    // cluster the reduced coordinates (2D) using KMeans or HClust (or the principal components
+    // using a neighbors graph) so to compute classes/colors for each spot
     void slotRun();
 
+    // stops the dimensionality reduction (t-SNE or UMAP)
+    void slotCancel();
+
+    // shows the current coordinates of the embedding in the scatter plot
+    void slotEmbeddingProgress(const int iteration);
+
     // exports the scatter plot to a file
     void slotExportPlot();
 
@@ -64,6 +83,9 @@ private slots:
     // when the user wants to estimate the number of clusters from the data
     void slotComputeClusters();
 
+    // adds the most similar spots to the user selected spots
+    void slotSelectSimilar();
+
 private:
 
     // helper function to do the heavy computations on a different thread
@@ -76,8 +98,19 @@ private:
     // function to update the num clusters field once the estimation of the number of classes is done
     void classesComputed();
 
-    // helper function to filter the matrix of counts
-    mat filterMatrix();
+    // helper function to set the axes of the scatter plot to the coordinates
+    void updatePlotAxes(const mat &coordinates);
+
+    // helper functions to filter, normalize and log the matrix of counts (it also stores
+    // the filtered spots)
+    STData::STDataFrame filterData();
+
+    // helper function that returns the first principal components of the filtered data
+    // (computed only when the settings change, it also stores the filtered spots)
+    mat principalComponents(const uword components, const bool center, const bool scale);
+
+    // the settings that the principal components depend on
+    QString pcaSettings(const bool center, const bool scale) const;
 
     // the data
     STData::STDataFrame m_data;
@@ -87,6 +120,20 @@ private:
     mat m_reduced_coordinates;
     QList<QString> m_spots;
 
+    // cache the principal components (and their spots) to reuse them while the
+    // filters, the normalization and the PCA settings do not change
+    PCA::Result m_pca;
+    QList<QString> m_pca_spots;
+    QString m_pca_settings;
+
+    // the nearest neighbors index of the cached principal components (built when needed)
+    Neighbors::Index m_index;
+
+    // the last coordinates of the embedding and whether the user stopped it
+    mat m_progress_coordinates;
+    QMutex m_progress_mutex;
+    std::atomic<bool> m_canceled;
+
     // the computational threads
     QFutureWatcher<void> m_watcher_colors;
     QFutureWatcher<unsigned> m_watcher_classes;
@@ -7,9 +7,12 @@
 #include <QCheckBox>
 #include <QSet>
 #include <QMessageBox>
+#include <QFileDialog>
+#include <QTextStream>
 #include <QtMath>
+#include <QtConcurrent>
 
-#include "math/RInterface.h"
+#include <algorithm>
 
 #include "ui_analysisCorrelation.h"
 
@@ -21,6 +24,7 @@ AnalysisCorrelation::AnalysisCorrelation(const STData::STDataFrame &data1,
                                          Qt::WindowFlags f)
     : QWidget(parent, f)
     , m_ui(new Ui::analysisCorrelation)
+    , m_matrix_exported(false)
 {
     m_ui->setupUi(this);
     m_ui->exportPlot->setEnabled(false);
@@ -43,20 +47,18 @@ AnalysisCorrelation::AnalysisCorrelation(const STData::STDataFrame &data1,
 
     if (num_shared_genes > 0) {
         // keep only the shared genes in the data matrix (same order)
-        std::vector<uword> to_keepA;
-        std::vector<uword> to_keepB;
-        for (const QString &shared_gene : shared_genes) {
-            to_keepA.push_back(data1.genes.indexOf(shared_gene));
-            to_keepB.push_back(data2.genes.indexOf(shared_gene));
-        }
-        m_dataA.counts = m_dataA.counts.cols(uvec(to_keepA));
-        m_dataB.counts = m_dataB.counts.cols(uvec(to_keepB));
+        m_dataA = STData::sliceDataFrameGenes(data1, m_genes);
+        m_dataB = STData::sliceDataFrameGenes(data2, m_genes);
 
         // create the connections
         connect(m_ui->logScale, &QCheckBox::clicked,
                 this, &AnalysisCorrelation::slotUpdateData);
         connect(m_ui->exportPlot, &QPushButton::clicked,
                 this, &AnalysisCorrelation::slotExportPlot);
+        connect(m_ui->exportMatrix, &QPushButton::clicked,
+                this, &AnalysisCorrelation::slotExportMatrix);
+        connect(&m_watcher, &QFutureWatcher<void>::finished,
+                this, &AnalysisCorrelation::slotMatrixExported);
 
         // Update the plots and data fields
         slotUpdateData();
@@ -67,12 +69,15 @@ AnalysisCorrelation::AnalysisCorrelation(const STData::STDataFrame &data1,
                               tr("There are no common genes between the selections."));
         m_ui->logScale->setEnabled(false);
         m_ui->exportPlot->setEnabled(false);
+        m_ui->exportMatrix->setEnabled(false);
+        m_ui->matrixGenes->setEnabled(false);
+        m_ui->matrixMethod->setEnabled(false);
     }
 }
 
 AnalysisCorrelation::~AnalysisCorrelation()
 {
-
+    m_watcher.waitForFinished();
 }
 
 void AnalysisCorrelation::slotUpdateData()
@@ -80,22 +85,19 @@ void AnalysisCorrelation::slotUpdateData()
     QGuiApplication::setOverrideCursor(Qt::WaitCursor);
 
     // get the matrices of counts and log them if applies
-    mat A = m_dataA.counts;
-    mat B = m_dataB.counts;
-    if (m_ui->logScale->isChecked()) {
-        A = log(A + 1.0);
-        B = log(B + 1.0);
-    }
+    const STData::STDataFrame A = transformedData(m_dataA);
+    const STData::STDataFrame B = transformedData(m_dataB);
 
     // get the accumulated gene counts
-    m_rowsumA = conv_to<std::vector<double>>::from(sum(A, 0));
-    m_rowsumB = conv_to<std::vector<double>>::from(sum(B, 0));
+    m_rowsumA = conv_to<std::vector<double>>::from(STData::computeColumnSums(A));
+    m_rowsumB = conv_to<std::vector<double>>::from(STData::computeColumnSums(B));
 
     // compute correlation values
-    const double pearson = RInterface::computeCorrelation(m_rowsumA, m_rowsumB, "pearson");
-    const double spearman = RInterface::computeCorrelation(m_rowsumA, m_rowsumB, "spearman");
-    m_ui->pearson->setText(QString::number(pearson));
-    m_ui->spearman->setText(QString::number(spearman));
+    const vec rowsumA(m_rowsumA);
+    const vec rowsumB(m_rowsumB);
+    m_ui->pearson->setText(QString::number(Correlation::pearson(rowsumA, rowsumB)));
+    m_ui->spearman->setText(QString::number(Correlation::spearman(rowsumA, rowsumB)));
+    m_ui->kendall->setText(QString::number(Correlation::kendall(rowsumA, rowsumB)));
 
     // create scatter plot
     m_series.reset(new QScatterSeries());
@@ -124,11 +126,112 @@ void AnalysisCorrelation::slotUpdateData()
     QGuiApplication::restoreOverrideCursor();
 }
 
+STData::STDataFrame AnalysisCorrelation::transformedData(const STData::STDataFrame &data) const
+{
+    STData::STDataFrame transformed = data;
+    if (m_ui->logScale->isChecked()) {
+        STData::logCounts(transformed);
+    }
+    return transformed;
+}
+
 void AnalysisCorrelation::slotExportPlot()
 {
     m_ui->plot->slotExportPlot(tr("Correlation Plot"));
 }
 
+void AnalysisCorrelation::slotExportMatrix()
+{
+    const QString filename =
+            QFileDialog::getSaveFileName(this,
+                                         tr("Export Gene Correlations"),
+                                         QDir::homePath(),
+                                         QString("%1").arg(tr("TXT Files (*.txt *.tsv)")));
+    // early out
+    if (filename.isEmpty()) {
+        return;
+    }
+
+    const Correlation::Method method =
+            static_cast<Correlation::Method>(m_ui->matrixMethod->currentIndex() + 1);
+    // disable controls
+    m_ui->exportMatrix->setEnabled(false);
+    m_ui->matrixGenes->setEnabled(false);
+    m_ui->matrixMethod->setEnabled(false);
+    // initialize worker
+    QFuture<void> future = QtConcurrent::run(this,
+                                             &AnalysisCorrelation::exportMatrixAsync,
+                                             filename,
+                                             method,
+                                             m_ui->matrixGenes->value(),
+                                             m_ui->logScale->isChecked());
+    m_watcher.setFuture(future);
+}
+
+void AnalysisCorrelation::exportMatrixAsync(const QString &filename,
+                                            const Correlation::Method method,
+                                            const int n_genes,
+                                            const bool log_scale)
+{
+    m_matrix_exported = false;
+
+    // the genes with the most counts in both selections (in the order of the data)
+    const rowvec counts_sums = STData::computeColumnSums(m_dataA)
+            + STData::computeColumnSums(m_dataB);
+    const uword n_top = std::min(static_cast<uword>(n_genes), counts_sums.n_elem);
+    const uvec top_genes = sort(uvec(sort_index(counts_sums, "descend").head(n_top)));
+    qDebug() << "Computing gene correlations asynchronously. Genes=" << n_top;
+
+    // the spots of both selections (they have the same genes in the same order)
+    const uword n_spotsA = m_dataA.spots.size();
+    const uword n_spotsB = m_dataB.spots.size();
+    STData::STDataFrame A = STData::sliceDataFrame(
+                m_dataA, linspace<uvec>(0, n_spotsA - 1, n_spotsA), top_genes);
+    STData::STDataFrame B = STData::sliceDataFrame(
+                m_dataB, linspace<uvec>(0, n_spotsB - 1, n_spotsB), top_genes);
+    if (log_scale) {
+        STData::logCounts(A);
+        STData::logCounts(B);
+    }
+    const mat correlations =
+            Correlation::correlationMatrix(join_cols(STData::denseCounts(A),
+                                                     STData::denseCounts(B)), method);
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Error opening the file of the gene correlations" << filename;
+        return;
+    }
+    QTextStream stream(&file);
+    // write the genes (1st row and 1st column)
+    for (const QString &gene : A.genes) {
+        stream << "\t" << gene;
+    }
+    stream << "\n";
+    for (uword i = 0; i < correlations.n_rows; ++i) {
+        stream << A.genes.at(i);
+        for (uword j = 0; j < correlations.n_cols; ++j) {
+            stream << "\t" << correlations.at(i, j);
+        }
+        stream << "\n";
+    }
+    stream.flush();
+    m_matrix_exported = stream.status() == QTextStream::Ok;
+}
+
+void AnalysisCorrelation::slotMatrixExported()
+{
+    // enable controls
+    m_ui->exportMatrix->setEnabled(true);
+    m_ui->matrixGenes->setEnabled(true);
+    m_ui->matrixMethod->setEnabled(true);
+    if (!m_matrix_exported) {
+        QMessageBox::critical(this,
+                              tr("Export Gene Correlations"),
+                              tr("There was an error exporting the gene correlations"));
+    }
+}
+
 void AnalysisCorrelation::slotClickedPoint(const QPointF point)
 {
     // Find the closest point from the series
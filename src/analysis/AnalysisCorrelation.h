@@ -3,8 +3,10 @@
 
 #include <QWidget>
 #include <QScatterSeries>
+#include <QFutureWatcher>
 
 #include "data/STData.h"
+#include "math/Correlation.h"
 
 namespace Ui {
 class analysisCorrelation;
@@ -15,7 +17,9 @@ QT_CHARTS_USE_NAMESPACE
 // This Widget takes two datasets (selections)
 // and computes correlation value for the common genes
 // it allows to chose normalization method and log scale and also to click and
-// see the clicked gene
+// see the clicked gene. It also exports the correlations of every pair of the common
+// genes with the most counts across the spots of both datasets (co-expression), the
+// number of genes is bounded by the user and the matrix is computed asynchronously
 class AnalysisCorrelation : public QWidget
 {
     Q_OBJECT
@@ -37,11 +41,27 @@ private slots:
     // when the user wants to export the plot to a file
     void slotExportPlot();
 
+    // when the user wants to export the correlations of every pair of genes to a file
+    void slotExportMatrix();
+
+    // when the correlations of the genes have been computed and exported
+    void slotMatrixExported();
+
     // when the user clicks a point in the plot
     void slotClickedPoint(const QPointF point);
 
 private:
 
+    // helper function that returns the data logged if the user wants it
+    STData::STDataFrame transformedData(const STData::STDataFrame &data) const;
+
+    // computes the correlations of every pair of the n_genes genes with the most counts
+    // and writes them to the file (it is run in a worker thread)
+    void exportMatrixAsync(const QString &filename,
+                           const Correlation::Method method,
+                           const int n_genes,
+                           const bool log_scale);
+
     // GUI object
     QScopedPointer<Ui::analysisCorrelation> m_ui;
 
@@ -59,6 +79,10 @@ private:
     // store the plotting series to allow interaction with the plot
     QScopedPointer<QScatterSeries> m_series;
 
+    // the export of the gene correlations (and whether it worked)
+    QFutureWatcher<void> m_watcher;
+    bool m_matrix_exported;
+
     Q_DISABLE_COPY(AnalysisCorrelation)
 };
 
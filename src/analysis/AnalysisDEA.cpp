@@ -13,6 +13,7 @@
 #include <QClipboard>
 
 #include "math/RInterface.h"
+#include "math/DEA.h"
 
 #include "ui_analysisDEA.h"
 
@@ -69,6 +70,13 @@ AnalysisDEA::AnalysisDEA(const QList<STData::STDataFrame> &datasetsA,
     m_ui->tableview->setContextMenuPolicy(Qt::CustomContextMenu);
     connect(m_ui->tableview, &QTableView::customContextMenuRequested,
             this, &AnalysisDEA::customMenuRequested);
+    // R starts in the background, it is started now if it was not started
+    RWorkerPool *R = RWorkerPool::instancePtr();
+    if (R != nullptr) {
+        connect(R, &RWorkerPool::stateChanged, this, &AnalysisDEA::slotRStateChanged);
+        R->start();
+    }
+    slotRStateChanged();
 }
 
 AnalysisDEA::~AnalysisDEA()
@@ -100,11 +108,10 @@ void AnalysisDEA::slotExportTable()
         // write columns (1st row)
         stream << "Gene" << "\t" << "FDR" << "\t" << "p-value" << "\t" << "log2FoldChange" << endl;
         // write values
-        const bool DESEQ2 = m_method == AnalysisDEA::DESEQ2;
+        const int pvalue_index = pvalueColumn();
+        const int fdr_index = fdrColumn();
+        const int fc_index = foldChangeColumn();
         for (uword i = 0; i < m_results.n_rows; ++i) {
-            const int pvalue_index = DESEQ2 ? 4 : 2;
-            const int fdr_index = DESEQ2 ? 5 : 3;
-            const int fc_index = DESEQ2 ? 1 : 0;
             const QString gene = QString::fromStdString(m_results_rows.at(i));
             const double fdr = m_results.at(i, fdr_index);
             const double pvalue = m_results.at(i, pvalue_index);
@@ -137,10 +144,9 @@ void AnalysisDEA::slotGeneSelected(QModelIndex index)
     }
 
     // update the highlight coordinate and refresh the plot
-    const bool DESEQ2 = m_method == AnalysisDEA::DESEQ2;
     const int row_index = selected_indexes.first().row();
-    const int pvalue_index = DESEQ2 ? 4 : 2;
-    const int fc_index = DESEQ2 ? 1 : 0;
+    const int pvalue_index = pvalueColumn();
+    const int fc_index = foldChangeColumn();
     const double pvalue = -log10(m_results.at(row_index, pvalue_index) + std::numeric_limits<double>::epsilon());
     const double foldchange = m_results.at(row_index, fc_index);
     m_gene_highlight = QPointF(foldchange, pvalue);
@@ -163,11 +169,10 @@ void AnalysisDEA::updatePlot()
     series2->setUseOpenGL(false);
 
     // populate
-    const bool DESEQ2 = m_method == AnalysisDEA::DESEQ2;
+    const int pvalue_index = pvalueColumn();
+    const int fdr_index = fdrColumn();
+    const int fc_index = foldChangeColumn();
     for (uword i = 0; i < m_results.n_rows; ++i) {
-        const int pvalue_index = DESEQ2 ? 4 : 2;
-        const int fdr_index = DESEQ2 ? 5 : 3;
-        const int fc_index = DESEQ2 ? 1 : 0;
         const double fdr = m_results.at(i, fdr_index);
         const double pvalue = -log10(m_results.at(i, pvalue_index) + std::numeric_limits<double>::epsilon());
         const double foldchange = m_results.at(i, fc_index);
@@ -218,11 +223,10 @@ void AnalysisDEA::updateTable()
 
     int high_confidence_de = 0;
     // populate
-    const bool DESEQ2 = m_method == AnalysisDEA::DESEQ2;
+    const int pvalue_index = pvalueColumn();
+    const int fdr_index = fdrColumn();
+    const int fc_index = foldChangeColumn();
     for (uword i = 0; i < m_results.n_rows; ++i) {
-        const int pvalue_index = DESEQ2 ? 4 : 2;
-        const int fdr_index = DESEQ2 ? 5 : 3;
-        const int fc_index = DESEQ2 ? 1 : 0;
         const QString gene = QString::fromStdString(m_results_rows.at(i));
         const double fdr = m_results.at(i, fdr_index);
         const QString fdr_str = QString::number(fdr);
@@ -296,13 +300,8 @@ void AnalysisDEA::run()
 {
     bool recompute = false;
 
-    if (m_ui->method_deseq->isChecked() && m_method != AnalysisDEA::DESEQ2) {
-        m_method = AnalysisDEA::DESEQ2;
-        recompute = true;
-    }
-
-    if (!m_ui->method_deseq->isChecked() && m_method != AnalysisDEA::EDGER) {
-        m_method = AnalysisDEA::EDGER;
+    if (m_method != selectedMethod()) {
+        m_method = selectedMethod();
         recompute = true;
     }
 
@@ -373,19 +372,72 @@ void AnalysisDEA::runDEAAsync(const STData::STDataFrame &data)
                    [](auto gene) {return gene.toStdString();});
 
     qDebug() << "Computing DEA Asynchronously. Rows="
-             << data.counts.n_rows << ", columns=" << data.counts.n_cols;
+             << data.spots.size() << ", columns=" << data.genes.size();
 
     m_results.clear();
     m_results_cols.clear();
     m_results_rows.clear();
-    // Make the DEA call
+
+    // Make the DEA call, R gets the sparse counts (they are passed to R without making
+    // them dense) and only the native tests use the dense counts
+    DEA::Test test = DEA::Wilcoxon;
+    switch (m_method) {
+    case AnalysisDEA::DESEQ2:
+    case AnalysisDEA::EDGER: {
+        const sp_mat converted_counts = data.is_sparse ? sp_mat() : sp_mat(data.counts);
+        const sp_mat &counts = data.is_sparse ? data.sp_counts : converted_counts;
+        if (m_method == AnalysisDEA::DESEQ2) {
+            RInterface::computeDEA_DESeq(counts, rows, cols, m_conditions,
+                                         m_results, m_results_rows, m_results_cols);
+        } else {
+            RInterface::computeDEA_EdgeR(counts, rows, cols, m_conditions,
+                                         m_results, m_results_rows, m_results_cols);
+        }
+        return;
+    }
+    case AnalysisDEA::NB_WALD:
+        test = DEA::NegativeBinomialWald;
+        break;
+    case AnalysisDEA::NB_LRT:
+        test = DEA::NegativeBinomialLRT;
+        break;
+    case AnalysisDEA::WILCOXON:
+        test = DEA::Wilcoxon;
+        break;
+    }
+    DEA::computeDEA(STData::denseCounts(data), cols, m_conditions, test,
+                    m_results, m_results_rows, m_results_cols);
+}
+
+AnalysisDEA::Method AnalysisDEA::selectedMethod() const
+{
     if (m_ui->method_deseq->isChecked()) {
-        RInterface::computeDEA_DESeq(data.counts, rows, cols, m_conditions,
-                                     m_results, m_results_rows, m_results_cols);
-    } else {
-        RInterface::computeDEA_EdgeR(data.counts, rows, cols, m_conditions,
-                                     m_results, m_results_rows, m_results_cols);
+        return AnalysisDEA::DESEQ2;
+    } else if (m_ui->method_nb_wald->isChecked()) {
+        return AnalysisDEA::NB_WALD;
+    } else if (m_ui->method_nb_lrt->isChecked()) {
+        return AnalysisDEA::NB_LRT;
+    } else if (m_ui->method_wilcoxon->isChecked()) {
+        return AnalysisDEA::WILCOXON;
     }
+    return AnalysisDEA::EDGER;
+}
+
+// EdgeR results are (logFC, logCPM, PValue, FDR), the rest of the methods
+// have the columns of DESeq2 (baseMean, log2FoldChange, lfcSE, stat, pvalue, padj)
+int AnalysisDEA::pvalueColumn() const
+{
+    return m_method == AnalysisDEA::EDGER ? 2 : DEA::PValue;
+}
+
+int AnalysisDEA::fdrColumn() const
+{
+    return m_method == AnalysisDEA::EDGER ? 3 : DEA::FDR;
+}
+
+int AnalysisDEA::foldChangeColumn() const
+{
+    return m_method == AnalysisDEA::EDGER ? 0 : DEA::Log2FoldChange;
 }
 
 void AnalysisDEA::slotDEAComputed()
@@ -433,3 +485,23 @@ void AnalysisDEA::customMenuRequested(const QPoint &pos)
         }
     }
 }
+
+void AnalysisDEA::slotRStateChanged()
+{
+    const RWorkerPool *R = RWorkerPool::instancePtr();
+    const RWorkerPool::State state = R != nullptr ? R->state() : RWorkerPool::Failed;
+    const bool ready = state == RWorkerPool::Ready;
+    QString tooltip;
+    if (state == RWorkerPool::Failed) {
+        tooltip = tr("R could not be started");
+    } else if (!ready) {
+        tooltip = tr("R is starting");
+    }
+    m_ui->method_deseq->setEnabled(ready);
+    m_ui->method_edger->setEnabled(ready);
+    m_ui->method_deseq->setToolTip(tooltip);
+    m_ui->method_edger->setToolTip(tooltip);
+    if (!ready && (m_ui->method_deseq->isChecked() || m_ui->method_edger->isChecked())) {
+        m_ui->method_nb_wald->setChecked(true);
+    }
+}
@@ -29,6 +29,10 @@ public:
     enum Method {
         DESEQ2 = 1,
         EDGER = 2,
+        // native implementations (math/DEA.h)
+        NB_WALD = 3,
+        NB_LRT = 4,
+        WILCOXON = 5
     };
 
     AnalysisDEA(const QList<STData::STDataFrame> &datasetsA,
@@ -55,6 +59,8 @@ private slots:
     void slotExportPlot();
     // to handle when the user right clicks
     void customMenuRequested(const QPoint &pos);
+    // the methods done with R are enabled when R is ready
+    void slotRStateChanged();
 
 private:
 
@@ -64,6 +70,13 @@ private:
     void updateTable();
     void updatePlot();
 
+    // the method selected in the GUI
+    Method selectedMethod() const;
+    // the columns of the p-values, FDR and fold changes in the results of the current method
+    int pvalueColumn() const;
+    int fdrColumn() const;
+    int foldChangeColumn() const;
+
     // GUI object
     QScopedPointer<Ui::analysisDEA> m_ui;
 
@@ -0,0 +1,295 @@
+#include "AnalysisMarkers.h"
+
+#include <QPushButton>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QStandardItemModel>
+#include <QFuture>
+#include <QtConcurrent>
+
+#include <QMenu>
+#include <QClipboard>
+
+#include "math/DEA.h"
+
+#include "ui_analysisMarkers.h"
+
+AnalysisMarkers::AnalysisMarkers(const QList<STData::STDataFrame> &datasets,
+                                 const QList<QString> &names,
+                                 QWidget *parent,
+                                 Qt::WindowFlags f)
+    : QWidget(parent, f)
+    , m_ui(new Ui::analysisMarkers)
+    , m_data()
+    , m_groups()
+    , m_n_groups(names.size())
+    , m_method(AnalysisMarkers::WILCOXON)
+    , m_computed(false)
+{
+    m_ui->setupUi(this);
+
+    // default values
+    m_ui->method_wilcoxon->setChecked(true);
+    m_ui->exportTable->setEnabled(false);
+    m_ui->searchField->setEnabled(false);
+    m_ui->progressBar->setTextVisible(true);
+    m_ui->searchField->setClearButtonEnabled(true);
+    m_ui->group->addItems(names);
+    m_proxy.reset(new QSortFilterProxyModel());
+    m_proxy->setFilterKeyColumn(1);
+
+    // merge datasets (the spots of every dataset are prefixed with its index)
+    m_data = STData::aggregate(datasets, true);
+    m_groups.set_size(m_data.spots.size());
+    for (int i = 0; i < m_data.spots.size(); ++i) {
+        m_groups[i] = m_data.spots.at(i).split("_").first().toUInt();
+    }
+
+    // create connections
+    connect(m_ui->searchField,
+            &QLineEdit::textChanged,
+            m_proxy.data(),
+            &QSortFilterProxyModel::setFilterFixedString);
+    connect(m_ui->run, &QPushButton::clicked, this, &AnalysisMarkers::run);
+    connect(m_ui->exportTable, &QPushButton::clicked, this, &AnalysisMarkers::slotExportTable);
+    connect(m_ui->group, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+            this, [this]() {
+        if (m_computed) {
+            updateTable();
+        }
+    });
+    connect(&m_watcher, &QFutureWatcher<void>::finished,
+            this, &AnalysisMarkers::slotMarkersComputed);
+    // allow to copy the content of the table
+    m_ui->tableview->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(m_ui->tableview, &QTableView::customContextMenuRequested,
+            this, &AnalysisMarkers::customMenuRequested);
+}
+
+AnalysisMarkers::~AnalysisMarkers()
+{
+    m_watcher.waitForFinished();
+}
+
+void AnalysisMarkers::slotExportTable()
+{
+    const int group = m_ui->group->currentIndex();
+    if (!m_computed || group < 0 || group >= static_cast<int>(m_results.size())) {
+        return;
+    }
+
+    const QString filename = QFileDialog::getSaveFileName(this,
+                                                          tr("Export Marker Genes"),
+                                                          QDir::homePath(),
+                                                          QString("%1").arg(tr("TXT Files (*.txt *.tsv)")));
+    // early out
+    if (filename.isEmpty()) {
+        return;
+    }
+
+    const QFileInfo fileInfo(filename);
+    const QFileInfo dirInfo(fileInfo.dir().canonicalPath());
+    if (!fileInfo.exists() && !dirInfo.isWritable()) {
+        QMessageBox::critical(this, tr("Export Marker Genes"), tr("The directory is not writable"));
+        return;
+    }
+
+    QFile file(filename);
+    if (file.open(QIODevice::ReadWrite)) {
+        QTextStream stream(&file);
+        // write columns (1st row)
+        stream << "Gene" << "\t" << "FDR" << "\t" << "p-value" << "\t" << "log2FoldChange" << endl;
+        // write values
+        const mat &results = m_results.at(group);
+        const std::vector<std::string> &rows = m_results_rows.at(group);
+        for (uword i = 0; i < results.n_rows; ++i) {
+            const QString gene = QString::fromStdString(rows.at(i));
+            const double fdr = results.at(i, DEA::FDR);
+            const double pvalue = results.at(i, DEA::PValue);
+            const double foldchange = results.at(i, DEA::Log2FoldChange);
+            if (fdr <= m_ui->fdr->value() && foldchange >= m_ui->foldchange->value()) {
+                stream << gene << "\t" << fdr << "\t" << pvalue << "\t" << foldchange << endl;
+            }
+        }
+    } else {
+        QMessageBox::critical(this, tr("Export Marker Genes"), tr("Coult not open the file"));
+    }
+    file.close();
+}
+
+void AnalysisMarkers::updateTable()
+{
+    const int group = m_ui->group->currentIndex();
+    if (group < 0 || group >= static_cast<int>(m_results.size())) {
+        return;
+    }
+    const mat &results = m_results.at(group);
+    const std::vector<std::string> &rows = m_results_rows.at(group);
+
+    // data model
+    const int columns = 5;
+    QStandardItemModel *model = new QStandardItemModel(rows.size(), columns, this);
+    model->setHorizontalHeaderItem(0, new QStandardItem(QString("Rank")));
+    model->setHorizontalHeaderItem(1, new QStandardItem(QString("Gene")));
+    model->setHorizontalHeaderItem(2, new QStandardItem(QString("FDR")));
+    model->setHorizontalHeaderItem(3, new QStandardItem(QString("p-value")));
+    model->setHorizontalHeaderItem(4, new QStandardItem(QString("log2FoldChange")));
+
+    int high_confidence_markers = 0;
+    // populate (the results are ranked already)
+    for (uword i = 0; i < results.n_rows; ++i) {
+        const int rank = i + 1;
+        const QString gene = QString::fromStdString(rows.at(i));
+        const double fdr = results.at(i, DEA::FDR);
+        const double pvalue = results.at(i, DEA::PValue);
+        const double foldchange = results.at(i, DEA::Log2FoldChange);
+        QList<QStandardItem *> items;
+        items << new QStandardItem(QString::number(rank))
+              << new QStandardItem(gene)
+              << new QStandardItem(QString::number(fdr))
+              << new QStandardItem(QString::number(pvalue))
+              << new QStandardItem(QString::number(foldchange));
+        items.at(0)->setData(rank, Qt::DisplayRole);
+        items.at(0)->setData(rank, Qt::UserRole);
+        items.at(1)->setData(gene, Qt::DisplayRole);
+        items.at(1)->setData(gene, Qt::UserRole);
+        items.at(2)->setData(fdr, Qt::DisplayRole);
+        items.at(2)->setData(fdr, Qt::UserRole);
+        items.at(3)->setData(pvalue, Qt::DisplayRole);
+        items.at(3)->setData(pvalue, Qt::UserRole);
+        items.at(4)->setData(foldchange, Qt::DisplayRole);
+        items.at(4)->setData(foldchange, Qt::UserRole);
+        // the markers are the up-regulated genes of the group
+        const bool marker = fdr <= m_ui->fdr->value() && foldchange >= m_ui->foldchange->value();
+        for (int j = 0; j < columns; ++j) {
+            if (marker) {
+                items.at(j)->setBackground(Qt::red);
+            }
+            model->setItem(i, j, items.at(j));
+        }
+        if (marker) {
+            ++high_confidence_markers;
+        }
+    }
+
+    // update total number of marker genes
+    m_ui->total_genes->setText(QString::number(high_confidence_markers));
+
+    // sorting model
+    m_proxy->setSourceModel(model);
+    m_proxy->setSortCaseSensitivity(Qt::CaseInsensitive);
+    m_proxy->setFilterCaseSensitivity(Qt::CaseInsensitive);
+    m_proxy->setSortRole(Qt::UserRole);
+    m_ui->tableview->setModel(m_proxy.data());
+
+    // settings for the table
+    m_ui->tableview->setSortingEnabled(true);
+    m_ui->tableview->setShowGrid(true);
+    m_ui->tableview->setWordWrap(true);
+    m_ui->tableview->setAlternatingRowColors(true);
+    m_ui->tableview->sortByColumn(0, Qt::AscendingOrder);
+
+    m_ui->tableview->setFrameShape(QFrame::StyledPanel);
+    m_ui->tableview->setFrameShadow(QFrame::Sunken);
+    m_ui->tableview->setGridStyle(Qt::SolidLine);
+    m_ui->tableview->setCornerButtonEnabled(false);
+    m_ui->tableview->setLineWidth(1);
+
+    m_ui->tableview->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_ui->tableview->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_ui->tableview->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+    for (int j = 0; j < columns; ++j) {
+        m_ui->tableview->horizontalHeader()->setSectionResizeMode(j, QHeaderView::Stretch);
+    }
+    m_ui->tableview->horizontalHeader()->setSortIndicatorShown(true);
+    m_ui->tableview->verticalHeader()->hide();
+
+    m_ui->tableview->model()->submit(); // support for caching (speed up)
+}
+
+void AnalysisMarkers::run()
+{
+    const Method method =
+            m_ui->method_ttest->isChecked() ? AnalysisMarkers::TTEST : AnalysisMarkers::WILCOXON;
+    if (m_computed && m_method == method) {
+        slotMarkersComputed();
+        return;
+    }
+    m_method = method;
+    m_computed = false;
+
+    // clear the table
+    m_proxy->clear();
+    m_ui->tableview->reset();
+    m_ui->tableview->update();
+    // initialize progress bar
+    m_ui->progressBar->setRange(0, 0);
+    // disable controls
+    m_ui->run->setEnabled(false);
+    m_ui->exportTable->setEnabled(false);
+    m_ui->searchField->setEnabled(false);
+    // initialize worker
+    QFuture<void> future = QtConcurrent::run(this, &AnalysisMarkers::runMarkersAsync);
+    m_watcher.setFuture(future);
+}
+
+void AnalysisMarkers::runMarkersAsync()
+{
+    std::vector<std::string> genes;
+    std::transform(m_data.genes.begin(), m_data.genes.end(), std::back_inserter(genes),
+                   [](auto gene) {return gene.toStdString();});
+
+    qDebug() << "Computing marker genes asynchronously. Rows="
+             << m_data.spots.size() << ", columns=" << m_data.genes.size();
+
+    const sp_mat counts = STData::sparseCounts(m_data);
+    DEA::computeMarkers(counts,
+                        genes,
+                        m_groups,
+                        m_n_groups,
+                        m_method == AnalysisMarkers::TTEST ? DEA::MarkersTTest
+                                                           : DEA::MarkersWilcoxon,
+                        m_results,
+                        m_results_rows,
+                        m_results_cols);
+}
+
+void AnalysisMarkers::slotMarkersComputed()
+{
+    // stop progress bar
+    m_ui->progressBar->setRange(0, 10);
+    m_ui->progressBar->setValue(10);
+    // enable run button
+    m_ui->run->setEnabled(true);
+
+    // check that the marker genes were computed
+    if (m_results.empty() || m_results_cols.empty()) {
+        QMessageBox::critical(this,
+                              tr("Marker Genes"),
+                              tr("There was an error computing the marker genes"));
+        return;
+    }
+    m_computed = true;
+
+    // enable controls
+    m_ui->exportTable->setEnabled(true);
+    m_ui->searchField->setEnabled(true);
+
+    // update table with fdr and foldchange
+    updateTable();
+}
+
+void AnalysisMarkers::customMenuRequested(const QPoint &pos)
+{
+    const QModelIndex index = m_ui->tableview->indexAt(pos);
+    if (index.isValid()) {
+        QMenu *menu = new QMenu(this);
+        menu->addAction(new QAction(tr("Copy"), this));
+        if (menu->exec(m_ui->tableview->viewport()->mapToGlobal(pos))) {
+            const QString text = m_proxy->mapToSource(index).data().toString();
+            QClipboard *clipboard = QApplication::clipboard();
+            clipboard->setText(text);
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef ANALYSISMARKERS_H
+#define ANALYSISMARKERS_H
+
+#include <QWidget>
+#include <QModelIndex>
+#include <QSortFilterProxyModel>
+#include <QFutureWatcher>
+
+#include <string>
+
+#include "data/STData.h"
+
+namespace Ui
+{
+class analysisMarkers;
+}
+
+// AnalysisMarkers is a widget that finds the marker genes of several groups of spots
+// (selections or clusters), every group is tested against the rest of the groups
+// with a rank test or a t-test (math/DEA.h). It shows the ranked genes of one group
+// in a table that highlights the marker genes at a given FDR and fold change
+class AnalysisMarkers : public QWidget
+{
+    Q_OBJECT
+
+public:
+
+    enum Method {
+        WILCOXON = 1,
+        TTEST = 2
+    };
+
+    AnalysisMarkers(const QList<STData::STDataFrame> &datasets,
+                    const QList<QString> &names,
+                    QWidget *parent = nullptr,
+                    Qt::WindowFlags f = 0);
+    virtual ~AnalysisMarkers();
+
+signals:
+
+private slots:
+
+    // the user wants to export the marker genes of the current group
+    void slotExportTable();
+    // when the marker genes have been computed in the worker thread
+    void slotMarkersComputed();
+    // to handle when the user right clicks
+    void customMenuRequested(const QPoint &pos);
+
+private:
+
+    // to compute the marker genes (if the method has changed) and show them
+    void run();
+    void runMarkersAsync();
+    void updateTable();
+
+    // GUI object
+    QScopedPointer<Ui::analysisMarkers> m_ui;
+
+    // the merged data frame and the group of every spot
+    STData::STDataFrame m_data;
+    uvec m_groups;
+    uword m_n_groups;
+
+    // cache the settings to not recompute always
+    Method m_method;
+    bool m_computed;
+
+    // cache the results to not recompute (one table per group)
+    std::vector<mat> m_results;
+    std::vector<std::vector<std::string>> m_results_rows;
+    std::vector<std::string> m_results_cols;
+
+    // the proxy model
+    QScopedPointer<QSortFilterProxyModel> m_proxy;
+
+    // The computational thread
+    QFutureWatcher<void> m_watcher;
+
+    Q_DISABLE_COPY(AnalysisMarkers)
+};
+
+#endif // ANALYSISMARKERS_H
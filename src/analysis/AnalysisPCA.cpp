@@ -4,7 +4,7 @@
 #include <QScatterSeries>
 
 #include "color/HeatMap.h"
-#include "math/RInterface.h"
+#include "math/PCA.h"
 
 #include "ui_AnalysisPCA.h"
 
@@ -29,8 +29,8 @@ AnalysisPCA::AnalysisPCA(const QList<STData::STDataFrame> &datasets,
     merged.fill(0.0);
 
     for (unsigned d = 0; d < datasets.size(); ++d) {
-        const auto data = datasets.at(d);
-        const rowvec colsums = sum(data.counts, 0);
+        const auto &data = datasets.at(d);
+        const rowvec colsums = STData::computeColumnSums(data);
         for (uword j = 0; j < n_cols; ++j) {
             const auto &gene = genes.at(j);
             const int index = data.genes.indexOf(gene);
@@ -40,8 +40,7 @@ AnalysisPCA::AnalysisPCA(const QList<STData::STDataFrame> &datasets,
         }
     }
 
-    mat results;
-    RInterface::PCA(merged, false, true, results);
+    const mat results = PCA::compute(merged, 2, true, false).scores;
 
     for (unsigned d = 0; d < datasets.size(); ++d) {
         QScatterSeries *series = new QScatterSeries(this);
@@ -13,16 +13,16 @@ AnalysisQC::AnalysisQC(const STData::STDataFrame &data,
 {
     m_ui->setupUi(this);
 
-    Q_ASSERT(data.counts.size() > 0);
+    Q_ASSERT(!data.spots.empty() && !data.genes.empty());
 
     // compute the stats
-    const colvec rowsums = sum(data.counts, 1);
-    const ucolvec nonzero_row = STData::computeNonZeroRows(data.counts);
+    const colvec rowsums = STData::computeRowSums(data);
+    const ucolvec nonzero_row = STData::computeNonZeroRows(data);
     const QString max_transcripts_spot = QString::number(rowsums.max());
     const QString max_genes_spot = QString::number(nonzero_row.max());
-    const QString num_genes = QString::number(data.counts.n_cols);
-    const QString num_spots = QString::number(data.counts.n_rows);
-    const QString total_transcripts = QString::number(accu(data.counts));
+    const QString num_genes = QString::number(data.genes.size());
+    const QString num_spots = QString::number(data.spots.size());
+    const QString total_transcripts = QString::number(accu(rowsums));
     const QString avg_genes = QString::number(mean(nonzero_row));
     const QString avg_transcritps = QString::number(mean(rowsums));
     const QString std_genes = QString::number(stddev(nonzero_row));
@@ -18,8 +18,8 @@ AnalysisScatter::AnalysisScatter(const STData::STDataFrame &data,
     m_ui->setupUi(this);
 
     const unsigned num_spots = data.spots.size();
-    const colvec spot_reads = sum(data.counts, 1);
-    const ucolvec spot_genes = STData::computeNonZeroRows(data.counts);
+    const colvec spot_reads = STData::computeRowSums(data);
+    const ucolvec spot_genes = STData::computeNonZeroRows(data);
     const float min_reads = spot_reads.min();
     const float max_reads = spot_reads.max();
     const float min_genes = spot_genes.min();
@@ -0,0 +1,289 @@
+#include "AnalysisSpatial.h"
+
+#include <QPushButton>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QStandardItemModel>
+#include <QFuture>
+#include <QtConcurrent>
+
+#include <QMenu>
+#include <QClipboard>
+
+#include "math/Spatial.h"
+
+#include "ui_analysisSpatial.h"
+
+AnalysisSpatial::AnalysisSpatial(const STData::STDataFrame &data,
+                                 const mat &coordinates,
+                                 QWidget *parent,
+                                 Qt::WindowFlags f)
+    : QWidget(parent, f)
+    , m_ui(new Ui::analysisSpatial)
+    , m_data(data)
+    , m_coordinates(coordinates)
+    , m_settings()
+    , m_computed(false)
+    , m_graph(AnalysisSpatial::RADIUS)
+    , m_radius(0.0)
+    , m_neighbors(0)
+{
+    m_ui->setupUi(this);
+
+    // default values
+    m_ui->graph_radius->setChecked(true);
+    m_ui->exportTable->setEnabled(false);
+    m_ui->searchField->setEnabled(false);
+    m_ui->progressBar->setTextVisible(true);
+    m_ui->searchField->setClearButtonEnabled(true);
+    m_proxy.reset(new QSortFilterProxyModel());
+    m_proxy->setFilterKeyColumn(1);
+
+    // create connections
+    connect(m_ui->searchField,
+            &QLineEdit::textChanged,
+            m_proxy.data(),
+            &QSortFilterProxyModel::setFilterFixedString);
+    connect(m_ui->run, &QPushButton::clicked, this, &AnalysisSpatial::run);
+    connect(m_ui->exportTable, &QPushButton::clicked, this, &AnalysisSpatial::slotExportTable);
+    connect(&m_watcher, &QFutureWatcher<void>::finished,
+            this, &AnalysisSpatial::slotSpatialGenesComputed);
+    // allow to copy the content of the table
+    m_ui->tableview->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(m_ui->tableview, &QTableView::customContextMenuRequested,
+            this, &AnalysisSpatial::customMenuRequested);
+}
+
+AnalysisSpatial::~AnalysisSpatial()
+{
+    m_watcher.waitForFinished();
+}
+
+QString AnalysisSpatial::graphSettings() const
+{
+    if (m_ui->graph_neighbors->isChecked()) {
+        return QString("neighbors %1").arg(m_ui->neighbors->value());
+    }
+    return QString("radius %1").arg(m_ui->radius->value());
+}
+
+void AnalysisSpatial::slotExportTable()
+{
+    if (!m_computed) {
+        return;
+    }
+
+    const QString filename = QFileDialog::getSaveFileName(this,
+                                                          tr("Export Spatial Genes"),
+                                                          QDir::homePath(),
+                                                          QString("%1").arg(tr("TXT Files (*.txt *.tsv)")));
+    // early out
+    if (filename.isEmpty()) {
+        return;
+    }
+
+    const QFileInfo fileInfo(filename);
+    const QFileInfo dirInfo(fileInfo.dir().canonicalPath());
+    if (!fileInfo.exists() && !dirInfo.isWritable()) {
+        QMessageBox::critical(this,
+                              tr("Export Spatial Genes"),
+                              tr("The directory is not writable"));
+        return;
+    }
+
+    QFile file(filename);
+    if (file.open(QIODevice::ReadWrite)) {
+        QTextStream stream(&file);
+        // write columns (1st row)
+        stream << "Gene" << "\t" << "FDR" << "\t" << "p-value" << "\t" << "MoransI"
+               << "\t" << "GearysC" << endl;
+        // write values
+        for (uword i = 0; i < m_results.n_rows; ++i) {
+            const QString gene = QString::fromStdString(m_results_rows.at(i));
+            const double fdr = m_results.at(i, Spatial::FDR);
+            const double pvalue = m_results.at(i, Spatial::MoransIPValue);
+            const double morans_i = m_results.at(i, Spatial::MoransI);
+            const double gearys_c = m_results.at(i, Spatial::GearysC);
+            if (fdr <= m_ui->fdr->value()) {
+                stream << gene << "\t" << fdr << "\t" << pvalue << "\t" << morans_i
+                       << "\t" << gearys_c << endl;
+            }
+        }
+    } else {
+        QMessageBox::critical(this, tr("Export Spatial Genes"), tr("Coult not open the file"));
+    }
+    file.close();
+}
+
+void AnalysisSpatial::updateTable()
+{
+    // data model
+    const int columns = 5;
+    QStandardItemModel *model = new QStandardItemModel(m_results_rows.size(), columns, this);
+    model->setHorizontalHeaderItem(0, new QStandardItem(QString("Rank")));
+    model->setHorizontalHeaderItem(1, new QStandardItem(QString("Gene")));
+    model->setHorizontalHeaderItem(2, new QStandardItem(QString("FDR")));
+    model->setHorizontalHeaderItem(3, new QStandardItem(QString("Moran's I")));
+    model->setHorizontalHeaderItem(4, new QStandardItem(QString("Geary's C")));
+
+    int spatial_genes = 0;
+    // populate (the results are ranked already)
+    for (uword i = 0; i < m_results.n_rows; ++i) {
+        const int rank = i + 1;
+        const QString gene = QString::fromStdString(m_results_rows.at(i));
+        const double fdr = m_results.at(i, Spatial::FDR);
+        const double morans_i = m_results.at(i, Spatial::MoransI);
+        const double gearys_c = m_results.at(i, Spatial::GearysC);
+        QList<QStandardItem *> items;
+        items << new QStandardItem(QString::number(rank))
+              << new QStandardItem(gene)
+              << new QStandardItem(QString::number(fdr))
+              << new QStandardItem(QString::number(morans_i))
+              << new QStandardItem(QString::number(gearys_c));
+        items.at(0)->setData(rank, Qt::DisplayRole);
+        items.at(0)->setData(rank, Qt::UserRole);
+        items.at(1)->setData(gene, Qt::DisplayRole);
+        items.at(1)->setData(gene, Qt::UserRole);
+        items.at(2)->setData(fdr, Qt::DisplayRole);
+        items.at(2)->setData(fdr, Qt::UserRole);
+        items.at(3)->setData(morans_i, Qt::DisplayRole);
+        items.at(3)->setData(morans_i, Qt::UserRole);
+        items.at(4)->setData(gearys_c, Qt::DisplayRole);
+        items.at(4)->setData(gearys_c, Qt::UserRole);
+        const bool spatial = fdr <= m_ui->fdr->value();
+        for (int j = 0; j < columns; ++j) {
+            if (spatial) {
+                items.at(j)->setBackground(Qt::red);
+            }
+            model->setItem(i, j, items.at(j));
+        }
+        if (spatial) {
+            ++spatial_genes;
+        }
+    }
+
+    // update total number of spatial genes
+    m_ui->total_genes->setText(QString::number(spatial_genes));
+
+    // sorting model
+    m_proxy->setSourceModel(model);
+    m_proxy->setSortCaseSensitivity(Qt::CaseInsensitive);
+    m_proxy->setFilterCaseSensitivity(Qt::CaseInsensitive);
+    m_proxy->setSortRole(Qt::UserRole);
+    m_ui->tableview->setModel(m_proxy.data());
+
+    // settings for the table
+    m_ui->tableview->setSortingEnabled(true);
+    m_ui->tableview->setShowGrid(true);
+    m_ui->tableview->setWordWrap(true);
+    m_ui->tableview->setAlternatingRowColors(true);
+    m_ui->tableview->sortByColumn(0, Qt::AscendingOrder);
+
+    m_ui->tableview->setFrameShape(QFrame::StyledPanel);
+    m_ui->tableview->setFrameShadow(QFrame::Sunken);
+    m_ui->tableview->setGridStyle(Qt::SolidLine);
+    m_ui->tableview->setCornerButtonEnabled(false);
+    m_ui->tableview->setLineWidth(1);
+
+    m_ui->tableview->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_ui->tableview->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_ui->tableview->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+    for (int j = 0; j < columns; ++j) {
+        m_ui->tableview->horizontalHeader()->setSectionResizeMode(j, QHeaderView::Stretch);
+    }
+    m_ui->tableview->horizontalHeader()->setSortIndicatorShown(true);
+    m_ui->tableview->verticalHeader()->hide();
+
+    m_ui->tableview->model()->submit(); // support for caching (speed up)
+}
+
+void AnalysisSpatial::run()
+{
+    const QString settings = graphSettings();
+    if (m_computed && m_settings == settings) {
+        slotSpatialGenesComputed();
+        return;
+    }
+    m_settings = settings;
+    m_computed = false;
+    m_graph = m_ui->graph_neighbors->isChecked() ? AnalysisSpatial::NEIGHBORS
+                                                 : AnalysisSpatial::RADIUS;
+    m_radius = m_ui->radius->value();
+    m_neighbors = m_ui->neighbors->value();
+
+    // clear the table
+    m_proxy->clear();
+    m_ui->tableview->reset();
+    m_ui->tableview->update();
+    // initialize progress bar
+    m_ui->progressBar->setRange(0, 0);
+    // disable controls
+    m_ui->run->setEnabled(false);
+    m_ui->exportTable->setEnabled(false);
+    m_ui->searchField->setEnabled(false);
+    // initialize worker
+    QFuture<void> future = QtConcurrent::run(this, &AnalysisSpatial::runSpatialGenesAsync);
+    m_watcher.setFuture(future);
+}
+
+void AnalysisSpatial::runSpatialGenesAsync()
+{
+    std::vector<std::string> genes;
+    std::transform(m_data.genes.begin(), m_data.genes.end(), std::back_inserter(genes),
+                   [](auto gene) {return gene.toStdString();});
+
+    qDebug() << "Computing spatial genes asynchronously. Rows="
+             << m_data.spots.size() << ", columns=" << m_data.genes.size();
+
+    const sp_mat weights = m_graph == AnalysisSpatial::NEIGHBORS
+            ? Spatial::nearestNeighborsGraph(m_coordinates, m_neighbors)
+            : Spatial::radiusGraph(m_coordinates, m_radius);
+    const sp_mat counts = STData::sparseCounts(m_data);
+    Spatial::computeSpatialGenes(counts,
+                                 genes,
+                                 weights,
+                                 m_results,
+                                 m_results_rows,
+                                 m_results_cols);
+}
+
+void AnalysisSpatial::slotSpatialGenesComputed()
+{
+    // stop progress bar
+    m_ui->progressBar->setRange(0, 10);
+    m_ui->progressBar->setValue(10);
+    // enable run button
+    m_ui->run->setEnabled(true);
+
+    // check that the spatial genes were computed
+    if (m_results_cols.empty()) {
+        QMessageBox::critical(this,
+                              tr("Spatial Genes"),
+                              tr("There was an error computing the spatial genes\n"
+                                 "Perhaps the spots have no neighbors?"));
+        return;
+    }
+    m_computed = true;
+
+    // enable controls
+    m_ui->exportTable->setEnabled(true);
+    m_ui->searchField->setEnabled(true);
+
+    // update table with fdr
+    updateTable();
+}
+
+void AnalysisSpatial::customMenuRequested(const QPoint &pos)
+{
+    const QModelIndex index = m_ui->tableview->indexAt(pos);
+    if (index.isValid()) {
+        QMenu *menu = new QMenu(this);
+        menu->addAction(new QAction(tr("Copy"), this));
+        if (menu->exec(m_ui->tableview->viewport()->mapToGlobal(pos))) {
+            const QString text = m_proxy->mapToSource(index).data().toString();
+            QClipboard *clipboard = QApplication::clipboard();
+            clipboard->setText(text);
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef ANALYSISSPATIAL_H
+#define ANALYSISSPATIAL_H
+
+#include <QWidget>
+#include <QModelIndex>
+#include <QSortFilterProxyModel>
+#include <QFutureWatcher>
+
+#include <string>
+
+#include "data/STData.h"
+
+namespace Ui
+{
+class analysisSpatial;
+}
+
+// AnalysisSpatial is a widget that finds the spatially variable genes of a dataset.
+// The spots are connected to their neighbors in the tissue (within a radius or the
+// nearest ones) and every gene is ranked by its spatial autocorrelation, Moran's I and
+// Geary's C (math/Spatial.h). It shows the ranked genes in a table that highlights the
+// spatially variable genes at a given FDR
+class AnalysisSpatial : public QWidget
+{
+    Q_OBJECT
+
+public:
+
+    enum Graph {
+        RADIUS = 1,
+        NEIGHBORS = 2
+    };
+
+    // coordinates has the coordinates (x and y) of every spot of the data
+    AnalysisSpatial(const STData::STDataFrame &data,
+                    const mat &coordinates,
+                    QWidget *parent = nullptr,
+                    Qt::WindowFlags f = 0);
+    virtual ~AnalysisSpatial();
+
+signals:
+
+private slots:
+
+    // the user wants to export the spatially variable genes
+    void slotExportTable();
+    // when the spatial genes have been computed in the worker thread
+    void slotSpatialGenesComputed();
+    // to handle when the user right clicks
+    void customMenuRequested(const QPoint &pos);
+
+private:
+
+    // to compute the spatial genes (if the graph has changed) and show them
+    void run();
+    void runSpatialGenesAsync();
+    void updateTable();
+
+    // the settings of the spatial graph
+    QString graphSettings() const;
+
+    // GUI object
+    QScopedPointer<Ui::analysisSpatial> m_ui;
+
+    // the data and the coordinates of its spots
+    STData::STDataFrame m_data;
+    mat m_coordinates;
+
+    // cache the settings to not recompute always
+    QString m_settings;
+    bool m_computed;
+
+    // the settings of the graph used by the worker thread
+    Graph m_graph;
+    double m_radius;
+    uword m_neighbors;
+
+    // cache the results to not recompute
+    mat m_results;
+    std::vector<std::string> m_results_rows;
+    std::vector<std::string> m_results_cols;
+
+    // the proxy model
+    QScopedPointer<QSortFilterProxyModel> m_proxy;
+
+    // The computational thread
+    QFutureWatcher<void> m_watcher;
+
+    Q_DISABLE_COPY(AnalysisSpatial)
+};
+
+#endif // ANALYSISSPATIAL_H
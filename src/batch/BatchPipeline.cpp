@@ -0,0 +1,353 @@
+#include "BatchPipeline.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFuture>
+#include <QRegularExpression>
+#include <QSet>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "math/Clustering.h"
+#include "math/DEA.h"
+#include "math/PCA.h"
+
+namespace
+{
+
+// the number of bins of the histograms of the quality control
+const uword HISTOGRAM_BINS = 10;
+
+// Writes the lines to a text file, returns false if the file could not be written
+bool writeLines(const QString &filename, const QStringList &lines)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qDebug() << "Error writing file " << filename;
+        return false;
+    }
+    QTextStream stream(&file);
+    for (const QString &line : lines) {
+        stream << line << "\n";
+    }
+    stream.flush();
+    return file.error() == QFile::NoError;
+}
+
+// The quality control statistics of a data frame (the same as AnalysisQC)
+QList<QPair<QString, QString>> qualityStats(const STData::STDataFrame &data)
+{
+    QList<QPair<QString, QString>> stats;
+    stats << qMakePair(QString("spots"), QString::number(data.spots.size()))
+          << qMakePair(QString("genes"), QString::number(data.genes.size()));
+    if (data.spots.empty() || data.genes.empty()) {
+        return stats;
+    }
+    const colvec rowsums = STData::computeRowSums(data);
+    const colvec nonzero_row = conv_to<colvec>::from(STData::computeNonZeroRows(data));
+    const auto histogram = [](const uvec &counts) {
+        QStringList values;
+        for (const auto &value : counts) {
+            values << QString::number(value);
+        }
+        return values.join(",");
+    };
+    stats << qMakePair(QString("total_transcripts"), QString::number(accu(rowsums)))
+          << qMakePair(QString("max_transcripts_spot"), QString::number(rowsums.max()))
+          << qMakePair(QString("max_genes_spot"), QString::number(nonzero_row.max()))
+          << qMakePair(QString("mean_transcripts_spot"), QString::number(mean(rowsums)))
+          << qMakePair(QString("mean_genes_spot"), QString::number(mean(nonzero_row)))
+          << qMakePair(QString("std_transcripts_spot"), QString::number(stddev(rowsums)))
+          << qMakePair(QString("std_genes_spot"), QString::number(stddev(nonzero_row)))
+          << qMakePair(QString("hist_transcripts_spot"),
+                       histogram(hist(rowsums, HISTOGRAM_BINS)))
+          << qMakePair(QString("hist_genes_spot"), histogram(hist(nonzero_row, HISTOGRAM_BINS)));
+    return stats;
+}
+
+// The name of a dataset as a folder name
+QString folderName(const QString &name)
+{
+    QString folder = name;
+    folder.replace(QRegularExpression("[^A-Za-z0-9._-]"), "_");
+    return folder.isEmpty() ? QString("dataset") : folder;
+}
+}
+
+BatchPipeline::BatchPipeline(const Settings &settings)
+    : m_settings(settings)
+{
+}
+
+BatchPipeline::~BatchPipeline()
+{
+}
+
+bool BatchPipeline::parseDescriptor(const QString &descriptor, Dataset &dataset)
+{
+    const QFileInfo info(descriptor);
+    if (info.isDir()) {
+        return dataset.parseFolder(info.absoluteFilePath());
+    }
+    // the files of an info.json are in its folder
+    if (info.fileName() == "info.json") {
+        return dataset.parseFolder(info.absolutePath());
+    }
+    return dataset.parseMetaFile(info.absoluteFilePath());
+}
+
+QList<BatchPipeline::Result> BatchPipeline::run(const QStringList &descriptors,
+                                                const Progress &progress) const
+{
+    QDir().mkpath(m_settings.output);
+
+    // the descriptors are parsed first to give a folder to every dataset
+    // (the datasets with the same name are numbered)
+    std::vector<Dataset> datasets(descriptors.size());
+    std::vector<Result> results(descriptors.size());
+    QSet<QString> folders;
+    for (int i = 0; i < descriptors.size(); ++i) {
+        Result &result = results[i];
+        result.descriptor = descriptors.at(i);
+        if (!parseDescriptor(result.descriptor, datasets[i])) {
+            result.error = QString("Error parsing the descriptor of the dataset");
+            continue;
+        }
+        result.name = datasets[i].name();
+        QString folder = folderName(result.name);
+        for (int copy = 2; folders.contains(folder); ++copy) {
+            folder = QString("%1_%2").arg(folderName(result.name)).arg(copy);
+        }
+        folders.insert(folder);
+        result.folder = QDir(m_settings.output).absoluteFilePath(folder);
+    }
+
+    // the datasets are processed in their own pool so the computations of every
+    // dataset can use the global pool (the datasets are released once processed)
+    QThreadPool pool;
+    pool.setMaxThreadCount(jobs());
+    QList<QFuture<void>> futures;
+    for (int i = 0; i < descriptors.size(); ++i) {
+        if (!results[i].error.isEmpty()) {
+            if (progress) {
+                progress(results[i]);
+            }
+            continue;
+        }
+        futures << QtConcurrent::run(&pool, [&, i]() {
+            Dataset dataset(datasets[i]);
+            try {
+                results[i] = process(dataset, results[i]);
+            } catch (const std::exception &e) {
+                results[i].error = QString("Error processing the dataset: %1").arg(e.what());
+            }
+            if (progress) {
+                progress(results[i]);
+            }
+        });
+    }
+    for (auto &future : futures) {
+        future.waitForFinished();
+    }
+
+    // the summary of all the datasets
+    QList<Result> processed;
+    QStringList summary;
+    summary << "descriptor\tname\tfolder\tstatus\tspots\tgenes\tclusters\terror";
+    for (const Result &result : results) {
+        summary << QStringList({result.descriptor,
+                                result.name,
+                                result.folder,
+                                result.succeeded ? "OK" : "ERROR",
+                                QString::number(result.spots),
+                                QString::number(result.genes),
+                                QString::number(result.clusters),
+                                result.error}).join("\t");
+        processed << result;
+    }
+    writeLines(QDir(m_settings.output).absoluteFilePath("summary.tsv"), summary);
+    return processed;
+}
+
+BatchPipeline::Result BatchPipeline::process(Dataset &dataset, Result result) const
+{
+    qDebug() << "Processing dataset " << result.name << " from " << result.descriptor;
+
+    // load
+    try {
+        dataset.load_data();
+    } catch (const std::exception &e) {
+        result.error = QString("Error loading the dataset: %1").arg(e.what());
+        return result;
+    }
+    if (!QDir().mkpath(result.folder)) {
+        result.error = QString("Error creating the folder of the results");
+        return result;
+    }
+    const QDir folder(result.folder);
+
+    // filter
+    const STData::STDataFrame &data = dataset.data()->data();
+    const STData::STDataFrame filtered = STData::filterDataFrame(data,
+                                                                 m_settings.min_exp_value,
+                                                                 m_settings.min_reads_spot,
+                                                                 m_settings.min_genes_spot,
+                                                                 m_settings.min_spots_gene);
+    result.spots = filtered.spots.size();
+    result.genes = filtered.genes.size();
+
+    // quality control of the data before and after filtering
+    const auto stats = qualityStats(data);
+    const auto filtered_stats = qualityStats(filtered);
+    QStringList qc;
+    qc << "stat\traw\tfiltered";
+    for (int i = 0; i < stats.size(); ++i) {
+        const QString filtered_value = i < filtered_stats.size() ? filtered_stats.at(i).second
+                                                                 : QString();
+        qc << stats.at(i).first + "\t" + stats.at(i).second + "\t" + filtered_value;
+    }
+    if (!writeLines(folder.absoluteFilePath("qc.tsv"), qc)) {
+        result.error = QString("Error writing the quality control");
+        return result;
+    }
+    if (filtered.spots.empty() || filtered.genes.empty()) {
+        result.error = QString("No spots or genes are left after filtering");
+        return result;
+    }
+
+    // normalize
+    const STData::STDataFrame normalized = normalize(filtered);
+    if (m_settings.save_counts) {
+        try {
+            STData::save(folder.absoluteFilePath("counts.tsv"), normalized);
+        } catch (const std::exception &e) {
+            result.error = QString("Error writing the normalized counts: %1").arg(e.what());
+            return result;
+        }
+    }
+
+    // cluster
+    if (m_settings.clustering != NoClustering) {
+        const uvec clusters = cluster(normalized);
+        result.clusters = clusters.empty() ? 0 : clusters.max() + 1;
+        QStringList lines;
+        lines << "spot\tcluster";
+        for (uword i = 0; i < clusters.n_elem; ++i) {
+            lines << normalized.spots.at(i) + "\t" + QString::number(clusters[i]);
+        }
+        if (!writeLines(folder.absoluteFilePath("clusters.tsv"), lines)) {
+            result.error = QString("Error writing the clusters");
+            return result;
+        }
+
+        // DE (the marker genes of every cluster)
+        if (m_settings.markers != NoMarkers && result.clusters > 1) {
+            std::vector<std::string> genes;
+            std::transform(filtered.genes.begin(), filtered.genes.end(),
+                           std::back_inserter(genes),
+                           [](const QString &gene) { return gene.toStdString(); });
+            const sp_mat counts = STData::sparseCounts(filtered);
+            std::vector<mat> markers;
+            std::vector<std::vector<std::string>> rows;
+            std::vector<std::string> cols;
+            DEA::computeMarkers(counts,
+                                genes,
+                                clusters,
+                                result.clusters,
+                                m_settings.markers == MarkersTTest ? DEA::MarkersTTest
+                                                                   : DEA::MarkersWilcoxon,
+                                markers,
+                                rows,
+                                cols);
+            if (markers.size() != result.clusters || rows.size() != result.clusters) {
+                result.error = QString("Error computing the marker genes");
+                return result;
+            }
+            QStringList header("cluster");
+            header << "gene";
+            for (const auto &col : cols) {
+                header << QString::fromStdString(col);
+            }
+            lines.clear();
+            lines << header.join("\t");
+            for (uword k = 0; k < markers.size(); ++k) {
+                for (uword i = 0; i < markers[k].n_rows; ++i) {
+                    QStringList line;
+                    line << QString::number(k) << QString::fromStdString(rows[k][i]);
+                    for (uword j = 0; j < markers[k].n_cols; ++j) {
+                        line << QString::number(markers[k](i, j));
+                    }
+                    lines << line.join("\t");
+                }
+            }
+            if (!writeLines(folder.absoluteFilePath("markers.tsv"), lines)) {
+                result.error = QString("Error writing the marker genes");
+                return result;
+            }
+        }
+    }
+
+    result.succeeded = true;
+    qDebug() << "Processed dataset " << result.name << " in " << result.folder;
+    return result;
+}
+
+STData::STDataFrame BatchPipeline::normalize(const STData::STDataFrame &data) const
+{
+    // Normalize and log matrix of counts
+    STData::STDataFrame normalized = STData::normalizeCounts(data, m_settings.normalization);
+    if (m_settings.log_scale) {
+        STData::logCounts(normalized);
+    }
+    return normalized;
+}
+
+uvec BatchPipeline::cluster(const STData::STDataFrame &data) const
+{
+    const uword n_spots = data.spots.size();
+    if (n_spots < 2) {
+        return uvec(n_spots, fill::zeros);
+    }
+
+    // the principal components of the centered data (at most one per spot or gene)
+    const uword components = std::max<uword>(1, std::min(m_settings.components,
+                                                         std::min<uword>(n_spots - 1,
+                                                                         data.genes.size())));
+    const PCA::Result pca = data.is_sparse
+            ? PCA::compute(data.sp_counts, components, true, m_settings.scale)
+            : PCA::compute(data.counts, components, true, m_settings.scale);
+
+    // the number of clusters is estimated with the communities of the neighbors graph
+    uword k = m_settings.clusters;
+    if (k == 0) {
+        k = Clustering::estimateClusters(pca.scores);
+    }
+    k = std::max<uword>(1, std::min(k, n_spots));
+
+    switch (m_settings.clustering) {
+    case Ward:
+        return Clustering::ward(pca.scores, k);
+    case Louvain:
+        return Clustering::graphClusters(pca.scores, k);
+    default:
+        return Clustering::kmeans(pca.scores, k);
+    }
+}
+
+int BatchPipeline::jobs() const
+{
+    if (m_settings.jobs > 0) {
+        return m_settings.jobs;
+    }
+    // every dataset uses all the cores in its computations so half of the cores
+    // are enough to keep them busy while the datasets are loaded and exported
+    return std::max(1, QThread::idealThreadCount() / 2);
+}
@@ -0,0 +1,109 @@
+#ifndef BATCHPIPELINE_H
+#define BATCHPIPELINE_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include <functional>
+
+#include "data/Dataset.h"
+#include "data/STData.h"
+#include "viewPages/SettingsWidget.h"
+
+#include <armadillo>
+
+using namespace arma;
+
+// BatchPipeline processes datasets without the user interface (it is used by the batch
+// executable, mainBatch.cpp). Every dataset is loaded from its descriptor and then
+// filtered, normalized, clustered, the marker genes of its clusters are computed and the
+// results are exported to a folder of the dataset. Several datasets are processed at the
+// same time and the computations of every dataset are done in several threads too
+class BatchPipeline
+{
+
+public:
+
+    enum ClusteringMethod {
+        NoClustering = 1,
+        KMeans = 2,
+        Ward = 3,
+        Louvain = 4
+    };
+
+    enum MarkersMethod {
+        NoMarkers = 1,
+        MarkersWilcoxon = 2,
+        MarkersTTest = 3
+    };
+
+    // The steps of the pipeline (the same options as the analysis views)
+    struct Settings {
+        // the thresholds of STData::filterDataFrame()
+        int min_exp_value = 0;
+        int min_reads_spot = 0;
+        int min_genes_spot = 0;
+        int min_spots_gene = 0;
+        SettingsWidget::NormalizationMode normalization = SettingsWidget::RAW;
+        // log(x + 1) of the normalized counts
+        bool log_scale = true;
+        // the spots are clustered in their principal components
+        ClusteringMethod clustering = KMeans;
+        uword components = 10;
+        bool scale = false;
+        // the number of clusters (0 to estimate it)
+        uword clusters = 0;
+        // the marker genes of every cluster against the rest of the spots
+        MarkersMethod markers = MarkersWilcoxon;
+        // export the filtered and normalized counts too
+        bool save_counts = false;
+        // the datasets processed at the same time (0 to choose it from the number of cores)
+        int jobs = 0;
+        // the folder of the results (there is a folder for every dataset)
+        QString output;
+    };
+
+    // The result of a dataset
+    struct Result {
+        QString descriptor;
+        QString name;
+        QString folder;
+        bool succeeded = false;
+        QString error;
+        uword spots = 0;
+        uword genes = 0;
+        uword clusters = 0;
+    };
+
+    // Called when a dataset has been processed (from the threads of the pipeline)
+    typedef std::function<void(const Result &)> Progress;
+
+    explicit BatchPipeline(const Settings &settings);
+    ~BatchPipeline();
+
+    // Parses the descriptor of a dataset: a meta file (JSON with the files of the dataset),
+    // an info.json file (the files of the dataset are in its folder) or a folder
+    static bool parseDescriptor(const QString &descriptor, Dataset &dataset);
+
+    // Processes the datasets (in the order of the descriptors) and writes a summary
+    // of the results (summary.tsv) in the output folder
+    QList<Result> run(const QStringList &descriptors, const Progress &progress = Progress()) const;
+
+private:
+
+    // Processes a dataset and exports its results to the folder
+    Result process(Dataset &dataset, Result result) const;
+
+    // the steps of the pipeline (the normalized counts are used to cluster the spots and
+    // the filtered counts to compute the marker genes)
+    STData::STDataFrame normalize(const STData::STDataFrame &data) const;
+    uvec cluster(const STData::STDataFrame &data) const;
+
+    // the number of datasets processed at the same time
+    int jobs() const;
+
+    Settings m_settings;
+};
+
+#endif // BATCHPIPELINE_H
@@ -1,7 +1,12 @@
 #include "Dataset.h"
 #include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonObject>
+#include <QJsonDocument>
 #include "STData.h"
 #include "DatasetImporter.h"
+#include "STDataBinary.h"
 
 Dataset::Dataset()
     : m_name()
@@ -143,7 +148,7 @@ const QRect Dataset::chip() const
 
 const QString Dataset::sizeFactorsFile() const
 {
-    return m_spots_file;
+    return m_size_factors_file;
 }
 
 void Dataset::name(const QString &name)
@@ -203,13 +208,37 @@ void Dataset::sizeFactorsFile(const QString &sizeFactorsFile)
 
 void Dataset::load_data()
 {
-    // Parse ST Data file and spot coordinates (if any)
+    // Load the ST Data from the binary cache if it was created from the same files
     m_data = QSharedPointer<STData>(new STData());
-    try {
-        m_data->init(m_data_file, m_spots_file);
-    } catch (const std::exception &e) {
-        qDebug() << "Error parsing data matrix or spot coordinates " << e.what();
-        throw;
+    const QString cache_file = m_data_file + "." + STDataBinary::SUFFIX;
+    const quint64 fingerprint = STDataBinary::fingerprint(
+                QStringList() << m_data_file << m_spots_file << m_size_factors_file);
+    if (m_data->initFromBinary(cache_file, fingerprint)) {
+        qDebug() << "Loaded dataset from cache file " << cache_file;
+    } else {
+        // Parse ST Data file and spot coordinates (if any)
+        try {
+            m_data->init(m_data_file, m_spots_file);
+        } catch (const std::exception &e) {
+            qDebug() << "Error parsing data matrix or spot coordinates " << e.what();
+            throw;
+        }
+
+        // Parse size-factors
+        if (!m_size_factors_file.isEmpty()) {
+            const bool parsed = m_data->parseSizeFactors(m_size_factors_file);
+            if (!parsed) {
+                qDebug() << "Error parsing Size Factors file";
+                throw std::runtime_error("Error parsing Size Factors file");
+            }
+        }
+
+        // Create the cache (it is not an error if it cannot be created)
+        try {
+            m_data->saveBinary(cache_file, fingerprint);
+        } catch (const std::exception &e) {
+            qDebug() << "Could not create the cache file " << cache_file << " " << e.what();
+        }
     }
 
     // Parse image alignment
@@ -220,15 +249,111 @@ void Dataset::load_data()
             throw std::runtime_error("Error parsing Image alignment file");
         }
     }
+}
 
-    // Parse size-factors
-    if (!m_size_factors_file.isEmpty()) {
-        const bool parsed = m_data->parseSizeFactors(m_size_factors_file);
-        if (!parsed) {
-            qDebug() << "Error parsing Size Factors file";
-            throw std::runtime_error("Error parsing Size Factors file");
+bool Dataset::parseMetaFile(const QString &filename)
+{
+    QFile file_data(filename);
+    if (!file_data.open(QIODevice::ReadOnly)) {
+        qDebug() << "Error opening dataset meta file " << filename;
+        return false;
+    }
+    QJsonParseError error;
+    const QJsonDocument loadDoc = QJsonDocument::fromJson(file_data.readAll(), &error);
+    if (error.error != QJsonParseError::NoError || !loadDoc.isObject()) {
+        qDebug() << "Error parsing dataset meta file " << filename << error.errorString();
+        return false;
+    }
+    const QJsonObject jsonObject = loadDoc.object();
+    const QDir folder = QFileInfo(filename).absoluteDir();
+    const auto path = [&](const QString &key) {
+        const QString value = jsonObject[key].toString();
+        return value.isEmpty() ? value : QDir::cleanPath(folder.absoluteFilePath(value));
+    };
+    if (jsonObject.contains("name")) {
+        m_name = jsonObject["name"].toString();
+    }
+    if (jsonObject.contains("species")) {
+        m_statSpecies = jsonObject["species"].toString();
+    }
+    if (jsonObject.contains("tissue")) {
+        m_statTissue = jsonObject["tissue"].toString();
+    }
+    if (jsonObject.contains("comments")) {
+        m_statComments = jsonObject["comments"].toString();
+    }
+    if (jsonObject.contains("data")) {
+        m_data_file = path("data");
+    }
+    if (jsonObject.contains("image")) {
+        m_image_file = path("image");
+    }
+    if (jsonObject.contains("aligment")) {
+        m_alignment_file = path("aligment");
+    }
+    if (jsonObject.contains("coordinates")) {
+        m_spots_file = path("coordinates");
+    }
+    if (jsonObject.contains("size_factors")) {
+        m_size_factors_file = path("size_factors");
+    }
+    return !m_data_file.isEmpty();
+}
+
+bool Dataset::parseFolder(const QString &folder)
+{
+    const QFileInfoList files = QDir(folder).entryInfoList(QDir::Files, QDir::Name);
+    for (const QFileInfo &file : files) {
+        const QString name = file.fileName();
+        const QString path = file.absoluteFilePath();
+        qDebug() << "Parsing dataset file from folder " << path;
+        // the binary cache of the matrix (data.tsv.stbin) is not a file of the dataset
+        if (file.suffix() == STDataBinary::SUFFIX) {
+            continue;
         }
+        if (name.contains(".tsv")) {
+            m_data_file = path;
+        } else if (name.contains(".jpg")) {
+            m_image_file = path;
+        } else if (name.contains("alignment")) {
+            m_alignment_file = path;
+        } else if (name.contains("spots")) {
+            m_spots_file = path;
+        } else if (name.contains("sizefactors")) {
+            m_size_factors_file = path;
+        } else if (name.contains("info.json")) {
+            parseInfoJSON(path);
+        }
+    }
+    // the name of the folder if the dataset has no info.json
+    if (m_name.isEmpty()) {
+        m_name = QDir(folder).dirName();
+    }
+    return !m_data_file.isEmpty();
+}
+
+bool Dataset::parseInfoJSON(const QString &filename)
+{
+    QFile file_data(filename);
+    if (!file_data.open(QIODevice::ReadOnly)) {
+        qDebug() << "Error parsing info.json for dataset";
+        return false;
+    }
+    const QJsonDocument loadDoc = QJsonDocument::fromJson(file_data.readAll());
+    const QJsonObject jsonObject = loadDoc.object();
+    if (jsonObject.contains("name")) {
+        m_name = jsonObject["name"].toString();
+    }
+    if (jsonObject.contains("species")) {
+        m_statSpecies = jsonObject["species"].toString();
+    }
+    if (jsonObject.contains("tissue")) {
+        m_statTissue = jsonObject["tissue"].toString();
+    }
+    if (jsonObject.contains("comments")) {
+        m_statComments = jsonObject["comments"].toString();
     }
+    return true;
 }
 
 bool Dataset::load_imageAligment()
@@ -56,6 +56,18 @@ public:
     // throws exception if parsing is something went wrong
     void load_data();
 
+    // Functions to describe the dataset from files (the same as the dataset importer)
+    // Parses a meta file (JSON) with the name, the stats and the files of the dataset
+    // (relative paths are relative to the folder of the meta file)
+    // returns false if the file could not be parsed or it has no matrix of counts
+    bool parseMetaFile(const QString &filename);
+    // Parses a folder with the files of the dataset: the matrix (*.tsv), the image (*.jpg),
+    // the alignment, the spots file, the size factors and the stats (info.json)
+    // returns false if the folder has no matrix of counts
+    bool parseFolder(const QString &folder);
+    // Parses the name and the stats (species, tissue and comments) of an info.json file
+    bool parseInfoJSON(const QString &filename);
+
 private:
 
     // Private function to load the image aligment matrix from a file
@@ -4,10 +4,8 @@
 #include <QTextStream>
 #include <QDebug>
 #include <QCommandLinkButton>
+#include <QLineEdit>
 #include <QFileDialog>
-#include <QDirIterator>
-#include <QJsonObject>
-#include <QJsonDocument>
 #include <QStandardPaths>
 
 #include "Dataset.h"
@@ -246,26 +244,9 @@ void DatasetImporter::slotParseFolder()
     dialog.setFileMode(QFileDialog::Directory);
     dialog.setViewMode(QFileDialog::Detail);
     if (dialog.exec()) {
-        QDir selectedDir = dialog.directory();
-        selectedDir.setFilter(QDir::Files);
-        QDirIterator it(selectedDir, QDirIterator::NoIteratorFlags);
-        while (it.hasNext()) {
-            const QString file = it.next();
-            qDebug() << "Parsing dataset file from folder " << file;
-            if (file.contains(".tsv")) {
-                m_ui->stDataFile->setText(file);
-            } else if (file.contains(".jpg")) {
-                m_ui->mainImageFile->setText(file);
-            } else if (file.contains("alignment")) {
-                m_ui->imageAlignmentFile->setText(file);
-            } else if (file.contains("spots")) {
-                m_ui->spotMapFile->setText(file);
-            } else if (file.contains("sizefactors")) {
-                m_ui->sizeFactorsFile->setText(file);
-            } else if (file.contains("info.json")) {
-                parseInfoJSON(file);
-            }
-        }
+        Dataset dataset;
+        dataset.parseFolder(dialog.directory().absolutePath());
+        loadDataset(dataset);
     }
 }
 
@@ -289,66 +270,33 @@ void DatasetImporter::slotParseMetaFile()
         return;
     }
 
-    QFile file_data(filename);
-    if (file_data.open(QIODevice::ReadOnly)) {
-        const QByteArray &data = file_data.readAll();
-        const QJsonDocument &loadDoc = QJsonDocument::fromJson(data);
-        const QJsonObject &jsonObject = loadDoc.object();
-        if (jsonObject.contains("name")) {
-            m_ui->datasetName->setText(jsonObject["name"].toString());
-        }
-        if (jsonObject.contains("species")) {
-            m_ui->species->setText(jsonObject["species"].toString());
-        }
-        if (jsonObject.contains("tissue")) {
-            m_ui->tissue->setText(jsonObject["tissue"].toString());
-        }
-        if (jsonObject.contains("comments")) {
-            m_ui->comments->setText(jsonObject["comments"].toString());
-        }
-        if (jsonObject.contains("data")) {
-            m_ui->stDataFile->setText(jsonObject["data"].toString());
-        }
-        if (jsonObject.contains("image")) {
-            m_ui->mainImageFile->setText(jsonObject["image"].toString());
-        }
-        if (jsonObject.contains("aligment")) {
-            m_ui->imageAlignmentFile->setText(jsonObject["aligment"].toString());
-        }
-        if (jsonObject.contains("coordinates")) {
-            m_ui->spotMapFile->setText(jsonObject["coordinates"].toString());
-        }
-        if (jsonObject.contains("size_factors")) {
-            m_ui->sizeFactorsFile->setText(jsonObject["size_factors"].toString());
-        }
-    } else {
+    Dataset dataset;
+    const bool parsed = dataset.parseMetaFile(filename);
+    loadDataset(dataset);
+    if (!parsed) {
         QMessageBox::critical(this,
                               tr("Dataset's meta file"),
                               tr("Error parsing file"));
     }
 }
 
-
-void DatasetImporter::parseInfoJSON(const QString &filename)
+void DatasetImporter::loadDataset(const Dataset &dataset)
 {
-    QFile file_data(filename);
-    if (file_data.open(QIODevice::ReadOnly)) {
-        const QByteArray &data = file_data.readAll();
-        const QJsonDocument &loadDoc = QJsonDocument::fromJson(data);
-        const QJsonObject &jsonObject = loadDoc.object();
-        if (jsonObject.contains("name")) {
-            m_ui->datasetName->setText(jsonObject["name"].toString());
+    // only the fields that were parsed are changed
+    const auto setText = [](QLineEdit *field, const QString &text) {
+        if (!text.isEmpty()) {
+            field->setText(text);
         }
-        if (jsonObject.contains("species")) {
-            m_ui->species->setText(jsonObject["species"].toString());
-        }
-        if (jsonObject.contains("tissue")) {
-            m_ui->tissue->setText(jsonObject["tissue"].toString());
-        }
-        if (jsonObject.contains("comments")) {
-            m_ui->comments->setText(jsonObject["comments"].toString());
-        }
-    } else {
-        qDebug() << "Error parsing info.json for dataset";
+    };
+    setText(m_ui->datasetName, dataset.name());
+    setText(m_ui->species, dataset.statSpecies());
+    setText(m_ui->tissue, dataset.statTissue());
+    setText(m_ui->stDataFile, dataset.dataFile());
+    setText(m_ui->mainImageFile, dataset.imageFile());
+    setText(m_ui->imageAlignmentFile, dataset.imageAlignmentFile());
+    setText(m_ui->spotMapFile, dataset.spotsFile());
+    setText(m_ui->sizeFactorsFile, dataset.sizeFactorsFile());
+    if (!dataset.statComments().isEmpty()) {
+        m_ui->comments->setText(dataset.statComments());
     }
 }
@@ -63,7 +63,8 @@ private slots:
 
 private:
     void init();
-    void parseInfoJSON(const QString &filename);
+    // fills the fields with the parsed files and stats of a dataset
+    void loadDataset(const Dataset &dataset);
     QScopedPointer<Ui::DatasetImporter> m_ui;
 
 };
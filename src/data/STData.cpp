@@ -2,15 +2,35 @@
 #include <QDebug>
 #include <QMessageBox>
 #include <QtConcurrent>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QThread>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <numeric>
 #include "math/Common.h"
 #include "color/HeatMap.h"
-#include "math/RInterface.h"
+#include "math/SizeFactors.h"
+#include "data/STDataBinary.h"
 
 static const int ROW = 1;
 static const int COLUMN = 0;
 
+// Data frames with a smaller fraction of non zero values than this are stored as sparse
+static const double SPARSE_MAX_DENSITY = 0.3;
+
+// Maximum number of normalization factors (of different filtering states) kept in memory
+static const int MAX_CACHED_FACTORS = 16;
+
+// Average number of spots in every cell of the spatial index of the spots
+static const double SPOTS_PER_GRID_CELL = 4.0;
+
 STData::STData()
-    : m_data()
+    : m_mapped_file()
+    , m_data()
     , m_size_factors()
     , m_spots()
     , m_genes()
@@ -23,63 +43,311 @@ STData::~STData()
 
 }
 
+namespace
+{
+
+// Powers of ten that are exactly representable as doubles
+const double EXACT_POW10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                              1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                              1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Parses a decimal number in the range [begin, end) with no locale or allocations.
+// The common case (up to 19 significant digits and small exponents) is computed exactly,
+// anything else (inf, nan, hex, huge exponents...) falls back to strtod.
+// Returns false if the token is not a valid number.
+bool parseNumber(const char *begin, const char *end, double &value)
+{
+    const char *p = begin;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    const char *digits_start = p;
+    while (p != end && *p >= '0' && *p <= '9') {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            if (mantissa != 0) {
+                ++digits;
+            }
+        } else {
+            ++exponent;
+        }
+        ++p;
+    }
+    bool has_digits = p != digits_start;
+    if (p != end && *p == '.') {
+        ++p;
+        const char *fraction_start = p;
+        while (p != end && *p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                if (mantissa != 0) {
+                    ++digits;
+                }
+                --exponent;
+            }
+            ++p;
+        }
+        has_digits |= p != fraction_start;
+    }
+    if (has_digits && p != end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negative_exp = false;
+        if (p != end && (*p == '-' || *p == '+')) {
+            negative_exp = *p == '-';
+            ++p;
+        }
+        int exp_value = 0;
+        const char *exp_start = p;
+        while (p != end && *p >= '0' && *p <= '9') {
+            if (exp_value < 10000) {
+                exp_value = exp_value * 10 + (*p - '0');
+            }
+            ++p;
+        }
+        if (p == exp_start) {
+            has_digits = false;
+        }
+        exponent += negative_exp ? -exp_value : exp_value;
+    }
+
+    if (has_digits && p == end && digits < 19 && exponent >= -22 && exponent <= 22
+            && mantissa <= (uint64_t(1) << 53)) {
+        double result = static_cast<double>(mantissa);
+        result = exponent < 0 ? result / EXACT_POW10[-exponent] : result * EXACT_POW10[exponent];
+        value = negative ? -result : result;
+        return true;
+    }
+
+    // Slow path (strtod needs a null terminated string)
+    const std::string token(begin, end);
+    if (token.empty()) {
+        return false;
+    }
+    char *parsed_end = nullptr;
+    value = std::strtod(token.c_str(), &parsed_end);
+    return parsed_end == token.c_str() + token.size();
+}
+
+// Removes trailing carriage returns (files created in Windows)
+inline const char *trimLineEnd(const char *begin, const char *end)
+{
+    while (end != begin && *(end - 1) == '\r') {
+        --end;
+    }
+    return end;
+}
+
+// Returns the indexes [0, n)
+uvec indexRange(const uword n)
+{
+    uvec indexes(n);
+    std::iota(indexes.begin(), indexes.end(), uword(0));
+    return indexes;
+}
+
+// Gathers the given rows and columns of a sparse matrix
+sp_mat gatherSparse(const sp_mat &matrix, const uvec &rows, const uvec &cols)
+{
+    const uword not_kept = matrix.n_rows;
+    std::vector<uword> row_map(matrix.n_rows, not_kept);
+    for (uword i = 0; i < rows.n_elem; ++i) {
+        row_map[rows[i]] = i;
+    }
+    std::vector<uword> locations;
+    std::vector<double> values;
+    for (uword j = 0; j < cols.n_elem; ++j) {
+        const uword col = cols[j];
+        for (uword k = matrix.col_ptrs[col]; k < matrix.col_ptrs[col + 1]; ++k) {
+            const uword row = row_map[matrix.row_indices[k]];
+            if (row != not_kept) {
+                locations.push_back(row);
+                locations.push_back(j);
+                values.push_back(matrix.values[k]);
+            }
+        }
+    }
+    if (values.empty()) {
+        return sp_mat(rows.n_elem, cols.n_elem);
+    }
+    const umat locations_mat(locations.data(), 2, values.size());
+    return sp_mat(locations_mat, vec(values), rows.n_elem, cols.n_elem, true, false);
+}
+
+// Computes the DESeq2 size factors of the counts of a data frame (sparse counts are
+// not made dense)
+rowvec deseqFactors(const STData::STDataFrame &data, const SizeFactors::Backend backend)
+{
+    return data.is_sparse ? SizeFactors::computeDESeqFactors(data.sp_counts, backend)
+                          : SizeFactors::computeDESeqFactors(data.counts, backend);
+}
+
+// Computes the SCRAN size factors of the counts of a data frame (sparse counts are
+// not made dense)
+rowvec scranFactors(const STData::STDataFrame &data, const SizeFactors::Backend backend)
+{
+    return data.is_sparse ? SizeFactors::computeScranFactors(data.sp_counts, backend)
+                          : SizeFactors::computeScranFactors(data.counts, backend);
+}
+
+// A block of complete lines of the matrix body that is parsed by one thread
+struct ParseChunk {
+    const char *begin;
+    const char *end;
+    uword n_rows;
+    uword first_row;
+    QList<QString> spots;
+    QString error;
+};
+
+}
+
 STData::STDataFrame STData::read(const QString &filename)
 {
+    if (STDataBinary::isBinary(filename)) {
+        return STDataBinary::read(filename).data;
+    }
+
     STDataFrame data;
-    std::vector<std::vector<float>> values;
 
-    // Open file
-    std::ifstream f(filename.toStdString());
+    // Open file and map it into memory (fall back to read it if it cannot be mapped)
     qDebug() << "Opening ST Data file " << filename;
-
-    // Process the rest of the lines (row names and counts)
-    int row_number = 0;
-    int col_number = 0;
-    char sep = '\t';
-    bool parsed = true;
-    for (std::string line; std::getline(f, line);) {
-        std::istringstream iss(line);
-        std::string token;
-        std::vector<float> values_row;
-        col_number = 0;
-        while(std::getline(iss, token, sep)) {
-            if (row_number == 0) {
-                const QString gene = QString::fromStdString(token).trimmed();
-                if (data.genes.contains(gene)) {
-                    throw std::runtime_error("The matrix contains duplicated genes!");
-                }
-                if (!gene.isEmpty() && !gene.isNull()) {
-                    data.genes.append(gene);
-                }
-            } else if (col_number == 0) {
-                const QString spot = QString::fromStdString(token).trimmed();
-                data.spots.append(spot);
-            } else {
-                values_row.push_back(std::stof(token));
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw std::runtime_error("The file could not be opened");
+    }
+    const qint64 file_size = file.size();
+    QByteArray buffer;
+    const char *file_begin = nullptr;
+    if (file_size > 0) {
+        file_begin = reinterpret_cast<const char *>(file.map(0, file_size));
+        if (file_begin == nullptr) {
+            buffer = file.readAll();
+            file_begin = buffer.constData();
+        }
+    }
+    if (file_begin == nullptr) {
+        throw std::runtime_error("The file does not contain a valid matrix");
+    }
+    const char *file_end = file_begin + file_size;
+
+    // Parse the header (genes), empty names are skipped
+    const char *header_end = std::find(file_begin, file_end, '\n');
+    QSet<QString> unique_genes;
+    for (const char *token = file_begin; token < header_end;) {
+        const char *token_end = std::find(token, header_end, '\t');
+        const char *name_end = trimLineEnd(token, token_end);
+        const QString gene = QString::fromUtf8(token, name_end - token).trimmed();
+        if (!gene.isEmpty()) {
+            if (unique_genes.contains(gene)) {
+                throw std::runtime_error("The matrix contains duplicated genes!");
             }
-            ++col_number;
+            unique_genes.insert(gene);
+            data.genes.append(gene);
         }
-        if (row_number > 0) {
-            values.push_back(values_row);
+        token = token_end == header_end ? header_end : token_end + 1;
+    }
+    const uword n_cols = data.genes.size();
+
+    // Split the body into blocks of complete lines (one or more blocks per thread)
+    const char *body_begin = header_end == file_end ? file_end : header_end + 1;
+    const qint64 body_size = file_end - body_begin;
+    const qint64 min_chunk_size = 1 << 20;
+    const qint64 n_chunks = std::max<qint64>(
+        1, std::min<qint64>(QThread::idealThreadCount() * 4, body_size / min_chunk_size));
+    QVector<ParseChunk> chunks;
+    const char *chunk_begin = body_begin;
+    for (qint64 c = 1; c <= n_chunks && chunk_begin < file_end; ++c) {
+        const char *chunk_end = file_end;
+        if (c < n_chunks) {
+            const char *target = std::max(chunk_begin, body_begin + (body_size * c) / n_chunks);
+            chunk_end = std::find(target, file_end, '\n');
+            chunk_end = chunk_end == file_end ? file_end : chunk_end + 1;
+        }
+        if (chunk_end > chunk_begin) {
+            chunks.push_back({chunk_begin, chunk_end, 0, 0, QList<QString>(), QString()});
         }
-        ++row_number;
+        chunk_begin = chunk_end;
     }
-    // Close file
-    f.close();
 
-    if (!parsed || data.spots.empty() || data.genes.empty()) {
+    // Count the rows of each block (blank lines are ignored)
+    QtConcurrent::blockingMap(chunks, [](ParseChunk &chunk) {
+        for (const char *line = chunk.begin; line < chunk.end;) {
+            const char *line_end = std::find(line, chunk.end, '\n');
+            if (trimLineEnd(line, line_end) != line) {
+                ++chunk.n_rows;
+            }
+            line = line_end == chunk.end ? chunk.end : line_end + 1;
+        }
+    });
+    uword n_rows = 0;
+    for (auto &chunk : chunks) {
+        chunk.first_row = n_rows;
+        n_rows += chunk.n_rows;
+    }
+
+    if (n_rows == 0 || n_cols == 0) {
         throw std::runtime_error("The file does not contain a valid matrix");
     }
 
-    // Create an armadillo matrix
-    mat counts_matrix(row_number - 1, col_number - 1);
-    for (int i = 0; i < row_number - 1; ++i) {
-        for (int j = 0; j < col_number - 1; ++j) {
-            counts_matrix.at(i, j) = values[i][j];
+    // Parse the blocks in parallel writing the values directly into the matrix
+    mat counts(n_rows, n_cols, fill::none);
+    double *counts_mem = counts.memptr();
+    QtConcurrent::blockingMap(chunks, [=](ParseChunk &chunk) {
+        uword row = chunk.first_row;
+        for (const char *line = chunk.begin; line < chunk.end && chunk.error.isEmpty();) {
+            const char *next_line = std::find(line, chunk.end, '\n');
+            const char *line_end = trimLineEnd(line, next_line);
+            const char *following_line = next_line == chunk.end ? chunk.end : next_line + 1;
+            if (line_end == line) {
+                line = following_line;
+                continue;
+            }
+            // The first column is the spot
+            const char *token_end = std::find(line, line_end, '\t');
+            chunk.spots.append(QString::fromUtf8(line, token_end - line).trimmed());
+            // The rest are the counts
+            uword col = 0;
+            while (token_end != line_end) {
+                const char *token = token_end + 1;
+                token_end = std::find(token, line_end, '\t');
+                const char *value_begin = token;
+                const char *value_end = token_end;
+                while (value_begin != value_end && *value_begin == ' ') {
+                    ++value_begin;
+                }
+                while (value_end != value_begin && *(value_end - 1) == ' ') {
+                    --value_end;
+                }
+                double value;
+                if (col >= n_cols || !parseNumber(value_begin, value_end, value)) {
+                    chunk.error = col >= n_cols ? "The matrix has more values than genes"
+                                                : "The matrix contains invalid values";
+                    break;
+                }
+                counts_mem[col * n_rows + row] = value;
+                ++col;
+            }
+            if (chunk.error.isEmpty() && col != n_cols) {
+                chunk.error = "The matrix has less values than genes";
+            }
+            ++row;
+            line = following_line;
         }
+    });
 
+    for (auto &chunk : chunks) {
+        if (!chunk.error.isEmpty()) {
+            qDebug() << "Error parsing the matrix " << chunk.error;
+            throw std::runtime_error(chunk.error.toStdString());
+        }
+        data.spots.append(chunk.spots);
     }
-    data.counts = counts_matrix;
+    data.counts = std::move(counts);
 
     qDebug() << "Parsed data file with " << data.genes.size()
              << " genes and " << data.spots.size() << " spots";
@@ -107,18 +375,16 @@ void STData::init(const QString &filename, const QString &spots_coordinates) {
         }
     }
 
-    // The containers for the gene/spot objects
-    m_genes.clear();
-    m_spots.clear();
+    // Choose the storage type (dense or sparse) for the matrix
+    m_mapped_file.clear();
+    optimizeStorage(m_data);
 
-    // Create the spot object (if spot coordinates have been given only the spots
-    // there will be added), compute the total sum of the spot to add it to the spot objects
-    // and if the total sum == 0 the spot is discarded
-    colvec row_sum = sum(m_data.counts, ROW);
+    // Keep the spots with counts (if spot coordinates have been given only the spots
+    // there will be kept) and if the total sum == 0 the spot is discarded
+    const colvec row_sum = computeRowSums(m_data);
     std::vector<uword> to_keep_spots;
-    QList<QString> spots;
-    m_spot_index.clear();
-    for (uword i = 0; i < m_data.counts.n_rows; ++i) {
+    QVector<Spot::SpotType> adj_coordinates;
+    for (uword i = 0; i < row_sum.n_elem; ++i) {
         const auto &spot = m_data.spots.at(i);
         auto adj_spot = spot;
         if (!spots_dict.empty() && spots_dict.contains(spot)) {
@@ -126,59 +392,120 @@ void STData::init(const QString &filename, const QString &spots_coordinates) {
         } else if (!spots_dict.empty()) {
             continue;
         }
-        const double row_sum_value = row_sum.at(i);
-        if (row_sum_value > 0) {
+        if (row_sum.at(i) > 0) {
             to_keep_spots.push_back(i);
-            auto spot_obj = SpotObjectType(new Spot(spot));
-            spot_obj->adj_coordinates(Spot::getCoordinates(adj_spot));
-            spot_obj->totalCount(row_sum_value);
-            m_spots.push_back(spot_obj);
-            spots.push_back(spot);
-            m_spot_index.insert(spot, m_spots.size() - 1);
+            adj_coordinates.push_back(Spot::getCoordinates(adj_spot));
         }
     }
-    m_data.spots = spots;
-    m_data.counts = m_data.counts.rows(uvec(to_keep_spots));
+    m_data = sliceDataFrame(m_data, uvec(to_keep_spots), indexRange(m_data.genes.size()));
 
-    if (m_spots.empty()) {
-        qDebug() << "No valid spots could be found in the file.";
-        throw std::runtime_error("No valid spots could be found in the file.");
-    }
-
-    // Create the gene object and compute the total sums to add them to the gene objects
-    // if total sum is == 0 then the gene is discarded
-    rowvec col_sum = sum(m_data.counts, COLUMN);
+    // Keep the genes with counts (if total sum is == 0 then the gene is discarded)
+    const rowvec col_sum = computeColumnSums(m_data);
     std::vector<uword> to_keep_genes;
-    QList<QString> genes;
-    m_gene_index.clear();
-    for (uword j = 0; j < m_data.counts.n_cols; ++j) {
-        const double col_sum_value = col_sum.at(j);
-        if (col_sum_value > 0) {
-            const auto &gene = m_data.genes.at(j);
-            auto gene_obj = GeneObjectType(new Gene(gene));
-            gene_obj->totalCount(col_sum_value);
-            genes.push_back(gene);
+    for (uword j = 0; j < col_sum.n_elem; ++j) {
+        if (col_sum.at(j) > 0) {
             to_keep_genes.push_back(j);
-            m_genes.push_back(gene_obj);
-            m_gene_index.insert(gene, m_genes.size() - 1);
         }
     }
-    m_data.genes = genes;
-    m_data.counts = m_data.counts.cols(uvec(to_keep_genes));
+    m_data = sliceDataFrame(m_data, indexRange(m_data.spots.size()), uvec(to_keep_genes));
+
+    initObjects(adj_coordinates);
+}
+
+bool STData::initFromBinary(const QString &filename, const quint64 source_fingerprint)
+{
+    if (!QFile::exists(filename)) {
+        return false;
+    }
+    try {
+        STDataBinary::Content content = STDataBinary::read(filename, true);
+        if (content.source_fingerprint != source_fingerprint
+                || content.coordinates.size() != content.data.spots.size()) {
+            qDebug() << "The binary file " << filename << " is not up to date";
+            return false;
+        }
+        // the matrix is moved so it keeps aliasing the mapped file
+        m_mapped_file = content.mapped_file;
+        m_data = std::move(content.data);
+        m_size_factors = content.size_factors;
+        initObjects(content.coordinates);
+    } catch (const std::exception &e) {
+        qDebug() << "Error loading binary file " << filename << " " << e.what();
+        return false;
+    }
+    return true;
+}
 
-    if (m_genes.empty()) {
+void STData::saveBinary(const QString &filename, const quint64 source_fingerprint) const
+{
+    STDataBinary::Content content;
+    content.data = m_data;
+    content.size_factors = m_size_factors;
+    content.source_fingerprint = source_fingerprint;
+    for (const auto &spot : m_spots) {
+        content.coordinates.push_back(spot->adj_coordinates());
+    }
+    STDataBinary::write(filename, content);
+}
+
+void STData::initObjects(const QVector<Spot::SpotType> &adj_coordinates)
+{
+    Q_ASSERT(adj_coordinates.size() == m_data.spots.size());
+
+    // The containers for the gene/spot objects
+    m_genes.clear();
+    m_spots.clear();
+    m_spot_index.clear();
+    m_gene_index.clear();
+
+    if (m_data.spots.empty()) {
+        qDebug() << "No valid spots could be found in the file.";
+        throw std::runtime_error("No valid spots could be found in the file.");
+    }
+
+    if (m_data.genes.empty()) {
         qDebug() << "No valid genes could be found in the file.";
         throw std::runtime_error("No valid genes could be found in the file.");
     }
 
+    // Create the spot objects and add the total sum of the spot to them
+    const colvec row_sum = computeRowSums(m_data);
+    for (int i = 0; i < m_data.spots.size(); ++i) {
+        const auto &spot = m_data.spots.at(i);
+        auto spot_obj = SpotObjectType(new Spot(spot));
+        spot_obj->adj_coordinates(adj_coordinates.at(i));
+        spot_obj->totalCount(row_sum.at(i));
+        m_spots.push_back(spot_obj);
+        m_spot_index.insert(spot, i);
+    }
+
+    // Create the gene objects and add the total sum of the gene to them
+    const rowvec col_sum = computeColumnSums(m_data);
+    for (int j = 0; j < m_data.genes.size(); ++j) {
+        const auto &gene = m_data.genes.at(j);
+        auto gene_obj = GeneObjectType(new Gene(gene));
+        gene_obj->totalCount(col_sum.at(j));
+        m_genes.push_back(gene_obj);
+        m_gene_index.insert(gene, j);
+    }
+
     m_rendering_colors.resize(m_spots.size());
     m_rendering_selected.resize(m_spots.size());
     m_rendering_visible.resize(m_spots.size());
     m_rendering_values.resize(m_spots.size());
+    m_rendering_cache = RenderingCache();
+    initSpotGrid();
 }
 
 void STData::save(const QString &filename, const STData::STDataFrame &data)
 {
+    if (QFileInfo(filename).suffix() == STDataBinary::SUFFIX) {
+        STDataBinary::Content content;
+        content.data = data;
+        STDataBinary::write(filename, content);
+        return;
+    }
+
     QFile file(filename);
     if (file.open(QIODevice::WriteOnly)) {
         QTextStream stream(&file);
@@ -188,18 +515,28 @@ void STData::save(const QString &filename, const STData::STDataFrame &data)
         }
         stream << endl;
         // write spots (1st column and the rest of the rows (counts))
-        for (uword i = 0; i < data.counts.n_rows; ++i) {
-            const auto spot = data.spots.at(i);
-            stream <<  spot;
-            for (uword j = 0; j < data.counts.n_cols; ++j) {
-                stream << "\t" << data.counts(i,j);
+        // sparse matrices are transposed so the spots can be accessed by column
+        const sp_mat spots_counts = data.is_sparse ? sp_mat(data.sp_counts.t()) : sp_mat();
+        rowvec row(data.genes.size());
+        for (int i = 0; i < data.spots.size(); ++i) {
+            if (data.is_sparse) {
+                row.zeros();
+                for (uword k = spots_counts.col_ptrs[i]; k < spots_counts.col_ptrs[i + 1]; ++k) {
+                    row[spots_counts.row_indices[k]] = spots_counts.values[k];
+                }
+            } else {
+                row = data.counts.row(i);
+            }
+            stream << data.spots.at(i);
+            for (uword j = 0; j < row.n_elem; ++j) {
+                stream << "\t" << row[j];
             }
             stream << endl;
         }
     }
 }
 
-STData::STDataFrame STData::data() const
+const STData::STDataFrame &STData::data() const
 {
     return m_data;
 }
@@ -214,9 +551,65 @@ const STData::SpotListType &STData::spots() const
     return m_spots;
 }
 
+namespace
+{
+
+// Calls visit(gene, value) for the non zero values of a spot in gene order
+// (counts are transposed so every column is a spot)
+template <typename Visitor>
+inline void visitSpot(const mat &counts,
+                      const sp_mat &sp_counts,
+                      const bool is_sparse,
+                      const uword spot,
+                      Visitor visit)
+{
+    if (is_sparse) {
+        for (uword k = sp_counts.col_ptrs[spot]; k < sp_counts.col_ptrs[spot + 1]; ++k) {
+            visit(sp_counts.row_indices[k], sp_counts.values[k]);
+        }
+    } else {
+        const double *values = counts.colptr(spot);
+        for (uword j = 0; j < counts.n_rows; ++j) {
+            if (values[j] != 0) {
+                visit(j, values[j]);
+            }
+        }
+    }
+}
+
+// Marks the spots (rows) where the gene (column) has counts
+void markSpotsWithGene(const STData::STDataFrame &data,
+                       const uword gene,
+                       std::vector<char> &spots)
+{
+    if (data.is_sparse) {
+        const sp_mat &counts = data.sp_counts;
+        for (uword k = counts.col_ptrs[gene]; k < counts.col_ptrs[gene + 1]; ++k) {
+            spots[counts.row_indices[k]] = true;
+        }
+    } else {
+        const double *values = data.counts.colptr(gene);
+        for (uword i = 0; i < data.counts.n_rows; ++i) {
+            if (values[i] != 0) {
+                spots[i] = true;
+            }
+        }
+    }
+}
+
+// Returns the cell that contains the value in a grid axis (the cells divide the extent)
+int gridCell(const double value, const double origin, const double extent, const int cells)
+{
+    if (extent <= 0) {
+        return 0;
+    }
+    return qBound(0, static_cast<int>((value - origin) / extent * cells), cells - 1);
+}
+}
+
 void STData::computeRenderingData(SettingsWidget::Rendering &rendering_settings)
 {
-    Q_ASSERT(m_data.counts.size() > 0);
+    Q_ASSERT(!m_data.spots.empty());
 
     const bool use_genes =
             rendering_settings.visual_type_mode == SettingsWidget::VisualTypeMode::Genes ||
@@ -228,81 +621,160 @@ void STData::computeRenderingData(SettingsWidget::Rendering &rendering_settings)
             rendering_settings.visual_mode == SettingsWidget::VisualMode::DynamicRange ||
             rendering_settings.visual_mode == SettingsWidget::VisualMode::Normal;
     const bool do_values = rendering_settings.visual_mode != SettingsWidget::VisualMode::Normal;
+    const auto normalization =
+            do_values ? rendering_settings.normalization_mode : SettingsWidget::NormalizationMode::RAW;
+    const bool global_normalization =
+            normalization == SettingsWidget::NormalizationMode::DESEQ ||
+            normalization == SettingsWidget::NormalizationMode::SCRAN;
+    const bool size_factors =
+            rendering_settings.size_factors && m_size_factors.size() == m_data.spots.size();
+    // the thresholds are not negative (zeros are never visited)
+    const int ind_reads_threshold = std::max(0, rendering_settings.ind_reads_threshold);
+    const uword spots_threshold = std::max(0, rendering_settings.spots_threshold);
+    const uword n_spots = m_data.spots.size();
+    const uword n_genes = m_data.genes.size();
+    auto &cache = m_rendering_cache;
+
+    // Stage 1: apply size factors if indicated by the user
+    bool update_counts = !cache.valid || cache.size_factors != size_factors;
+    if (update_counts) {
+        computeRenderingCounts(size_factors);
+        cache.size_factors = size_factors;
+    }
 
-    // Set visible to false for all the spots
-    QtConcurrent::blockingMap(m_rendering_visible, [] (auto &visible) { visible = false; });
+    // Stage 2: count the spots above the individual threshold of each gene
+    if (update_counts || cache.ind_reads_threshold != ind_reads_threshold) {
+        cache.ind_reads_threshold = ind_reads_threshold;
+        computeRenderingGeneSpots(ind_reads_threshold);
+        update_counts = true;
+    }
 
-    // Create copy of the data frame so to reduce and normalize it
-    STDataFrame data = m_data;
+    // Keep only the genes that are visible and pass the threshold and
+    // find the genes that changed since the last update
+    if (update_counts) {
+        cache.gene_kept.assign(n_genes, false);
+        cache.gene_selected.assign(n_genes, false);
+        cache.gene_thresholds.assign(n_genes, 0.0);
+        cache.gene_red.assign(n_genes, 0);
+        cache.gene_green.assign(n_genes, 0);
+        cache.gene_blue.assign(n_genes, 0);
+        cache.gene_alpha.assign(n_genes, 0);
+    }
+    std::vector<uword> changed_genes;
+    bool kept_genes_changed = false;
+    for (uword j = 0; j < n_genes; ++j) {
+        const auto &gene_obj = m_genes.at(j);
+        const bool kept = gene_obj->visible() && cache.gene_spots[j] > spots_threshold;
+        const bool selected = gene_obj->selected();
+        const double cut_off = gene_obj->cut_off();
+        const double threshold = rendering_settings.gene_cutoff ? std::max(0.0, cut_off) : 0.0;
+        const QColor color = gene_obj->color();
+        const bool kept_changed = kept != static_cast<bool>(cache.gene_kept[j]);
+        if (kept_changed
+                || (kept && (selected != static_cast<bool>(cache.gene_selected[j])
+                             || threshold != cache.gene_thresholds[j]
+                             || color.red() != cache.gene_red[j]
+                             || color.green() != cache.gene_green[j]
+                             || color.blue() != cache.gene_blue[j]
+                             || color.alpha() != cache.gene_alpha[j]))) {
+            changed_genes.push_back(j);
+            kept_genes_changed |= kept_changed;
+        }
+        cache.gene_kept[j] = kept;
+        cache.gene_selected[j] = selected;
+        cache.gene_thresholds[j] = threshold;
+        cache.gene_red[j] = color.red();
+        cache.gene_green[j] = color.green();
+        cache.gene_blue[j] = color.blue();
+        cache.gene_alpha[j] = color.alpha();
+    }
 
-    // Apply size factors if indicated by the user
-    if (rendering_settings.size_factors && m_size_factors.size() == data.counts.n_rows) {
-        data.counts.each_col() /= m_size_factors.t();
+    // Updating every spot is faster than finding the spots of many genes
+    if (changed_genes.size() > n_genes / 8) {
+        update_counts = true;
     }
 
-    // Remove genes that are not visible
-    std::vector<uword> to_keep_genes;
-    QList<QString> genes;
-    for (uword i = 0; i < data.counts.n_cols; ++i) {
-        const QString &gene = data.genes.at(i);
-        const uword gene_index = m_gene_index.value(gene);
-        const auto gene_obj = m_genes.at(gene_index);
-        if (gene_obj->visible()) {
-            genes.push_back(gene);
-            to_keep_genes.push_back(i);
-        }
-    }
-    data.genes = genes;
-    data.counts = data.counts.cols(uvec(to_keep_genes));
-
-    // Slice the data frame with the thresholds
-    data = filterDataFrame(data,
-                           rendering_settings.ind_reads_threshold,
-                           rendering_settings.reads_threshold,
-                           rendering_settings.genes_threshold,
-                           rendering_settings.spots_threshold);
-
-    // Early out
-    if (data.spots.empty() && data.genes.empty()) {
-        return;
+    // Stage 3: compute the reads and genes of each spot (only the genes that are kept)
+    // and keep the spots that pass the thresholds
+    // (the spots are independent so they are updated in parallel)
+    const auto spot_counts = [this](const uword spot) { computeRenderingSpotCounts(spot); };
+    std::vector<uword> changed_spots;
+    if (update_counts) {
+        cache.spot_reads.set_size(n_spots);
+        cache.spot_genes.set_size(n_spots);
+        cache.spot_totals.set_size(n_spots);
+        std::vector<uword> spots(n_spots);
+        std::iota(spots.begin(), spots.end(), 0);
+        QtConcurrent::blockingMap(spots, spot_counts);
+    } else if (!changed_genes.empty()) {
+        std::vector<char> spots_with_genes(n_spots, false);
+        for (const uword j : changed_genes) {
+            markSpotsWithGene(m_data, j, spots_with_genes);
+        }
+        for (uword i = 0; i < n_spots; ++i) {
+            if (spots_with_genes[i]) {
+                changed_spots.push_back(i);
+            }
+        }
+        if (kept_genes_changed) {
+            QtConcurrent::blockingMap(changed_spots, spot_counts);
+        }
+    }
+    cache.spot_kept.resize(n_spots, false);
+    bool kept_spots_changed = false;
+    for (uword i = 0; i < n_spots; ++i) {
+        const bool kept = cache.spot_reads[i] > rendering_settings.reads_threshold
+                && cache.spot_genes[i] > rendering_settings.genes_threshold;
+        kept_spots_changed |= kept != static_cast<bool>(cache.spot_kept[i]);
+        cache.spot_kept[i] = kept;
     }
 
-    // Check if we need to compute normalization factors and normalize the data
-    if (do_values) {
-        // Normalize the data
-        data = normalizeCounts(data, rendering_settings.normalization_mode);
+    // Stage 4: compute the normalization factors if they depend on all the spots
+    bool update_values = update_counts
+            || cache.normalization != normalization
+            || cache.do_color != do_color;
+    cache.normalization = normalization;
+    cache.do_color = do_color;
+    if (global_normalization && (update_values || kept_genes_changed || kept_spots_changed)) {
+        computeRenderingSpotFactors();
+        update_values = true;
     }
 
-    // Iterate the spots and genes in the matrix to compute the rendering colors
+    // Stage 5: accumulate the values and colors of the genes in each spot
+    const auto spot_value = [this](const uword spot) { computeRenderingSpotValue(spot); };
+    if (update_values) {
+        cache.spot_values.set_size(n_spots);
+        cache.spot_num_genes.set_size(n_spots);
+        cache.spot_colors.fill(QColor(), n_spots);
+        cache.spot_any_selected.assign(n_spots, false);
+        std::vector<uword> spots(n_spots);
+        std::iota(spots.begin(), spots.end(), 0);
+        QtConcurrent::blockingMap(spots, spot_value);
+    } else if (!changed_spots.empty()) {
+        QtConcurrent::blockingMap(changed_spots, spot_value);
+    }
+    cache.valid = true;
+
+    // Early out (no genes pass the thresholds)
+    cache.any_gene_kept = std::any_of(cache.gene_kept.begin(), cache.gene_kept.end(),
+                                      [](const char kept) { return kept; });
+    if (!cache.any_gene_kept) {
+        QtConcurrent::blockingMap(m_rendering_visible, [] (auto &visible) { visible = false; });
+        return;
+    }
+
+    // Compute the rendering values and colors of the spots
     double min_value = 10e6;
     double max_value = -10e6;
-    //TODO make this paralell
-    for (uword i = 0; i < data.counts.n_rows; ++ i) {
-        const int spot_index = m_spot_index.value(data.spots.at(i), -1);
-        Q_ASSERT(spot_index != -1);
-        const auto spot_obj = m_spots.at(spot_index);
-        bool visible = false;
-        double merged_value = 0.0;
-        double num_genes = 0.0;
-        bool any_gene_selected = false;
-        QColor merged_color;
-        // Iterate the genes in the spot to compute the sum of values and color
-        for (uword j = 0; j < data.counts.n_cols; ++j) {
-            const int gene_index = m_gene_index.value(data.genes.at(j), -1);
-            Q_ASSERT(gene_index != -1);
-            const auto gene_obj = m_genes.at(gene_index);
-            const double value = data.counts.at(i,j);
-            if (value <= 0
-                    || (rendering_settings.gene_cutoff && gene_obj->cut_off() >= value)) {
-                continue;
-            }
-            ++num_genes;
-            merged_value += value;
-            if (do_color) {
-                merged_color = STMath::lerp(1.0 / num_genes, merged_color, gene_obj->color());
-            }
-            any_gene_selected |= gene_obj->selected();
+    for (uword i = 0; i < n_spots; ++i) {
+        if (!cache.spot_kept[i]) {
+            m_rendering_visible[i] = false;
+            continue;
         }
+        const auto &spot_obj = m_spots.at(i);
+        bool visible = false;
+        double merged_value = cache.spot_values[i];
+        QColor merged_color = cache.spot_colors.at(i);
         // Update the color of the spot
         if (spot_obj->visible()) {
             merged_color = spot_obj->color();
@@ -310,23 +782,228 @@ void STData::computeRenderingData(SettingsWidget::Rendering &rendering_settings)
         } else if (merged_value > 0.0) {
             // Use number of genes or total reads in the spot depending on settings
             if (do_values) {
-                merged_value = use_genes ? num_genes : merged_value;
+                merged_value = use_genes ? cache.spot_num_genes[i] : merged_value;
                 merged_value = use_log ? std::log(merged_value) : merged_value;
                 min_value = std::min(min_value, merged_value);
                 max_value = std::max(max_value, merged_value);
             }
             visible = true;
         }
-        spot_obj->selected(visible && (spot_obj->selected() || any_gene_selected));
-        m_rendering_colors[spot_index] = merged_color;
-        m_rendering_selected[spot_index] = spot_obj->selected();
-        m_rendering_values[spot_index] = merged_value;
-        m_rendering_visible[spot_index] = visible;
+        spot_obj->selected(visible && (spot_obj->selected() || cache.spot_any_selected[i]));
+        m_rendering_colors[i] = merged_color;
+        m_rendering_selected[i] = spot_obj->selected();
+        m_rendering_values[i] = merged_value;
+        m_rendering_visible[i] = visible;
     }
     rendering_settings.legend_min = min_value;
     rendering_settings.legend_max = max_value;
 }
 
+void STData::computeRenderingCounts(const bool size_factors)
+{
+    auto &cache = m_rendering_cache;
+    if (m_data.is_sparse) {
+        cache.counts.reset();
+        cache.sp_counts = m_data.sp_counts.t();
+        if (size_factors) {
+            // the spots are the columns of the transposed counts
+            const sp_mat &counts = cache.sp_counts;
+            const uvec row_indices(counts.row_indices, counts.n_nonzero);
+            const uvec col_ptrs(counts.col_ptrs, counts.n_cols + 1);
+            vec values(counts.values, counts.n_nonzero);
+            for (uword i = 0; i < counts.n_cols; ++i) {
+                for (uword k = col_ptrs[i]; k < col_ptrs[i + 1]; ++k) {
+                    values[k] /= m_size_factors[i];
+                }
+            }
+            cache.sp_counts = sp_mat(row_indices, col_ptrs, values, counts.n_rows, counts.n_cols);
+        }
+    } else {
+        cache.sp_counts.reset();
+        cache.counts = m_data.counts.t();
+        if (size_factors) {
+            cache.counts.each_row() /= m_size_factors;
+        }
+    }
+}
+
+void STData::computeRenderingGeneSpots(const int ind_reads_threshold)
+{
+    // The genes are the columns of the original counts so they are counted in parallel
+    // (the values are scaled the same way as in computeRenderingCounts())
+    auto &cache = m_rendering_cache;
+    const bool size_factors = cache.size_factors;
+    cache.gene_spots.zeros(m_data.genes.size());
+    std::vector<uword> genes(m_data.genes.size());
+    std::iota(genes.begin(), genes.end(), 0);
+    QtConcurrent::blockingMap(genes, [&](const uword gene) {
+        uword spots = 0;
+        if (m_data.is_sparse) {
+            const sp_mat &counts = m_data.sp_counts;
+            for (uword k = counts.col_ptrs[gene]; k < counts.col_ptrs[gene + 1]; ++k) {
+                const double value = size_factors
+                        ? counts.values[k] / m_size_factors[counts.row_indices[k]]
+                        : counts.values[k];
+                if (value > ind_reads_threshold) {
+                    ++spots;
+                }
+            }
+        } else {
+            const double *values = m_data.counts.colptr(gene);
+            for (uword i = 0; i < m_data.counts.n_rows; ++i) {
+                const double value = size_factors ? values[i] / m_size_factors[i] : values[i];
+                if (value > ind_reads_threshold) {
+                    ++spots;
+                }
+            }
+        }
+        cache.gene_spots[gene] = spots;
+    });
+}
+
+void STData::computeRenderingSpotCounts(const uword spot)
+{
+    auto &cache = m_rendering_cache;
+    double reads = 0.0;
+    double total = 0.0;
+    uword genes = 0;
+    visitSpot(cache.counts, cache.sp_counts, m_data.is_sparse, spot,
+              [&](const uword gene, const double value) {
+        if (cache.gene_kept[gene]) {
+            total += value;
+            if (value > cache.ind_reads_threshold) {
+                reads += value;
+                ++genes;
+            }
+        }
+    });
+    cache.spot_reads[spot] = reads;
+    cache.spot_genes[spot] = genes;
+    cache.spot_totals[spot] = total;
+}
+
+void STData::computeRenderingSpotFactors()
+{
+    auto &cache = m_rendering_cache;
+    cache.spot_factors.ones(m_data.spots.size());
+    std::vector<uword> to_keep_spots;
+    for (uword i = 0; i < cache.spot_kept.size(); ++i) {
+        if (cache.spot_kept[i]) {
+            to_keep_spots.push_back(i);
+        }
+    }
+    std::vector<uword> to_keep_genes;
+    for (uword j = 0; j < cache.gene_kept.size(); ++j) {
+        if (cache.gene_kept[j]) {
+            to_keep_genes.push_back(j);
+        }
+    }
+    if (to_keep_spots.empty() || to_keep_genes.empty()) {
+        return;
+    }
+
+    // The factors only depend on the method and the filtered data so the ones
+    // computed before are reused (e.g. when a threshold goes back to a previous value)
+    QByteArray key;
+    key.append(static_cast<char>(cache.normalization));
+    key.append(static_cast<char>(cache.size_factors));
+    key.append(cache.gene_kept.data(), cache.gene_kept.size());
+    key.append(cache.spot_kept.data(), cache.spot_kept.size());
+    const auto cached = cache.spot_factors_cache.find(key);
+    if (cached != cache.spot_factors_cache.end()) {
+        cache.spot_factors = cached.value();
+        return;
+    }
+
+    // The factors are computed on the filtered data
+    const uvec rows(to_keep_spots);
+    STDataFrame data = sliceDataFrame(m_data, rows, uvec(to_keep_genes));
+    if (cache.size_factors) {
+        divideRows(data, colvec(m_size_factors.elem(rows)));
+    }
+    const rowvec factors =
+            cache.normalization == SettingsWidget::NormalizationMode::DESEQ
+            ? deseqFactors(data, SizeFactors::Native)
+            : scranFactors(data, SizeFactors::Native);
+    Q_ASSERT(factors.n_elem == rows.n_elem);
+    for (uword i = 0; i < rows.n_elem; ++i) {
+        cache.spot_factors[rows[i]] = factors[i];
+    }
+
+    if (cache.spot_factors_cache.size() >= MAX_CACHED_FACTORS) {
+        cache.spot_factors_cache.clear();
+    }
+    cache.spot_factors_cache.insert(key, cache.spot_factors);
+}
+
+void STData::computeRenderingSpotValue(const uword spot)
+{
+    auto &cache = m_rendering_cache;
+    double factor = 1.0;
+    switch (cache.normalization) {
+    case (SettingsWidget::NormalizationMode::RAW): {
+    } break;
+    case (SettingsWidget::NormalizationMode::REL): {
+        factor = cache.spot_totals[spot];
+    } break;
+    case (SettingsWidget::NormalizationMode::TPM): {
+        factor = cache.spot_totals[spot] / 1e6;
+    } break;
+    case (SettingsWidget::NormalizationMode::DESEQ):
+    case (SettingsWidget::NormalizationMode::SCRAN): {
+        factor = cache.spot_factors[spot];
+    } break;
+    }
+    const bool normalize = cache.normalization != SettingsWidget::NormalizationMode::RAW;
+    const bool do_color = cache.do_color;
+    const char *gene_kept = cache.gene_kept.data();
+    const char *gene_selected = cache.gene_selected.data();
+    const double *gene_thresholds = cache.gene_thresholds.data();
+    const int *gene_red = cache.gene_red.data();
+    const int *gene_green = cache.gene_green.data();
+    const int *gene_blue = cache.gene_blue.data();
+    const int *gene_alpha = cache.gene_alpha.data();
+
+    // Genes are visited in order so the colors are blended in order.
+    // The colors are blended with integers exactly as STMath::lerp() does with
+    // QColor (starting from an invalid QColor that is opaque black)
+    double merged_value = 0.0;
+    int num_genes = 0;
+    int red = 0;
+    int green = 0;
+    int blue = 0;
+    int alpha = 255;
+    bool any_gene_selected = false;
+    visitSpot(cache.counts, cache.sp_counts, m_data.is_sparse, spot,
+              [&](const uword gene, double value) {
+        if (!gene_kept[gene]) {
+            return;
+        }
+        if (normalize) {
+            value /= factor;
+        }
+        if (value <= gene_thresholds[gene]) {
+            return;
+        }
+        ++num_genes;
+        merged_value += value;
+        if (do_color) {
+            const float t = 1.0 / num_genes;
+            red = static_cast<int>(red + (gene_red[gene] - red) * t);
+            green = static_cast<int>(green + (gene_green[gene] - green) * t);
+            blue = static_cast<int>(blue + (gene_blue[gene] - blue) * t);
+            alpha = static_cast<int>(alpha + (gene_alpha[gene] - alpha) * t);
+        }
+        if (gene_selected[gene]) {
+            any_gene_selected = true;
+        }
+    });
+    cache.spot_values[spot] = merged_value;
+    cache.spot_num_genes[spot] = num_genes;
+    cache.spot_colors[spot] = do_color && num_genes > 0 ? QColor(red, green, blue, alpha) : QColor();
+    cache.spot_any_selected[spot] = any_gene_selected;
+}
+
 const QVector<bool> &STData::renderingVisible() const
 {
     return m_rendering_visible;
@@ -428,107 +1105,210 @@ bool STData::parseSizeFactors(const QString &sizefactors)
         parsed = false;
     } else {
         m_size_factors = rowvec(size_factors);
+        m_rendering_cache.valid = false;
+        m_rendering_cache.spot_factors_cache.clear();
     }
 
     return parsed;
 }
 
 STData::STDataFrame STData::normalizeCounts(const STDataFrame &data,
-                                            SettingsWidget::NormalizationMode mode)
+                                            SettingsWidget::NormalizationMode mode,
+                                            const SizeFactors::Backend backend)
 {
     STDataFrame norm_counts = data;
     switch (mode) {
     case (SettingsWidget::NormalizationMode::RAW): {
     } break;
     case (SettingsWidget::NormalizationMode::REL): {
-        norm_counts.counts.each_col() /= sum(norm_counts.counts, ROW);
+        divideRows(norm_counts, computeRowSums(norm_counts));
     } break;
     case (SettingsWidget::NormalizationMode::TPM): {
-        norm_counts.counts.each_col() /= sum(norm_counts.counts, ROW);
-        norm_counts.counts *= 1e6;
+        divideRows(norm_counts, computeRowSums(norm_counts) / 1e6);
     } break;
     case (SettingsWidget::NormalizationMode::DESEQ): {
-        const auto m_deseq_size_factors = RInterface::computeDESeqFactors(data.counts);
-        norm_counts.counts.each_col() /= m_deseq_size_factors.t();
+        const auto m_deseq_size_factors = deseqFactors(data, backend);
+        divideRows(norm_counts, m_deseq_size_factors.t());
     } break;
     case (SettingsWidget::NormalizationMode::SCRAN): {
-        const auto scran_size_factors = RInterface::computeScranFactors(data.counts, true);
-        norm_counts.counts.each_col() /= scran_size_factors.t();
+        const auto scran_size_factors = scranFactors(data, backend);
+        divideRows(norm_counts, scran_size_factors.t());
     } break;
     }
     return norm_counts;
 }
 
-STData::STDataFrame STData::sliceDataFrameSpots(const STDataFrame &data,
-                                                const QList<QString> &spots)
+namespace
 {
-    STDataFrame sliced_data = data;
 
-    // Keep only the spots given in the list
-    sliced_data.spots.clear();
-    uvec to_keep_rows(spots.size());
-    for (uword i = 0; i < spots.size(); ++i) {
-        const auto &spot = spots.at(i);
-        const int spot_index = data.spots.indexOf(spot);
-        if (spot_index != -1) {
-            to_keep_rows.at(i) = spot_index;
-            sliced_data.spots.push_back(spot);
+// Returns the look-up table name -> index of a list of names (the first index is
+// used for repeated names)
+QHash<QString, uword> indexNames(const QList<QString> &names)
+{
+    QHash<QString, uword> index;
+    index.reserve(names.size());
+    for (int i = 0; i < names.size(); ++i) {
+        if (!index.contains(names.at(i))) {
+            index.insert(names.at(i), i);
         }
     }
-    sliced_data.counts = sliced_data.counts.rows(to_keep_rows);
+    return index;
+}
 
-    // Remove non present genes (total count == 0 after removing spots)
-    rowvec gene_counts = sum(sliced_data.counts, COLUMN);
-    std::vector<uword> to_keep_cols;
-    QList<QString> new_genes;
-    for (uword j = 0; j < sliced_data.counts.n_cols; ++j) {
-        if (gene_counts.at(j) > 0) {
-            const auto &gene = sliced_data.genes.at(j);
-            to_keep_cols.push_back(j);
-            new_genes.push_back(gene);
+// Returns the indexes of the names that are present in the look-up table
+uvec findNames(const QHash<QString, uword> &index, const QList<QString> &names)
+{
+    std::vector<uword> indexes;
+    indexes.reserve(names.size());
+    for (const auto &name : names) {
+        const auto it = index.constFind(name);
+        if (it != index.constEnd()) {
+            indexes.push_back(it.value());
         }
     }
-    sliced_data.genes = new_genes;
-    sliced_data.counts = sliced_data.counts.cols(uvec(to_keep_cols));
+    return uvec(indexes);
+}
 
-    // Return the sliced data frame
-    return sliced_data;
+// Sums the counts of the given rows (spots) in every column (gene)
+// (the rows are not copied, repeated rows are added every time)
+rowvec columnSumsOfRows(const STData::STDataFrame &data, const uvec &rows)
+{
+    if (data.is_sparse) {
+        const sp_mat &counts = data.sp_counts;
+        std::vector<double> row_weights(counts.n_rows, 0.0);
+        for (const uword i : rows) {
+            ++row_weights[i];
+        }
+        rowvec sums(counts.n_cols, fill::zeros);
+        for (uword j = 0; j < counts.n_cols; ++j) {
+            for (uword k = counts.col_ptrs[j]; k < counts.col_ptrs[j + 1]; ++k) {
+                sums[j] += counts.values[k] * row_weights[counts.row_indices[k]];
+            }
+        }
+        return sums;
+    }
+    const mat &counts = data.counts;
+    rowvec sums(counts.n_cols, fill::zeros);
+    for (uword j = 0; j < counts.n_cols; ++j) {
+        const double *values = counts.colptr(j);
+        double sum = 0.0;
+        for (const uword i : rows) {
+            sum += values[i];
+        }
+        sums[j] = sum;
+    }
+    return sums;
+}
+
+// Sums the counts of the given columns (genes) in every row (spot)
+// (the columns are not copied, repeated columns are added every time)
+colvec rowSumsOfColumns(const STData::STDataFrame &data, const uvec &cols)
+{
+    if (data.is_sparse) {
+        const sp_mat &counts = data.sp_counts;
+        colvec sums(counts.n_rows, fill::zeros);
+        for (const uword j : cols) {
+            for (uword k = counts.col_ptrs[j]; k < counts.col_ptrs[j + 1]; ++k) {
+                sums[counts.row_indices[k]] += counts.values[k];
+            }
+        }
+        return sums;
+    }
+    colvec sums(data.counts.n_rows, fill::zeros);
+    for (const uword j : cols) {
+        sums += data.counts.col(j);
+    }
+    return sums;
+}
+
+// Slices every list of names with the slicing function (in parallel)
+template <typename Slice>
+QList<STData::STDataFrame> sliceLists(const QList<QList<QString>> &lists, Slice slice)
+{
+    std::vector<STData::STDataFrame> sliced(lists.size());
+    std::vector<int> indexes(lists.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    QtConcurrent::blockingMap(indexes, [&](const int i) { sliced[i] = slice(lists.at(i)); });
+    // moved to the list so the counts are not copied
+    QList<STData::STDataFrame> sliced_list;
+    for (auto &frame : sliced) {
+        sliced_list.append(STData::STDataFrame());
+        std::swap(sliced_list.last(), frame);
+    }
+    return sliced_list;
+}
+}
+
+STData::STDataFrameIndex STData::indexDataFrame(const STDataFrame &data)
+{
+    STDataFrameIndex index;
+    index.spots = indexNames(data.spots);
+    index.genes = indexNames(data.genes);
+    return index;
+}
+
+STData::STDataFrame STData::sliceDataFrameSpots(const STDataFrame &data,
+                                                const QList<QString> &spots)
+{
+    STDataFrameIndex index;
+    index.spots = indexNames(data.spots);
+    return sliceDataFrameSpots(data, index, spots);
+}
+
+STData::STDataFrame STData::sliceDataFrameSpots(const STDataFrame &data,
+                                                const STDataFrameIndex &index,
+                                                const QList<QString> &spots)
+{
+    // Keep only the spots given in the list
+    const uvec rows = findNames(index.spots, spots);
+
+    // Remove non present genes (total count == 0 in the kept spots)
+    const uvec cols = find(columnSumsOfRows(data, rows) > 0);
+
+    // Return the sliced data frame (only the kept rows and columns are copied)
+    return sliceDataFrame(data, rows, cols);
 }
 
 STData::STDataFrame STData::sliceDataFrameGenes(const STDataFrame &data,
                                                 const QList<QString> &genes)
 {
-    STDataFrame sliced_data = data;
+    STDataFrameIndex index;
+    index.genes = indexNames(data.genes);
+    return sliceDataFrameGenes(data, index, genes);
+}
 
+STData::STDataFrame STData::sliceDataFrameGenes(const STDataFrame &data,
+                                                const STDataFrameIndex &index,
+                                                const QList<QString> &genes)
+{
     // Keep only the genes given in the list
-    sliced_data.genes.clear();
-    uvec to_keep_cols(genes.size());
-    for (uword j = 0; j < genes.size(); ++j) {
-        const auto &gene = genes.at(j);
-        const int gene_index = data.genes.indexOf(gene);
-        if (gene_index != -1) {
-            to_keep_cols.at(j) = gene_index;
-            sliced_data.genes.push_back(gene);
-        }
-    }
-    sliced_data.counts = data.counts.cols(to_keep_cols);
+    const uvec cols = findNames(index.genes, genes);
 
-    // Remove non present spots (total count == 0 after removing genes)
-    colvec spot_counts = sum(sliced_data.counts, ROW);
-    std::vector<uword> to_keep_rows;
-    QList<QString> new_spots;
-    for (uword i = 0; i < sliced_data.counts.n_rows; ++i) {
-        if (spot_counts.at(i) > 0) {
-            const auto &spot = sliced_data.spots.at(i);
-            to_keep_rows.push_back(i);
-            new_spots.push_back(spot);
-        }
-    }
-    sliced_data.spots = new_spots;
-    sliced_data.counts = sliced_data.counts.rows(uvec(to_keep_rows));
+    // Remove non present spots (total count == 0 in the kept genes)
+    const uvec rows = find(rowSumsOfColumns(data, cols) > 0);
 
-    // Return the sliced data frame
-    return sliced_data;
+    // Return the sliced data frame (only the kept rows and columns are copied)
+    return sliceDataFrame(data, rows, cols);
+}
+
+QList<STData::STDataFrame> STData::sliceDataFrameSpots(const STDataFrame &data,
+                                                       const QList<QList<QString>> &spots_lists)
+{
+    STDataFrameIndex index;
+    index.spots = indexNames(data.spots);
+    return sliceLists(spots_lists, [&](const QList<QString> &spots) {
+        return sliceDataFrameSpots(data, index, spots);
+    });
+}
+
+QList<STData::STDataFrame> STData::sliceDataFrameGenes(const STDataFrame &data,
+                                                       const QList<QList<QString>> &genes_lists)
+{
+    STDataFrameIndex index;
+    index.genes = indexNames(data.genes);
+    return sliceLists(genes_lists, [&](const QList<QString> &genes) {
+        return sliceDataFrameGenes(data, index, genes);
+    });
 }
 
 STData::STDataFrame STData::filterDataFrame(const STDataFrame &data,
@@ -537,47 +1317,64 @@ STData::STDataFrame STData::filterDataFrame(const STDataFrame &data,
                                             const int min_genes_spot,
                                             const int min_spots_gene)
 {
-    if (data.counts.n_cols == 0 || data.counts.n_rows == 0) {
+    const uword n_rows = data.spots.size();
+    if (data.genes.empty() || n_rows == 0) {
         return data;
     }
 
-    STDataFrame sliced_data = data;
-
     // Filter out genes
-    const urowvec spot_counts = computeNonZeroColumns(sliced_data.counts, min_exp_value);
+    const urowvec spot_counts = computeNonZeroColumns(data, min_exp_value);
     std::vector<uword> to_keep_genes;
-    QList<QString> new_genes;
-    for (uword j = 0; j < sliced_data.counts.n_cols; ++j) {
+    for (uword j = 0; j < spot_counts.n_elem; ++j) {
         if (spot_counts.at(j) > min_spots_gene) {
-            const auto &gene = sliced_data.genes.at(j);
             to_keep_genes.push_back(j);
-            new_genes.push_back(gene);
         }
     }
-    sliced_data.genes = new_genes;
-    sliced_data.counts = sliced_data.counts.cols(uvec(to_keep_genes));
+
+    // Compute the reads and genes of each spot (only the genes that are kept)
+    colvec spot_reads(n_rows, fill::zeros);
+    ucolvec spot_genes(n_rows, fill::zeros);
+    for (const uword j : to_keep_genes) {
+        if (data.is_sparse) {
+            const sp_mat &counts = data.sp_counts;
+            for (uword k = counts.col_ptrs[j]; k < counts.col_ptrs[j + 1]; ++k) {
+                const double value = counts.values[k];
+                if (value > min_exp_value) {
+                    spot_reads[counts.row_indices[k]] += value;
+                    ++spot_genes[counts.row_indices[k]];
+                }
+            }
+            // zeros are not stored
+            if (min_exp_value < 0) {
+                spot_genes += 1;
+                for (uword k = counts.col_ptrs[j]; k < counts.col_ptrs[j + 1]; ++k) {
+                    --spot_genes[counts.row_indices[k]];
+                }
+            }
+        } else {
+            const double *values = data.counts.colptr(j);
+            for (uword i = 0; i < n_rows; ++i) {
+                if (values[i] > min_exp_value) {
+                    spot_reads[i] += values[i];
+                    ++spot_genes[i];
+                }
+            }
+        }
+    }
 
     // Filter out spots
-    const ucolvec gene_counts = computeNonZeroRows(sliced_data.counts, min_exp_value);
     std::vector<uword> to_keep_spots;
-    QList<QString> new_spots;
-    for (uword i = 0; i < sliced_data.counts.n_rows; ++i) {
-        const rowvec row = sliced_data.counts.row(i);
-        const double row_sum = sum(row.elem(find(row > min_exp_value)));
-        if (row_sum > min_reads_spot && gene_counts.at(i) > min_genes_spot) {
-            const auto &spot = sliced_data.spots.at(i);
+    for (uword i = 0; i < n_rows; ++i) {
+        if (spot_reads.at(i) > min_reads_spot && spot_genes.at(i) > min_genes_spot) {
             to_keep_spots.push_back(i);
-            new_spots.push_back(spot);
         }
     }
-    sliced_data.spots = new_spots;
-    sliced_data.counts = sliced_data.counts.rows(uvec(to_keep_spots));
 
     // Return the filtered data
-    return sliced_data;
+    return sliceDataFrame(data, uvec(to_keep_spots), uvec(to_keep_genes));
 }
 
-STData::STDataFrame STData::aggregate(const QList<STDataFrame> &datasets)
+STData::STDataFrame STData::aggregate(const QList<STDataFrame> &datasets, const bool sparse)
 {
     if (datasets.empty()) {
         qDebug() << "Trying to merge a list of empty data frames";
@@ -586,49 +1383,126 @@ STData::STDataFrame STData::aggregate(const QList<STDataFrame> &datasets)
         return datasets.first();
     }
 
-    QSet<QString> merged_genes;
-    QList<QString> merged_spots;
-    for (unsigned i = 0; i < datasets.size(); ++i) {
-        const auto data = datasets.at(i);
-        merged_genes += data.genes.toSet();
-        QList<QString> adj_spots;
-        std::transform(data.spots.begin(), data.spots.end(), std::back_inserter(adj_spots),
-                       [=](auto spot) { return QString::number(i) + "_" + spot; });
-        merged_spots += adj_spots;
-        //merged_spots += QtConcurrent::blockingMapped<QList<QString> >(
-        //            data.spots, [=] (auto spot) { return QString::number(i) + "_" + spot; });
+    // The union of the genes (sorted by name) and the spots of every dataset
+    // with the index of the dataset prepended
+    const uword n_datasets = datasets.size();
+    QHash<QString, uword> genes_index;
+    STDataFrame merged;
+    std::vector<uword> row_offsets(n_datasets + 1, 0);
+    for (uword d = 0; d < n_datasets; ++d) {
+        const auto &data = datasets.at(d);
+        for (const auto &gene : data.genes) {
+            if (!genes_index.contains(gene)) {
+                genes_index.insert(gene, 0);
+                merged.genes.append(gene);
+            }
+        }
+        const QString prefix = QString::number(d) + "_";
+        for (const auto &spot : data.spots) {
+            merged.spots.append(prefix + spot);
+        }
+        row_offsets[d + 1] = row_offsets[d] + data.spots.size();
+    }
+    std::sort(merged.genes.begin(), merged.genes.end());
+    for (int j = 0; j < merged.genes.size(); ++j) {
+        genes_index[merged.genes.at(j)] = j;
+    }
+    const uword n_rows = merged.spots.size();
+    const uword n_cols = merged.genes.size();
+
+    // The merged column of every column of every dataset
+    std::vector<uvec> merged_cols(n_datasets);
+    for (uword d = 0; d < n_datasets; ++d) {
+        const auto &genes = datasets.at(d).genes;
+        merged_cols[d].set_size(genes.size());
+        for (int j = 0; j < genes.size(); ++j) {
+            merged_cols[d][j] = genes_index.value(genes.at(j));
+        }
     }
 
-    STDataFrame merged;
-    merged.genes = merged_genes.toList();
-    merged.spots = merged_spots;
-    const unsigned n_rows = merged_spots.size();
-    const unsigned n_cols = merged_genes.size();
-    merged.counts = mat(n_rows, n_cols);
-    merged.counts.fill(0.0);
-
-    unsigned spot_counter = 0;
-    for (unsigned d = 0; d < datasets.size(); ++d) {
-        const auto data = datasets.at(d);
-        std::vector<uword> gene_indexes;
-        for (uword i = 0; i < data.counts.n_rows; ++i) {
-            for (uword j = 0; j < n_cols; ++j) {
-                const auto &gene = merged.genes.at(j);
-                int index;
-                if (i == 0) {
-                    index = data.genes.indexOf(gene);
-                    gene_indexes.push_back(index);
+    // Every dataset fills its own rows of the merged counts (in parallel)
+    std::vector<uword> dataset_indexes(n_datasets);
+    std::iota(dataset_indexes.begin(), dataset_indexes.end(), 0);
+    if (!sparse) {
+        merged.counts = mat(n_rows, n_cols, fill::zeros);
+        QtConcurrent::blockingMap(dataset_indexes, [&](const uword d) {
+            const auto &data = datasets.at(d);
+            const uword row_offset = row_offsets[d];
+            const uword n_spots = data.spots.size();
+            for (uword j = 0; j < merged_cols[d].n_elem; ++j) {
+                double *merged_values = merged.counts.colptr(merged_cols[d][j]) + row_offset;
+                if (data.is_sparse) {
+                    const sp_mat &counts = data.sp_counts;
+                    for (uword k = counts.col_ptrs[j]; k < counts.col_ptrs[j + 1]; ++k) {
+                        merged_values[counts.row_indices[k]] = counts.values[k];
+                    }
                 } else {
-                    index = gene_indexes.at(j);
-                }
-                if (index != -1) {
-                    merged.counts.at(spot_counter, j) = data.counts(i, index);
+                    const double *values = data.counts.colptr(j);
+                    std::copy(values, values + n_spots, merged_values);
                 }
             }
-            ++spot_counter;
-        }
+        });
+        optimizeStorage(merged);
+        return merged;
     }
 
+    // The sparse counts are created directly (compressed by columns), the values of
+    // each dataset start in every column after the values of the previous datasets
+    std::vector<std::vector<uword>> dataset_nonzeros(n_datasets);
+    QtConcurrent::blockingMap(dataset_indexes, [&](const uword d) {
+        const auto &data = datasets.at(d);
+        auto &nonzeros = dataset_nonzeros[d];
+        nonzeros.resize(merged_cols[d].n_elem);
+        for (uword j = 0; j < nonzeros.size(); ++j) {
+            if (data.is_sparse) {
+                nonzeros[j] = data.sp_counts.col_ptrs[j + 1] - data.sp_counts.col_ptrs[j];
+            } else {
+                const double *values = data.counts.colptr(j);
+                nonzeros[j] = std::count_if(values, values + data.spots.size(),
+                                            [](const double value) { return value != 0; });
+            }
+        }
+    });
+    uvec col_ptrs(n_cols + 1, fill::zeros);
+    std::vector<std::vector<uword>> dataset_starts(n_datasets);
+    for (uword d = 0; d < n_datasets; ++d) {
+        dataset_starts[d].resize(merged_cols[d].n_elem);
+        for (uword j = 0; j < merged_cols[d].n_elem; ++j) {
+            // the position in the column (the column offsets are added below)
+            const uword col = merged_cols[d][j];
+            dataset_starts[d][j] = col_ptrs[col + 1];
+            col_ptrs[col + 1] += dataset_nonzeros[d][j];
+        }
+    }
+    std::partial_sum(col_ptrs.begin(), col_ptrs.end(), col_ptrs.begin());
+    uvec row_indices(col_ptrs[n_cols]);
+    vec values(col_ptrs[n_cols]);
+    QtConcurrent::blockingMap(dataset_indexes, [&](const uword d) {
+        const auto &data = datasets.at(d);
+        const uword row_offset = row_offsets[d];
+        for (uword j = 0; j < merged_cols[d].n_elem; ++j) {
+            uword position = col_ptrs[merged_cols[d][j]] + dataset_starts[d][j];
+            if (data.is_sparse) {
+                const sp_mat &counts = data.sp_counts;
+                for (uword k = counts.col_ptrs[j]; k < counts.col_ptrs[j + 1]; ++k) {
+                    row_indices[position] = row_offset + counts.row_indices[k];
+                    values[position] = counts.values[k];
+                    ++position;
+                }
+            } else {
+                const double *counts = data.counts.colptr(j);
+                for (uword i = 0; i < data.spots.size(); ++i) {
+                    if (counts[i] != 0) {
+                        row_indices[position] = row_offset + i;
+                        values[position] = counts[i];
+                        ++position;
+                    }
+                }
+            }
+        }
+    });
+    merged.sp_counts = sp_mat(row_indices, col_ptrs, values, n_rows, n_cols);
+    merged.is_sparse = true;
     return merged;
 }
 
@@ -637,34 +1511,320 @@ urowvec STData::computeNonZeroColumns(const mat &matrix, const int min_value)
     return sum(matrix > min_value, COLUMN);
 }
 
+urowvec STData::computeNonZeroColumns(const sp_mat &matrix, const int min_value)
+{
+    urowvec nonzero(matrix.n_cols, fill::zeros);
+    for (uword j = 0; j < matrix.n_cols; ++j) {
+        const uword begin = matrix.col_ptrs[j];
+        const uword end = matrix.col_ptrs[j + 1];
+        // zeros are not stored
+        uword count = min_value < 0 ? matrix.n_rows - (end - begin) : 0;
+        for (uword k = begin; k < end; ++k) {
+            count += matrix.values[k] > min_value;
+        }
+        nonzero[j] = count;
+    }
+    return nonzero;
+}
+
+urowvec STData::computeNonZeroColumns(const STDataFrame &data, const int min_value)
+{
+    return data.is_sparse ? computeNonZeroColumns(data.sp_counts, min_value)
+                          : computeNonZeroColumns(data.counts, min_value);
+}
+
 ucolvec STData::computeNonZeroRows(const mat &matrix, const int min_value)
 {
     return sum(matrix > min_value, ROW);
 }
 
+ucolvec STData::computeNonZeroRows(const sp_mat &matrix, const int min_value)
+{
+    // zeros are not stored
+    ucolvec nonzero(matrix.n_rows, fill::zeros);
+    if (min_value < 0) {
+        nonzero.fill(matrix.n_cols);
+    }
+    for (uword k = 0; k < matrix.n_nonzero; ++k) {
+        if (min_value < 0) {
+            nonzero[matrix.row_indices[k]] -= matrix.values[k] <= min_value;
+        } else {
+            nonzero[matrix.row_indices[k]] += matrix.values[k] > min_value;
+        }
+    }
+    return nonzero;
+}
+
+ucolvec STData::computeNonZeroRows(const STDataFrame &data, const int min_value)
+{
+    return data.is_sparse ? computeNonZeroRows(data.sp_counts, min_value)
+                          : computeNonZeroRows(data.counts, min_value);
+}
+
+colvec STData::computeRowSums(const STDataFrame &data)
+{
+    if (!data.is_sparse) {
+        return sum(data.counts, ROW);
+    }
+    const sp_mat &counts = data.sp_counts;
+    colvec sums(counts.n_rows, fill::zeros);
+    for (uword k = 0; k < counts.n_nonzero; ++k) {
+        sums[counts.row_indices[k]] += counts.values[k];
+    }
+    return sums;
+}
+
+rowvec STData::computeColumnSums(const STDataFrame &data)
+{
+    if (!data.is_sparse) {
+        return sum(data.counts, COLUMN);
+    }
+    const sp_mat &counts = data.sp_counts;
+    rowvec sums(counts.n_cols, fill::zeros);
+    for (uword j = 0; j < counts.n_cols; ++j) {
+        for (uword k = counts.col_ptrs[j]; k < counts.col_ptrs[j + 1]; ++k) {
+            sums[j] += counts.values[k];
+        }
+    }
+    return sums;
+}
+
+STData::STDataFrame STData::sliceDataFrame(const STDataFrame &data,
+                                           const uvec &rows,
+                                           const uvec &cols)
+{
+    STDataFrame sliced_data;
+    sliced_data.is_sparse = data.is_sparse;
+    if (data.is_sparse) {
+        sliced_data.sp_counts = gatherSparse(data.sp_counts, rows, cols);
+    } else {
+        sliced_data.counts = data.counts.submat(rows, cols);
+    }
+    for (const uword i : rows) {
+        sliced_data.spots.push_back(data.spots.at(i));
+    }
+    for (const uword j : cols) {
+        sliced_data.genes.push_back(data.genes.at(j));
+    }
+    return sliced_data;
+}
+
+void STData::divideRows(STDataFrame &data, const colvec &factors)
+{
+    if (!data.is_sparse) {
+        data.counts.each_col() /= factors;
+        return;
+    }
+    // only the non zero values need to be updated
+    const sp_mat &counts = data.sp_counts;
+    const uvec row_indices(counts.row_indices, counts.n_nonzero);
+    const uvec col_ptrs(counts.col_ptrs, counts.n_cols + 1);
+    vec values(counts.values, counts.n_nonzero);
+    for (uword k = 0; k < values.n_elem; ++k) {
+        values[k] /= factors[row_indices[k]];
+    }
+    data.sp_counts = sp_mat(row_indices, col_ptrs, values, counts.n_rows, counts.n_cols);
+}
+
+void STData::optimizeStorage(STDataFrame &data)
+{
+    const double n_elem = static_cast<double>(data.spots.size()) * data.genes.size();
+    if (n_elem == 0) {
+        return;
+    }
+    const double n_nonzero = data.is_sparse
+            ? data.sp_counts.n_nonzero
+            : std::count_if(data.counts.begin(), data.counts.end(),
+                            [](const double value) { return value != 0; });
+    const bool sparse = (n_nonzero / n_elem) < SPARSE_MAX_DENSITY;
+    if (sparse && !data.is_sparse) {
+        toSparse(data);
+    } else if (!sparse && data.is_sparse) {
+        toDense(data);
+    }
+}
+
+void STData::toSparse(STDataFrame &data)
+{
+    if (!data.is_sparse) {
+        data.sp_counts = sp_mat(data.counts);
+        data.counts.reset();
+        data.is_sparse = true;
+    }
+}
+
+void STData::toDense(STDataFrame &data)
+{
+    if (data.is_sparse) {
+        data.counts = mat(data.sp_counts);
+        data.sp_counts.reset();
+        data.is_sparse = false;
+    }
+}
+
+mat STData::denseCounts(const STDataFrame &data)
+{
+    return data.is_sparse ? mat(data.sp_counts) : data.counts;
+}
+
+sp_mat STData::sparseCounts(const STDataFrame &data)
+{
+    return data.is_sparse ? data.sp_counts : sp_mat(data.counts);
+}
+
+void STData::logCounts(STDataFrame &data)
+{
+    if (data.is_sparse) {
+        data.sp_counts.transform([](const double value) { return std::log(value + 1.0); });
+    } else {
+        data.counts = log(data.counts + 1.0);
+    }
+}
+
 void STData::clearSelection()
 {
     QtConcurrent::blockingMap(m_spots, [] (auto spot) { spot->selected(false); });
     QtConcurrent::blockingMap(m_genes, [] (auto gene) { gene->selected(false); });
 }
 
-void STData::selectSpots(const SelectionEvent &event)
+bool STData::selectSpots(const SelectionEvent &event)
 {
     const QPainterPath path = event.path();
     const auto mode = event.mode();
 
+    // the selection of the genes changes the selection of the spots
+    // so clearing it needs computeRenderingData()
+    bool genes_deselected = false;
     if (mode == SelectionEvent::SelectionMode::NewSelection) {
+        genes_deselected = std::any_of(m_genes.begin(), m_genes.end(),
+                                       [](const GeneObjectType &gene) { return gene->selected(); });
         clearSelection();
     }
+    const bool update_rendering = m_rendering_cache.valid && !genes_deselected;
+    // detached before the spots are updated in parallel
+    m_rendering_selected.detach();
 
-    // update selection
+    // only the spots in the bounds of the path are tested
+    // (the bounds are computed here as contains() would cache them in the threads)
+    std::vector<uword> candidates = spotsInRect(path.controlPointRect());
     const bool remove = (mode == SelectionEvent::SelectionMode::ExcludeSelection);
-    for (auto spot : m_spots) {
-        const auto &coord = spot->coordinates();
+    QtConcurrent::blockingMap(candidates, [&](const uword spot) {
+        const auto &spot_obj = m_spots.at(spot);
+        const auto &coord = spot_obj->coordinates();
         if (path.contains(QPointF(coord.first, coord.second))) {
-            spot->selected(!remove);
+            spot_obj->selected(!remove);
+            if (update_rendering) {
+                updateRenderingSelection(spot);
+            }
+        }
+    });
+
+    // the rest of the spots were deselected
+    if (update_rendering && mode == SelectionEvent::SelectionMode::NewSelection) {
+        std::vector<uword> spots(m_spots.size());
+        std::iota(spots.begin(), spots.end(), 0);
+        QtConcurrent::blockingMap(spots, [this](const uword spot) {
+            updateRenderingSelection(spot);
+        });
+    }
+    return update_rendering;
+}
+
+void STData::updateRenderingSelection(const uword spot)
+{
+    const auto &cache = m_rendering_cache;
+    if (!cache.any_gene_kept || !cache.spot_kept[spot]) {
+        return;
+    }
+    const auto &spot_obj = m_spots.at(spot);
+    spot_obj->selected(m_rendering_visible.at(spot)
+                       && (spot_obj->selected() || cache.spot_any_selected[spot]));
+    m_rendering_selected[spot] = spot_obj->selected();
+}
+
+void STData::initSpotGrid()
+{
+    auto &grid = m_spot_grid;
+    grid = SpotGrid();
+    const uword n_spots = m_spots.size();
+    if (n_spots == 0) {
+        return;
+    }
+
+    double min_x = std::numeric_limits<double>::max();
+    double min_y = std::numeric_limits<double>::max();
+    double max_x = std::numeric_limits<double>::lowest();
+    double max_y = std::numeric_limits<double>::lowest();
+    for (const auto &spot : m_spots) {
+        const auto &coord = spot->coordinates();
+        min_x = std::min<double>(min_x, coord.first);
+        min_y = std::min<double>(min_y, coord.second);
+        max_x = std::max<double>(max_x, coord.first);
+        max_y = std::max<double>(max_y, coord.second);
+    }
+    grid.bounds = QRectF(QPointF(min_x, min_y), QPointF(max_x, max_y));
+
+    // cells with the aspect ratio of the spots area and a few spots each
+    const double width = grid.bounds.width();
+    const double height = grid.bounds.height();
+    const double cells = std::max(1.0, n_spots / SPOTS_PER_GRID_CELL);
+    if (width > 0 && height > 0) {
+        grid.columns = static_cast<int>(std::ceil(std::sqrt(cells * width / height)));
+        grid.rows = static_cast<int>(std::ceil(cells / grid.columns));
+    } else {
+        grid.columns = width > 0 ? static_cast<int>(std::ceil(cells)) : 1;
+        grid.rows = height > 0 ? static_cast<int>(std::ceil(cells)) : 1;
+    }
+    grid.columns = std::min<int>(grid.columns, n_spots);
+    grid.rows = std::min<int>(grid.rows, n_spots);
+
+    // the spots are sorted by cell (counting sort)
+    std::vector<uword> spot_cells(n_spots);
+    grid.offsets.assign(grid.columns * grid.rows + 1, 0);
+    for (uword i = 0; i < n_spots; ++i) {
+        const auto &coord = m_spots.at(i)->coordinates();
+        const int column = gridCell(coord.first, min_x, width, grid.columns);
+        const int row = gridCell(coord.second, min_y, height, grid.rows);
+        spot_cells[i] = row * grid.columns + column;
+        ++grid.offsets[spot_cells[i] + 1];
+    }
+    std::partial_sum(grid.offsets.begin(), grid.offsets.end(), grid.offsets.begin());
+    std::vector<uword> positions(grid.offsets.begin(), grid.offsets.end() - 1);
+    grid.spots.resize(n_spots);
+    for (uword i = 0; i < n_spots; ++i) {
+        grid.spots[positions[spot_cells[i]]++] = i;
+    }
+}
+
+std::vector<uword> STData::spotsInRect(const QRectF &rect) const
+{
+    const auto &grid = m_spot_grid;
+    std::vector<uword> spots;
+    if (grid.spots.empty() || rect.right() < grid.bounds.left()
+            || rect.left() > grid.bounds.right() || rect.bottom() < grid.bounds.top()
+            || rect.top() > grid.bounds.bottom()) {
+        return spots;
+    }
+
+    const double width = grid.bounds.width();
+    const double height = grid.bounds.height();
+    const int first_column = gridCell(rect.left(), grid.bounds.left(), width, grid.columns);
+    const int last_column = gridCell(rect.right(), grid.bounds.left(), width, grid.columns);
+    const int first_row = gridCell(rect.top(), grid.bounds.top(), height, grid.rows);
+    const int last_row = gridCell(rect.bottom(), grid.bounds.top(), height, grid.rows);
+    for (int row = first_row; row <= last_row; ++row) {
+        for (int column = first_column; column <= last_column; ++column) {
+            const int cell = row * grid.columns + column;
+            for (uword k = grid.offsets[cell]; k < grid.offsets[cell + 1]; ++k) {
+                const auto &coord = m_spots.at(grid.spots[k])->coordinates();
+                if (coord.first >= rect.left() && coord.first <= rect.right()
+                        && coord.second >= rect.top() && coord.second <= rect.bottom()) {
+                    spots.push_back(grid.spots[k]);
+                }
+            }
         }
     }
+    return spots;
 }
 
 void STData::selectSpots(const QList<QString> &spots)
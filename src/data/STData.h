@@ -7,11 +7,13 @@
 #include <QVector3D>
 #include <QVector4D>
 #include <QColor>
+#include <QFile>
 
 #include "data/Gene.h"
 #include "data/Spot.h"
 #include "viewPages/SettingsWidget.h"
 #include "viewRenderer/SelectionEvent.h"
+#include "math/SizeFactors.h"
 
 #include <armadillo>
 
@@ -27,8 +29,12 @@ public:
     typedef QList<SpotObjectType> SpotListType;
     typedef QList<GeneObjectType> GeneListType;
 
+    // The counts are stored either in a dense matrix (counts) or in a
+    // sparse matrix (sp_counts) when most of the values are zero, only one of them is used
     struct STDataFrame {
         mat counts;
+        sp_mat sp_counts;
+        bool is_sparse = false;
         QList<QString> genes;
         QList<QString> spots;
     };
@@ -39,12 +45,31 @@ public:
     // Parses the matrix and initialize the size-factors and genes/spots containers
     void init(const QString &filename, const QString &spots_coordinates = QString());
 
+    // Initializes the data (matrix, spot coordinates and size factors) from a binary file
+    // created with saveBinary() (the matrix is memory-mapped when possible).
+    // Returns false if the file does not exist, is not valid or it was created
+    // from different source files (source_fingerprint)
+    bool initFromBinary(const QString &filename, const quint64 source_fingerprint);
+
+    // Saves the data (matrix, spot coordinates and size factors) in a binary file
+    // It throws exceptions if the file cannot be written
+    void saveBinary(const QString &filename, const quint64 source_fingerprint) const;
+
     // Functions to import/export the data
+    // The binary format is detected when reading and used when saving
+    // if the file has the binary suffix (STDataBinary::SUFFIX)
     static STDataFrame read(const QString &filename);
     static void save(const QString &filename, const STDataFrame &data);
 
+    // A look-up table of the spots and genes of a data frame (name -> row/column index)
+    // It can be shared by several slicing operations on the same data frame
+    struct STDataFrameIndex {
+        QHash<QString, uword> spots;
+        QHash<QString, uword> genes;
+    };
+
     // Retrieves the original data frame (without filtering using the tresholds)
-    STDataFrame data() const;
+    const STDataFrame &data() const;
 
     // Returns the spot/gene objects corresponding to the data frame
     const GeneListType &genes() const;
@@ -66,12 +91,31 @@ public:
     // it returns bool if the parsing was okay and the number of factors is the same as rows
     bool parseSizeFactors(const QString &sizefactors);
 
-    // helper slicing functions (assumes the spots and genes lists given are present in the data)
-    static STDataFrame sliceDataFrameGenes(const STDataFrame &data,
+    // helper function to create the look-up table of the spots and genes of a data frame
+    static STDataFrameIndex indexDataFrame(const STDataFrame &data);
+
+    // helper slicing functions (the spots and genes not present in the data are ignored)
+    // sliceDataFrameSpots() keeps the given spots and the genes with counts in them and
+    // sliceDataFrameGenes() keeps the given genes and the spots with counts in them.
+    // The kept rows and columns are copied in one pass
+    static STDataFrame sliceDataFrameSpots(const STDataFrame &data,
                                            const QList<QString> &spots);
     static STDataFrame sliceDataFrameSpots(const STDataFrame &data,
+                                           const STDataFrameIndex &index,
+                                           const QList<QString> &spots);
+    static STDataFrame sliceDataFrameGenes(const STDataFrame &data,
+                                           const QList<QString> &genes);
+    static STDataFrame sliceDataFrameGenes(const STDataFrame &data,
+                                           const STDataFrameIndex &index,
                                            const QList<QString> &genes);
 
+    // helper functions to slice several lists of spots/genes at once (in parallel)
+    // with one look-up table, a data frame is returned for each list
+    static QList<STDataFrame> sliceDataFrameSpots(const STDataFrame &data,
+                                                  const QList<QList<QString>> &spots_lists);
+    static QList<STDataFrame> sliceDataFrameGenes(const STDataFrame &data,
+                                                  const QList<QList<QString>> &genes_lists);
+
     // helper function to filter out a data frame using thresholds
     static STDataFrame filterDataFrame(const STDataFrame &data,
                                        const int min_exp_value,
@@ -79,23 +123,64 @@ public:
                                        const int min_genes_spot,
                                        const int min_spots_gene);
 
-    // helper function to merge a list of data frames into one (by common genes)
-    // the spots (rows) will have the index of the dataset append (1_,2_..)
-    static STData::STDataFrame aggregate(const QList<STDataFrame> &datasets);
+    // helper function to merge a list of data frames into one (by the union of the genes)
+    // the spots (rows) will have the index of the dataset prepended (0_,1_..) and the
+    // genes (columns) are sorted by name. The merged counts are sparse if sparse is true,
+    // otherwise the storage is chosen with optimizeStorage()
+    static STData::STDataFrame aggregate(const QList<STDataFrame> &datasets,
+                                         const bool sparse = false);
 
     // helper function to get the sum of non zeroes elements (by column, aka gene)
     static urowvec computeNonZeroColumns(const mat &matrix, const int min_value = 0);
+    static urowvec computeNonZeroColumns(const sp_mat &matrix, const int min_value = 0);
+    static urowvec computeNonZeroColumns(const STDataFrame &data, const int min_value = 0);
 
     // helper function to get the sum of non zeroes elements (by row, aka spot)
     static ucolvec computeNonZeroRows(const mat &matrix, const int min_value = 0);
+    static ucolvec computeNonZeroRows(const sp_mat &matrix, const int min_value = 0);
+    static ucolvec computeNonZeroRows(const STDataFrame &data, const int min_value = 0);
+
+    // helper functions to get the total counts by row (spot) and column (gene)
+    static colvec computeRowSums(const STDataFrame &data);
+    static rowvec computeColumnSums(const STDataFrame &data);
+
+    // helper function to gather the given rows and columns (by index) of a data frame
+    // in one pass (the storage type of the data frame is preserved)
+    static STDataFrame sliceDataFrame(const STDataFrame &data,
+                                      const uvec &rows,
+                                      const uvec &cols);
+
+    // helper function to divide every row (spot) by the given factors
+    static void divideRows(STDataFrame &data, const colvec &factors);
+
+    // helper functions to change the storage type of a data frame
+    // optimizeStorage() chooses sparse or dense depending on the density of the counts
+    static void optimizeStorage(STDataFrame &data);
+    static void toSparse(STDataFrame &data);
+    static void toDense(STDataFrame &data);
+
+    // returns a dense copy of the counts of the data frame (sparse or dense)
+    static mat denseCounts(const STDataFrame &data);
+    // returns a sparse copy of the counts of the data frame (sparse or dense)
+    static sp_mat sparseCounts(const STDataFrame &data);
+
+    // transforms the counts of the data frame with log(x + 1)
+    // (sparse counts are kept sparse, log(0 + 1) = 0)
+    static void logCounts(STDataFrame &data);
 
     // helper function that returns the normalized matrix counts using the rendering settings
+    // (the DESeq2 and SCRAN factors are computed natively unless the R backend is given)
     static STDataFrame normalizeCounts(const STDataFrame &data,
-                                       SettingsWidget::NormalizationMode mode);
+                                       SettingsWidget::NormalizationMode mode,
+                                       const SizeFactors::Backend backend = SizeFactors::Native);
 
     // functions to select spots
     void clearSelection();
-    void selectSpots(const SelectionEvent &event);
+    // selects the spots inside the path of the event (only the spots of the grid cells
+    // in the bounds of the path are tested), the rendering selection of the changed
+    // spots is updated too. Returns false if computeRenderingData() has to be called
+    // (the rendering data was not computed or the selection of the genes was cleared)
+    bool selectSpots(const SelectionEvent &event);
     void selectSpots(const QList<QString> &spots);
     void selectSpots(const QList<int> &spots_indexes);
     void selectGenes(const QRegExp &regexp, const bool force = true);
@@ -110,6 +195,82 @@ public:
 
 private:
 
+    // The intermediate results of computeRenderingData() and the settings they were
+    // computed with, so a change only recomputes the stages that depend on it:
+    // 1) counts scaled by the size factors, 2) genes kept by the thresholds,
+    // 3) reads/genes of each spot and spots kept by the thresholds,
+    // 4) normalization factors and 5) accumulated value/color of each spot.
+    // Changes in the genes (visibility, color, selection...) only update the spots
+    // where the changed genes are present.
+    struct RenderingCache {
+        bool valid = false;
+        bool size_factors = false;
+        int ind_reads_threshold = 0;
+        SettingsWidget::NormalizationMode normalization = SettingsWidget::NormalizationMode::RAW;
+        bool do_color = false;
+        bool any_gene_kept = false;
+        // stage 1 (transposed so the genes of each spot are contiguous)
+        mat counts;
+        sp_mat sp_counts;
+        // stage 2 (spots above the individual threshold for each gene)
+        urowvec gene_spots;
+        std::vector<char> gene_kept;
+        // the gene attributes used in the last update (one array per attribute)
+        // a value of a gene is only used if it is greater than the threshold of the gene
+        std::vector<char> gene_selected;
+        std::vector<double> gene_thresholds;
+        std::vector<int> gene_red;
+        std::vector<int> gene_green;
+        std::vector<int> gene_blue;
+        std::vector<int> gene_alpha;
+        // stage 3 (reads above the threshold, genes above the threshold and total counts)
+        colvec spot_reads;
+        ucolvec spot_genes;
+        colvec spot_totals;
+        std::vector<char> spot_kept;
+        // stage 4 (only for normalizations that depend on all the spots)
+        // the factors of previous filtering states are kept by method and filtered data
+        colvec spot_factors;
+        QHash<QByteArray, colvec> spot_factors_cache;
+        // stage 5
+        colvec spot_values;
+        colvec spot_num_genes;
+        QVector<QColor> spot_colors;
+        std::vector<char> spot_any_selected;
+    };
+
+    // A uniform grid over the coordinates of the spots (built in initObjects())
+    // to find the spots in an area without testing every spot
+    struct SpotGrid {
+        QRectF bounds;
+        int columns = 0;
+        int rows = 0;
+        // the spots of the cell c are spots[offsets[c]] to spots[offsets[c + 1] - 1]
+        std::vector<uword> offsets;
+        std::vector<uword> spots;
+    };
+
+    // helper functions for the spatial index of the spots
+    void initSpotGrid();
+    std::vector<uword> spotsInRect(const QRectF &rect) const;
+
+    // updates the rendering selection of a spot as the last step of computeRenderingData()
+    void updateRenderingSelection(const uword spot);
+
+    // helper functions for the stages of computeRenderingData()
+    void computeRenderingCounts(const bool size_factors);
+    void computeRenderingGeneSpots(const int ind_reads_threshold);
+    void computeRenderingSpotCounts(const uword spot);
+    void computeRenderingSpotFactors();
+    void computeRenderingSpotValue(const uword spot);
+
+    // creates the spot/gene objects and the look-up tables for the data frame
+    void initObjects(const QVector<Spot::SpotType> &adj_coordinates);
+
+    // The memory-mapped binary file (if the matrix was loaded with initFromBinary())
+    // it must outlive the matrix
+    QSharedPointer<QFile> m_mapped_file;
+
     // The matrix with the counts (spots are rows and genes are columns)
     STDataFrame m_data;
 
@@ -131,6 +292,10 @@ private:
     QVector<bool> m_rendering_visible;
     QVector<QColor> m_rendering_colors;
     QVector<double> m_rendering_values;
+    RenderingCache m_rendering_cache;
+
+    // spatial index of the spots (for the selections)
+    SpotGrid m_spot_grid;
 
     Q_DISABLE_COPY(STData)
 };
@@ -0,0 +1,377 @@
+#include "STDataBinary.h"
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+
+#include <cstring>
+
+namespace STDataBinary
+{
+
+const QString SUFFIX = QStringLiteral("stbin");
+
+namespace
+{
+
+// The first bytes of every binary file (null terminated)
+const char MAGIC[8] = "STVBIN1";
+const quint32 VERSION = 1;
+const quint32 FLAG_SPARSE = 1;
+// The sections start at multiples of this (so doubles can be aliased)
+const quint64 ALIGNMENT = 8;
+
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 flags;
+    quint64 n_rows;
+    quint64 n_cols;
+    quint64 n_nonzero;
+    quint64 source_fingerprint;
+    quint64 genes_offset;
+    quint64 genes_size;
+    quint64 spots_offset;
+    quint64 spots_size;
+    quint64 counts_offset;
+    quint64 counts_size;
+    quint64 coordinates_offset;
+    quint64 coordinates_size;
+    quint64 size_factors_offset;
+    quint64 size_factors_size;
+    // checksum of the names, coordinates and size factors
+    quint64 metadata_checksum;
+    // checksum of the counts
+    quint64 counts_checksum;
+    // checksum of all the previous fields
+    quint64 header_checksum;
+};
+
+static_assert(sizeof(Header) % ALIGNMENT == 0, "The header must be aligned");
+
+// A section of the file (a block of bytes)
+struct Section {
+    const char *data;
+    quint64 size;
+};
+
+// 64 bits FNV-1a variant that consumes 8 bytes at a time (used to detect corrupted files)
+quint64 checksum(const char *data, const quint64 size, quint64 hash = 14695981039346656037ULL)
+{
+    const quint64 prime = 1099511628211ULL;
+    quint64 i = 0;
+    for (; i + 8 <= size; i += 8) {
+        quint64 word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 32;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+    }
+    return hash;
+}
+
+quint64 checksum(const QVector<Section> &sections)
+{
+    quint64 hash = 14695981039346656037ULL;
+    for (const auto &section : sections) {
+        hash = checksum(section.data, section.size, hash);
+    }
+    return hash;
+}
+
+quint64 headerChecksum(const Header &header)
+{
+    return checksum(reinterpret_cast<const char *>(&header),
+                    sizeof(Header) - sizeof(header.header_checksum));
+}
+
+quint64 alignedSize(const quint64 size)
+{
+    return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+QList<QString> splitNames(const char *data, const quint64 size)
+{
+    QList<QString> names;
+    if (size == 0) {
+        return names;
+    }
+    const char *end = data + size;
+    for (const char *name = data;;) {
+        const char *name_end = std::find(name, end, '\n');
+        names.append(QString::fromUtf8(name, name_end - name));
+        if (name_end == end) {
+            break;
+        }
+        name = name_end + 1;
+    }
+    return names;
+}
+
+}
+
+bool isBinary(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    char magic[sizeof(MAGIC)];
+    return file.read(magic, sizeof(MAGIC)) == sizeof(MAGIC)
+            && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+void write(const QString &filename, const Content &content)
+{
+    const STData::STDataFrame &data = content.data;
+    const quint64 n_rows = data.spots.size();
+    const quint64 n_cols = data.genes.size();
+    if (!content.coordinates.empty() && content.coordinates.size() != data.spots.size()) {
+        throw std::runtime_error("The number of coordinates is not the same as the spots");
+    }
+    if (!content.size_factors.empty() && content.size_factors.n_elem != n_rows) {
+        throw std::runtime_error("The number of size factors is not the same as the spots");
+    }
+
+    // names are stored separated by new lines
+    const QByteArray genes = QStringList(data.genes).join('\n').toUtf8();
+    const QByteArray spots = QStringList(data.spots).join('\n').toUtf8();
+
+    // sparse counts are stored in CSC format (column pointers, row indexes and values)
+    std::vector<quint64> col_ptrs;
+    std::vector<quint64> row_indices;
+    QVector<Section> counts;
+    if (data.is_sparse) {
+        const sp_mat &sp_counts = data.sp_counts;
+        col_ptrs.assign(sp_counts.col_ptrs, sp_counts.col_ptrs + sp_counts.n_cols + 1);
+        row_indices.assign(sp_counts.row_indices, sp_counts.row_indices + sp_counts.n_nonzero);
+        counts.push_back({reinterpret_cast<const char *>(col_ptrs.data()),
+                          col_ptrs.size() * sizeof(quint64)});
+        counts.push_back({reinterpret_cast<const char *>(row_indices.data()),
+                          row_indices.size() * sizeof(quint64)});
+        counts.push_back({reinterpret_cast<const char *>(sp_counts.values),
+                          sp_counts.n_nonzero * sizeof(double)});
+    } else {
+        counts.push_back({reinterpret_cast<const char *>(data.counts.memptr()),
+                          data.counts.n_elem * sizeof(double)});
+    }
+    quint64 counts_size = 0;
+    for (const auto &section : counts) {
+        counts_size += section.size;
+    }
+
+    const Section genes_section = {genes.constData(), static_cast<quint64>(genes.size())};
+    const Section spots_section = {spots.constData(), static_cast<quint64>(spots.size())};
+    std::vector<float> coordinates;
+    for (const auto &coordinate : content.coordinates) {
+        coordinates.push_back(coordinate.first);
+        coordinates.push_back(coordinate.second);
+    }
+    const Section coordinates_section = {reinterpret_cast<const char *>(coordinates.data()),
+                                         coordinates.size() * sizeof(float)};
+    const Section size_factors_section = {
+        reinterpret_cast<const char *>(content.size_factors.memptr()),
+        content.size_factors.n_elem * sizeof(double)};
+
+    // compute the header
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.flags = data.is_sparse ? FLAG_SPARSE : 0;
+    header.n_rows = n_rows;
+    header.n_cols = n_cols;
+    header.n_nonzero = data.is_sparse ? data.sp_counts.n_nonzero : 0;
+    header.source_fingerprint = content.source_fingerprint;
+    quint64 offset = sizeof(Header);
+    const auto place = [&offset](const quint64 size, quint64 &section_offset,
+                                 quint64 &section_size) {
+        section_offset = offset;
+        section_size = size;
+        offset += alignedSize(size);
+    };
+    place(genes_section.size, header.genes_offset, header.genes_size);
+    place(spots_section.size, header.spots_offset, header.spots_size);
+    place(counts_size, header.counts_offset, header.counts_size);
+    place(coordinates_section.size, header.coordinates_offset, header.coordinates_size);
+    place(size_factors_section.size, header.size_factors_offset, header.size_factors_size);
+    header.metadata_checksum =
+            checksum({genes_section, spots_section, coordinates_section, size_factors_section});
+    header.counts_checksum = checksum(counts);
+    header.header_checksum = headerChecksum(header);
+
+    // write the file (the file is replaced only if everything was written)
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        throw std::runtime_error("The binary file could not be created");
+    }
+    const char padding[ALIGNMENT] = {};
+    const auto writeSection = [&file, &padding](const QVector<Section> &sections) {
+        quint64 size = 0;
+        for (const auto &section : sections) {
+            if (section.size > 0) {
+                file.write(section.data, section.size);
+            }
+            size += section.size;
+        }
+        file.write(padding, alignedSize(size) - size);
+    };
+    file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    writeSection({genes_section});
+    writeSection({spots_section});
+    writeSection(counts);
+    writeSection({coordinates_section});
+    writeSection({size_factors_section});
+    if (!file.commit()) {
+        throw std::runtime_error("The binary file could not be written");
+    }
+}
+
+Content read(const QString &filename, const bool map_counts)
+{
+    QSharedPointer<QFile> file(new QFile(filename));
+    if (!file->open(QIODevice::ReadOnly)) {
+        throw std::runtime_error("The binary file could not be opened");
+    }
+    const quint64 file_size = file->size();
+    if (file_size < sizeof(Header)) {
+        throw std::runtime_error("The binary file is not valid");
+    }
+
+    // map the file (private so the aliased counts can be modified without changing the file)
+    QByteArray buffer;
+    const char *begin = reinterpret_cast<const char *>(
+                file->map(0, file_size, QFileDevice::MapPrivateOption));
+    const bool mapped = begin != nullptr;
+    if (!mapped) {
+        buffer = file->readAll();
+        begin = buffer.constData();
+    }
+
+    // validate the header
+    Header header;
+    std::memcpy(&header, begin, sizeof(Header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION
+            || header.header_checksum != headerChecksum(header)) {
+        throw std::runtime_error("The binary file is not valid or has a different version");
+    }
+    const bool is_sparse = (header.flags & FLAG_SPARSE) != 0;
+    const quint64 n_rows = header.n_rows;
+    const quint64 n_cols = header.n_cols;
+    const quint64 n_nonzero = header.n_nonzero;
+    const quint64 expected_counts_size = is_sparse
+            ? (n_cols + 1 + n_nonzero) * sizeof(quint64) + n_nonzero * sizeof(double)
+            : n_rows * n_cols * sizeof(double);
+    const auto valid = [file_size](const quint64 offset, const quint64 size) {
+        return offset % ALIGNMENT == 0 && offset <= file_size && size <= file_size - offset;
+    };
+    if (!valid(header.genes_offset, header.genes_size)
+            || !valid(header.spots_offset, header.spots_size)
+            || !valid(header.counts_offset, header.counts_size)
+            || !valid(header.coordinates_offset, header.coordinates_size)
+            || !valid(header.size_factors_offset, header.size_factors_size)
+            || header.counts_size != expected_counts_size
+            || (header.coordinates_size != 0
+                && header.coordinates_size != n_rows * 2 * sizeof(float))
+            || (header.size_factors_size != 0
+                && header.size_factors_size != n_rows * sizeof(double))) {
+        throw std::runtime_error("The binary file is truncated or corrupted");
+    }
+    const Section genes_section = {begin + header.genes_offset, header.genes_size};
+    const Section spots_section = {begin + header.spots_offset, header.spots_size};
+    const Section coordinates_section = {begin + header.coordinates_offset,
+                                         header.coordinates_size};
+    const Section size_factors_section = {begin + header.size_factors_offset,
+                                          header.size_factors_size};
+    const Section counts_section = {begin + header.counts_offset, header.counts_size};
+    if (header.metadata_checksum
+            != checksum({genes_section, spots_section, coordinates_section, size_factors_section})) {
+        throw std::runtime_error("The binary file is corrupted");
+    }
+    const bool alias_counts = map_counts && mapped && !is_sparse;
+    if (!alias_counts && header.counts_checksum != checksum({counts_section})) {
+        throw std::runtime_error("The binary file is corrupted");
+    }
+
+    Content content;
+    content.source_fingerprint = header.source_fingerprint;
+    STData::STDataFrame &data = content.data;
+    data.genes = splitNames(genes_section.data, genes_section.size);
+    data.spots = splitNames(spots_section.data, spots_section.size);
+    if (static_cast<quint64>(data.genes.size()) != n_cols
+            || static_cast<quint64>(data.spots.size()) != n_rows) {
+        throw std::runtime_error("The binary file is corrupted");
+    }
+
+    // counts
+    data.is_sparse = is_sparse;
+    if (is_sparse) {
+        const quint64 *col_ptrs_data = reinterpret_cast<const quint64 *>(counts_section.data);
+        const quint64 *row_indices_data = col_ptrs_data + n_cols + 1;
+        const double *values_data = reinterpret_cast<const double *>(row_indices_data + n_nonzero);
+        uvec col_ptrs(n_cols + 1);
+        uvec row_indices(n_nonzero);
+        bool consistent = col_ptrs_data[0] == 0 && col_ptrs_data[n_cols] == n_nonzero;
+        for (quint64 j = 0; j <= n_cols; ++j) {
+            col_ptrs[j] = col_ptrs_data[j];
+            consistent &= j == 0 || col_ptrs_data[j] >= col_ptrs_data[j - 1];
+        }
+        for (quint64 k = 0; k < n_nonzero; ++k) {
+            row_indices[k] = row_indices_data[k];
+            consistent &= row_indices_data[k] < n_rows;
+        }
+        if (!consistent) {
+            throw std::runtime_error("The binary file is corrupted");
+        }
+        data.sp_counts = sp_mat(row_indices, col_ptrs, vec(values_data, n_nonzero),
+                                n_rows, n_cols);
+    } else if (alias_counts) {
+        double *counts_data = reinterpret_cast<double *>(
+                    const_cast<char *>(counts_section.data));
+        data.counts = mat(counts_data, n_rows, n_cols, false, false);
+        content.mapped_file = file;
+    } else {
+        data.counts = mat(reinterpret_cast<const double *>(counts_section.data), n_rows, n_cols);
+    }
+
+    // coordinates and size factors
+    if (coordinates_section.size > 0) {
+        const float *coordinates = reinterpret_cast<const float *>(coordinates_section.data);
+        content.coordinates.reserve(n_rows);
+        for (quint64 i = 0; i < n_rows; ++i) {
+            content.coordinates.append(Spot::SpotType(coordinates[2 * i], coordinates[2 * i + 1]));
+        }
+    }
+    if (size_factors_section.size > 0) {
+        content.size_factors =
+                rowvec(reinterpret_cast<const double *>(size_factors_section.data), n_rows);
+    }
+
+    qDebug() << "Read binary data file with " << data.genes.size()
+             << " genes and " << data.spots.size() << " spots";
+
+    return content;
+}
+
+quint64 fingerprint(const QStringList &files)
+{
+    quint64 hash = checksum(reinterpret_cast<const char *>(&VERSION), sizeof(VERSION));
+    for (const auto &filename : files) {
+        if (filename.isEmpty()) {
+            hash = checksum("-", 1, hash);
+            continue;
+        }
+        const QFileInfo info(filename);
+        const QByteArray path = info.absoluteFilePath().toUtf8();
+        const qint64 values[] = {info.exists() ? info.size() : -1,
+                                 info.lastModified().toMSecsSinceEpoch()};
+        hash = checksum(path.constData(), path.size(), hash);
+        hash = checksum(reinterpret_cast<const char *>(values), sizeof(values), hash);
+    }
+    return hash;
+}
+
+}
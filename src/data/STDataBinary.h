@@ -0,0 +1,54 @@
+#ifndef STDATABINARY_H
+#define STDATABINARY_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QSharedPointer>
+#include <QFile>
+
+#include "data/STData.h"
+
+// STDataBinary reads and writes data frames in a compact binary format so they
+// can be loaded without parsing text. The file contains a header (with the
+// dimensions, the offsets of the sections and checksums) followed by the sections:
+// gene and spot names, counts (dense column-major or sparse CSC), spot coordinates
+// and size factors (the last two are optional).
+// Dense counts can be memory-mapped so opening the file does not read the matrix.
+namespace STDataBinary
+{
+
+// The suffix of the files with the binary format
+extern const QString SUFFIX;
+
+// The content of a binary file
+struct Content {
+    STData::STDataFrame data;
+    // the adjusted coordinates of each spot (optional)
+    QVector<Spot::SpotType> coordinates;
+    // the size factors of each spot (optional)
+    rowvec size_factors;
+    // a fingerprint of the files the data was created from (0 if none)
+    quint64 source_fingerprint = 0;
+    // the mapped file when the counts are aliased (must outlive the data frame)
+    QSharedPointer<QFile> mapped_file;
+};
+
+// Returns true if the file has the binary format (checks the header)
+bool isBinary(const QString &filename);
+
+// Writes the content to a binary file
+// It throws exceptions if the file cannot be written
+void write(const QString &filename, const Content &content);
+
+// Reads a binary file. When map_counts is true dense counts are not copied but aliased
+// to the memory-mapped file (Content::mapped_file) and their checksum is not verified.
+// It throws exceptions if the file is not valid
+Content read(const QString &filename, const bool map_counts = false);
+
+// Returns a fingerprint of a list of files (paths, sizes and modification times)
+// that can be used to check that a cached binary file is up to date
+quint64 fingerprint(const QStringList &files);
+}
+
+#endif // STDATABINARY_H
@@ -7,13 +7,12 @@
 #include <QSplashScreen>
 #include <QDesktopWidget>
 #include <QFontDatabase>
+#include <QTimer>
 
 #include "mainWindow.h"
 #include "options_cmake.h"
 
-// RcppArmadillo must be included before RInside
-#include "RcppArmadillo.h"
-#include "RInside.h"
+#include "math/RWorkerPool.h"
 
 #include <iostream>
 
@@ -59,25 +58,9 @@ int main(int argc, char **argv)
 
     qDebug() << "Application started successfully.";
 
-    // Initialize RInside object here since it is global...
-    RInside *dummyR = nullptr;
-    try {
-        dummyR = new RInside();
-    } catch (const std::exception &e) {
-        QMessageBox::critical(app.desktop()->screen(),
-                              app.tr("Error"),
-                              app.tr("Error initializing R") + "\n" + QString(e.what()));
-        delete dummyR;
-        dummyR = nullptr;
-        return EXIT_FAILURE;
-    } catch (...) {
-        QMessageBox::critical(app.desktop()->screen(),
-                              app.tr("Error"),
-                              app.tr("Unknown error initializing R"));
-        delete dummyR;
-        dummyR = nullptr;
-        return EXIT_FAILURE;
-    }
+    // The R processes that run the analysis done with R (they are started once the main
+    // window is shown so the viewer does not wait for R)
+    RWorkerPool rWorkers;
 
     // Create main window
     MainWindow mainWindow;
@@ -88,17 +71,22 @@ int main(int argc, char **argv)
         QMessageBox::critical(app.desktop()->screen(),
                               app.tr("Error"),
                               app.tr("Minimum requirements not satisfied"));
-        delete dummyR;
-        dummyR = nullptr;
         return EXIT_FAILURE;
     }
     // Initialize graphic components
     mainWindow.init();
     // Show main window.
     mainWindow.show();
+    // Start R in the background (the analysis done with R are enabled when it is ready)
+    QObject::connect(&rWorkers, &RWorkerPool::stateChanged, &mainWindow, [&]() {
+        if (rWorkers.state() == RWorkerPool::Failed) {
+            QMessageBox::warning(&mainWindow,
+                                 app.tr("Error"),
+                                 app.tr("Error initializing R, the analysis done with R "
+                                        "will not be available") + "\n" + rWorkers.error());
+        }
+    });
+    QTimer::singleShot(0, &rWorkers, &RWorkerPool::start);
     // launch the app
-    const int return_code = app.exec();
-    delete dummyR;
-    dummyR = nullptr;
-    return return_code;
+    return app.exec();
 }
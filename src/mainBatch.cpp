@@ -0,0 +1,172 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+
+#include "batch/BatchPipeline.h"
+#include "options_cmake.h"
+
+namespace
+{
+
+// Parses an option with one of the given values (the index of the value in values)
+bool parseChoice(const QCommandLineParser &parser,
+                 const QCommandLineOption &option,
+                 const QStringList &values,
+                 int &choice)
+{
+    choice = values.indexOf(parser.value(option).toLower());
+    return choice != -1;
+}
+
+// Parses an option with a non negative integer
+bool parseNumber(const QCommandLineParser &parser, const QCommandLineOption &option, int &number)
+{
+    bool ok = false;
+    number = parser.value(option).toInt(&ok);
+    return ok && number >= 0;
+}
+}
+
+// The batch executable runs the pipeline of BatchPipeline (filter, normalize, cluster,
+// marker genes and export) over many datasets without the user interface (no display
+// server is needed). The datasets are given with their descriptors: meta files (JSON),
+// info.json files or folders with the files of the datasets
+int main(int argc, char **argv)
+{
+    const QString VERSION = QString("%1.%2.%3").arg(MAJOR).arg(MINOR).arg(PATCH);
+
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("STViewerBatch");
+    app.setApplicationVersion(VERSION);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+                "Processes ST datasets without the viewer: the counts are filtered, "
+                "normalized, the spots are clustered, the marker genes of the clusters are "
+                "computed and the results are exported to a folder for every dataset.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("descriptors",
+                                 "Meta files (JSON), info.json files or folders of the datasets",
+                                 "descriptors...");
+    const QCommandLineOption output({"o", "output"}, "Folder of the results.", "folder", ".");
+    const QCommandLineOption min_exp_value("min-exp-value",
+                                           "Minimum count of a gene in a spot.", "count", "0");
+    const QCommandLineOption min_reads_spot("min-reads-spot",
+                                            "Minimum counts of a spot.", "count", "0");
+    const QCommandLineOption min_genes_spot("min-genes-spot",
+                                            "Minimum genes of a spot.", "count", "0");
+    const QCommandLineOption min_spots_gene("min-spots-gene",
+                                            "Minimum spots of a gene.", "count", "0");
+    const QCommandLineOption normalization("normalization",
+                                           "Normalization: raw, tpm, rel, deseq or scran.",
+                                           "method", "raw");
+    const QCommandLineOption no_log("no-log", "Do not log the normalized counts.");
+    const QCommandLineOption clustering("clustering",
+                                        "Clustering: kmeans, ward, louvain or none.",
+                                        "method", "kmeans");
+    const QCommandLineOption clusters("clusters",
+                                      "Number of clusters (0 to estimate it).", "number", "0");
+    const QCommandLineOption components("components",
+                                        "Principal components to cluster the spots.",
+                                        "number", "10");
+    const QCommandLineOption scale("scale", "Scale the genes to unit variance to cluster.");
+    const QCommandLineOption markers("markers",
+                                     "Marker genes test: wilcoxon, ttest or none.",
+                                     "test", "wilcoxon");
+    const QCommandLineOption save_counts("save-counts",
+                                         "Export the filtered and normalized counts.");
+    const QCommandLineOption jobs("jobs",
+                                  "Datasets processed at the same time (0 for half the cores).",
+                                  "number", "0");
+    parser.addOptions({output, min_exp_value, min_reads_spot, min_genes_spot, min_spots_gene,
+                       normalization, no_log, clustering, clusters, components, scale,
+                       markers, save_counts, jobs});
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    const QStringList descriptors = parser.positionalArguments();
+    if (descriptors.isEmpty()) {
+        err << "No datasets were given\n";
+        err.flush();
+        parser.showHelp(EXIT_FAILURE);
+    }
+
+    BatchPipeline::Settings settings;
+    int normalization_choice = 0;
+    int clustering_choice = 0;
+    int markers_choice = 0;
+    int n_clusters = 0;
+    int n_components = 0;
+    const bool parsed = parseNumber(parser, min_exp_value, settings.min_exp_value)
+            && parseNumber(parser, min_reads_spot, settings.min_reads_spot)
+            && parseNumber(parser, min_genes_spot, settings.min_genes_spot)
+            && parseNumber(parser, min_spots_gene, settings.min_spots_gene)
+            && parseNumber(parser, clusters, n_clusters)
+            && parseNumber(parser, components, n_components) && n_components > 0
+            && parseNumber(parser, jobs, settings.jobs)
+            && parseChoice(parser, normalization,
+                           {"raw", "tpm", "rel", "deseq", "scran"}, normalization_choice)
+            && parseChoice(parser, clustering,
+                           {"none", "kmeans", "ward", "louvain"}, clustering_choice)
+            && parseChoice(parser, markers, {"none", "wilcoxon", "ttest"}, markers_choice);
+    if (!parsed) {
+        err << "Invalid options, see --help\n";
+        return EXIT_FAILURE;
+    }
+    const SettingsWidget::NormalizationMode normalizations[] = {SettingsWidget::RAW,
+                                                                SettingsWidget::TPM,
+                                                                SettingsWidget::REL,
+                                                                SettingsWidget::DESEQ,
+                                                                SettingsWidget::SCRAN};
+    const BatchPipeline::ClusteringMethod clusterings[] = {BatchPipeline::NoClustering,
+                                                           BatchPipeline::KMeans,
+                                                           BatchPipeline::Ward,
+                                                           BatchPipeline::Louvain};
+    const BatchPipeline::MarkersMethod markers_tests[] = {BatchPipeline::NoMarkers,
+                                                          BatchPipeline::MarkersWilcoxon,
+                                                          BatchPipeline::MarkersTTest};
+    settings.normalization = normalizations[normalization_choice];
+    settings.clustering = clusterings[clustering_choice];
+    settings.markers = markers_tests[markers_choice];
+    settings.clusters = n_clusters;
+    settings.components = n_components;
+    settings.log_scale = !parser.isSet(no_log);
+    settings.scale = parser.isSet(scale);
+    settings.save_counts = parser.isSet(save_counts);
+    settings.output = parser.value(output);
+
+    // the datasets are reported as they are processed
+    QMutex mutex;
+    int done = 0;
+    const BatchPipeline::Progress progress = [&](const BatchPipeline::Result &result) {
+        QMutexLocker locker(&mutex);
+        ++done;
+        out << "[" << done << "/" << descriptors.size() << "] " << result.descriptor << " ";
+        if (result.succeeded) {
+            out << "OK (" << result.spots << " spots, " << result.genes << " genes, "
+                << result.clusters << " clusters) -> " << result.folder << "\n";
+        } else {
+            out << "ERROR " << result.error << "\n";
+        }
+        out.flush();
+    };
+
+    out << "Processing " << descriptors.size() << " datasets in " << settings.output
+        << " with " << QThread::idealThreadCount() << " cores\n";
+    out.flush();
+    const BatchPipeline pipeline(settings);
+    const QList<BatchPipeline::Result> results = pipeline.run(descriptors, progress);
+    const int failed = std::count_if(results.begin(), results.end(),
+                                     [](const BatchPipeline::Result &result) {
+        return !result.succeeded;
+    });
+    out << results.size() - failed << " datasets processed, " << failed << " failed\n";
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,495 @@
+#include "Clustering.h"
+
+#include <QDebug>
+#include <QtConcurrent>
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "math/Neighbors.h"
+
+namespace
+{
+
+// The spots from which k-means uses mini-batches and the size of the batches
+const uword MINI_BATCH_SPOTS = 10000;
+const uword BATCH_SIZE = 1024;
+// The clusters searched by every thread for the nearest cluster of the Ward chain
+const uword CHUNK_CLUSTERS = 2048;
+// The maximum passes of the Louvain local moving and the resolution search
+const int MAX_PASSES = 100;
+const int RESOLUTION_STEPS = 30;
+// The seed of the random numbers (the clusters are always the same)
+const unsigned RANDOM_SEED = 1;
+
+// The indexes of n elements (to visit them in several threads)
+std::vector<uword> indexes(const uword n)
+{
+    std::vector<uword> elements(n);
+    std::iota(elements.begin(), elements.end(), 0);
+    return elements;
+}
+
+double squaredDistance(const double *a, const double *b, const uword dims)
+{
+    double distance = 0.0;
+    for (uword d = 0; d < dims; ++d) {
+        distance += (a[d] - b[d]) * (a[d] - b[d]);
+    }
+    return distance;
+}
+
+// Numbers the clusters from 0 in the order of the spots
+uvec relabel(const uvec &labels)
+{
+    const uword unused = labels.n_elem;
+    std::vector<uword> numbers(labels.n_elem == 0 ? 0 : labels.max() + 1, unused);
+    uword count = 0;
+    uvec relabeled(labels.n_elem);
+    for (uword i = 0; i < labels.n_elem; ++i) {
+        uword &number = numbers[labels[i]];
+        if (number == unused) {
+            number = count++;
+        }
+        relabeled[i] = number;
+    }
+    return relabeled;
+}
+
+uword nearestCenter(const double *point, const mat &centers)
+{
+    uword nearest = 0;
+    double nearest_distance = datum::inf;
+    for (uword c = 0; c < centers.n_cols; ++c) {
+        const double distance = squaredDistance(point, centers.colptr(c), centers.n_rows);
+        if (distance < nearest_distance) {
+            nearest = c;
+            nearest_distance = distance;
+        }
+    }
+    return nearest;
+}
+
+// Assigns every point (columns) to the nearest center, returns the points that changed
+uword assignPoints(const mat &points, const mat &centers, uvec &labels)
+{
+    std::vector<uword> all_points = indexes(points.n_cols);
+    std::atomic<uword> changed(0);
+    QtConcurrent::blockingMap(all_points, [&](const uword i) {
+        const uword nearest = nearestCenter(points.colptr(i), centers);
+        if (nearest != labels[i]) {
+            labels[i] = nearest;
+            ++changed;
+        }
+    });
+    return changed;
+}
+
+// The k-means++ seeds, every center is a point chosen with probability proportional
+// to its squared distance to the closest center already chosen
+mat seedCenters(const mat &points, const uword k, std::mt19937 &generator)
+{
+    const uword n = points.n_cols;
+    std::uniform_int_distribution<uword> uniform(0, n - 1);
+    mat centers(points.n_rows, k);
+    centers.col(0) = points.col(uniform(generator));
+    vec closest(n);
+    closest.fill(datum::inf);
+    std::vector<uword> all_points = indexes(n);
+    for (uword c = 1; c < k; ++c) {
+        QtConcurrent::blockingMap(all_points, [&](const uword i) {
+            closest[i] = std::min(closest[i], squaredDistance(points.colptr(i),
+                                                              centers.colptr(c - 1),
+                                                              points.n_rows));
+        });
+        const double total = accu(closest);
+        uword chosen = uniform(generator);
+        if (total > 0.0) {
+            std::uniform_real_distribution<double> real(0.0, total);
+            const double target = real(generator);
+            double cumulative = 0.0;
+            chosen = n - 1;
+            for (uword i = 0; i < n; ++i) {
+                cumulative += closest[i];
+                if (cumulative > target) {
+                    chosen = i;
+                    break;
+                }
+            }
+        }
+        centers.col(c) = points.col(chosen);
+    }
+    return centers;
+}
+
+// Lloyd iterations (the centers of empty clusters do not move)
+void lloyd(const mat &points, mat &centers, uvec &labels, const int max_iter)
+{
+    for (int iter = 0; iter < max_iter; ++iter) {
+        if (assignPoints(points, centers, labels) == 0) {
+            break;
+        }
+        mat sums(centers.n_rows, centers.n_cols, fill::zeros);
+        uvec counts(centers.n_cols, fill::zeros);
+        for (uword i = 0; i < points.n_cols; ++i) {
+            sums.col(labels[i]) += points.col(i);
+            ++counts[labels[i]];
+        }
+        for (uword c = 0; c < centers.n_cols; ++c) {
+            if (counts[c] > 0) {
+                centers.col(c) = sums.col(c) / counts[c];
+            }
+        }
+    }
+}
+
+// Mini-batch k-means (Sculley), every center moves towards the points of the random
+// batches assigned to it with a decreasing rate
+void miniBatch(const mat &points, mat &centers, const int max_iter, std::mt19937 &generator)
+{
+    std::uniform_int_distribution<uword> uniform(0, points.n_cols - 1);
+    uvec counts(centers.n_cols, fill::zeros);
+    std::vector<uword> batch(BATCH_SIZE);
+    std::vector<uword> batch_labels(BATCH_SIZE);
+    std::vector<uword> positions = indexes(BATCH_SIZE);
+    for (int iter = 0; iter < max_iter; ++iter) {
+        for (uword &point : batch) {
+            point = uniform(generator);
+        }
+        QtConcurrent::blockingMap(positions, [&](const uword b) {
+            batch_labels[b] = nearestCenter(points.colptr(batch[b]), centers);
+        });
+        for (uword b = 0; b < BATCH_SIZE; ++b) {
+            const uword c = batch_labels[b];
+            const double rate = 1.0 / ++counts[c];
+            centers.col(c) = (1.0 - rate) * centers.col(c) + rate * points.col(batch[b]);
+        }
+    }
+}
+
+// The Ward distance of two clusters (the increase of the sum of squares if merged)
+double wardDistance(const mat &centroids, const vec &sizes, const uword a, const uword b)
+{
+    return sizes[a] * sizes[b] / (sizes[a] + sizes[b])
+            * squaredDistance(centroids.colptr(a), centroids.colptr(b), centroids.n_rows);
+}
+
+// The nearest active cluster of a cluster, the previous cluster of the chain is
+// preferred when there are ties (the active clusters are searched in several threads)
+uword nearestCluster(const mat &centroids,
+                     const vec &sizes,
+                     const std::vector<uword> &active,
+                     const uword a,
+                     const uword previous,
+                     double &distance)
+{
+    const uword invalid = centroids.n_cols;
+    const uword n_chunks = (active.size() + CHUNK_CLUSTERS - 1) / CHUNK_CLUSTERS;
+    std::vector<uword> chunks = indexes(n_chunks);
+    std::vector<uword> nearest(n_chunks, invalid);
+    std::vector<double> distances(n_chunks, datum::inf);
+    QtConcurrent::blockingMap(chunks, [&](const uword chunk) {
+        const uword end = std::min<uword>(active.size(), (chunk + 1) * CHUNK_CLUSTERS);
+        for (uword position = chunk * CHUNK_CLUSTERS; position < end; ++position) {
+            const uword b = active[position];
+            if (b == a) {
+                continue;
+            }
+            const double chunk_distance = wardDistance(centroids, sizes, a, b);
+            if (chunk_distance < distances[chunk]) {
+                distances[chunk] = chunk_distance;
+                nearest[chunk] = b;
+            }
+        }
+    });
+    uword cluster = previous;
+    distance = previous == invalid ? datum::inf : wardDistance(centroids, sizes, a, previous);
+    for (uword chunk = 0; chunk < n_chunks; ++chunk) {
+        if (distances[chunk] < distance) {
+            distance = distances[chunk];
+            cluster = nearest[chunk];
+        }
+    }
+    return cluster;
+}
+
+// Union-find of the spots to cut the Ward tree
+uword findRoot(std::vector<uword> &parents, uword i)
+{
+    while (parents[i] != i) {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
+}
+}
+
+namespace Clustering
+{
+
+uvec kmeans(const mat &data, const uword k, const int max_iter)
+{
+    const uword n = data.n_rows;
+    if (n == 0 || k == 0) {
+        return uvec(n, fill::zeros);
+    }
+    const mat points = data.t();
+    std::mt19937 generator(RANDOM_SEED);
+    mat centers = seedCenters(points, std::min(k, n), generator);
+    uvec labels(n);
+    labels.fill(centers.n_cols);
+    if (n > MINI_BATCH_SPOTS) {
+        miniBatch(points, centers, max_iter, generator);
+        assignPoints(points, centers, labels);
+    } else {
+        lloyd(points, centers, labels, max_iter);
+    }
+    qDebug() << "Computed k-means of" << n << "spots";
+    return relabel(labels);
+}
+
+uvec ward(const mat &data, const uword k)
+{
+    const uword n = data.n_rows;
+    if (n == 0) {
+        return uvec();
+    }
+
+    // nearest neighbor chain, the chain grows with the nearest cluster of its last
+    // cluster until two clusters are the nearest of each other and they are merged
+    // (the merged cluster takes the place of the first one)
+    struct Merge {
+        double height;
+        uword a;
+        uword b;
+    };
+    std::vector<Merge> merges;
+    mat centroids = data.t();
+    vec sizes(n, fill::ones);
+    std::vector<uword> active = indexes(n);
+    std::vector<uword> chain;
+    while (active.size() > 1) {
+        if (chain.empty()) {
+            chain.push_back(active.front());
+        }
+        const uword a = chain.back();
+        const uword previous = chain.size() > 1 ? chain[chain.size() - 2] : n;
+        double distance = 0.0;
+        const uword b = nearestCluster(centroids, sizes, active, a, previous, distance);
+        if (b != previous) {
+            chain.push_back(b);
+            continue;
+        }
+        chain.pop_back();
+        chain.pop_back();
+        merges.push_back({distance, a, b});
+        centroids.col(a) = (sizes[a] * centroids.col(a) + sizes[b] * centroids.col(b))
+                / (sizes[a] + sizes[b]);
+        sizes[a] += sizes[b];
+        active.erase(std::find(active.begin(), active.end(), b));
+    }
+
+    // the tree is cut applying the merges from the lowest one (the merges of the chain
+    // are not sorted but Ward is reducible so the order is consistent)
+    std::stable_sort(merges.begin(), merges.end(), [](const Merge &a, const Merge &b) {
+        return a.height < b.height;
+    });
+    std::vector<uword> parents = indexes(n);
+    const uword clusters = std::max<uword>(1, std::min(k, n));
+    for (uword m = 0; m < n - clusters; ++m) {
+        parents[findRoot(parents, merges[m].b)] = findRoot(parents, merges[m].a);
+    }
+    uvec labels(n);
+    for (uword i = 0; i < n; ++i) {
+        labels[i] = findRoot(parents, i);
+    }
+    qDebug() << "Computed Ward clustering of" << n << "spots";
+    return relabel(labels);
+}
+
+sp_mat neighborsGraph(const mat &data, const uword n_neighbors)
+{
+    const uword n = data.n_rows;
+    const uword k = std::min(n_neighbors, n == 0 ? 0 : n - 1);
+    if (k == 0) {
+        return sp_mat(n, n);
+    }
+    umat neighbors;
+    mat distances;
+    Neighbors::nearestNeighbors(data, k, neighbors, distances);
+
+    // the sorted neighbors of every spot (with the spot)
+    umat sets(k + 1, n);
+    sets.rows(0, k - 1) = neighbors;
+    sets.row(k) = regspace<urowvec>(0, n - 1);
+    sets = sort(sets);
+
+    // every edge is added by one of its spots (with both directions)
+    vec weights(n * k, fill::zeros);
+    std::vector<uword> spots = indexes(n);
+    QtConcurrent::blockingMap(spots, [&](const uword i) {
+        const uword *set_i = sets.colptr(i);
+        for (uword r = 0; r < k; ++r) {
+            const uword j = neighbors(r, i);
+            const uword *set_j = sets.colptr(j);
+            if (j < i && std::binary_search(set_j, set_j + k + 1, i)) {
+                continue;
+            }
+            uword shared = 0;
+            for (uword x = 0, y = 0; x <= k && y <= k;) {
+                if (set_i[x] == set_j[y]) {
+                    ++shared;
+                    ++x;
+                    ++y;
+                } else if (set_i[x] < set_j[y]) {
+                    ++x;
+                } else {
+                    ++y;
+                }
+            }
+            weights[i * k + r] = static_cast<double>(shared) / (2 * (k + 1) - shared);
+        }
+    });
+    const uvec edges = find(weights > 0.0);
+    umat locations(2, 2 * edges.n_elem);
+    vec values(2 * edges.n_elem);
+    for (uword e = 0; e < edges.n_elem; ++e) {
+        const uword i = edges[e] / k;
+        const uword j = neighbors(edges[e] % k, i);
+        locations(0, 2 * e) = i;
+        locations(1, 2 * e) = j;
+        locations(0, 2 * e + 1) = j;
+        locations(1, 2 * e + 1) = i;
+        values[2 * e] = weights[edges[e]];
+        values[2 * e + 1] = weights[edges[e]];
+    }
+    return sp_mat(locations, values, n, n);
+}
+
+uvec louvain(const sp_mat &graph, const double resolution)
+{
+    const uword n = graph.n_cols;
+    const double total = accu(graph);
+    if (n == 0) {
+        return uvec();
+    }
+    if (total <= 0.0) {
+        return regspace<uvec>(0, n - 1);
+    }
+
+    // the communities of the spots are the nodes of the current graph (the communities
+    // of the previous level)
+    uvec membership = regspace<uvec>(0, n - 1);
+    sp_mat current = graph;
+    while (true) {
+        current.sync();
+        const uword nodes = current.n_cols;
+        const vec degrees = vec(mat(sum(current, 1)));
+        uvec community = regspace<uvec>(0, nodes - 1);
+        vec totals = degrees;
+
+        // local moving, every node moves to the community of its neighbors that
+        // increases the modularity the most
+        vec weights(nodes, fill::zeros);
+        std::vector<uword> neighbor_communities;
+        bool moved_any = false;
+        bool moved = true;
+        for (int pass = 0; moved && pass < MAX_PASSES; ++pass) {
+            moved = false;
+            for (uword i = 0; i < nodes; ++i) {
+                neighbor_communities.clear();
+                for (uword e = current.col_ptrs[i]; e < current.col_ptrs[i + 1]; ++e) {
+                    const uword j = current.row_indices[e];
+                    if (j == i) {
+                        continue;
+                    }
+                    const uword c = community[j];
+                    if (weights[c] == 0.0) {
+                        neighbor_communities.push_back(c);
+                    }
+                    weights[c] += current.values[e];
+                }
+                const uword old = community[i];
+                totals[old] -= degrees[i];
+                uword best = old;
+                double best_gain = weights[old] - resolution * totals[old] * degrees[i] / total;
+                for (const uword c : neighbor_communities) {
+                    const double gain = weights[c] - resolution * totals[c] * degrees[i] / total;
+                    if (gain > best_gain + 1e-12) {
+                        best = c;
+                        best_gain = gain;
+                    }
+                    weights[c] = 0.0;
+                }
+                totals[best] += degrees[i];
+                community[i] = best;
+                if (best != old) {
+                    moved = true;
+                    moved_any = true;
+                }
+            }
+        }
+        if (!moved_any) {
+            break;
+        }
+
+        // the communities are the nodes of the next level
+        const uvec numbers = relabel(community);
+        const uword count = numbers.max() + 1;
+        membership = numbers.elem(membership);
+        umat locations(2, current.n_nonzero);
+        vec values(current.n_nonzero);
+        for (uword j = 0; j < nodes; ++j) {
+            for (uword e = current.col_ptrs[j]; e < current.col_ptrs[j + 1]; ++e) {
+                locations(0, e) = numbers[current.row_indices[e]];
+                locations(1, e) = numbers[j];
+                values[e] = current.values[e];
+            }
+        }
+        current = sp_mat(true, locations, values, count, count);
+        if (count == nodes) {
+            break;
+        }
+    }
+    return relabel(membership);
+}
+
+uvec graphClusters(const mat &data, const uword k, const uword n_neighbors)
+{
+    const sp_mat graph = neighborsGraph(data, n_neighbors);
+    // the communities grow with the resolution (searched in a logarithmic scale)
+    double low = 1e-3;
+    double high = 1e2;
+    uvec best(data.n_rows, fill::zeros);
+    uword best_count = 1;
+    for (int step = 0; step < RESOLUTION_STEPS; ++step) {
+        const double resolution = std::sqrt(low * high);
+        const uvec communities = louvain(graph, resolution);
+        const uword count = communities.is_empty() ? 0 : communities.max() + 1;
+        if (count <= k && count > best_count) {
+            best = communities;
+            best_count = count;
+        }
+        if (count == k) {
+            break;
+        }
+        if (count < k) {
+            low = resolution;
+        } else {
+            high = resolution;
+        }
+    }
+    qDebug() << "Computed" << best_count << "Louvain communities of" << data.n_rows << "spots";
+    return best;
+}
+
+uword estimateClusters(const mat &data, const uword n_neighbors)
+{
+    const uvec communities = louvain(neighborsGraph(data, n_neighbors));
+    const uword count = communities.is_empty() ? 0 : communities.max() + 1;
+    qDebug() << "Estimated" << count << "clusters";
+    return count;
+}
+}
@@ -0,0 +1,42 @@
+#ifndef CLUSTERING_H
+#define CLUSTERING_H
+
+#include <armadillo>
+
+using namespace arma;
+
+// Clustering groups the spots natively (without R) with k-means, Ward hierarchical
+// clustering or Louvain communities of the nearest neighbors graph. The data is given
+// with the spots as rows (the reduced coordinates or the principal components) and the
+// distances are computed in several threads. The clusters of the spots are numbered from
+// 0 in the order of the spots
+namespace Clustering
+{
+
+// Clusters the spots with k-means (k-means++ seeding and Lloyd iterations, or
+// mini-batches when there are many spots)
+uvec kmeans(const mat &data, const uword k, const int max_iter = 100);
+
+// Clusters the spots with Ward hierarchical clustering (the same merges as hclust with
+// ward.D2) cutting the tree in k clusters. The tree is built with the nearest neighbor
+// chain algorithm that only keeps the centroids of the clusters (not the distances)
+uvec ward(const mat &data, const uword k);
+
+// The shared nearest neighbors graph of the spots, the k nearest neighbors of every spot
+// weighted by the Jaccard index of the neighbors of both spots (symmetric)
+sp_mat neighborsGraph(const mat &data, const uword n_neighbors);
+
+// Finds the Louvain communities of a graph (the resolution multiplies the expected
+// weights of the modularity, larger values give more communities)
+uvec louvain(const sp_mat &graph, const double resolution = 1.0);
+
+// Clusters the spots with the Louvain communities of their neighbors graph with the
+// resolution that gives k communities (or the closest number below k)
+uvec graphClusters(const mat &data, const uword k, const uword n_neighbors = 10);
+
+// Estimates the number of clusters of the spots, the Louvain communities of their
+// neighbors graph (with resolution 1)
+uword estimateClusters(const mat &data, const uword n_neighbors = 10);
+}
+
+#endif // CLUSTERING_H
@@ -0,0 +1,264 @@
+#include "Correlation.h"
+
+#include <QDebug>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+// The columns of the blocks multiplied by every thread in the correlation matrices
+const uword BLOCK_SIZE = 256;
+
+// The indexes of n elements (to visit them in several threads)
+std::vector<uword> indexes(const uword n)
+{
+    std::vector<uword> elements(n);
+    std::iota(elements.begin(), elements.end(), 0);
+    return elements;
+}
+
+// The pairs of tied values (n * (n - 1) / 2 for every group of n equal values)
+// of sorted values
+double tiedPairs(const std::vector<double> &sorted)
+{
+    double pairs = 0.0;
+    uword begin = 0;
+    while (begin < sorted.size()) {
+        uword end = begin + 1;
+        while (end < sorted.size() && sorted[end] == sorted[begin]) {
+            ++end;
+        }
+        const double ties = end - begin;
+        pairs += ties * (ties - 1.0) / 2.0;
+        begin = end;
+    }
+    return pairs;
+}
+
+// Sorts the values with a merge sort and returns the number of swaps
+// (the pairs in the wrong order)
+double mergeSortSwaps(std::vector<double> &values)
+{
+    const uword n = values.size();
+    std::vector<double> buffer(n);
+    double swaps = 0.0;
+    for (uword width = 1; width < n; width *= 2) {
+        for (uword begin = 0; begin < n; begin += 2 * width) {
+            const uword middle = std::min(begin + width, n);
+            const uword end = std::min(begin + 2 * width, n);
+            uword left = begin;
+            uword right = middle;
+            uword position = begin;
+            while (left < middle && right < end) {
+                if (values[right] < values[left]) {
+                    swaps += middle - left;
+                    buffer[position++] = values[right++];
+                } else {
+                    buffer[position++] = values[left++];
+                }
+            }
+            std::copy(values.begin() + left, values.begin() + middle, buffer.begin() + position);
+            std::copy(values.begin() + right, values.begin() + end,
+                      buffer.begin() + position + (middle - left));
+        }
+        values.swap(buffer);
+    }
+    return swaps;
+}
+
+// The columns centered and scaled to norm 1 (the constant columns are NaN)
+// so their products are the Pearson correlations
+mat standardizedColumns(const mat &data)
+{
+    mat standardized = data;
+    std::vector<uword> columns = indexes(data.n_cols);
+    QtConcurrent::blockingMap(columns, [&](const uword j) {
+        standardized.col(j) -= mean(standardized.col(j));
+        const double column_norm = norm(standardized.col(j));
+        if (column_norm > 0) {
+            standardized.col(j) /= column_norm;
+        } else {
+            standardized.col(j).fill(datum::nan);
+        }
+    });
+    return standardized;
+}
+}
+
+namespace Correlation
+{
+
+double pearson(const vec &a, const vec &b)
+{
+    if (a.n_elem != b.n_elem || a.n_elem < 2) {
+        qDebug() << "Error computing the correlation of vectors of size" << a.n_elem
+                 << "and" << b.n_elem;
+        return datum::nan;
+    }
+    const vec centered_a = a - mean(a);
+    const vec centered_b = b - mean(b);
+    const double variances = dot(centered_a, centered_a) * dot(centered_b, centered_b);
+    if (!(variances > 0)) {
+        return datum::nan;
+    }
+    // the rounding errors can leave the correlation slightly out of [-1, 1]
+    return std::max(-1.0, std::min(1.0, dot(centered_a, centered_b) / std::sqrt(variances)));
+}
+
+double spearman(const vec &a, const vec &b)
+{
+    if (a.n_elem != b.n_elem) {
+        return pearson(a, b);
+    }
+    return pearson(ranks(a), ranks(b));
+}
+
+double kendall(const vec &a, const vec &b)
+{
+    const uword n = a.n_elem;
+    if (n != b.n_elem || n < 2) {
+        qDebug() << "Error computing the correlation of vectors of size" << a.n_elem
+                 << "and" << b.n_elem;
+        return datum::nan;
+    }
+
+    // the pairs sorted by a (and b) to count the ties of a and the joint ties
+    std::vector<std::pair<double, double>> pairs(n);
+    for (uword i = 0; i < n; ++i) {
+        pairs[i] = std::make_pair(a[i], b[i]);
+    }
+    std::sort(pairs.begin(), pairs.end());
+    std::vector<double> sorted_a(n);
+    std::vector<double> sorted_b(n);
+    for (uword i = 0; i < n; ++i) {
+        sorted_a[i] = pairs[i].first;
+        sorted_b[i] = pairs[i].second;
+    }
+    const double ties_a = tiedPairs(sorted_a);
+    double joint_ties = 0.0;
+    uword begin = 0;
+    while (begin < n) {
+        uword end = begin + 1;
+        while (end < n && pairs[end] == pairs[begin]) {
+            ++end;
+        }
+        const double ties = end - begin;
+        joint_ties += ties * (ties - 1.0) / 2.0;
+        begin = end;
+    }
+
+    // the discordant pairs are the swaps needed to sort b (b is sorted inside the
+    // ties of a so they are not counted) and then the ties of b are counted
+    const double swaps = mergeSortSwaps(sorted_b);
+    const double ties_b = tiedPairs(sorted_b);
+    const double total = n * (n - 1.0) / 2.0;
+    const double denominator = (total - ties_a) * (total - ties_b);
+    if (!(denominator > 0)) {
+        return datum::nan;
+    }
+    return (total - ties_a - ties_b + joint_ties - 2.0 * swaps) / std::sqrt(denominator);
+}
+
+double correlation(const vec &a, const vec &b, const Method method)
+{
+    switch (method) {
+    case Spearman:
+        return spearman(a, b);
+    case Kendall:
+        return kendall(a, b);
+    default:
+        return pearson(a, b);
+    }
+}
+
+vec ranks(const vec &values)
+{
+    const uword n = values.n_elem;
+    const uvec order = stable_sort_index(values);
+    vec result(n);
+    uword begin = 0;
+    while (begin < n) {
+        uword end = begin + 1;
+        while (end < n && values[order[end]] == values[order[begin]]) {
+            ++end;
+        }
+        // the average of the ranks from begin + 1 to end
+        const double rank = (begin + 1 + end) / 2.0;
+        for (uword k = begin; k < end; ++k) {
+            result[order[k]] = rank;
+        }
+        begin = end;
+    }
+    return result;
+}
+
+mat correlationMatrix(const mat &data, const Method method)
+{
+    const uword n_columns = data.n_cols;
+    mat result(n_columns, n_columns);
+    if (data.n_rows < 2) {
+        qDebug() << "Error computing a correlation matrix with" << data.n_rows << "rows";
+        result.fill(datum::nan);
+        return result;
+    }
+
+    if (method == Kendall) {
+        // every pair of columns (every thread computes a row of the upper triangle)
+        std::vector<uword> columns = indexes(n_columns);
+        QtConcurrent::blockingMap(columns, [&](const uword i) {
+            result(i, i) = kendall(data.col(i), data.col(i));
+            for (uword j = i + 1; j < n_columns; ++j) {
+                result(i, j) = kendall(data.col(i), data.col(j));
+            }
+        });
+        result = symmatu(result);
+        qDebug() << "Computed Kendall correlation matrix of" << n_columns << "columns";
+        return result;
+    }
+
+    // the ranks of the columns for Spearman
+    mat values = data;
+    if (method == Spearman) {
+        std::vector<uword> columns = indexes(n_columns);
+        QtConcurrent::blockingMap(columns, [&](const uword j) {
+            values.col(j) = ranks(data.col(j));
+        });
+    }
+    const mat standardized = standardizedColumns(values);
+
+    // the products of the blocks of columns (the upper blocks, the matrix is symmetric)
+    const uword n_blocks = (n_columns + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    std::vector<std::pair<uword, uword>> blocks;
+    for (uword i = 0; i < n_blocks; ++i) {
+        for (uword j = i; j < n_blocks; ++j) {
+            blocks.emplace_back(i, j);
+        }
+    }
+    QtConcurrent::blockingMap(blocks, [&](const std::pair<uword, uword> &block) {
+        const uword first_i = block.first * BLOCK_SIZE;
+        const uword last_i = std::min(n_columns, first_i + BLOCK_SIZE) - 1;
+        const uword first_j = block.second * BLOCK_SIZE;
+        const uword last_j = std::min(n_columns, first_j + BLOCK_SIZE) - 1;
+        const mat product = standardized.cols(first_i, last_i).t()
+                * standardized.cols(first_j, last_j);
+        result.submat(first_i, first_j, last_i, last_j) = clamp(product, -1.0, 1.0);
+        if (block.first != block.second) {
+            result.submat(first_j, first_i, last_j, last_i) = result.submat(first_i, first_j,
+                                                                            last_i, last_j).t();
+        }
+    });
+    // the diagonal is exactly 1 (except for the constant columns)
+    for (uword j = 0; j < n_columns; ++j) {
+        if (std::isfinite(result(j, j))) {
+            result(j, j) = 1.0;
+        }
+    }
+    qDebug() << "Computed correlation matrix of" << n_columns << "columns";
+    return result;
+}
+}
@@ -0,0 +1,44 @@
+#ifndef CORRELATION_H
+#define CORRELATION_H
+
+#include <armadillo>
+
+using namespace arma;
+
+// Correlation computes correlations natively (without R) between two vectors or between
+// all the columns of a matrix (the genes, with the spots as rows). The matrices are
+// computed in blocks of columns in several threads. The correlations are NaN when one
+// of the vectors is constant (as R)
+namespace Correlation
+{
+
+enum Method {
+    Pearson = 1,
+    Spearman = 2,
+    // Kendall's tau-b (corrected for ties)
+    Kendall = 3
+};
+
+// The Pearson correlation of two vectors of the same size
+double pearson(const vec &a, const vec &b);
+
+// The Spearman correlation of two vectors (the Pearson correlation of their ranks)
+double spearman(const vec &a, const vec &b);
+
+// Kendall's tau-b of two vectors, the pairs are counted in O(n log n) with a merge sort
+// (Knight's algorithm)
+double kendall(const vec &a, const vec &b);
+
+// The correlation of two vectors with the given method
+double correlation(const vec &a, const vec &b, const Method method);
+
+// The ranks of the values (from 1, ties have the average of their ranks)
+vec ranks(const vec &values);
+
+// The correlations of every pair of columns of the data (columns x columns). Pearson and
+// Spearman are computed with products of blocks of the standardized columns (or their
+// ranks) and Kendall with every pair of columns
+mat correlationMatrix(const mat &data, const Method method);
+}
+
+#endif // CORRELATION_H
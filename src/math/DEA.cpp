@@ -0,0 +1,612 @@
+#include "DEA.h"
+
+#include <QDebug>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <utility>
+
+#include "math/SizeFactors.h"
+
+namespace
+{
+
+// The limits of the negative binomial dispersions (the same as DESeq2)
+const double MIN_DISPERSION = 1e-8;
+const double MAX_DISPERSION = 10.0;
+// The mean of a condition without counts (the fold changes stay finite)
+const double MIN_MEAN = 1e-8;
+// The convergence of the fits of the means and of the dispersion trend
+const int MAX_ITERATIONS = 50;
+const double TOLERANCE = 1e-8;
+// The pseudo count added to the means of the conditions in the Wilcoxon fold changes
+const double WILCOXON_PSEUDOCOUNT = 1.0;
+
+// The names of the columns of the results (the same as DESeq2)
+const std::vector<std::string> COLUMN_NAMES =
+        {"baseMean", "log2FoldChange", "lfcSE", "stat", "pvalue", "padj"};
+
+// The maximum likelihood fit of the mean of a condition
+struct MeanFit {
+    double log_mean;
+    // the Fisher information of the log mean
+    double information;
+};
+
+// Fits the mean of the counts of the given spots (log link, the size factors
+// are offsets) with Fisher scoring
+MeanFit fitMean(const double *counts,
+                const rowvec &size_factors,
+                const uvec &spots,
+                const double dispersion)
+{
+    double sum_counts = 0.0;
+    double sum_factors = 0.0;
+    for (const uword spot : spots) {
+        sum_counts += counts[spot];
+        sum_factors += size_factors[spot];
+    }
+
+    // the ratio of the sums is the solution when all the factors are equal
+    double log_mean = std::log(std::max(sum_counts / sum_factors, MIN_MEAN));
+    double information = 0.0;
+    for (int iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+        double score = 0.0;
+        information = 0.0;
+        for (const uword spot : spots) {
+            const double mu = size_factors[spot] * std::exp(log_mean);
+            score += (counts[spot] - mu) / (1.0 + dispersion * mu);
+            information += mu / (1.0 + dispersion * mu);
+        }
+        if (sum_counts <= 0) {
+            break;
+        }
+        const double step = score / information;
+        log_mean = std::max(log_mean + step, std::log(MIN_MEAN));
+        if (std::fabs(step) < TOLERANCE) {
+            break;
+        }
+    }
+    return {log_mean, information};
+}
+
+// The negative binomial log likelihood of the counts of the given spots
+// (without the terms that do not depend on the mean)
+double logLikelihood(const double *counts,
+                     const rowvec &size_factors,
+                     const uvec &spots,
+                     const double dispersion,
+                     const double log_mean)
+{
+    double likelihood = 0.0;
+    for (const uword spot : spots) {
+        const double alpha_mu = dispersion * size_factors[spot] * std::exp(log_mean);
+        likelihood -= std::log1p(alpha_mu) / dispersion;
+        if (counts[spot] > 0) {
+            likelihood += counts[spot] * (std::log(alpha_mu) - std::log1p(alpha_mu));
+        }
+    }
+    return likelihood;
+}
+
+// Fits the trend of the dispersions (a0 + a1 / mean) with a gamma GLM (identity link)
+// leaving out the outliers, as the parametric fit of DESeq2. The mean of the
+// dispersions is used when the fit does not converge
+std::pair<double, double> fitDispersionTrend(const vec &means, const vec &dispersions)
+{
+    const uvec useful = find(dispersions >= 100 * MIN_DISPERSION);
+    if (useful.n_elem == 0) {
+        return {MIN_DISPERSION, 0.0};
+    }
+    const vec x = 1.0 / means.elem(useful);
+    const vec d = dispersions.elem(useful);
+
+    double a0 = 0.1;
+    double a1 = 1.0;
+    bool fitted = false;
+    for (int iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+        const vec residuals = d / (a0 + a1 * x);
+        const uvec good = find(residuals > 1e-4 && residuals < 15);
+        if (good.n_elem < 2) {
+            break;
+        }
+        const vec xg = x.elem(good);
+        const vec dg = d.elem(good);
+        // iteratively reweighted least squares (the variance of a gamma is mu^2)
+        double b0 = a0;
+        double b1 = a1;
+        for (int step = 0; step < MAX_ITERATIONS; ++step) {
+            const vec weights = 1.0 / square(b0 + b1 * xg);
+            const double sw = accu(weights);
+            const double swx = accu(weights % xg);
+            const double swxx = accu(weights % xg % xg);
+            const double swd = accu(weights % dg);
+            const double swxd = accu(weights % xg % dg);
+            const double determinant = sw * swxx - swx * swx;
+            if (!(std::fabs(determinant) > 0)) {
+                break;
+            }
+            const double c0 = (swxx * swd - swx * swxd) / determinant;
+            const double c1 = (sw * swxd - swx * swd) / determinant;
+            const bool converged = std::fabs(c0 - b0) + std::fabs(c1 - b1) < TOLERANCE;
+            b0 = c0;
+            b1 = c1;
+            if (converged || b0 <= 0 || b1 <= 0) {
+                break;
+            }
+        }
+        if (!(b0 > 0 && b1 > 0)) {
+            break;
+        }
+        const double change = std::pow(std::log(b0 / a0), 2) + std::pow(std::log(b1 / a1), 2);
+        a0 = b0;
+        a1 = b1;
+        if (change < 1e-6) {
+            fitted = true;
+            break;
+        }
+    }
+
+    if (!fitted) {
+        qDebug() << "The dispersion trend could not be fitted, using the mean dispersion";
+        return {mean(d), 0.0};
+    }
+    return {a0, a1};
+}
+
+// Sums the ranks of the values of every group (the ties get the average of their ranks)
+// and returns the ties correction term (the sum of t^3 - t for every tie of size t).
+// The non zero values are given sorted with their groups and the zeros (most of the
+// values) are ranked together before them
+double rankSums(const std::vector<std::pair<double, uword>> &non_zeros,
+                const std::vector<double> &zeros,
+                std::vector<double> &rank_sums)
+{
+    const double n_zeros = std::accumulate(zeros.begin(), zeros.end(), 0.0);
+    for (size_t group = 0; group < zeros.size(); ++group) {
+        rank_sums[group] = zeros[group] * (n_zeros + 1) / 2.0;
+    }
+    double ties = n_zeros * n_zeros * n_zeros - n_zeros;
+    for (size_t first = 0; first < non_zeros.size();) {
+        size_t last = first;
+        while (last + 1 < non_zeros.size()
+               && non_zeros[last + 1].first == non_zeros[first].first) {
+            ++last;
+        }
+        const double t = last - first + 1;
+        const double rank = n_zeros + (first + last) / 2.0 + 1.0;
+        for (size_t k = first; k <= last; ++k) {
+            rank_sums[non_zeros[k].second] += rank;
+        }
+        ties += t * t * t - t;
+        first = last + 1;
+    }
+    return ties;
+}
+
+// The Wilcoxon rank-sum test (normal approximation with continuity and ties
+// corrections, as wilcox.test(exact=FALSE) in R) from the sum of the ranks of A.
+// Returns the z statistic and the two-sided p-value
+std::pair<double, double> wilcoxonTest(const double rank_sum_a,
+                                       const double n_a,
+                                       const double n_b,
+                                       const double ties)
+{
+    const double n = n_a + n_b;
+    const double statistic = rank_sum_a - n_a * (n_a + 1) / 2.0 - n_a * n_b / 2.0;
+    const double variance = n_a * n_b / 12.0 * ((n + 1) - ties / (n * (n - 1)));
+    if (!(variance > 0)) {
+        return {0.0, 1.0};
+    }
+    const double correction = statistic > 0 ? 0.5 : (statistic < 0 ? -0.5 : 0.0);
+    const double z = (statistic - correction) / std::sqrt(variance);
+    return {z, std::erfc(std::fabs(z) / std::sqrt(2.0))};
+}
+
+// The continued fraction of the incomplete beta function (modified Lentz's method)
+double betaContinuedFraction(const double a, const double b, const double x)
+{
+    const double tiny = 1e-300;
+    double c = 1.0;
+    double d = 1.0 - (a + b) * x / (a + 1.0);
+    d = 1.0 / (std::fabs(d) < tiny ? tiny : d);
+    double fraction = d;
+    for (int m = 1; m <= 10 * MAX_ITERATIONS; ++m) {
+        for (int term = 0; term < 2; ++term) {
+            const double coefficient = term == 0
+                    ? m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m))
+                    : -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+            d = 1.0 + coefficient * d;
+            d = 1.0 / (std::fabs(d) < tiny ? tiny : d);
+            c = 1.0 + coefficient / c;
+            c = std::fabs(c) < tiny ? tiny : c;
+            fraction *= c * d;
+        }
+        if (std::fabs(c * d - 1.0) < 1e-15) {
+            break;
+        }
+    }
+    return fraction;
+}
+
+// The regularized incomplete beta function I_x(a, b)
+double regularizedBeta(const double x, const double a, const double b)
+{
+    if (x <= 0) {
+        return 0.0;
+    } else if (x >= 1) {
+        return 1.0;
+    }
+    const double front = std::exp(std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b)
+                                  + a * std::log(x) + b * std::log1p(-x));
+    if (x < (a + 1.0) / (a + b + 2.0)) {
+        return front * betaContinuedFraction(a, b, x) / a;
+    }
+    return 1.0 - front * betaContinuedFraction(b, a, 1.0 - x) / b;
+}
+
+// The Welch t-test from the means and variances of A and B.
+// Returns the t statistic and the two-sided p-value
+std::pair<double, double> welchTest(const double mean_a,
+                                    const double variance_a,
+                                    const double n_a,
+                                    const double mean_b,
+                                    const double variance_b,
+                                    const double n_b)
+{
+    const double error_a = variance_a / n_a;
+    const double error_b = variance_b / n_b;
+    if (!(error_a + error_b > 0)) {
+        return {0.0, 1.0};
+    }
+    const double t = (mean_a - mean_b) / std::sqrt(error_a + error_b);
+    const double df = std::pow(error_a + error_b, 2)
+            / (error_a * error_a / (n_a - 1) + error_b * error_b / (n_b - 1));
+    return {t, regularizedBeta(df / (df + t * t), df / 2.0, 0.5)};
+}
+
+// Keeps the tested genes (finite p-value) of the results of a group, adjusts
+// their p-values and orders them by FDR (and decreasing statistic)
+void rankResults(mat &values,
+                 const std::vector<std::string> &genes,
+                 mat &results,
+                 std::vector<std::string> &rows)
+{
+    const uvec tested = find_finite(values.col(DEA::PValue));
+    values = values.rows(tested);
+    values.col(DEA::FDR) = DEA::adjustPValues(values.col(DEA::PValue));
+    std::vector<uword> order(values.n_rows);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&values](const uword a, const uword b) {
+        if (values(a, DEA::FDR) != values(b, DEA::FDR)) {
+            return values(a, DEA::FDR) < values(b, DEA::FDR);
+        }
+        return values(a, DEA::Statistic) > values(b, DEA::Statistic);
+    });
+    results = values.rows(uvec(order));
+    rows.clear();
+    for (const uword index : order) {
+        rows.push_back(genes[tested[index]]);
+    }
+}
+}
+
+namespace DEA
+{
+
+void computeDEA(const mat &counts,
+                const std::vector<std::string> &genes,
+                const std::vector<std::string> &condition,
+                const Test test,
+                mat &results,
+                std::vector<std::string> &rows,
+                std::vector<std::string> &cols)
+{
+    const rowvec size_factors = SizeFactors::computeScranFactors(counts);
+    computeDEA(counts, size_factors, genes, condition, test, results, rows, cols);
+}
+
+void computeDEA(const mat &counts,
+                const rowvec &size_factors,
+                const std::vector<std::string> &genes,
+                const std::vector<std::string> &condition,
+                const Test test,
+                mat &results,
+                std::vector<std::string> &rows,
+                std::vector<std::string> &cols)
+{
+    results.clear();
+    rows.clear();
+    cols.clear();
+
+    const uword n_spots = counts.n_rows;
+    const uword n_genes = counts.n_cols;
+    if (condition.size() != n_spots || genes.size() != n_genes
+            || size_factors.n_elem != n_spots) {
+        qDebug() << "Error computing native DEA, the conditions, genes or size factors"
+                 << "do not match the counts";
+        return;
+    }
+
+    std::vector<uword> spots_a;
+    std::vector<uword> spots_b;
+    for (uword i = 0; i < n_spots; ++i) {
+        if (condition[i] == "A") {
+            spots_a.push_back(i);
+        } else {
+            spots_b.push_back(i);
+        }
+    }
+    if (spots_a.empty() || spots_b.empty()) {
+        qDebug() << "Error computing native DEA, one of the conditions has no spots";
+        return;
+    }
+    const uvec indexes_a(spots_a);
+    const uvec indexes_b(spots_b);
+    const uvec indexes_all = regspace<uvec>(0, n_spots - 1);
+    const double n_a = indexes_a.n_elem;
+    const double n_b = indexes_b.n_elem;
+
+    // the statistics of every gene (not tested genes have a NaN p-value)
+    mat values(n_genes, COLUMN_NAMES.size());
+    values.fill(datum::nan);
+    std::vector<uword> all_genes(n_genes);
+    std::iota(all_genes.begin(), all_genes.end(), 0);
+
+    // The means of the normalized counts and the dispersion of every gene
+    // (method of moments with the variance within the conditions)
+    const double mean_inverse_factor = mean(1.0 / size_factors);
+    vec means(n_genes, fill::zeros);
+    vec dispersions(n_genes, fill::zeros);
+    QtConcurrent::blockingMap(all_genes, [&](const uword gene) {
+        const double *gene_counts = counts.colptr(gene);
+        double sum_a = 0.0;
+        double sum_b = 0.0;
+        for (const uword spot : indexes_a) {
+            sum_a += gene_counts[spot] / size_factors[spot];
+        }
+        for (const uword spot : indexes_b) {
+            sum_b += gene_counts[spot] / size_factors[spot];
+        }
+        const double mean_a = sum_a / n_a;
+        const double mean_b = sum_b / n_b;
+        means[gene] = (sum_a + sum_b) / n_spots;
+        if (!(means[gene] > 0) || test == DEA::Wilcoxon) {
+            return;
+        }
+        double squares = 0.0;
+        for (const uword spot : indexes_a) {
+            squares += std::pow(gene_counts[spot] / size_factors[spot] - mean_a, 2);
+        }
+        for (const uword spot : indexes_b) {
+            squares += std::pow(gene_counts[spot] / size_factors[spot] - mean_b, 2);
+        }
+        const double variance = squares / std::max(1.0, n_spots - 2.0);
+        const double dispersion =
+                (variance - means[gene] * mean_inverse_factor) / std::pow(means[gene], 2);
+        dispersions[gene] = std::min(std::max(dispersion, MIN_DISPERSION), MAX_DISPERSION);
+    });
+
+    std::pair<double, double> trend(0.0, 0.0);
+    if (test != DEA::Wilcoxon) {
+        const uvec expressed = find(means > 0);
+        trend = fitDispersionTrend(means.elem(expressed), dispersions.elem(expressed));
+        qDebug() << "Native DEA dispersion trend" << trend.first << "+" << trend.second
+                 << "/ mean";
+    }
+
+    QtConcurrent::blockingMap(all_genes, [&](const uword gene) {
+        if (!(means[gene] > 0)) {
+            return;
+        }
+        const double *gene_counts = counts.colptr(gene);
+        values(gene, DEA::BaseMean) = means[gene];
+
+        if (test == DEA::Wilcoxon) {
+            // only the non zero normalized counts are sorted (A is the group 0)
+            std::vector<std::pair<double, uword>> non_zeros;
+            std::vector<double> zeros = {n_a, n_b};
+            double sum_a = 0.0;
+            double sum_b = 0.0;
+            for (const uword spot : indexes_a) {
+                if (gene_counts[spot] > 0) {
+                    const double value = gene_counts[spot] / size_factors[spot];
+                    non_zeros.emplace_back(value, 0);
+                    sum_a += value;
+                    zeros[0] -= 1;
+                }
+            }
+            for (const uword spot : indexes_b) {
+                if (gene_counts[spot] > 0) {
+                    const double value = gene_counts[spot] / size_factors[spot];
+                    non_zeros.emplace_back(value, 1);
+                    sum_b += value;
+                    zeros[1] -= 1;
+                }
+            }
+            std::sort(non_zeros.begin(), non_zeros.end());
+            std::vector<double> rank_sums(2);
+            const double ties = rankSums(non_zeros, zeros, rank_sums);
+            const auto result = wilcoxonTest(rank_sums[0], n_a, n_b, ties);
+            values(gene, DEA::Log2FoldChange) = std::log2((sum_a / n_a + WILCOXON_PSEUDOCOUNT)
+                                                          / (sum_b / n_b + WILCOXON_PSEUDOCOUNT));
+            values(gene, DEA::Statistic) = result.first;
+            values(gene, DEA::PValue) = result.second;
+            return;
+        }
+
+        const double dispersion =
+                std::max(dispersions[gene], trend.first + trend.second / means[gene]);
+        const MeanFit fit_a = fitMean(gene_counts, size_factors, indexes_a, dispersion);
+        const MeanFit fit_b = fitMean(gene_counts, size_factors, indexes_b, dispersion);
+        const double log2_fold_change = (fit_a.log_mean - fit_b.log_mean) / std::log(2.0);
+        const double log2_fold_change_se =
+                std::sqrt(1.0 / fit_a.information + 1.0 / fit_b.information) / std::log(2.0);
+        values(gene, DEA::Log2FoldChange) = log2_fold_change;
+        values(gene, DEA::Log2FoldChangeSE) = log2_fold_change_se;
+        if (test == DEA::NegativeBinomialWald) {
+            const double statistic = log2_fold_change / log2_fold_change_se;
+            values(gene, DEA::Statistic) = statistic;
+            values(gene, DEA::PValue) = std::erfc(std::fabs(statistic) / std::sqrt(2.0));
+        } else {
+            // the reduced model has the same mean in both conditions
+            const MeanFit fit_all = fitMean(gene_counts, size_factors, indexes_all, dispersion);
+            const double full =
+                    logLikelihood(gene_counts, size_factors, indexes_a, dispersion, fit_a.log_mean)
+                    + logLikelihood(gene_counts, size_factors, indexes_b, dispersion,
+                                    fit_b.log_mean);
+            const double reduced = logLikelihood(gene_counts, size_factors, indexes_all,
+                                                 dispersion, fit_all.log_mean);
+            const double statistic = std::max(0.0, 2.0 * (full - reduced));
+            values(gene, DEA::Statistic) = statistic;
+            values(gene, DEA::PValue) = std::erfc(std::sqrt(statistic / 2.0));
+        }
+    });
+
+    rankResults(values, genes, results, rows);
+    cols = COLUMN_NAMES;
+    qDebug() << "Computed native DEA with" << rows.size() << "genes";
+}
+
+void computeMarkers(const sp_mat &counts,
+                    const std::vector<std::string> &genes,
+                    const uvec &groups,
+                    const uword n_groups,
+                    const MarkersTest test,
+                    std::vector<mat> &results,
+                    std::vector<std::vector<std::string>> &rows,
+                    std::vector<std::string> &cols)
+{
+    results.clear();
+    rows.clear();
+    cols.clear();
+
+    const uword n_spots = counts.n_rows;
+    const uword n_genes = counts.n_cols;
+    if (groups.n_elem != n_spots || genes.size() != n_genes || n_groups < 2
+            || (n_spots > 0 && groups.max() >= n_groups)) {
+        qDebug() << "Error computing markers, the groups or genes do not match the counts";
+        return;
+    }
+
+    // the spots of every group and the library size factors
+    std::vector<double> group_sizes(n_groups, 0.0);
+    for (const uword group : groups) {
+        group_sizes[group] += 1;
+    }
+    if (std::count(group_sizes.begin(), group_sizes.end(), 0.0) > 0) {
+        qDebug() << "Error computing markers, some of the groups have no spots";
+        return;
+    }
+    const mat library_sizes(sum(counts, 1));
+    vec size_factors = library_sizes.col(0);
+    size_factors /= mean(size_factors.elem(find(size_factors > 0)));
+    size_factors.elem(find(size_factors <= 0)).ones();
+
+    // the statistics of every gene for every group (not tested genes have a NaN p-value)
+    std::vector<mat> values(n_groups, mat(n_genes, COLUMN_NAMES.size()));
+    for (mat &group_values : values) {
+        group_values.fill(datum::nan);
+    }
+    std::vector<uword> all_genes(n_genes);
+    std::iota(all_genes.begin(), all_genes.end(), 0);
+    counts.sync();
+    QtConcurrent::blockingMap(all_genes, [&](const uword gene) {
+        const uword first = counts.col_ptrs[gene];
+        const uword last = counts.col_ptrs[gene + 1];
+        if (first == last) {
+            return;
+        }
+
+        // the sums of the normalized (and log normalized) counts of every group
+        // with only the non zero counts (zeros add nothing)
+        std::vector<std::pair<double, uword>> non_zeros;
+        non_zeros.reserve(last - first);
+        std::vector<double> zeros(group_sizes);
+        std::vector<double> sums(n_groups, 0.0);
+        std::vector<double> log_sums(n_groups, 0.0);
+        std::vector<double> log_squares(n_groups, 0.0);
+        for (uword k = first; k < last; ++k) {
+            const uword spot = counts.row_indices[k];
+            const uword group = groups[spot];
+            const double value = counts.values[k] / size_factors[spot];
+            if (!(value > 0)) {
+                continue;
+            }
+            non_zeros.emplace_back(value, group);
+            zeros[group] -= 1;
+            sums[group] += value;
+            log_sums[group] += std::log1p(value);
+            log_squares[group] += std::pow(std::log1p(value), 2);
+        }
+        if (non_zeros.empty()) {
+            return;
+        }
+        const double total = std::accumulate(sums.begin(), sums.end(), 0.0);
+        const double log_total = std::accumulate(log_sums.begin(), log_sums.end(), 0.0);
+        const double log_squares_total =
+                std::accumulate(log_squares.begin(), log_squares.end(), 0.0);
+
+        // the ranks are computed once for all the groups
+        std::vector<double> rank_sums(n_groups, 0.0);
+        double ties = 0.0;
+        if (test == DEA::MarkersWilcoxon) {
+            std::sort(non_zeros.begin(), non_zeros.end());
+            ties = rankSums(non_zeros, zeros, rank_sums);
+        }
+
+        // every group against the rest of the spots
+        for (uword group = 0; group < n_groups; ++group) {
+            const double n_a = group_sizes[group];
+            const double n_b = n_spots - n_a;
+            mat &group_values = values[group];
+            group_values(gene, DEA::BaseMean) = total / n_spots;
+            group_values(gene, DEA::Log2FoldChange) =
+                    std::log2((sums[group] / n_a + WILCOXON_PSEUDOCOUNT)
+                              / ((total - sums[group]) / n_b + WILCOXON_PSEUDOCOUNT));
+            std::pair<double, double> result;
+            if (test == DEA::MarkersWilcoxon) {
+                result = wilcoxonTest(rank_sums[group], n_a, n_b, ties);
+            } else {
+                if (n_a < 2 || n_b < 2) {
+                    continue;
+                }
+                const double mean_a = log_sums[group] / n_a;
+                const double mean_b = (log_total - log_sums[group]) / n_b;
+                const double variance_a =
+                        std::max(0.0, (log_squares[group] - n_a * mean_a * mean_a) / (n_a - 1));
+                const double squares_b = log_squares_total - log_squares[group];
+                const double variance_b =
+                        std::max(0.0, (squares_b - n_b * mean_b * mean_b) / (n_b - 1));
+                result = welchTest(mean_a, variance_a, n_a, mean_b, variance_b, n_b);
+            }
+            group_values(gene, DEA::Statistic) = result.first;
+            group_values(gene, DEA::PValue) = result.second;
+        }
+    });
+
+    results.resize(n_groups);
+    rows.resize(n_groups);
+    for (uword group = 0; group < n_groups; ++group) {
+        rankResults(values[group], genes, results[group], rows[group]);
+    }
+    cols = COLUMN_NAMES;
+    qDebug() << "Computed markers of" << n_groups << "groups with" << n_genes << "genes";
+}
+
+vec adjustPValues(const vec &pvalues)
+{
+    const uword n = pvalues.n_elem;
+    vec adjusted(n);
+    // from the largest p-value to the smallest one keeping the adjusted values monotonic
+    const uvec order = sort_index(pvalues, "descend");
+    double minimum = 1.0;
+    for (uword k = 0; k < n; ++k) {
+        const uword index = order[k];
+        minimum = std::min(minimum, pvalues[index] * n / (n - k));
+        adjusted[index] = minimum;
+    }
+    return adjusted;
+}
+}
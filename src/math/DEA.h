@@ -0,0 +1,92 @@
+#ifndef DEA_H
+#define DEA_H
+
+#include <armadillo>
+#include <string>
+#include <vector>
+
+using namespace arma;
+
+// DEA computes differential expression between two conditions natively (without R).
+// The counts are given with the spots as rows and the genes as columns and the
+// genes are tested in several threads. The results have the same columns as the
+// results of DESeq2 (RInterface::computeDEA_DESeq) so they can be used in the same way.
+namespace DEA
+{
+
+// The test used to compute the p-values
+enum Test {
+    // negative binomial GLM (one mean per condition) with the Wald test
+    NegativeBinomialWald = 1,
+    // negative binomial GLM with the likelihood ratio test (against one mean)
+    NegativeBinomialLRT = 2,
+    // Wilcoxon rank-sum test of the normalized counts
+    Wilcoxon = 3
+};
+
+// The test used to find marker genes
+enum MarkersTest {
+    // Wilcoxon rank-sum test of the normalized counts
+    MarkersWilcoxon = 1,
+    // Welch t-test of the log normalized counts (log(1 + x))
+    MarkersTTest = 2
+};
+
+// The columns of the results (the statistic is the Wald z, the likelihood ratio, the
+// Wilcoxon z or the Welch t and the fold changes of the rank tests have no standard
+// error (NaN))
+enum Column {
+    BaseMean = 0,
+    Log2FoldChange = 1,
+    Log2FoldChangeSE = 2,
+    Statistic = 3,
+    PValue = 4,
+    FDR = 5
+};
+
+// Computes the DE genes between the spots of the condition "A" and the spots of the
+// condition "B" (condition has one element per spot). The counts are normalized
+// with the scran factors (SizeFactors::computeScranFactors).
+// The negative binomial dispersions are the maximum of the estimate of each gene and
+// a trend (a0 + a1 / mean) fitted to all the genes.
+// The fold changes are A over B and the FDR is computed with Benjamini-Hochberg.
+// results has one row per tested gene ordered by FDR (genes without counts are not
+// tested), rows has the names of the genes and cols the names of the columns
+void computeDEA(const mat &counts,
+                const std::vector<std::string> &genes,
+                const std::vector<std::string> &condition,
+                const Test test,
+                mat &results,
+                std::vector<std::string> &rows,
+                std::vector<std::string> &cols);
+
+// The same with the given size factors (one per spot)
+void computeDEA(const mat &counts,
+                const rowvec &size_factors,
+                const std::vector<std::string> &genes,
+                const std::vector<std::string> &condition,
+                const Test test,
+                mat &results,
+                std::vector<std::string> &rows,
+                std::vector<std::string> &cols);
+
+// Computes the marker genes of every group of spots against the rest of the spots
+// (groups has the group of every spot, from 0 to n_groups - 1). The counts are normalized
+// by library size and only the non zero counts are visited (and sorted to be ranked,
+// once for all the groups). The fold changes are the group over the rest (with a pseudo
+// count of 1). results has one matrix per group with the same columns as computeDEA()
+// ordered by FDR (and decreasing statistic) and rows has the names of their genes
+void computeMarkers(const sp_mat &counts,
+                    const std::vector<std::string> &genes,
+                    const uvec &groups,
+                    const uword n_groups,
+                    const MarkersTest test,
+                    std::vector<mat> &results,
+                    std::vector<std::vector<std::string>> &rows,
+                    std::vector<std::string> &cols);
+
+// Adjusts the p-values for multiple testing with the Benjamini-Hochberg method
+vec adjustPValues(const vec &pvalues);
+}
+
+#endif // DEA_H
@@ -0,0 +1,603 @@
+#include "Embedding.h"
+
+#include <QDebug>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "math/Neighbors.h"
+
+namespace
+{
+
+// The t-SNE iterations with exaggerated similarities (and low momentum)
+const int EXAGGERATION_ITER = 250;
+const double EXAGGERATION = 12.0;
+const double INITIAL_MOMENTUM = 0.5;
+const double FINAL_MOMENTUM = 0.8;
+// The UMAP negative samples for every positive sample
+const int NEGATIVE_SAMPLES = 5;
+// The seed of the random numbers (the embeddings are always the same)
+const unsigned RANDOM_SEED = 1;
+
+// The indexes of n points (to visit them in several threads)
+std::vector<uword> indexes(const uword n)
+{
+    std::vector<uword> points(n);
+    std::iota(points.begin(), points.end(), 0);
+    return points;
+}
+
+// A fast random generator (splitmix64) so every point can have its own generator
+uint64_t nextRandom(uint64_t &state)
+{
+    state += 0x9e3779b97f4a7c15ULL;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// The conditional probabilities of the k neighbors of a point with the given perplexity
+// (binary search of the precision of the gaussian kernel as in bhtsne)
+void gaussianPerplexity(const double *squared,
+                        const uword k,
+                        const double perplexity,
+                        double *probabilities)
+{
+    const double entropy = std::log(perplexity);
+    double beta = 1.0;
+    double min_beta = -DBL_MAX;
+    double max_beta = DBL_MAX;
+    double sum_p = DBL_MIN;
+    for (int iter = 0; iter < 200; ++iter) {
+        sum_p = DBL_MIN;
+        double h = 0.0;
+        for (uword j = 0; j < k; ++j) {
+            probabilities[j] = std::exp(-beta * squared[j]);
+            sum_p += probabilities[j];
+            h += beta * squared[j] * probabilities[j];
+        }
+        const double difference = h / sum_p + std::log(sum_p) - entropy;
+        if (std::abs(difference) < 1e-5) {
+            break;
+        }
+        if (difference > 0) {
+            min_beta = beta;
+            beta = max_beta == DBL_MAX ? beta * 2.0 : (beta + max_beta) / 2.0;
+        } else {
+            max_beta = beta;
+            beta = min_beta == -DBL_MAX ? beta / 2.0 : (beta + min_beta) / 2.0;
+        }
+    }
+    for (uword j = 0; j < k; ++j) {
+        probabilities[j] /= sum_p;
+    }
+}
+
+// The coordinates where an embedding starts, the first columns of the data (random
+// when there are not enough) centered and scaled so the largest value is scale
+mat initialCoordinates(const mat &points, const uword no_dims, const double scale)
+{
+    std::mt19937 generator(RANDOM_SEED);
+    std::normal_distribution<double> normal;
+    mat coordinates(no_dims, points.n_cols);
+    coordinates.imbue([&]() { return normal(generator); });
+    const uword rows = std::min(no_dims, static_cast<uword>(points.n_rows));
+    if (rows > 0) {
+        coordinates.rows(0, rows - 1) = points.rows(0, rows - 1);
+    }
+    coordinates.each_col() -= mean(coordinates, 1);
+    const double max_value = abs(coordinates).max();
+    if (max_value > 0.0) {
+        coordinates *= scale / max_value;
+    }
+    return coordinates;
+}
+
+// Calls the progress function every few iterations (and in the last one), returns
+// false when the embedding has to stop
+bool reportProgress(const Embedding::Progress &progress,
+                    const int progress_every,
+                    const int iteration,
+                    const int max_iter,
+                    const mat &coordinates)
+{
+    if (!progress || (iteration % std::max(1, progress_every) != 0 && iteration != max_iter)) {
+        return true;
+    }
+    return progress(iteration, coordinates.t());
+}
+
+// A space partitioning tree (a quadtree in 2D) of the points of an embedding with the
+// center of mass of every cell, used to approximate the t-SNE repulsive forces
+class SpaceTree
+{
+public:
+    explicit SpaceTree(const mat &points);
+
+    // Adds the repulsive forces of all the points on a point (not normalized) to force
+    // and returns the sum of their t-SNE similarities (not normalized). The cells that
+    // are small (relative to their distance) are used as a single point
+    double repulsion(const double *point, const double theta, double *force) const;
+
+private:
+    void insert(const double *point);
+    void add(const uword node, const double *point);
+    void split(const uword node);
+    uword child(const uword node, const double *point) const;
+    bool samePoint(const uword node, const double *point) const;
+
+    const uword m_dims;
+    const uword m_children;
+    // the first child of every cell (0 for the leaves) and its number of points
+    std::vector<uword> m_child;
+    std::vector<uword> m_count;
+    // the center, the half widths, the sum of the points (the center of mass once
+    // built) and the point of the leaves of every cell (m_dims values per cell)
+    std::vector<double> m_center;
+    std::vector<double> m_width;
+    std::vector<double> m_mass;
+    std::vector<double> m_point;
+};
+
+SpaceTree::SpaceTree(const mat &points)
+    : m_dims(points.n_rows)
+    , m_children(static_cast<uword>(1) << points.n_rows)
+{
+    const vec min_values = min(points, 1);
+    const vec max_values = max(points, 1);
+    m_child.push_back(0);
+    m_count.push_back(0);
+    for (uword d = 0; d < m_dims; ++d) {
+        m_center.push_back((min_values[d] + max_values[d]) / 2.0);
+        m_width.push_back((max_values[d] - min_values[d]) / 2.0 + 1e-5);
+        m_mass.push_back(0.0);
+        m_point.push_back(0.0);
+    }
+    for (uword i = 0; i < points.n_cols; ++i) {
+        insert(points.colptr(i));
+    }
+    // the sums of the points are replaced by the centers of mass (the exact
+    // position of the points in the leaves)
+    for (uword node = 0; node < m_count.size(); ++node) {
+        for (uword d = 0; d < m_dims && m_count[node] > 0; ++d) {
+            double &mass = m_mass[node * m_dims + d];
+            mass = m_child[node] == 0 ? m_point[node * m_dims + d] : mass / m_count[node];
+        }
+    }
+}
+
+void SpaceTree::insert(const double *point)
+{
+    uword node = 0;
+    while (true) {
+        if (m_child[node] == 0) {
+            if (m_count[node] == 0) {
+                std::copy(point, point + m_dims, m_point.begin() + node * m_dims);
+            }
+            if (m_count[node] == 0 || samePoint(node, point)) {
+                add(node, point);
+                return;
+            }
+            split(node);
+        }
+        add(node, point);
+        node = child(node, point);
+    }
+}
+
+void SpaceTree::add(const uword node, const double *point)
+{
+    ++m_count[node];
+    for (uword d = 0; d < m_dims; ++d) {
+        m_mass[node * m_dims + d] += point[d];
+    }
+}
+
+void SpaceTree::split(const uword node)
+{
+    const uword first = m_count.size();
+    for (uword c = 0; c < m_children; ++c) {
+        m_child.push_back(0);
+        m_count.push_back(0);
+        for (uword d = 0; d < m_dims; ++d) {
+            const double width = m_width[node * m_dims + d] / 2.0;
+            const double side = (c >> d) & 1 ? 1.0 : -1.0;
+            m_center.push_back(m_center[node * m_dims + d] + side * width);
+            m_width.push_back(width);
+            m_mass.push_back(0.0);
+            m_point.push_back(0.0);
+        }
+    }
+    m_child[node] = first;
+    // the points of the cell (all in the same position) are moved to a child
+    const uword moved = child(node, &m_point[node * m_dims]);
+    m_count[moved] = m_count[node];
+    for (uword d = 0; d < m_dims; ++d) {
+        m_point[moved * m_dims + d] = m_point[node * m_dims + d];
+        m_mass[moved * m_dims + d] = m_point[node * m_dims + d] * m_count[node];
+    }
+}
+
+uword SpaceTree::child(const uword node, const double *point) const
+{
+    uword index = 0;
+    for (uword d = 0; d < m_dims; ++d) {
+        if (point[d] > m_center[node * m_dims + d]) {
+            index |= static_cast<uword>(1) << d;
+        }
+    }
+    return m_child[node] + index;
+}
+
+bool SpaceTree::samePoint(const uword node, const double *point) const
+{
+    return std::equal(point, point + m_dims, m_point.begin() + node * m_dims);
+}
+
+double SpaceTree::repulsion(const double *point, const double theta, double *force) const
+{
+    double sum_q = 0.0;
+    std::vector<uword> stack(1, 0);
+    while (!stack.empty()) {
+        const uword node = stack.back();
+        stack.pop_back();
+        double count = m_count[node];
+        if (count == 0) {
+            continue;
+        }
+        const double *center = &m_mass[node * m_dims];
+        double squared = 0.0;
+        double max_width = 0.0;
+        for (uword d = 0; d < m_dims; ++d) {
+            squared += (point[d] - center[d]) * (point[d] - center[d]);
+            max_width = std::max(max_width, 2.0 * m_width[node * m_dims + d]);
+        }
+        const bool leaf = m_child[node] == 0;
+        if (leaf || max_width * max_width < theta * theta * squared) {
+            // the point does not push itself
+            if (leaf && squared == 0.0) {
+                count -= 1.0;
+            }
+            const double q = 1.0 / (1.0 + squared);
+            sum_q += count * q;
+            for (uword d = 0; d < m_dims; ++d) {
+                force[d] += count * q * q * (point[d] - center[d]);
+            }
+        } else {
+            for (uword c = 0; c < m_children; ++c) {
+                stack.push_back(m_child[node] + c);
+            }
+        }
+    }
+    return sum_q;
+}
+}
+
+namespace Embedding
+{
+
+mat computeTSNE(const mat &data,
+                const uword no_dims,
+                const double perplexity,
+                const double theta,
+                const int max_iter,
+                const Progress &progress,
+                const int progress_every)
+{
+    const uword n = data.n_rows;
+    if (n < 2 || no_dims == 0) {
+        return mat(n, no_dims, fill::zeros);
+    }
+
+    // the data is centered and scaled (as Rtsne does) and the perplexity is reduced
+    // when there are less than 3 * perplexity neighbors
+    mat points = data.t();
+    points.each_col() -= mean(points, 1);
+    const double max_value = abs(points).max();
+    if (max_value > 0.0) {
+        points /= max_value;
+    }
+    const double used_perplexity = std::min(perplexity, (n - 1) / 3.0);
+    const uword k = std::max<uword>(1, std::min(n - 1, static_cast<uword>(3.0 * used_perplexity)));
+    if (used_perplexity < perplexity) {
+        qDebug() << "The t-SNE perplexity is reduced to" << used_perplexity;
+    }
+
+    // the similarities of the nearest neighbors (symmetric and normalized)
+    umat neighbors;
+    mat distances;
+    Neighbors::nearestNeighbors(points.t(), k, neighbors, distances);
+    umat locations(2, n * k);
+    vec values(n * k);
+    std::vector<uword> all_points = indexes(n);
+    QtConcurrent::blockingMap(all_points, [&](const uword i) {
+        const vec squared = square(distances.col(i));
+        gaussianPerplexity(squared.memptr(), k, used_perplexity, values.memptr() + i * k);
+        for (uword r = 0; r < k; ++r) {
+            locations(0, i * k + r) = neighbors(r, i);
+            locations(1, i * k + r) = i;
+        }
+    });
+    sp_mat P(locations, values, n, n);
+    P = P + P.t();
+    P /= accu(P);
+    P.sync();
+
+    // gradient descent with momentum and gains (as bhtsne)
+    mat Y = initialCoordinates(points, no_dims, 1e-4);
+    mat update(no_dims, n, fill::zeros);
+    mat gains(no_dims, n, fill::ones);
+    mat attraction(no_dims, n);
+    mat repulsion(no_dims, n);
+    vec sums_q(n);
+    const double learning_rate = std::max(200.0, n / EXAGGERATION);
+    const double used_theta = std::max(0.0, theta);
+    for (int iter = 0; iter < max_iter; ++iter) {
+        const double exaggeration = iter < EXAGGERATION_ITER ? EXAGGERATION : 1.0;
+        const double momentum = iter < EXAGGERATION_ITER ? INITIAL_MOMENTUM : FINAL_MOMENTUM;
+        const SpaceTree tree(Y);
+        QtConcurrent::blockingMap(all_points, [&](const uword i) {
+            const double *yi = Y.colptr(i);
+            double *attractive = attraction.colptr(i);
+            double *repulsive = repulsion.colptr(i);
+            std::fill(attractive, attractive + no_dims, 0.0);
+            std::fill(repulsive, repulsive + no_dims, 0.0);
+            for (uword e = P.col_ptrs[i]; e < P.col_ptrs[i + 1]; ++e) {
+                const double *yj = Y.colptr(P.row_indices[e]);
+                double squared = 0.0;
+                for (uword d = 0; d < no_dims; ++d) {
+                    squared += (yi[d] - yj[d]) * (yi[d] - yj[d]);
+                }
+                const double force = exaggeration * P.values[e] / (1.0 + squared);
+                for (uword d = 0; d < no_dims; ++d) {
+                    attractive[d] += force * (yi[d] - yj[d]);
+                }
+            }
+            sums_q[i] = tree.repulsion(yi, used_theta, repulsive);
+        });
+        const mat gradient = attraction - repulsion / accu(sums_q);
+        for (uword e = 0; e < gradient.n_elem; ++e) {
+            const bool same_sign = (gradient[e] > 0.0) == (update[e] > 0.0);
+            gains[e] = std::max(0.01, same_sign ? gains[e] * 0.8 : gains[e] + 0.2);
+        }
+        update = momentum * update - learning_rate * (gains % gradient);
+        Y += update;
+        Y.each_col() -= mean(Y, 1);
+        if (!reportProgress(progress, progress_every, iter + 1, max_iter, Y)) {
+            qDebug() << "t-SNE stopped at iteration" << iter + 1;
+            return mat();
+        }
+    }
+    qDebug() << "Computed t-SNE of" << n << "spots";
+    return Y.t();
+}
+
+mat computeUMAP(const mat &data,
+                const uword no_dims,
+                const uword n_neighbors,
+                const double min_dist,
+                const int n_epochs,
+                const Progress &progress,
+                const int progress_every)
+{
+    const uword n = data.n_rows;
+    if (n < 2 || no_dims == 0) {
+        return mat(n, no_dims, fill::zeros);
+    }
+
+    // the graph of the nearest neighbors with the fuzzy union of the membership
+    // strengths of both points of every edge
+    const mat points = data.t();
+    const uword k = std::max<uword>(1, std::min(n - 1, n_neighbors - 1));
+    umat neighbors;
+    mat distances;
+    Neighbors::nearestNeighbors(data, k, neighbors, distances);
+    const double mean_distance = mean(vectorise(distances));
+    umat locations(2, n * k);
+    vec values(n * k);
+    std::vector<uword> all_points = indexes(n);
+    QtConcurrent::blockingMap(all_points, [&](const uword i) {
+        fuzzyMemberships(distances.colptr(i), k, mean_distance, values.memptr() + i * k);
+        for (uword r = 0; r < k; ++r) {
+            locations(0, i * k + r) = neighbors(r, i);
+            locations(1, i * k + r) = i;
+        }
+    });
+    const sp_mat memberships(locations, values, n, n);
+    const sp_mat transposed = memberships.t();
+    sp_mat graph = memberships + transposed - memberships % transposed;
+    graph.sync();
+
+    // the edges are sampled proportionally to their weight (the weakest are not used)
+    const double max_weight = graph.max();
+    vec epochs_per_sample(graph.n_nonzero);
+    for (uword e = 0; e < graph.n_nonzero; ++e) {
+        const double weight = graph.values[e];
+        epochs_per_sample[e] = weight * n_epochs >= max_weight ? max_weight / weight : -1.0;
+    }
+    vec next_sample = epochs_per_sample;
+    vec next_negative = epochs_per_sample / NEGATIVE_SAMPLES;
+
+    // stochastic gradient descent, every point moves itself with the positions of the
+    // previous epoch so the points can move in several threads
+    double a = 0.0;
+    double b = 0.0;
+    Embedding::fitUMAPCurve(min_dist, a, b);
+    mat Y = initialCoordinates(points, no_dims, 10.0);
+    mat previous;
+    const auto clip = [](const double value) { return std::max(-4.0, std::min(4.0, value)); };
+    for (int epoch = 0; epoch < n_epochs; ++epoch) {
+        const double alpha = 1.0 - static_cast<double>(epoch) / n_epochs;
+        previous = Y;
+        QtConcurrent::blockingMap(all_points, [&](const uword i) {
+            uint64_t state = RANDOM_SEED + static_cast<uint64_t>(epoch) * n + i;
+            double *yi = Y.colptr(i);
+            for (uword e = graph.col_ptrs[i]; e < graph.col_ptrs[i + 1]; ++e) {
+                if (epochs_per_sample[e] <= 0.0 || next_sample[e] > epoch) {
+                    continue;
+                }
+                const double *yj = previous.colptr(graph.row_indices[e]);
+                double squared = 0.0;
+                for (uword d = 0; d < no_dims; ++d) {
+                    squared += (yi[d] - yj[d]) * (yi[d] - yj[d]);
+                }
+                if (squared > 0.0) {
+                    const double coefficient = -2.0 * a * b * std::pow(squared, b - 1.0)
+                            / (a * std::pow(squared, b) + 1.0);
+                    for (uword d = 0; d < no_dims; ++d) {
+                        yi[d] += clip(coefficient * (yi[d] - yj[d])) * alpha;
+                    }
+                }
+                next_sample[e] += epochs_per_sample[e];
+
+                const double epochs_per_negative = epochs_per_sample[e] / NEGATIVE_SAMPLES;
+                const int n_negative = static_cast<int>((epoch - next_negative[e])
+                                                        / epochs_per_negative);
+                for (int s = 0; s < n_negative; ++s) {
+                    const uword j = nextRandom(state) % n;
+                    if (j == i) {
+                        continue;
+                    }
+                    const double *yk = previous.colptr(j);
+                    squared = 0.0;
+                    for (uword d = 0; d < no_dims; ++d) {
+                        squared += (yi[d] - yk[d]) * (yi[d] - yk[d]);
+                    }
+                    const double coefficient = 2.0 * b
+                            / ((0.001 + squared) * (a * std::pow(squared, b) + 1.0));
+                    for (uword d = 0; d < no_dims; ++d) {
+                        const double gradient =
+                                squared > 0.0 ? clip(coefficient * (yi[d] - yk[d])) : 4.0;
+                        yi[d] += gradient * alpha;
+                    }
+                }
+                next_negative[e] += n_negative * epochs_per_negative;
+            }
+        });
+        if (!reportProgress(progress, progress_every, epoch + 1, n_epochs, Y)) {
+            qDebug() << "UMAP stopped at epoch" << epoch + 1;
+            return mat();
+        }
+    }
+    qDebug() << "Computed UMAP of" << n << "spots";
+    return Y.t();
+}
+
+void fitUMAPCurve(const double min_dist, double &a, double &b)
+{
+    // least squares fit (Levenberg-Marquardt) to the target similarities (1 closer
+    // than min_dist and then exponential decay) as curve_fit in umap-learn
+    const int n_points = 300;
+    std::vector<double> x(n_points);
+    std::vector<double> y(n_points);
+    for (int i = 0; i < n_points; ++i) {
+        x[i] = 3.0 * i / (n_points - 1);
+        y[i] = x[i] < min_dist ? 1.0 : std::exp(min_dist - x[i]);
+    }
+    const auto error = [&](const double curve_a, const double curve_b) {
+        double total = 0.0;
+        for (int i = 0; i < n_points; ++i) {
+            const double residual = 1.0 / (1.0 + curve_a * std::pow(x[i], 2.0 * curve_b)) - y[i];
+            total += residual * residual;
+        }
+        return total;
+    };
+
+    a = 1.0;
+    b = 1.0;
+    double lambda = 1e-3;
+    double current = error(a, b);
+    for (int iter = 0; iter < 200 && lambda < 1e10; ++iter) {
+        // normal equations of the linearized problem
+        double jaa = 0.0;
+        double jab = 0.0;
+        double jbb = 0.0;
+        double ja = 0.0;
+        double jb = 0.0;
+        for (int i = 0; i < n_points; ++i) {
+            if (x[i] <= 0.0) {
+                continue;
+            }
+            const double power = std::pow(x[i], 2.0 * b);
+            const double f = 1.0 / (1.0 + a * power);
+            const double da = -power * f * f;
+            const double db = -2.0 * a * power * std::log(x[i]) * f * f;
+            const double residual = f - y[i];
+            jaa += da * da;
+            jab += da * db;
+            jbb += db * db;
+            ja += da * residual;
+            jb += db * residual;
+        }
+        const double maa = jaa * (1.0 + lambda);
+        const double mbb = jbb * (1.0 + lambda);
+        const double determinant = maa * mbb - jab * jab;
+        if (determinant == 0.0) {
+            break;
+        }
+        const double new_a = a - (mbb * ja - jab * jb) / determinant;
+        const double new_b = b - (maa * jb - jab * ja) / determinant;
+        const double new_error = new_a > 0.0 && new_b > 0.0 ? error(new_a, new_b) : DBL_MAX;
+        if (new_error < current) {
+            const bool converged = current - new_error < 1e-12 * current;
+            a = new_a;
+            b = new_b;
+            current = new_error;
+            lambda /= 10.0;
+            if (converged) {
+                break;
+            }
+        } else {
+            lambda *= 10.0;
+        }
+    }
+}
+
+void fuzzyMemberships(const double *distances,
+                      const uword k,
+                      const double mean_distance,
+                      double *memberships)
+{
+    const double target = std::log2(k + 1.0);
+    double rho = 0.0;
+    double mean_point = 0.0;
+    for (uword r = 0; r < k; ++r) {
+        if (rho == 0.0 && distances[r] > 0.0) {
+            rho = distances[r];
+        }
+        mean_point += distances[r] / k;
+    }
+    double low = 0.0;
+    double high = datum::inf;
+    double sigma = 1.0;
+    for (int iter = 0; iter < 64; ++iter) {
+        double sum = 0.0;
+        for (uword r = 0; r < k; ++r) {
+            const double distance = distances[r] - rho;
+            sum += distance > 0.0 ? std::exp(-distance / sigma) : 1.0;
+        }
+        if (std::abs(sum - target) < 1e-5) {
+            break;
+        }
+        if (sum > target) {
+            high = sigma;
+            sigma = (low + high) / 2.0;
+        } else {
+            low = sigma;
+            sigma = std::isinf(high) ? sigma * 2.0 : (low + high) / 2.0;
+        }
+    }
+    sigma = std::max(sigma, 1e-3 * (rho > 0.0 ? mean_point : mean_distance));
+    for (uword r = 0; r < k; ++r) {
+        const double distance = distances[r] - rho;
+        memberships[r] = distance > 0.0 ? std::exp(-distance / sigma) : 1.0;
+    }
+}
+}
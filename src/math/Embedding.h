@@ -0,0 +1,59 @@
+#ifndef EMBEDDING_H
+#define EMBEDDING_H
+
+#include <armadillo>
+#include <functional>
+
+using namespace arma;
+
+// Embedding computes low dimensional embeddings of the spots natively (without R)
+// with Barnes-Hut t-SNE (van der Maaten) or a UMAP layout (McInnes, Healy and Melville)
+// of the k nearest neighbors graph. The data is given with the spots as rows (usually
+// the principal components, math/PCA.h) and the gradients are computed in several
+// threads. The embeddings report their progress every few iterations with the current
+// coordinates and can be stopped from there
+namespace Embedding
+{
+
+// Called with the number of iterations done and the current coordinates
+// (spots x dimensions), the embedding is stopped when it returns false
+typedef std::function<bool(const int, const mat &)> Progress;
+
+// Computes the t-SNE embedding of the data (the perplexity is reduced when there are
+// not enough spots and theta is the accuracy of the Barnes-Hut approximation, 0 is
+// exact). The data is normalized as Rtsne does and the embedding is initialized with
+// its first columns (with a small variance). Returns an empty matrix when it is stopped
+mat computeTSNE(const mat &data,
+                const uword no_dims,
+                const double perplexity,
+                const double theta,
+                const int max_iter,
+                const Progress &progress = Progress(),
+                const int progress_every = 50);
+
+// Computes the UMAP embedding of the data (n_neighbors includes the spot itself,
+// as in umap-learn). The embedding is initialized with the first columns of the data.
+// Returns an empty matrix when it is stopped
+mat computeUMAP(const mat &data,
+                const uword no_dims,
+                const uword n_neighbors,
+                const double min_dist,
+                const int n_epochs,
+                const Progress &progress = Progress(),
+                const int progress_every = 10);
+
+// Fits the parameters of the UMAP similarity 1 / (1 + a * d^2b) in the embedding
+// to the given minimum distance (with spread 1)
+void fitUMAPCurve(const double min_dist, double &a, double &b);
+
+// Computes the UMAP membership strengths of the k nearest neighbors of a point (without
+// the point itself) from their sorted distances, as smooth_knn_dist in umap-learn: the
+// neighbors at the distance of the nearest one have strength 1 and the strengths add
+// up to log2(k + 1). mean_distance is the mean distance of all the neighbors
+void fuzzyMemberships(const double *distances,
+                      const uword k,
+                      const double mean_distance,
+                      double *memberships);
+}
+
+#endif // EMBEDDING_H
@@ -0,0 +1,271 @@
+#include "Neighbors.h"
+
+#include <QtConcurrent>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <utility>
+
+namespace
+{
+
+// The spots from which the neighbors are found with an index (approximately)
+const uword EXACT_SPOTS = 5000;
+// The trees of the index and the neighbors of every neighbor used to refine the neighbors
+const uword TREES = 10;
+const uword REFINE_NEIGHBORS = 10;
+// The seed of the random numbers (the trees are always the same)
+const unsigned RANDOM_SEED = 1;
+
+// The indexes of n elements (to visit them in several threads)
+std::vector<uword> indexes(const uword n)
+{
+    std::vector<uword> elements(n);
+    std::iota(elements.begin(), elements.end(), 0);
+    return elements;
+}
+
+double squaredDistance(const double *a, const double *b, const uword dims)
+{
+    double distance = 0.0;
+    for (uword d = 0; d < dims; ++d) {
+        distance += (a[d] - b[d]) * (a[d] - b[d]);
+    }
+    return distance;
+}
+
+// Keeps the k nearest candidates of a point (sorted by distance), returns how many
+uword nearestCandidates(const mat &points,
+                        const double *point,
+                        std::vector<uword> &candidates,
+                        const uword k,
+                        uword *indices,
+                        double *distances)
+{
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    std::vector<std::pair<double, uword>> scored;
+    scored.reserve(candidates.size());
+    for (const uword candidate : candidates) {
+        scored.emplace_back(squaredDistance(point, points.colptr(candidate), points.n_rows),
+                            candidate);
+    }
+    const uword count = std::min<uword>(k, scored.size());
+    std::partial_sort(scored.begin(), scored.begin() + count, scored.end());
+    for (uword r = 0; r < count; ++r) {
+        indices[r] = scored[r].second;
+        distances[r] = std::sqrt(scored[r].first);
+    }
+    return count;
+}
+
+// The exact nearest neighbors (brute force)
+void exactNeighbors(const mat &data, const uword k, umat &indices, mat &distances)
+{
+    const uword n = data.n_rows;
+    const mat points = data.t();
+    const vec norms = sum(square(points), 0).t();
+    indices.set_size(k, n);
+    distances.set_size(k, n);
+    std::vector<uword> spots = indexes(n);
+    QtConcurrent::blockingMap(spots, [&](const uword i) {
+        vec squared = norms + norms[i] - 2.0 * (points.t() * points.col(i));
+        squared[i] = datum::inf;
+        std::vector<uword> order = indexes(n);
+        std::partial_sort(order.begin(), order.begin() + k, order.end(),
+                          [&](const uword a, const uword b) { return squared[a] < squared[b]; });
+        for (uword r = 0; r < k; ++r) {
+            indices(r, i) = order[r];
+            distances(r, i) = std::sqrt(std::max(0.0, squared[order[r]]));
+        }
+    });
+}
+}
+
+namespace Neighbors
+{
+
+Index::Index()
+    : m_points()
+    , m_leaf_size(0)
+    , m_trees()
+{
+}
+
+Index::Index(const mat &data, const uword n_trees, const uword leaf_size)
+    : m_points(data.t())
+    , m_leaf_size(std::max<uword>(1, leaf_size))
+    , m_trees(n_trees)
+{
+    std::vector<uword> trees = indexes(n_trees);
+    QtConcurrent::blockingMap(trees, [this](const uword t) {
+        m_trees[t] = buildTree(RANDOM_SEED + t);
+    });
+}
+
+uword Index::size() const
+{
+    return m_points.n_cols;
+}
+
+Index::Tree Index::buildTree(const unsigned seed) const
+{
+    const uword n = m_points.n_cols;
+    const uword dims = m_points.n_rows;
+    Tree tree;
+    tree.spots = indexes(n);
+    tree.leaves.assign(n, 0);
+    std::mt19937 generator(seed);
+    const auto addNode = [&](const uword begin, const uword end) {
+        tree.left.push_back(0);
+        tree.right.push_back(0);
+        tree.normals.insert(tree.normals.end(), dims, 0.0);
+        tree.offsets.push_back(0.0);
+        tree.begin.push_back(begin);
+        tree.end.push_back(end);
+        return static_cast<uword>(tree.left.size() - 1);
+    };
+
+    std::vector<uword> pending(1, addNode(0, n));
+    while (!pending.empty()) {
+        const uword node = pending.back();
+        pending.pop_back();
+        const uword begin = tree.begin[node];
+        const uword end = tree.end[node];
+        if (end - begin <= m_leaf_size) {
+            for (uword s = begin; s < end; ++s) {
+                tree.leaves[tree.spots[s]] = node;
+            }
+            continue;
+        }
+
+        // the hyperplane between two random spots of the node
+        std::uniform_int_distribution<uword> uniform(begin, end - 1);
+        const double *a = m_points.colptr(tree.spots[uniform(generator)]);
+        const double *b = m_points.colptr(tree.spots[uniform(generator)]);
+        double *normal = &tree.normals[node * dims];
+        double offset = 0.0;
+        for (uword d = 0; d < dims; ++d) {
+            normal[d] = a[d] - b[d];
+            offset += normal[d] * (a[d] + b[d]) / 2.0;
+        }
+        const auto below = [&](const uword spot) {
+            const double *point = m_points.colptr(spot);
+            double projection = 0.0;
+            for (uword d = 0; d < dims; ++d) {
+                projection += normal[d] * point[d];
+            }
+            return projection <= offset;
+        };
+        uword middle = std::partition(tree.spots.begin() + begin,
+                                      tree.spots.begin() + end, below) - tree.spots.begin();
+        if (middle == begin || middle == end) {
+            // the spots are not split (they are the same), they are split in halves
+            // and the queries always go left
+            std::fill(normal, normal + dims, 0.0);
+            offset = 0.0;
+            middle = begin + (end - begin) / 2;
+        }
+        tree.offsets[node] = offset;
+        const uword left = addNode(begin, middle);
+        const uword right = addNode(middle, end);
+        tree.left[node] = left;
+        tree.right[node] = right;
+        pending.push_back(left);
+        pending.push_back(right);
+    }
+    return tree;
+}
+
+uword Index::leaf(const Tree &tree, const double *point) const
+{
+    const uword dims = m_points.n_rows;
+    uword node = 0;
+    while (tree.left[node] != 0) {
+        const double *normal = &tree.normals[node * dims];
+        double projection = 0.0;
+        for (uword d = 0; d < dims; ++d) {
+            projection += normal[d] * point[d];
+        }
+        node = projection > tree.offsets[node] ? tree.right[node] : tree.left[node];
+    }
+    return node;
+}
+
+void Index::query(const rowvec &point, const uword k, uvec &indices, vec &distances) const
+{
+    indices.reset();
+    distances.reset();
+    if (size() == 0 || point.n_elem != m_points.n_rows) {
+        return;
+    }
+    std::vector<uword> candidates;
+    for (const Tree &tree : m_trees) {
+        const uword node = leaf(tree, point.memptr());
+        candidates.insert(candidates.end(),
+                          tree.spots.begin() + tree.begin[node],
+                          tree.spots.begin() + tree.end[node]);
+    }
+    if (candidates.size() < k) {
+        candidates = indexes(size());
+    }
+    indices.set_size(k);
+    distances.set_size(k);
+    const uword count = nearestCandidates(m_points, point.memptr(), candidates, k,
+                                          indices.memptr(), distances.memptr());
+    indices.resize(count);
+    distances.resize(count);
+}
+
+void Index::neighbors(const uword k, umat &indices, mat &distances) const
+{
+    const uword n = size();
+    indices.set_size(k, n);
+    distances.set_size(k, n);
+    std::vector<uword> spots = indexes(n);
+
+    // the nearest spots in the leaves of the spot
+    QtConcurrent::blockingMap(spots, [&](const uword i) {
+        std::vector<uword> candidates;
+        for (const Tree &tree : m_trees) {
+            const uword node = tree.leaves[i];
+            candidates.insert(candidates.end(),
+                              tree.spots.begin() + tree.begin[node],
+                              tree.spots.begin() + tree.end[node]);
+        }
+        candidates.erase(std::remove(candidates.begin(), candidates.end(), i), candidates.end());
+        if (candidates.size() < k) {
+            candidates = indexes(n);
+            candidates.erase(candidates.begin() + i);
+        }
+        nearestCandidates(m_points, m_points.colptr(i), candidates, k,
+                          indices.colptr(i), distances.colptr(i));
+    });
+
+    // the nearest spots of the neighbors are candidates too
+    const umat leaf_neighbors = indices;
+    const uword refine = std::min(k, REFINE_NEIGHBORS);
+    QtConcurrent::blockingMap(spots, [&](const uword i) {
+        std::vector<uword> candidates(leaf_neighbors.colptr(i), leaf_neighbors.colptr(i) + k);
+        for (uword r = 0; r < k; ++r) {
+            const uword j = leaf_neighbors(r, i);
+            for (uword s = 0; s < refine; ++s) {
+                if (leaf_neighbors(s, j) != i) {
+                    candidates.push_back(leaf_neighbors(s, j));
+                }
+            }
+        }
+        nearestCandidates(m_points, m_points.colptr(i), candidates, k,
+                          indices.colptr(i), distances.colptr(i));
+    });
+}
+
+void nearestNeighbors(const mat &data, const uword k, umat &indices, mat &distances)
+{
+    if (data.n_rows <= EXACT_SPOTS) {
+        exactNeighbors(data, k, indices, distances);
+    } else {
+        Index(data, TREES, std::max<uword>(32, 2 * k)).neighbors(k, indices, distances);
+    }
+}
+}
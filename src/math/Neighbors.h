@@ -0,0 +1,68 @@
+#ifndef NEIGHBORS_H
+#define NEIGHBORS_H
+
+#include <armadillo>
+#include <vector>
+
+using namespace arma;
+
+// Neighbors finds the nearest neighbors of the spots in a reduced space (usually the
+// principal components, math/PCA.h) for the graph based methods (math/Embedding.h and
+// math/Clustering.h) and to find similar spots. The data is given with the spots as rows
+namespace Neighbors
+{
+
+// An approximate nearest neighbors index of the spots, a forest of random projection
+// trees (as Annoy). Every tree splits the spots recursively by the hyperplane between
+// two random spots until the leaves are small and the trees are built in several
+// threads. A query only computes the distances to the spots in its leaf of every tree
+class Index
+{
+public:
+    Index();
+    explicit Index(const mat &data, const uword n_trees = 10, const uword leaf_size = 32);
+
+    // the number of spots of the index
+    uword size() const;
+
+    // Finds the (approximate) k nearest spots of a point (with the columns of the data)
+    // sorted by distance, a spot of the index is its own nearest spot
+    void query(const rowvec &point, const uword k, uvec &indices, vec &distances) const;
+
+    // Finds the (approximate) k nearest neighbors of every spot excluding the spot,
+    // the neighbors in the leaves are refined with the neighbors of the neighbors
+    // (the same format as nearestNeighbors())
+    void neighbors(const uword k, umat &indices, mat &distances) const;
+
+private:
+    struct Tree {
+        // the children of the inner nodes (0 for the leaves, the root is not a child)
+        std::vector<uword> left;
+        std::vector<uword> right;
+        // the hyperplanes of the inner nodes (the spots above the offset go right)
+        std::vector<double> normals;
+        std::vector<double> offsets;
+        // the spots of the leaves (from begin to end) and the leaf of every spot
+        std::vector<uword> begin;
+        std::vector<uword> end;
+        std::vector<uword> spots;
+        std::vector<uword> leaves;
+    };
+
+    Tree buildTree(const unsigned seed) const;
+    uword leaf(const Tree &tree, const double *point) const;
+
+    // the spots as columns
+    mat m_points;
+    uword m_leaf_size;
+    std::vector<Tree> m_trees;
+};
+
+// Finds the k nearest neighbors (euclidean distance) of every spot, excluding the spot
+// itself, in several threads (exactly or with an Index when there are many spots).
+// indices and distances have one column per spot with its neighbors sorted by distance
+// (k must be smaller than the spots)
+void nearestNeighbors(const mat &data, const uword k, umat &indices, mat &distances);
+}
+
+#endif // NEIGHBORS_H
@@ -0,0 +1,189 @@
+#include "PCA.h"
+
+#include <QDebug>
+#include <QtConcurrent>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+// The extra components computed to make the randomized SVD accurate
+const uword OVERSAMPLING = 10;
+// The power iterations of the randomized SVD (needed when the spectrum decays slowly)
+const int POWER_ITERATIONS = 4;
+// The seed of the random projection (the results are always the same)
+const unsigned RANDOM_SEED = 1;
+
+// The products of the data with dense matrices, the columns of the dense matrix
+// are multiplied in several threads when the data is sparse
+mat multiply(const mat &data, const mat &b)
+{
+    return data * b;
+}
+
+mat multiplyTransposed(const mat &data, const mat &b)
+{
+    return data.t() * b;
+}
+
+mat multiply(const sp_mat &data, const mat &b)
+{
+    mat result(data.n_rows, b.n_cols);
+    std::vector<uword> columns(b.n_cols);
+    std::iota(columns.begin(), columns.end(), 0);
+    data.sync();
+    QtConcurrent::blockingMap(columns, [&](const uword j) {
+        result.col(j) = data * b.col(j);
+    });
+    return result;
+}
+
+mat multiplyTransposed(const sp_mat &data, const mat &b)
+{
+    mat result(data.n_cols, b.n_cols);
+    std::vector<uword> columns(b.n_cols);
+    std::iota(columns.begin(), columns.end(), 0);
+    data.sync();
+    QtConcurrent::blockingMap(columns, [&](const uword j) {
+        result.col(j) = trans(b.col(j).t() * data);
+    });
+    return result;
+}
+
+// The products of the centered and scaled data (X) with dense matrices without
+// computing X, X * b
+template <typename T>
+mat productRight(const T &data, const rowvec &center, const rowvec &scale, const mat &b)
+{
+    const mat scaled = b.each_col() / scale.t();
+    mat result = multiply(data, scaled);
+    result.each_row() -= center * scaled;
+    return result;
+}
+
+// X' * b
+template <typename T>
+mat productLeft(const T &data, const rowvec &center, const rowvec &scale, const mat &b)
+{
+    mat result = multiplyTransposed(data, b);
+    result -= center.t() * sum(b, 0);
+    result.each_col() /= scale.t();
+    return result;
+}
+
+// The mean and the standard deviation of every column
+void columnStats(const mat &data, rowvec &means, rowvec &deviations)
+{
+    means = mean(data, 0);
+    deviations = stddev(data, 0, 0);
+}
+
+void columnStats(const sp_mat &data, rowvec &means, rowvec &deviations)
+{
+    const double n = data.n_rows;
+    means = rowvec(mat(sum(data, 0))) / n;
+    const rowvec squares(mat(sum(square(data), 0)));
+    deviations = sqrt(clamp((squares - n * square(means)) / std::max(1.0, n - 1), 0.0,
+                            datum::inf));
+}
+
+template <typename T>
+PCA::Result computePCA(const T &data, const uword components, const bool center,
+                       const bool scale)
+{
+    const uword n_spots = data.n_rows;
+    const uword n_genes = data.n_cols;
+    PCA::Result result;
+    result.scores.zeros(n_spots, components);
+    result.loadings.zeros(n_genes, components);
+    result.sdev.zeros(components);
+    result.center.zeros(n_genes);
+    result.scale.ones(n_genes);
+    if (n_spots == 0 || n_genes == 0 || components == 0) {
+        return result;
+    }
+
+    rowvec means;
+    rowvec deviations;
+    columnStats(data, means, deviations);
+    if (center) {
+        result.center = means;
+    }
+    if (scale) {
+        result.scale = deviations;
+        result.scale.elem(find(result.scale <= 0)).ones();
+    }
+
+    mat U;
+    vec s;
+    mat V;
+    bool computed = false;
+    if (std::min(n_spots, n_genes) <= components + OVERSAMPLING) {
+        // small matrices are decomposed directly
+        mat x(data);
+        x.each_row() -= result.center;
+        x.each_row() /= result.scale;
+        computed = svd_econ(U, s, V, x);
+    } else {
+        // the range of X is approximated with a random projection refined with
+        // power iterations (orthonormalized in every step) and X is decomposed in it
+        std::mt19937 generator(RANDOM_SEED);
+        std::normal_distribution<double> normal;
+        mat omega(n_genes, components + OVERSAMPLING);
+        omega.imbue([&]() { return normal(generator); });
+        mat Q;
+        mat R;
+        computed = qr_econ(Q, R, productRight(data, result.center, result.scale, omega));
+        for (int i = 0; computed && i < POWER_ITERATIONS; ++i) {
+            computed = qr_econ(Q, R, productLeft(data, result.center, result.scale, Q))
+                    && qr_econ(Q, R, productRight(data, result.center, result.scale, Q));
+        }
+        mat Ub;
+        computed = computed
+                && svd_econ(Ub, s, V, productLeft(data, result.center, result.scale, Q).t());
+        if (computed) {
+            U = Q * Ub;
+        }
+    }
+    if (!computed) {
+        qDebug() << "Error computing the PCA of a matrix" << n_spots << "x" << n_genes;
+        return result;
+    }
+
+    // the largest loading of every component is positive
+    const uword n_components = std::min(components, static_cast<uword>(s.n_elem));
+    for (uword j = 0; j < n_components; ++j) {
+        const double sign = V(abs(V.col(j)).index_max(), j) < 0 ? -1.0 : 1.0;
+        result.scores.col(j) = sign * s[j] * U.col(j);
+        result.loadings.col(j) = sign * V.col(j);
+        result.sdev[j] = s[j] / std::sqrt(std::max(1.0, n_spots - 1.0));
+    }
+    qDebug() << "Computed PCA with" << n_components << "components";
+    return result;
+}
+}
+
+namespace PCA
+{
+
+Result compute(const mat &data, const uword components, const bool center, const bool scale)
+{
+    return computePCA(data, components, center, scale);
+}
+
+Result compute(const sp_mat &data, const uword components, const bool center, const bool scale)
+{
+    return computePCA(data, components, center, scale);
+}
+
+mat project(const mat &data, const Result &pca)
+{
+    mat x = data;
+    x.each_row() -= pca.center;
+    x.each_row() /= pca.scale;
+    return x * pca.loadings;
+}
+}
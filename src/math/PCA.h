@@ -0,0 +1,40 @@
+#ifndef PCA_H
+#define PCA_H
+
+#include <armadillo>
+
+using namespace arma;
+
+// PCA computes the top principal components of a matrix natively with a randomized
+// truncated SVD (Halko, Martinsson and Tropp) so only the requested components are
+// computed. The data is given with the spots as rows and the genes as columns, sparse
+// data is centered and scaled implicitly (it is never made dense) and the products
+// are split in several threads (dense products are done by BLAS)
+namespace PCA
+{
+
+// The principal components of a matrix (the same as prcomp in R)
+struct Result {
+    // the coordinates of the spots in the components (spots x components)
+    mat scores;
+    // the loadings (rotation) of the genes in the components (genes x components)
+    mat loadings;
+    // the standard deviations of the components
+    vec sdev;
+    // the values subtracted from and dividing each gene (0 and 1 when not used)
+    rowvec center;
+    rowvec scale;
+};
+
+// Computes the first components of the data (centered and scaled to unit variance
+// if requested, genes without variance are not scaled). The signs of the components
+// are chosen so the largest loading of each component is positive. The result has
+// always the requested components (components that do not exist are zero)
+Result compute(const mat &data, const uword components, const bool center, const bool scale);
+Result compute(const sp_mat &data, const uword components, const bool center, const bool scale);
+
+// Projects data (with the same genes) in the components of a result
+mat project(const mat &data, const Result &pca);
+}
+
+#endif // PCA_H
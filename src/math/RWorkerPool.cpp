@@ -0,0 +1,497 @@
+#include "RWorkerPool.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+
+namespace
+{
+
+// The R packages loaded by every worker when it starts
+const QStringList R_PACKAGES = {"Matrix", "DESeq2", "edgeR", "scran", "akima"};
+// The maximum number of R processes (every one has the R packages loaded)
+const int MAX_WORKERS = 4;
+// The time to wait for an R process to start or to quit (in ms)
+const int PROCESS_TIMEOUT = 30000;
+// The time between the checks of the pool while a worker waits for R (in ms)
+const int POLL_INTERVAL = 100;
+// The prefix of the lines with the status of a worker (the R code can print other lines)
+const QByteArray STATUS_PREFIX = "@STVI@ ";
+
+// The script run by every R process, it loads the packages and then runs the R files of the
+// jobs read from the standard input (one per line) in new environments
+const char *WORKER_SCRIPT =
+        "status = function(text) {\n"
+        "    cat('@STVI@ ', gsub('[\\r\\n]+', ' ', text), '\\n', sep='')\n"
+        "    flush(stdout())\n"
+        "}\n"
+        "for (package in commandArgs(trailingOnly=TRUE)) {\n"
+        "    tryCatch(suppressMessages(library(package, character.only=TRUE)),\n"
+        "             error=function(e) message('Error loading ', package))\n"
+        "}\n"
+        "status('READY')\n"
+        "input = file('stdin', open='r')\n"
+        "repeat {\n"
+        "    job = readLines(input, n=1, encoding='UTF-8')\n"
+        "    if (length(job) == 0 || job == 'QUIT') break\n"
+        "    result = tryCatch({source(job, local=new.env(), encoding='UTF-8'); 'OK'},\n"
+        "                      error=function(e) paste('ERROR', conditionMessage(e)))\n"
+        "    invisible(gc())\n"
+        "    status(result)\n"
+        "}\n";
+
+RWorkerPool *pool_instance = nullptr;
+
+// The directory of the temporary files of the jobs, it is in shared memory when the system has
+// it (/dev/shm in Linux) so the matrices are exchanged in memory and not written to disk
+QString jobsPath()
+{
+    const QFileInfo shared_memory("/dev/shm");
+    if (shared_memory.isDir() && shared_memory.isWritable()) {
+        return shared_memory.absoluteFilePath();
+    }
+    return QDir::tempPath();
+}
+
+// Writes the memory of a matrix (its values or indexes) to a file as it is
+bool writeMemory(QFile &file, const void *memory, const qint64 size)
+{
+    return size == 0 || file.write(static_cast<const char *>(memory), size) == size;
+}
+
+// The Rscript executable (in R_HOME, in the PATH or in the default R framework of OSX)
+QString rscriptPath()
+{
+    const QString home = QString::fromLocal8Bit(qgetenv("R_HOME"));
+    if (!home.isEmpty()) {
+        const QString path =
+                QStandardPaths::findExecutable("Rscript", QStringList() << home + "/bin");
+        if (!path.isEmpty()) {
+            return path;
+        }
+    }
+    const QString path = QStandardPaths::findExecutable("Rscript");
+    if (!path.isEmpty()) {
+        return path;
+    }
+    const QString framework = QStandardPaths::findExecutable(
+            "Rscript", QStringList() << "/Library/Frameworks/R.framework/Resources/bin");
+    return framework.isEmpty() ? QString("Rscript") : framework;
+}
+
+// A path as an R string
+std::string quoted(const QString &path)
+{
+    QString escaped = path;
+    escaped.replace("\\", "\\\\").replace("'", "\\'");
+    return "'" + escaped.toStdString() + "'";
+}
+}
+
+class RWorkerPool::Worker : public QThread
+{
+
+public:
+
+    Worker(RWorkerPool &pool, const QString &script)
+        : m_pool(pool)
+        , m_script(script)
+    {
+    }
+
+protected:
+
+    void run() override
+    {
+        QProcess process;
+        // the messages of R (the packages are verbose) are not needed
+        process.setStandardErrorFile(QProcess::nullDevice());
+        QString error;
+        const bool ready = startProcess(process, error);
+        m_pool.workerStarted(ready, error);
+        while (Job *job = m_pool.takeJob()) {
+            // the R process is started again if it stopped (R crashed in the last job)
+            if (process.state() == QProcess::NotRunning && !startProcess(process, error)) {
+                m_pool.finishJob(job, error);
+                continue;
+            }
+            m_pool.finishJob(job, runJob(process, *job));
+        }
+        if (process.state() != QProcess::NotRunning) {
+            process.write("QUIT\n");
+            if (!process.waitForFinished(PROCESS_TIMEOUT)) {
+                process.kill();
+                process.waitForFinished();
+            }
+        }
+    }
+
+private:
+
+    bool startProcess(QProcess &process, QString &error)
+    {
+        process.start(rscriptPath(), QStringList() << m_script << R_PACKAGES);
+        if (!process.waitForStarted(PROCESS_TIMEOUT)) {
+            error = QString("Could not start R (%1)").arg(process.errorString());
+            return false;
+        }
+        QString status;
+        if (!readStatus(process, status) || status != "READY") {
+            error = QString("R stopped before loading the R packages");
+            process.kill();
+            process.waitForFinished();
+            return false;
+        }
+        return true;
+    }
+
+    // reads the lines of the R process until its next status (false if the R process
+    // stopped or the pool is stopped, then the R process is not waited for)
+    bool readStatus(QProcess &process, QString &status)
+    {
+        while (true) {
+            while (!process.canReadLine()) {
+                if (!process.waitForReadyRead(POLL_INTERVAL)
+                        && (process.state() == QProcess::NotRunning || m_pool.isStopped())) {
+                    return false;
+                }
+            }
+            const QByteArray line = process.readLine().trimmed();
+            if (line.startsWith(STATUS_PREFIX)) {
+                status = QString::fromUtf8(line.mid(STATUS_PREFIX.size()));
+                return true;
+            }
+            qDebug() << "[R]" << line;
+        }
+    }
+
+    // runs the job and returns its error (empty if it succeeded)
+    QString runJob(QProcess &process, const Job &job)
+    {
+        process.write(job.scriptPath().toUtf8() + "\n");
+        process.waitForBytesWritten(PROCESS_TIMEOUT);
+        QString status;
+        if (!readStatus(process, status)) {
+            return QString("R stopped running the job");
+        }
+        if (status != "OK") {
+            return status;
+        }
+        return QString();
+    }
+
+    RWorkerPool &m_pool;
+    const QString m_script;
+};
+
+RWorkerPool::Job::Job(const std::string &script)
+    : m_dir(jobsPath() + "/stvi-job-XXXXXX")
+    , m_script(script)
+    , m_inputs()
+    , m_outputs()
+    , m_error()
+    , m_finished(false)
+{
+}
+
+RWorkerPool::Job::~Job()
+{
+}
+
+void RWorkerPool::Job::setMatrix(const std::string &name, const mat &values)
+{
+    const QString filename = path(name, "bin");
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            || !writeMemory(file, values.memptr(), values.n_elem * sizeof(double))) {
+        m_error = QString("Could not write the matrix %1").arg(QString::fromStdString(name));
+        return;
+    }
+    m_inputs += name + " = matrix(readBin(" + quoted(filename) + ", 'double', n="
+            + std::to_string(values.n_elem) + "), nrow=" + std::to_string(values.n_rows)
+            + ", ncol=" + std::to_string(values.n_cols) + ");\n";
+}
+
+void RWorkerPool::Job::setMatrix(const std::string &name, const sp_mat &values)
+{
+    // the compressed columns are written as they are and they are the slots of a dgCMatrix
+    // (the indexes are read by R as integers of the size of uword)
+    values.sync();
+    const QString filename = path(name, "bin");
+    QFile file(filename);
+    const qint64 index_size = sizeof(uword);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            || !writeMemory(file, values.col_ptrs, (values.n_cols + 1) * index_size)
+            || !writeMemory(file, values.row_indices, values.n_nonzero * index_size)
+            || !writeMemory(file, values.values, values.n_nonzero * sizeof(double))) {
+        m_error = QString("Could not write the matrix %1").arg(QString::fromStdString(name));
+        return;
+    }
+    const std::string size = std::to_string(index_size);
+    const std::string nonzeros = std::to_string(values.n_nonzero);
+    m_inputs += name + " = local({"
+            "input = file(" + quoted(filename) + ", 'rb'); on.exit(close(input));"
+            "p = readBin(input, 'integer', n=" + std::to_string(values.n_cols + 1)
+            + ", size=" + size + ");"
+            "i = readBin(input, 'integer', n=" + nonzeros + ", size=" + size + ");"
+            "x = readBin(input, 'double', n=" + nonzeros + ");"
+            "new('dgCMatrix', i=i, p=p, x=x, Dim=c(" + std::to_string(values.n_rows) + "L, "
+            + std::to_string(values.n_cols) + "L))});\n";
+}
+
+void RWorkerPool::Job::setStrings(const std::string &name,
+                                  const std::vector<std::string> &values)
+{
+    const QString filename = path(name, "txt");
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        m_error = QString("Could not write the strings %1").arg(QString::fromStdString(name));
+        return;
+    }
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+    for (const auto &value : values) {
+        stream << QString::fromStdString(value) << "\n";
+    }
+    m_inputs += name + " = readLines(" + quoted(filename) + ", encoding='UTF-8');\n";
+}
+
+void RWorkerPool::Job::addMatrixOutput(const std::string &name, const std::string &expression)
+{
+    m_outputs += ".output = as.matrix(" + expression + ");\n"
+                 "storage.mode(.output) = 'double';\n"
+                 "writeLines(as.character(dim(.output)), " + quoted(path(name, "dim")) + ");\n"
+                 "writeBin(as.vector(.output), " + quoted(path(name, "bin")) + ");\n";
+}
+
+void RWorkerPool::Job::addStringsOutput(const std::string &name, const std::string &expression)
+{
+    m_outputs += "writeLines(enc2utf8(as.character(" + expression + ")), "
+            + quoted(path(name, "txt")) + ", useBytes=TRUE);\n";
+}
+
+mat RWorkerPool::Job::matrix(const std::string &name) const
+{
+    QFile dimensions(path(name, "dim"));
+    if (!m_finished || !m_error.isEmpty() || !dimensions.open(QIODevice::ReadOnly)) {
+        return mat();
+    }
+    const uword rows = dimensions.readLine().trimmed().toULongLong();
+    const uword cols = dimensions.readLine().trimmed().toULongLong();
+    if (rows * cols == 0) {
+        return mat(rows, cols);
+    }
+    // the values are copied once from the memory of the file
+    QFile file(path(name, "bin"));
+    const qint64 size = rows * cols * sizeof(double);
+    uchar *memory = file.open(QIODevice::ReadOnly) && file.size() == size
+            ? file.map(0, size) : nullptr;
+    if (memory == nullptr) {
+        qDebug() << "Error reading the R matrix" << QString::fromStdString(name);
+        return mat();
+    }
+    const mat values(reinterpret_cast<const double *>(memory), rows, cols);
+    file.unmap(memory);
+    return values;
+}
+
+std::vector<std::string> RWorkerPool::Job::strings(const std::string &name) const
+{
+    std::vector<std::string> values;
+    QFile file(path(name, "txt"));
+    if (!m_finished || !m_error.isEmpty() || !file.open(QIODevice::ReadOnly)) {
+        return values;
+    }
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+    while (!stream.atEnd()) {
+        values.push_back(stream.readLine().toStdString());
+    }
+    return values;
+}
+
+const QString &RWorkerPool::Job::error() const
+{
+    return m_error;
+}
+
+QString RWorkerPool::Job::path(const std::string &name, const QString &extension) const
+{
+    return m_dir.filePath(QString::fromStdString(name) + "." + extension);
+}
+
+QString RWorkerPool::Job::scriptPath() const
+{
+    return m_dir.filePath("job.R");
+}
+
+bool RWorkerPool::Job::writeScript()
+{
+    QFile file(scriptPath());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    const std::string script = m_inputs + m_script + "\n" + m_outputs;
+    return file.write(script.data(), script.size()) == static_cast<qint64>(script.size());
+}
+
+RWorkerPool::RWorkerPool(const unsigned workers, QObject *parent)
+    : QObject(parent)
+    , m_dir(QDir::tempPath() + "/stvi-r-XXXXXX")
+    , m_n_workers(workers)
+    , m_workers()
+    , m_state(RWorkerPool::NotStarted)
+    , m_n_started(0)
+    , m_n_ready(0)
+    , m_error()
+    , m_stopped(false)
+{
+    if (m_n_workers == 0) {
+        // leave some cores for the computations of the viewer
+        m_n_workers = std::max(1, std::min(MAX_WORKERS, QThread::idealThreadCount() / 2));
+    }
+    pool_instance = this;
+}
+
+RWorkerPool::~RWorkerPool()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopped = true;
+        m_job_available.wakeAll();
+    }
+    for (auto &worker : m_workers) {
+        worker->wait();
+    }
+    if (pool_instance == this) {
+        pool_instance = nullptr;
+    }
+}
+
+RWorkerPool *RWorkerPool::instancePtr()
+{
+    return pool_instance;
+}
+
+RWorkerPool::State RWorkerPool::state() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_state;
+}
+
+QString RWorkerPool::error() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_error;
+}
+
+void RWorkerPool::start()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_state != RWorkerPool::NotStarted || m_stopped) {
+            return;
+        }
+        const QString script = m_dir.filePath("worker.R");
+        QFile file(script);
+        if (m_dir.isValid() && file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+                && file.write(WORKER_SCRIPT) >= 0) {
+            file.close();
+            m_state = RWorkerPool::Starting;
+            for (unsigned i = 0; i < m_n_workers; ++i) {
+                m_workers.emplace_back(new Worker(*this, script));
+                m_workers.back()->start();
+            }
+            qDebug() << "Starting" << m_n_workers << "R workers";
+        } else {
+            m_state = RWorkerPool::Failed;
+            m_error = QString("Could not write the R script of the workers");
+        }
+    }
+    emit stateChanged();
+}
+
+bool RWorkerPool::run(Job &job)
+{
+    if (!job.m_error.isEmpty()) {
+        qDebug() << "Error preparing the R job" << job.m_error;
+        return false;
+    }
+    if (!job.m_dir.isValid() || !job.writeScript()) {
+        job.m_error = QString("Could not write the R script of the job");
+        return false;
+    }
+    // R is started by the first job if it was not started yet
+    start();
+    QMutexLocker locker(&m_mutex);
+    if (m_workers.empty() || m_stopped) {
+        job.m_error = m_error.isEmpty() ? QString("The R workers are stopped") : m_error;
+        return false;
+    }
+    job.m_finished = false;
+    m_jobs.enqueue(&job);
+    m_job_available.wakeOne();
+    while (!job.m_finished) {
+        m_job_finished.wait(&m_mutex);
+    }
+    if (!job.m_error.isEmpty()) {
+        qDebug() << "Error running the R job" << job.m_error;
+    }
+    return job.m_error.isEmpty();
+}
+
+RWorkerPool::Job *RWorkerPool::takeJob()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_jobs.isEmpty() && !m_stopped) {
+        m_job_available.wait(&m_mutex);
+    }
+    return m_jobs.isEmpty() ? nullptr : m_jobs.dequeue();
+}
+
+void RWorkerPool::finishJob(Job *job, const QString &error)
+{
+    QMutexLocker locker(&m_mutex);
+    job->m_error = error;
+    job->m_finished = true;
+    m_job_finished.wakeAll();
+}
+
+void RWorkerPool::workerStarted(const bool ready, const QString &error)
+{
+    bool changed = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        ++m_n_started;
+        if (ready) {
+            ++m_n_ready;
+        } else {
+            m_error = error;
+        }
+        // the pool is ready with the first R process
+        if (ready && m_state == RWorkerPool::Starting) {
+            m_state = RWorkerPool::Ready;
+            changed = true;
+        } else if (m_n_started == m_n_workers && m_n_ready == 0) {
+            m_state = RWorkerPool::Failed;
+            changed = true;
+        }
+    }
+    if (changed) {
+        qDebug() << "R workers started, ready" << ready << error;
+        emit stateChanged();
+    }
+}
+
+bool RWorkerPool::isStopped() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_stopped;
+}
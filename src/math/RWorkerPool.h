@@ -0,0 +1,148 @@
+#ifndef RWORKERPOOL_H
+#define RWORKERPOOL_H
+
+#include <QObject>
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+#include <QTemporaryDir>
+#include <QWaitCondition>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <armadillo>
+
+using namespace arma;
+
+// RWorkerPool runs R code in a pool of persistent R processes (Rscript) behind a job queue.
+// R is single threaded so an embedded R interpreter can only be used by one thread at a time,
+// instead every worker is an R process that loads the R packages once when it starts and
+// runs one job at a time, so the analyses of different threads run concurrently.
+// The inputs and outputs of the jobs (matrices and strings) are exchanged with temporary
+// binary files (in shared memory when possible) that have the memory of the Armadillo
+// matrices as it is. There is one pool in the application (created in main()), it is started
+// in the background once the viewer is shown (or by the first job) so the viewer does not
+// wait for R to start
+class RWorkerPool : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    enum State {
+        NotStarted = 1,
+        // the R processes are loading the R packages
+        Starting = 2,
+        // at least one R process can run jobs
+        Ready = 3,
+        // no R process could be started
+        Failed = 4
+    };
+
+    // A job is an R script, the inputs are assigned to R variables before the script and the
+    // outputs are R expressions evaluated after the script (every job runs in a new R
+    // environment so the jobs do not share variables)
+    class Job
+    {
+
+    public:
+
+        explicit Job(const std::string &script);
+        ~Job();
+
+        // the inputs are written to the temporary directory of the job, the sparse matrices
+        // are dgCMatrix in R (they are never dense)
+        void setMatrix(const std::string &name, const mat &values);
+        void setMatrix(const std::string &name, const sp_mat &values);
+        void setStrings(const std::string &name, const std::vector<std::string> &values);
+
+        // the outputs are converted to a numeric matrix or to strings
+        void addMatrixOutput(const std::string &name, const std::string &expression);
+        void addStringsOutput(const std::string &name, const std::string &expression);
+
+        // the outputs once the job has run (empty if the job failed)
+        mat matrix(const std::string &name) const;
+        std::vector<std::string> strings(const std::string &name) const;
+
+        // the error of the job (empty if the job succeeded)
+        const QString &error() const;
+
+    private:
+
+        // the file of a variable in the temporary directory of the job
+        QString path(const std::string &name, const QString &extension) const;
+        // the R file with the inputs, the script and the outputs (run by a worker)
+        QString scriptPath() const;
+        bool writeScript();
+
+        QTemporaryDir m_dir;
+        std::string m_script;
+        std::string m_inputs;
+        std::string m_outputs;
+        QString m_error;
+        bool m_finished;
+
+        friend class RWorkerPool;
+
+        Q_DISABLE_COPY(Job)
+    };
+
+    // workers is the number of R processes (0 to choose it from the number of cores)
+    explicit RWorkerPool(const unsigned workers = 0, QObject *parent = nullptr);
+    virtual ~RWorkerPool();
+
+    // The pool of the application (nullptr if it has not been created)
+    static RWorkerPool *instancePtr();
+
+    State state() const;
+    // the error of the R processes that could not be started
+    QString error() const;
+
+    // Runs the job in the first free R process and waits until it has finished (it must be
+    // called from a computational thread), it returns false if the job failed. The pool is
+    // started if it was not
+    bool run(Job &job);
+
+public slots:
+
+    // Starts the R processes in the background (it returns at once)
+    void start();
+
+signals:
+
+    // the state has changed (it is emitted from the threads of the workers)
+    void stateChanged();
+
+private:
+
+    // The thread of a worker, it owns its R process
+    class Worker;
+
+    // the next job of the queue for a worker (nullptr when the pool is stopped)
+    Job *takeJob();
+    void finishJob(Job *job, const QString &error);
+    void workerStarted(const bool ready, const QString &error);
+    bool isStopped() const;
+
+    // the temporary directory of the script of the workers
+    QTemporaryDir m_dir;
+    unsigned m_n_workers;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    // the queue of jobs and the state of the workers (guarded by the mutex)
+    mutable QMutex m_mutex;
+    QWaitCondition m_job_available;
+    QWaitCondition m_job_finished;
+    QQueue<Job *> m_jobs;
+    State m_state;
+    unsigned m_n_started;
+    unsigned m_n_ready;
+    QString m_error;
+    bool m_stopped;
+
+    Q_DISABLE_COPY(RWorkerPool)
+};
+
+#endif // RWORKERPOOL_H
@@ -0,0 +1,453 @@
+#include "SizeFactors.h"
+
+#include <QDebug>
+#include <QtConcurrent>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "math/RInterface.h"
+
+namespace
+{
+
+// The weight of the equations of the individual spots in the scran linear system
+// (they only make the system solvable, the pools determine the factors)
+const double SCRAN_SPOT_WEIGHT = 0.000001;
+
+// Returns the median of the values (the order of the values is changed)
+double median(std::vector<double> &values)
+{
+    if (values.empty()) {
+        return datum::nan;
+    }
+    const size_t half = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + half, values.end());
+    const double upper = values[half];
+    if (values.size() % 2 == 1) {
+        return upper;
+    }
+    const double lower = *std::max_element(values.begin(), values.begin() + half);
+    return (lower + upper) / 2.0;
+}
+
+// Replaces the factors that cannot be used (not finite, zero or negative) by 1
+void sanitize(rowvec &factors, const QString &method)
+{
+    const uword n_invalid = std::count_if(factors.begin(), factors.end(), [](const double f) {
+        return !std::isfinite(f) || f <= 0;
+    });
+    if (n_invalid > 0) {
+        qDebug() << "Computed" << method << "factors has" << n_invalid
+                 << "non finite, zero or negative elements";
+        factors.transform([](const double f) { return std::isfinite(f) && f > 0 ? f : 1.0; });
+    }
+}
+
+// Sums the values of the pools of the given size that start at each position of the ring
+void poolSums(const vec &values, const uword size, vec &sums)
+{
+    const uword n = values.n_elem;
+    double sum = 0.0;
+    for (uword t = 0; t < size; ++t) {
+        sum += values[t % n];
+    }
+    sums[0] = sum;
+    for (uword k = 1; k < n; ++k) {
+        sum += values[(k + size - 1) % n] - values[k - 1];
+        sums[k] = sum;
+    }
+}
+
+// Adds to each position of the ring the values of the pools of the given size that
+// contain it (the pools that start at the previous positions)
+void addToPools(const vec &sums, const uword size, vec &out)
+{
+    const uword n = sums.n_elem;
+    double sum = 0.0;
+    for (uword t = 0; t < size; ++t) {
+        sum += sums[(n - t) % n];
+    }
+    out[0] += sum;
+    for (uword p = 1; p < n; ++p) {
+        sum += sums[p] - sums[(p + n - size) % n];
+        out[p] += sum;
+    }
+}
+
+// A range of pools of one size to be computed in one thread
+struct PoolTask {
+    uword size_index;
+    uword begin;
+    uword end;
+};
+
+// Adds the column of the expression (genes x spots) multiplied by weight to the pool
+void addColumn(const mat &expression, const uword column, const double weight, vec &pool)
+{
+    pool += weight * expression.col(column);
+}
+
+// The same with sparse expression (only the values of the compressed column are added)
+void addColumn(const sp_mat &expression, const uword column, const double weight, vec &pool)
+{
+    for (uword k = expression.col_ptrs[column]; k < expression.col_ptrs[column + 1]; ++k) {
+        pool[expression.row_indices[k]] += weight * expression.values[k];
+    }
+}
+
+// Copies the column of the expression (genes x spots) to values
+void columnValues(const mat &expression, const uword column, std::vector<double> &values)
+{
+    std::copy(expression.colptr(column), expression.colptr(column) + expression.n_rows,
+              values.begin());
+}
+
+// The same with sparse expression
+void columnValues(const sp_mat &expression, const uword column, std::vector<double> &values)
+{
+    std::fill(values.begin(), values.end(), 0.0);
+    for (uword k = expression.col_ptrs[column]; k < expression.col_ptrs[column + 1]; ++k) {
+        values[expression.row_indices[k]] = expression.values[k];
+    }
+}
+
+// The spots with counts (the rest have factor 1), their library sizes, the pool sizes
+// (the same that are used with the R implementation) and the order of the spots in a
+// ring by library size (increasing sizes in the even positions and decreasing sizes in
+// the odd positions) so that every pool contains spots with similar library sizes
+struct ScranPools {
+    uvec spots;
+    colvec lib_sizes;
+    std::vector<uword> sizes;
+    std::vector<uword> ring;
+};
+
+ScranPools scranPools(const colvec &all_lib_sizes)
+{
+    ScranPools pools;
+    pools.spots = find(all_lib_sizes > 0);
+    pools.lib_sizes = all_lib_sizes.elem(pools.spots);
+    const uword n = pools.spots.n_elem;
+    for (double size = std::min(n / 4.0, 10.0); size <= std::min(n / 2.0, 50.0); size += 10) {
+        const uword pool_size = static_cast<uword>(size);
+        if (pool_size > 0
+                && std::find(pools.sizes.begin(), pools.sizes.end(), pool_size)
+                == pools.sizes.end()) {
+            pools.sizes.push_back(pool_size);
+        }
+    }
+    const uvec order = sort_index(pools.lib_sizes);
+    for (uword k = 0; k < n; k += 2) {
+        pools.ring.push_back(order[k]);
+    }
+    // (the index wraps around when it goes below zero)
+    for (uword k = n - (n % 2 == 0 ? 1 : 2); k < n; k -= 2) {
+        pools.ring.push_back(order[k]);
+    }
+    return pools;
+}
+
+// Computes the deconvolved factors of the spots of the ring from their expression
+// relative to their library size and to the average spot (genes x spots in the order
+// of the ring)
+template <typename MatType>
+vec deconvolvedFactors(const MatType &expression, const std::vector<uword> &sizes)
+{
+    const uword n = expression.n_cols;
+    const uword n_genes = expression.n_rows;
+
+    // Estimate the factor of every pool (the median of the ratios of the pooled
+    // expression to the average spot), each size and range of pools in one thread
+    const uword n_chunks = std::max(1, QThread::idealThreadCount());
+    const uword chunk_size = (n + n_chunks - 1) / n_chunks;
+    std::vector<PoolTask> tasks;
+    for (uword s = 0; s < sizes.size(); ++s) {
+        for (uword begin = 0; begin < n; begin += chunk_size) {
+            tasks.push_back({s, begin, std::min(n, begin + chunk_size)});
+        }
+    }
+    mat pool_estimates(n, sizes.size());
+    QtConcurrent::blockingMap(tasks, [&](const PoolTask &task) {
+        const uword size = sizes[task.size_index];
+        vec pool(n_genes, fill::zeros);
+        for (uword t = 0; t < size; ++t) {
+            addColumn(expression, (task.begin + t) % n, 1.0, pool);
+        }
+        std::vector<double> ratios(n_genes);
+        for (uword k = task.begin; k < task.end; ++k) {
+            if (k > task.begin) {
+                addColumn(expression, (k + size - 1) % n, 1.0, pool);
+                addColumn(expression, k - 1, -1.0, pool);
+            }
+            std::copy(pool.begin(), pool.end(), ratios.begin());
+            pool_estimates(k, task.size_index) = median(ratios);
+        }
+    });
+
+    // Estimate the factor of every spot on its own
+    vec spot_estimates(n);
+    std::vector<uword> positions(n);
+    std::iota(positions.begin(), positions.end(), 0);
+    QtConcurrent::blockingMap(positions, [&](const uword position) {
+        std::vector<double> ratios(n_genes);
+        columnValues(expression, position, ratios);
+        spot_estimates[position] = median(ratios);
+    });
+
+    // Solve the least squares system where the sum of the factors of the spots of
+    // each pool is the estimate of the pool. The normal equations of the system
+    // are circulant (pools wrap around the ring) so they are solved with FFTs
+    vec rhs = SCRAN_SPOT_WEIGHT * spot_estimates;
+    vec system(n, fill::zeros);
+    vec unit(n, fill::zeros);
+    unit[0] = 1.0;
+    system[0] = SCRAN_SPOT_WEIGHT;
+    vec sums(n);
+    for (uword s = 0; s < sizes.size(); ++s) {
+        addToPools(pool_estimates.col(s), sizes[s], rhs);
+        poolSums(unit, sizes[s], sums);
+        addToPools(sums, sizes[s], system);
+    }
+    return real(ifft(cx_vec(fft(rhs) / fft(system))));
+}
+
+// The factors of the spots are the deconvolved factors scaled by the library sizes
+// (centered to have mean 1)
+void scaleFactors(const vec &theta, const ScranPools &pools, rowvec &factors)
+{
+    vec spot_factors(pools.ring.size());
+    for (uword r = 0; r < pools.ring.size(); ++r) {
+        spot_factors[pools.ring[r]] = theta[r] * pools.lib_sizes[pools.ring[r]];
+    }
+    spot_factors /= mean(spot_factors);
+    factors.elem(pools.spots) = spot_factors;
+}
+}
+
+namespace SizeFactors
+{
+
+rowvec computeDESeqFactors(const mat &counts, const Backend backend)
+{
+    if (backend == R) {
+        return RInterface::computeDESeqFactors(sp_mat(counts));
+    }
+
+    const uword n_spots = counts.n_rows;
+    const uword n_genes = counts.n_cols;
+    rowvec factors(n_spots, fill::ones);
+    if (n_spots == 0 || n_genes == 0) {
+        return factors;
+    }
+
+    // Log geometric mean of each gene (only the genes with counts in every spot are used)
+    std::vector<uword> genes(n_genes);
+    std::iota(genes.begin(), genes.end(), 0);
+    std::vector<double> log_means(n_genes, 0.0);
+    std::vector<char> present(n_genes, false);
+    QtConcurrent::blockingMap(genes, [&](const uword gene) {
+        const double *values = counts.colptr(gene);
+        double sum = 0.0;
+        for (uword i = 0; i < n_spots; ++i) {
+            if (!(values[i] > 0)) {
+                return;
+            }
+            sum += std::log(values[i]);
+        }
+        log_means[gene] = sum / n_spots;
+        present[gene] = true;
+    });
+    std::vector<uword> to_keep_genes;
+    for (uword j = 0; j < n_genes; ++j) {
+        if (present[j]) {
+            to_keep_genes.push_back(j);
+        }
+    }
+    if (to_keep_genes.empty()) {
+        qDebug() << "No genes are present in every spot to compute DESeq2 factors";
+        return factors;
+    }
+
+    // The factor of each spot is the median of the ratios to the geometric means
+    // (the counts are transposed so the genes of each spot are contiguous)
+    const mat spot_counts = counts.cols(uvec(to_keep_genes)).t();
+    std::vector<uword> spots(n_spots);
+    std::iota(spots.begin(), spots.end(), 0);
+    QtConcurrent::blockingMap(spots, [&](const uword spot) {
+        const double *values = spot_counts.colptr(spot);
+        std::vector<double> ratios(to_keep_genes.size());
+        for (uword k = 0; k < ratios.size(); ++k) {
+            ratios[k] = std::log(values[k]) - log_means[to_keep_genes[k]];
+        }
+        factors[spot] = std::exp(median(ratios));
+    });
+
+    sanitize(factors, "DESeq2");
+    qDebug() << "Computed DESeq2 size factors " << factors.size();
+    return factors;
+}
+
+rowvec computeDESeqFactors(const sp_mat &counts, const Backend backend)
+{
+    if (backend == R) {
+        return RInterface::computeDESeqFactors(counts);
+    }
+
+    // Only the genes present in every spot are used (they have a value in every row of
+    // their compressed column) so only those are made dense
+    counts.sync();
+    std::vector<uword> present_genes;
+    for (uword j = 0; j < counts.n_cols; ++j) {
+        const uword first = counts.col_ptrs[j];
+        const uword last = counts.col_ptrs[j + 1];
+        if (last - first == counts.n_rows
+                && std::all_of(counts.values + first, counts.values + last,
+                               [](const double value) { return value > 0; })) {
+            present_genes.push_back(j);
+        }
+    }
+    if (present_genes.empty()) {
+        if (counts.n_rows > 0 && counts.n_cols > 0) {
+            qDebug() << "No genes are present in every spot to compute DESeq2 factors";
+        }
+        return rowvec(counts.n_rows, fill::ones);
+    }
+    // (the values of a full compressed column are the values of the rows in order)
+    mat present_counts(counts.n_rows, present_genes.size());
+    for (uword c = 0; c < present_genes.size(); ++c) {
+        const uword first = counts.col_ptrs[present_genes[c]];
+        std::copy(counts.values + first, counts.values + first + counts.n_rows,
+                  present_counts.colptr(c));
+    }
+    return computeDESeqFactors(present_counts, Native);
+}
+
+rowvec computeScranFactors(const mat &counts, const Backend backend)
+{
+    if (backend == R) {
+        return RInterface::computeScranFactors(sp_mat(counts), true);
+    }
+
+    rowvec factors(counts.n_rows, fill::ones);
+    if (counts.n_rows == 0 || counts.n_cols == 0) {
+        return factors;
+    }
+    const colvec all_lib_sizes = sum(counts, 1);
+    const ScranPools pools = scranPools(all_lib_sizes);
+    if (pools.spots.is_empty()) {
+        return factors;
+    }
+
+    // Expression of each spot relative to its library size and to the average spot
+    // (genes are rows so the genes of each spot are contiguous)
+    mat expression = counts.rows(pools.spots).t();
+    expression.each_row() /= pools.lib_sizes.t();
+    const colvec average = mean(expression, 1);
+    expression = expression.rows(find(average > 0));
+    expression.each_col() /= average.elem(find(average > 0));
+
+    // Not enough spots or genes to make pools, library sizes are used instead
+    if (pools.sizes.empty() || expression.n_rows == 0) {
+        qDebug() << "Not enough spots or genes to compute SCRAN factors";
+        factors.elem(pools.spots) = pools.lib_sizes / mean(pools.lib_sizes);
+        return factors;
+    }
+
+    expression = expression.cols(uvec(pools.ring));
+    scaleFactors(deconvolvedFactors(expression, pools.sizes), pools, factors);
+
+    sanitize(factors, "SCRAN");
+    qDebug() << "Computed SCRAN size factors " << factors.size();
+    return factors;
+}
+
+rowvec computeScranFactors(const sp_mat &counts, const Backend backend)
+{
+    if (backend == R) {
+        return RInterface::computeScranFactors(counts, true);
+    }
+
+    const uword n_spots = counts.n_rows;
+    rowvec factors(n_spots, fill::ones);
+    if (n_spots == 0 || counts.n_cols == 0) {
+        return factors;
+    }
+
+    // The library sizes are the sums of the rows of the compressed columns
+    counts.sync();
+    colvec all_lib_sizes(n_spots, fill::zeros);
+    for (uword k = 0; k < counts.n_nonzero; ++k) {
+        all_lib_sizes[counts.row_indices[k]] += counts.values[k];
+    }
+    const ScranPools pools = scranPools(all_lib_sizes);
+    const uword n = pools.spots.n_elem;
+    if (n == 0) {
+        return factors;
+    }
+
+    // The position of every spot in the ring (n for the spots without counts)
+    std::vector<uword> ring_positions(n_spots, n);
+    for (uword r = 0; r < n; ++r) {
+        ring_positions[pools.spots[pools.ring[r]]] = r;
+    }
+
+    // Average expression of every gene relative to the library sizes (the genes are
+    // the compressed columns)
+    std::vector<double> averages(counts.n_cols, 0.0);
+    std::vector<uword> gene_rows(counts.n_cols, 0);
+    uword n_genes = 0;
+    uword n_values = 0;
+    for (uword j = 0; j < counts.n_cols; ++j) {
+        for (uword k = counts.col_ptrs[j]; k < counts.col_ptrs[j + 1]; ++k) {
+            const uword spot = counts.row_indices[k];
+            if (ring_positions[spot] < n) {
+                averages[j] += counts.values[k] / all_lib_sizes[spot];
+                ++n_values;
+            }
+        }
+        averages[j] /= n;
+        if (averages[j] > 0) {
+            gene_rows[j] = n_genes++;
+        }
+    }
+
+    // Not enough spots or genes to make pools, library sizes are used instead
+    if (pools.sizes.empty() || n_genes == 0) {
+        qDebug() << "Not enough spots or genes to compute SCRAN factors";
+        factors.elem(pools.spots) = pools.lib_sizes / mean(pools.lib_sizes);
+        return factors;
+    }
+
+    // Expression of each spot relative to its library size and to the average spot
+    // (genes x spots in the order of the ring, the spots are the compressed columns)
+    umat locations(2, n_values);
+    vec values(n_values);
+    uword e = 0;
+    for (uword j = 0; j < counts.n_cols; ++j) {
+        if (!(averages[j] > 0)) {
+            continue;
+        }
+        for (uword k = counts.col_ptrs[j]; k < counts.col_ptrs[j + 1]; ++k) {
+            const uword spot = counts.row_indices[k];
+            if (ring_positions[spot] < n) {
+                locations(0, e) = gene_rows[j];
+                locations(1, e) = ring_positions[spot];
+                values[e] = counts.values[k] / all_lib_sizes[spot] / averages[j];
+                ++e;
+            }
+        }
+    }
+    locations.resize(2, e);
+    values.resize(e);
+    const sp_mat expression(locations, values, n_genes, n);
+    expression.sync();
+    scaleFactors(deconvolvedFactors(expression, pools.sizes), pools, factors);
+
+    sanitize(factors, "SCRAN");
+    qDebug() << "Computed SCRAN size factors " << factors.size();
+    return factors;
+}
+}
@@ -0,0 +1,37 @@
+#ifndef SIZEFACTORS_H
+#define SIZEFACTORS_H
+
+#include <armadillo>
+
+using namespace arma;
+
+// SizeFactors computes normalization factors (one per spot) natively
+// with the methods of DESeq2 and scran. The counts are given with the spots as
+// rows and the genes as columns and the work is split in several threads.
+// The R implementations (RInterface) can still be used to validate the results.
+namespace SizeFactors
+{
+
+// The implementation used to compute the factors
+enum Backend {
+    Native = 1,
+    R = 2
+};
+
+// Computes size factors with the median of ratios method of DESeq2
+// (estimateSizeFactorsForMatrix). Only the genes present in every spot are used.
+rowvec computeDESeqFactors(const mat &counts, const Backend backend = Native);
+
+// The same with sparse counts (only the genes present in every spot are made dense)
+rowvec computeDESeqFactors(const sp_mat &counts, const Backend backend = Native);
+
+// Computes size factors with the pooling and deconvolution method of scran
+// (computeSumFactors with pools of 10 to 50 spots). The native implementation
+// does not pre-cluster the spots. The factors are centered to have mean 1.
+rowvec computeScranFactors(const mat &counts, const Backend backend = Native);
+
+// The same with sparse counts (the relative expression of the spots is kept sparse)
+rowvec computeScranFactors(const sp_mat &counts, const Backend backend = Native);
+}
+
+#endif // SIZEFACTORS_H
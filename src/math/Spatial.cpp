@@ -0,0 +1,287 @@
+#include "Spatial.h"
+
+#include <QDebug>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "math/DEA.h"
+#include "math/Neighbors.h"
+
+namespace
+{
+
+// The genes visited by every thread at once (they share the buffer of normalized counts)
+const uword GENES_PER_BLOCK = 64;
+// The minimum variance of a tested gene (constant genes have rounding errors)
+const double MIN_VARIANCE = 1e-12;
+
+// The names of the columns of the results
+const std::vector<std::string> COLUMN_NAMES =
+        {"moransI", "moransI_z", "moransI_pvalue", "gearysC", "gearysC_z", "gearysC_pvalue",
+         "padj"};
+
+// The indexes of n elements (to visit them in several threads)
+std::vector<uword> indexes(const uword n)
+{
+    std::vector<uword> elements(n);
+    std::iota(elements.begin(), elements.end(), 0);
+    return elements;
+}
+
+// The upper tail p-value of a standard deviate
+double upperPValue(const double statistic)
+{
+    return 0.5 * std::erfc(statistic / std::sqrt(2.0));
+}
+
+// The cell of a coordinate in a grid that starts at minimum
+uword gridCell(const double coordinate, const double minimum, const double size)
+{
+    return static_cast<uword>(std::floor((coordinate - minimum) / size));
+}
+}
+
+namespace Spatial
+{
+
+sp_mat radiusGraph(const mat &coordinates, const double radius)
+{
+    const uword n_spots = coordinates.n_rows;
+    if (n_spots == 0 || coordinates.n_cols != 2 || !(radius > 0)) {
+        qDebug() << "Error computing the spatial graph, invalid coordinates or radius";
+        return sp_mat(n_spots, n_spots);
+    }
+
+    // the spots are sorted by cell (counting sort), the cells are never smaller than the
+    // radius (the neighbors are in the 9 cells around a spot) and there are not many
+    // more cells than spots
+    const double min_x = coordinates.col(0).min();
+    const double min_y = coordinates.col(1).min();
+    const double width = coordinates.col(0).max() - min_x;
+    const double height = coordinates.col(1).max() - min_y;
+    const double size = std::max(radius, std::max(width, height) / std::sqrt(n_spots));
+    const uword columns = gridCell(min_x + width, min_x, size) + 1;
+    const uword rows = gridCell(min_y + height, min_y, size) + 1;
+    std::vector<uword> spot_cells(n_spots);
+    std::vector<uword> offsets(columns * rows + 1, 0);
+    for (uword i = 0; i < n_spots; ++i) {
+        spot_cells[i] = gridCell(coordinates(i, 1), min_y, size) * columns
+                + gridCell(coordinates(i, 0), min_x, size);
+        ++offsets[spot_cells[i] + 1];
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<uword> positions(offsets.begin(), offsets.end() - 1);
+    std::vector<uword> grid(n_spots);
+    for (uword i = 0; i < n_spots; ++i) {
+        grid[positions[spot_cells[i]]++] = i;
+    }
+
+    // the neighbors of every spot
+    std::vector<std::vector<uword>> neighbors(n_spots);
+    std::vector<uword> spots = indexes(n_spots);
+    QtConcurrent::blockingMap(spots, [&](const uword i) {
+        const uword column = spot_cells[i] % columns;
+        const uword row = spot_cells[i] / columns;
+        for (uword r = row > 0 ? row - 1 : 0; r <= std::min(row + 1, rows - 1); ++r) {
+            for (uword c = column > 0 ? column - 1 : 0; c <= std::min(column + 1, columns - 1);
+                 ++c) {
+                const uword cell = r * columns + c;
+                for (uword k = offsets[cell]; k < offsets[cell + 1]; ++k) {
+                    const uword j = grid[k];
+                    const double dx = coordinates(i, 0) - coordinates(j, 0);
+                    const double dy = coordinates(i, 1) - coordinates(j, 1);
+                    if (j != i && dx * dx + dy * dy <= radius * radius) {
+                        neighbors[i].push_back(j);
+                    }
+                }
+            }
+        }
+    });
+
+    uword n_edges = 0;
+    for (const auto &spot_neighbors : neighbors) {
+        n_edges += spot_neighbors.size();
+    }
+    umat locations(2, n_edges);
+    uword edge = 0;
+    for (uword i = 0; i < n_spots; ++i) {
+        for (const uword j : neighbors[i]) {
+            locations(0, edge) = j;
+            locations(1, edge) = i;
+            ++edge;
+        }
+    }
+    return sp_mat(locations, vec(n_edges, fill::ones), n_spots, n_spots);
+}
+
+sp_mat nearestNeighborsGraph(const mat &coordinates, const uword k)
+{
+    const uword n_spots = coordinates.n_rows;
+    if (n_spots < 2 || k == 0) {
+        return sp_mat(n_spots, n_spots);
+    }
+    const uword n_neighbors = std::min(k, n_spots - 1);
+    umat indices;
+    mat distances;
+    Neighbors::nearestNeighbors(coordinates, n_neighbors, indices, distances);
+    umat locations(2, indices.n_elem);
+    for (uword i = 0; i < n_spots; ++i) {
+        for (uword r = 0; r < n_neighbors; ++r) {
+            locations(0, i * n_neighbors + r) = indices(r, i);
+            locations(1, i * n_neighbors + r) = i;
+        }
+    }
+    const sp_mat graph(locations, vec(indices.n_elem, fill::ones), n_spots, n_spots);
+    return spones(graph + graph.t());
+}
+
+void computeSpatialGenes(const sp_mat &counts,
+                         const std::vector<std::string> &genes,
+                         const sp_mat &weights,
+                         mat &results,
+                         std::vector<std::string> &rows,
+                         std::vector<std::string> &cols)
+{
+    results.reset();
+    rows.clear();
+    cols.clear();
+
+    const uword n_spots = counts.n_rows;
+    const uword n_genes = counts.n_cols;
+    if (genes.size() != n_genes || weights.n_rows != n_spots || weights.n_cols != n_spots) {
+        qDebug() << "Error computing spatial genes, the genes or weights do not match the counts";
+        return;
+    }
+    // the variances under randomization need at least 4 spots
+    const double n = n_spots;
+    const double S0 = accu(weights);
+    if (n_spots < 4 || !(S0 > 0)) {
+        qDebug() << "Error computing spatial genes, there are not enough spots or neighbors";
+        return;
+    }
+
+    // the constants of the weights
+    const vec row_sums = mat(sum(weights, 1)).col(0);
+    const vec col_sums = mat(sum(weights, 0)).row(0).t();
+    const double S1 = 0.5 * accu(square(weights + weights.t()));
+    const double S2 = accu(square(row_sums + col_sums));
+    const double expected_I = -1.0 / (n - 1.0);
+
+    // the library size factors
+    const mat library_sizes(sum(counts, 1));
+    vec size_factors = library_sizes.col(0);
+    size_factors /= mean(size_factors.elem(find(size_factors > 0)));
+    size_factors.elem(find(size_factors <= 0)).ones();
+
+    // the statistics of every gene (not tested genes have a NaN p-value)
+    mat values(n_genes, COLUMN_NAMES.size());
+    values.fill(datum::nan);
+    std::vector<uword> blocks = indexes((n_genes + GENES_PER_BLOCK - 1) / GENES_PER_BLOCK);
+    counts.sync();
+    weights.sync();
+    QtConcurrent::blockingMap(blocks, [&](const uword block) {
+        // the log normalized counts of the current gene (only its non zeros are set)
+        vec normalized(n_spots, fill::zeros);
+        const uword last_gene = std::min(n_genes, (block + 1) * GENES_PER_BLOCK);
+        for (uword gene = block * GENES_PER_BLOCK; gene < last_gene; ++gene) {
+            const uword first = counts.col_ptrs[gene];
+            const uword last = counts.col_ptrs[gene + 1];
+            if (first == last) {
+                continue;
+            }
+
+            // the sums (weighted with the sums of the weights) of the non zeros
+            double total = 0.0;
+            double row_total = 0.0;
+            double col_total = 0.0;
+            double row_squares = 0.0;
+            double col_squares = 0.0;
+            for (uword k = first; k < last; ++k) {
+                const uword spot = counts.row_indices[k];
+                const double value = std::log1p(counts.values[k] / size_factors[spot]);
+                normalized[spot] = value;
+                total += value;
+                row_total += row_sums[spot] * value;
+                col_total += col_sums[spot] * value;
+                row_squares += row_sums[spot] * value * value;
+                col_squares += col_sums[spot] * value * value;
+            }
+
+            // x' W x and the central moments (the zeros are added at once)
+            const double mean = total / n;
+            double cross = 0.0;
+            double m2 = (n - (last - first)) * mean * mean;
+            double m4 = m2 * mean * mean;
+            for (uword k = first; k < last; ++k) {
+                const uword spot = counts.row_indices[k];
+                const double value = normalized[spot];
+                for (uword l = weights.col_ptrs[spot]; l < weights.col_ptrs[spot + 1]; ++l) {
+                    cross += value * weights.values[l] * normalized[weights.row_indices[l]];
+                }
+                const double deviation = (value - mean) * (value - mean);
+                m2 += deviation;
+                m4 += deviation * deviation;
+            }
+            for (uword k = first; k < last; ++k) {
+                normalized[counts.row_indices[k]] = 0.0;
+            }
+            if (!(m2 / n > MIN_VARIANCE)) {
+                continue;
+            }
+
+            // z' W z with z = x - mean and sum(w_ij * (x_i - x_j)^2)
+            const double autocovariance =
+                    cross - mean * (row_total + col_total) + mean * mean * S0;
+            const double differences = row_squares + col_squares - 2.0 * cross;
+            const double I = n / S0 * autocovariance / m2;
+            const double C = (n - 1.0) * differences / (2.0 * S0 * m2);
+
+            // the variances under randomization (with the kurtosis of the gene)
+            const double K = n * m4 / (m2 * m2);
+            const double variance_I =
+                    (n * ((n * n - 3.0 * n + 3.0) * S1 - n * S2 + 3.0 * S0 * S0)
+                     - K * ((n * n - n) * S1 - 2.0 * n * S2 + 6.0 * S0 * S0))
+                    / ((n - 1.0) * (n - 2.0) * (n - 3.0) * S0 * S0)
+                    - expected_I * expected_I;
+            const double variance_C =
+                    ((n - 1.0) * S1 * (n * n - 3.0 * n + 3.0 - (n - 1.0) * K)
+                     - 0.25 * (n - 1.0) * S2 * (n * n + 3.0 * n - 6.0 - (n * n - n + 2.0) * K)
+                     + S0 * S0 * (n * n - 3.0 - (n - 1.0) * (n - 1.0) * K))
+                    / (n * (n - 2.0) * (n - 3.0) * S0 * S0);
+
+            values(gene, Spatial::MoransI) = I;
+            values(gene, Spatial::GearysC) = C;
+            if (variance_I > 0) {
+                const double statistic = (I - expected_I) / std::sqrt(variance_I);
+                values(gene, Spatial::MoransIStatistic) = statistic;
+                values(gene, Spatial::MoransIPValue) = upperPValue(statistic);
+            }
+            if (variance_C > 0) {
+                const double statistic = (1.0 - C) / std::sqrt(variance_C);
+                values(gene, Spatial::GearysCStatistic) = statistic;
+                values(gene, Spatial::GearysCPValue) = upperPValue(statistic);
+            }
+        }
+    });
+
+    // the tested genes ranked by FDR and decreasing Moran's I
+    const uvec tested = find_finite(values.col(Spatial::MoransIPValue));
+    values = values.rows(tested);
+    values.col(Spatial::FDR) = DEA::adjustPValues(values.col(Spatial::MoransIPValue));
+    std::vector<uword> order = indexes(values.n_rows);
+    std::stable_sort(order.begin(), order.end(), [&values](const uword a, const uword b) {
+        if (values(a, Spatial::FDR) != values(b, Spatial::FDR)) {
+            return values(a, Spatial::FDR) < values(b, Spatial::FDR);
+        }
+        return values(a, Spatial::MoransI) > values(b, Spatial::MoransI);
+    });
+    results = values.rows(uvec(order));
+    for (const uword index : order) {
+        rows.push_back(genes[tested[index]]);
+    }
+    cols = COLUMN_NAMES;
+    qDebug() << "Computed spatial autocorrelation of" << rows.size() << "genes";
+}
+}
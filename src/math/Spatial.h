@@ -0,0 +1,55 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include <armadillo>
+#include <string>
+#include <vector>
+
+using namespace arma;
+
+// Spatial finds the spatially variable genes of a dataset natively (without R). The spots
+// are connected by a neighbors graph of their array coordinates (a sparse matrix of
+// weights) and the spatial autocorrelation of every gene is measured with Moran's I and
+// Geary's C. The counts are given with the spots as rows and the genes as columns and the
+// genes are visited in several threads (only their non zero counts)
+namespace Spatial
+{
+
+// The columns of the results (the statistics are the standard deviates of Moran's I and
+// Geary's C under randomization, both positive when the gene is spatially autocorrelated,
+// and the FDR is the one of the p-values of Moran's I)
+enum Column {
+    MoransI = 0,
+    MoransIStatistic = 1,
+    MoransIPValue = 2,
+    GearysC = 3,
+    GearysCStatistic = 4,
+    GearysCPValue = 5,
+    FDR = 6
+};
+
+// Connects every spot to the spots within the given distance (coordinates has one row
+// per spot with its x and y). The weights are binary and symmetric and the spots are
+// looked up in a grid of the size of the radius
+sp_mat radiusGraph(const mat &coordinates, const double radius);
+
+// Connects every spot to its k nearest spots (math/Neighbors.h) and to the spots that
+// have it as one of their k nearest spots (the weights are binary and symmetric)
+sp_mat nearestNeighborsGraph(const mat &coordinates, const uword k);
+
+// Computes Moran's I and Geary's C of every gene with the given weights (spots x spots).
+// The counts are normalized by library size and log transformed (log(1 + x)).
+// The p-values are one-sided (positive autocorrelation) with the moments under
+// randomization (as spdep) and the FDR is computed with Benjamini-Hochberg.
+// results has one row per tested gene (genes without variance are not tested) ordered by
+// FDR and decreasing Moran's I, rows has the names of the genes and cols the names of
+// the columns
+void computeSpatialGenes(const sp_mat &counts,
+                         const std::vector<std::string> &genes,
+                         const sp_mat &weights,
+                         mat &results,
+                         std::vector<std::string> &rows,
+                         std::vector<std::string> &cols);
+}
+
+#endif // SPATIAL_H
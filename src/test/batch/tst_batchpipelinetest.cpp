@@ -0,0 +1,234 @@
+#include <QtTest/QTest>
+#include <QTemporaryDir>
+#include <QDir>
+#include <QFile>
+
+#include "batch/BatchPipeline.h"
+#include "data/Dataset.h"
+#include "data/STDataBinary.h"
+#include "tst_batchpipelinetest.h"
+
+namespace unit
+{
+
+// helper function to write a file
+static bool writeFile(const QString &filename, const QByteArray &content)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    return file.write(content) == content.size();
+}
+
+// helper function to read the lines of a file
+static QStringList readLines(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return QStringList();
+    }
+    return QString(file.readAll()).split("\n", QString::SkipEmptyParts);
+}
+
+// helper function to create a matrix of counts with two groups of spots
+// (the first half expresses the first half of the genes and the second half the rest)
+static QByteArray twoGroupsMatrix(const int n_spots, const int n_genes)
+{
+    QByteArray content;
+    for (int j = 0; j < n_genes; ++j) {
+        content += "\tGene" + QByteArray::number(j);
+    }
+    content += "\n";
+    for (int i = 0; i < n_spots; ++i) {
+        content += QByteArray::number(i + 1) + "x" + QByteArray::number(i % 5 + 1);
+        for (int j = 0; j < n_genes; ++j) {
+            const bool expressed = (i < n_spots / 2) == (j < n_genes / 2);
+            content += "\t" + QByteArray::number(expressed ? 20 + (i + j) % 7 : (i + j) % 2);
+        }
+        content += "\n";
+    }
+    return content;
+}
+
+BatchPipelineTest::BatchPipelineTest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void BatchPipelineTest::initTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void BatchPipelineTest::cleanupTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void BatchPipelineTest::testParseFolder()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QDir folder(dir.path());
+    QVERIFY(writeFile(folder.filePath("stdata.tsv"), twoGroupsMatrix(4, 4)));
+    // the binary cache of the matrix is not the matrix
+    QVERIFY(writeFile(folder.filePath("stdata.tsv." + STDataBinary::SUFFIX), "cache"));
+    QVERIFY(writeFile(folder.filePath("image.jpg"), "image"));
+    QVERIFY(writeFile(folder.filePath("alignment.txt"), "1 0 0 0 1 0 0 0 1"));
+    QVERIFY(writeFile(folder.filePath("spots.txt"), "spots"));
+    QVERIFY(writeFile(folder.filePath("info.json"),
+                      "{\"name\": \"section\", \"species\": \"mouse\", \"tissue\": \"brain\"}"));
+
+    Dataset dataset;
+    QVERIFY(BatchPipeline::parseDescriptor(folder.filePath("info.json"), dataset));
+    QCOMPARE(dataset.name(), QString("section"));
+    QCOMPARE(dataset.statSpecies(), QString("mouse"));
+    QCOMPARE(dataset.statTissue(), QString("brain"));
+    QCOMPARE(dataset.dataFile(), folder.absoluteFilePath("stdata.tsv"));
+    QCOMPARE(dataset.imageFile(), folder.absoluteFilePath("image.jpg"));
+    QCOMPARE(dataset.imageAlignmentFile(), folder.absoluteFilePath("alignment.txt"));
+    QCOMPARE(dataset.spotsFile(), folder.absoluteFilePath("spots.txt"));
+    QVERIFY(dataset.sizeFactorsFile().isEmpty());
+
+    // the folder gives the name when there is no info.json
+    QTemporaryDir empty_dir;
+    QVERIFY(empty_dir.isValid());
+    Dataset empty;
+    QVERIFY(!BatchPipeline::parseDescriptor(empty_dir.path(), empty));
+    QCOMPARE(empty.name(), QDir(empty_dir.path()).dirName());
+}
+
+void BatchPipelineTest::testParseMetaFile()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QDir folder(dir.path());
+    QVERIFY(folder.mkdir("files"));
+    const QString meta_file = folder.filePath("meta.json");
+    const QByteArray alignment_file = folder.absoluteFilePath("alignment.txt").toUtf8();
+    QVERIFY(writeFile(meta_file,
+                      "{\"name\": \"test\", \"comments\": \"test_comments\","
+                      " \"data\": \"files/stdata.tsv\","
+                      " \"aligment\": \"" + alignment_file + "\","
+                      " \"size_factors\": \"\"}"));
+
+    Dataset dataset;
+    QVERIFY(BatchPipeline::parseDescriptor(meta_file, dataset));
+    QCOMPARE(dataset.name(), QString("test"));
+    QCOMPARE(dataset.statComments(), QString("test_comments"));
+    // the relative paths are relative to the meta file
+    QCOMPARE(dataset.dataFile(), folder.absoluteFilePath("files/stdata.tsv"));
+    QCOMPARE(dataset.imageAlignmentFile(), folder.absoluteFilePath("alignment.txt"));
+    QVERIFY(dataset.sizeFactorsFile().isEmpty());
+    QVERIFY(dataset.imageFile().isEmpty());
+
+    // invalid meta files and meta files without matrix
+    QVERIFY(writeFile(meta_file, "{\"name\": "));
+    Dataset invalid;
+    QVERIFY(!BatchPipeline::parseDescriptor(meta_file, invalid));
+    QVERIFY(writeFile(meta_file, "{\"name\": \"test\"}"));
+    QVERIFY(!BatchPipeline::parseDescriptor(meta_file, invalid));
+    QVERIFY(!BatchPipeline::parseDescriptor(folder.filePath("missing.json"), invalid));
+}
+
+void BatchPipelineTest::testRun()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QDir folder(dir.path());
+
+    // two datasets with the same name
+    QStringList descriptors;
+    for (const QString &name : {"first", "second"}) {
+        QVERIFY(folder.mkdir(name));
+        const QDir dataset_folder(folder.filePath(name));
+        QVERIFY(writeFile(dataset_folder.filePath("stdata.tsv"), twoGroupsMatrix(40, 20)));
+        QVERIFY(writeFile(dataset_folder.filePath("info.json"), "{\"name\": \"section 1\"}"));
+        descriptors << dataset_folder.absolutePath();
+    }
+
+    BatchPipeline::Settings settings;
+    settings.min_spots_gene = 1;
+    settings.normalization = SettingsWidget::REL;
+    settings.clustering = BatchPipeline::KMeans;
+    settings.clusters = 2;
+    settings.components = 2;
+    settings.save_counts = true;
+    settings.jobs = 2;
+    settings.output = folder.filePath("results");
+    const BatchPipeline pipeline(settings);
+    int reported = 0;
+    const QList<BatchPipeline::Result> results
+            = pipeline.run(descriptors, [&](const BatchPipeline::Result &) { ++reported; });
+
+    QCOMPARE(reported, 2);
+    QCOMPARE(results.size(), 2);
+    QCOMPARE(results.at(0).folder, QDir(settings.output).absoluteFilePath("section_1"));
+    QCOMPARE(results.at(1).folder, QDir(settings.output).absoluteFilePath("section_1_2"));
+    for (const BatchPipeline::Result &result : results) {
+        QVERIFY2(result.succeeded, qPrintable(result.error));
+        QCOMPARE(result.name, QString("section 1"));
+        QCOMPARE(result.spots, uword(40));
+        QCOMPARE(result.genes, uword(20));
+        QCOMPARE(result.clusters, uword(2));
+
+        const QDir result_folder(result.folder);
+        const QStringList qc = readLines(result_folder.filePath("qc.tsv"));
+        QVERIFY(qc.size() > 2);
+        QCOMPARE(qc.at(0), QString("stat\traw\tfiltered"));
+        QCOMPARE(qc.at(1), QString("spots\t40\t40"));
+        QVERIFY(QFile::exists(result_folder.filePath("counts.tsv")));
+
+        // the clusters are the two groups of spots
+        const QStringList clusters = readLines(result_folder.filePath("clusters.tsv"));
+        QCOMPARE(clusters.size(), 41);
+        QCOMPARE(clusters.at(0), QString("spot\tcluster"));
+        const QString first_cluster = clusters.at(1).split("\t").at(1);
+        for (int i = 1; i < clusters.size(); ++i) {
+            const bool same = clusters.at(i).split("\t").at(1) == first_cluster;
+            QCOMPARE(same, i <= 20);
+        }
+
+        // the markers of both clusters
+        const QStringList markers = readLines(result_folder.filePath("markers.tsv"));
+        QVERIFY(markers.size() > 1);
+        QVERIFY(markers.at(0).startsWith("cluster\tgene\t"));
+    }
+
+    const QStringList summary = readLines(QDir(settings.output).filePath("summary.tsv"));
+    QCOMPARE(summary.size(), 3);
+    QVERIFY(summary.at(1).contains("\tOK\t"));
+    QVERIFY(summary.at(2).contains("\tOK\t"));
+}
+
+void BatchPipelineTest::testRunInvalidDatasets()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QDir folder(dir.path());
+    QVERIFY(writeFile(folder.filePath("invalid.tsv"), "\tGeneA\n1x1\tnot_a_number\n"));
+    QVERIFY(writeFile(folder.filePath("invalid.json"), "{\"data\": \"invalid.tsv\"}"));
+
+    BatchPipeline::Settings settings;
+    settings.output = folder.filePath("results");
+    const BatchPipeline pipeline(settings);
+    const QList<BatchPipeline::Result> results
+            = pipeline.run(QStringList() << folder.filePath("missing.json")
+                                         << folder.filePath("invalid.json"));
+    QCOMPARE(results.size(), 2);
+    QVERIFY(!results.at(0).succeeded);
+    QVERIFY(!results.at(0).error.isEmpty());
+    QVERIFY(!results.at(1).succeeded);
+    QVERIFY(!results.at(1).error.isEmpty());
+
+    const QStringList summary = readLines(QDir(settings.output).filePath("summary.tsv"));
+    QCOMPARE(summary.size(), 3);
+    QVERIFY(summary.at(1).contains("\tERROR\t"));
+    QVERIFY(summary.at(2).contains("\tERROR\t"));
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::BatchPipelineTest)
+#include "tst_batchpipelinetest.moc"
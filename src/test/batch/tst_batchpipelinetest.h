@@ -0,0 +1,28 @@
+#ifndef TST_BATCHPIPELINETEST_H
+#define TST_BATCHPIPELINETEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class BatchPipelineTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BatchPipelineTest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testParseFolder();
+    void testParseMetaFile();
+    void testRun();
+    void testRunInvalidDatasets();
+};
+
+} // namespace unit //
+
+#endif // TST_BATCHPIPELINETEST_H
@@ -0,0 +1,512 @@
+#include <QtTest/QTest>
+#include <QApplication>
+#include <QDebug>
+#include <QDateTime>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLPaintDevice>
+#include <QPainter>
+#include <QPainterPath>
+#include <QSurfaceFormat>
+#include <QSysInfo>
+#include <QThread>
+#include <QXmlStreamReader>
+
+#include <algorithm>
+#include <cmath>
+
+#include "color/HeatMap.h"
+#include "data/STDataBinary.h"
+#include "viewRenderer/GeneRendererGL.h"
+#include "viewRenderer/SelectionEvent.h"
+#include "options_cmake.h"
+#include "bench_datarendering.h"
+
+namespace unit
+{
+
+// the seed of the random counts (the same dataset in every run)
+static const int SEED = 1;
+// the counts are from 1 to MAX_COUNT
+static const double MAX_COUNT = 50.0;
+// the size of the offscreen framebuffer
+static const QSize RENDER_SIZE(1024, 1024);
+// the vertices of the lasso paths
+static const int LASSO_VERTICES = 64;
+
+// helper function to create a synthetic data frame: the spots are in a square grid
+// (XxY) and the counts are random with the given density
+static STData::STDataFrame syntheticFrame(const uword n_spots,
+                                          const uword n_genes,
+                                          const double density)
+{
+    arma_rng::set_seed(SEED);
+    STData::STDataFrame data;
+    data.sp_counts = sprandu<sp_mat>(n_spots, n_genes, density);
+    data.sp_counts.transform([](const double value) { return std::ceil(value * MAX_COUNT); });
+    data.is_sparse = true;
+    const uword side = static_cast<uword>(std::ceil(std::sqrt(static_cast<double>(n_spots))));
+    for (uword i = 0; i < n_spots; ++i) {
+        data.spots << QString("%1x%2").arg(i % side + 1).arg(i / side + 1);
+    }
+    for (uword j = 0; j < n_genes; ++j) {
+        data.genes << QString("Gene%1").arg(j);
+    }
+    STData::optimizeStorage(data);
+    return data;
+}
+
+// helper function to create a lasso path (a polygon approximating an ellipse) centered
+// in the rectangle that covers the given fraction of its area
+static QPainterPath lassoPath(const QRectF &bounds, const double fraction)
+{
+    const double scale = std::sqrt(fraction * 4.0 / datum::pi);
+    const double radius_x = bounds.width() * scale / 2.0;
+    const double radius_y = bounds.height() * scale / 2.0;
+    QPainterPath path;
+    for (int i = 0; i < LASSO_VERTICES; ++i) {
+        const double angle = 2.0 * datum::pi * i / LASSO_VERTICES;
+        // a wavy border as drawn by hand
+        const double wave = 1.0 + 0.05 * std::sin(7.0 * angle);
+        const QPointF point(bounds.center().x() + radius_x * wave * std::cos(angle),
+                            bounds.center().y() + radius_y * wave * std::sin(angle));
+        if (i == 0) {
+            path.moveTo(point);
+        } else {
+            path.lineTo(point);
+        }
+    }
+    path.closeSubpath();
+    return path;
+}
+
+DataRenderingBenchmark::DataRenderingBenchmark(const uword spots,
+                                               const uword genes,
+                                               const double density,
+                                               QObject *parent)
+    : QObject(parent)
+    , m_n_spots(spots)
+    , m_n_genes(genes)
+    , m_density(density)
+{
+}
+
+void DataRenderingBenchmark::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+    m_frame = syntheticFrame(m_n_spots, m_n_genes, m_density);
+    m_matrix_file = m_dir.filePath("stdata.tsv");
+    m_binary_file = m_dir.filePath("stdata." + STDataBinary::SUFFIX);
+    STData::save(m_matrix_file, m_frame);
+    STData::save(m_binary_file, m_frame);
+    QVERIFY(QFile::exists(m_matrix_file));
+    QVERIFY(QFile::exists(m_binary_file));
+
+    m_data = QSharedPointer<STData>(new STData());
+    m_data->init(m_matrix_file);
+    for (const auto &gene : m_data->genes()) {
+        gene->visible(true);
+    }
+    SettingsWidget::Rendering settings = renderingSettings();
+    m_data->computeRenderingData(settings);
+    qDebug() << "Benchmark dataset with" << m_n_spots << "spots," << m_n_genes
+             << "genes and density" << m_density
+             << (m_frame.is_sparse ? "(sparse)" : "(dense)");
+}
+
+void DataRenderingBenchmark::cleanupTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+SettingsWidget::Rendering DataRenderingBenchmark::renderingSettings() const
+{
+    SettingsWidget::Rendering settings;
+    settings.reads_threshold = 0;
+    settings.genes_threshold = 0;
+    settings.spots_threshold = 0;
+    settings.ind_reads_threshold = 0;
+    settings.legend_min = 0.0;
+    settings.legend_max = 1.0;
+    settings.intensity = 1.0;
+    settings.size = 1.0;
+    settings.visual_mode = SettingsWidget::VisualMode::HeatMap;
+    settings.normalization_mode = SettingsWidget::NormalizationMode::RAW;
+    settings.visual_type_mode = SettingsWidget::VisualTypeMode::Reads;
+    settings.gene_cutoff = false;
+    settings.size_factors = false;
+    return settings;
+}
+
+void DataRenderingBenchmark::benchmarkRead()
+{
+    QFETCH(bool, binary);
+    const QString filename = binary ? m_binary_file : m_matrix_file;
+    STData::STDataFrame data;
+    QBENCHMARK {
+        data = STData::read(filename);
+    }
+    QCOMPARE(data.spots.size(), m_frame.spots.size());
+    QCOMPARE(data.genes.size(), m_frame.genes.size());
+}
+
+void DataRenderingBenchmark::benchmarkRead_data()
+{
+    QTest::addColumn<bool>("binary");
+
+    QTest::newRow("tsv") << false;
+    QTest::newRow("binary") << true;
+}
+
+void DataRenderingBenchmark::benchmarkInit()
+{
+    QBENCHMARK {
+        STData data;
+        data.init(m_matrix_file);
+    }
+}
+
+void DataRenderingBenchmark::benchmarkComputeRenderingData()
+{
+    QFETCH(QString, change);
+    SettingsWidget::Rendering settings = renderingSettings();
+    STData data;
+    data.init(m_matrix_file);
+    for (const auto &gene : data.genes()) {
+        gene->visible(true);
+    }
+    // the size factors are switched on and off to compute all the stages
+    if (change == "full") {
+        QStringList factors;
+        for (int i = 0; i < data.spots().size(); ++i) {
+            factors << QString::number(1.0 + (i % 10) / 10.0);
+        }
+        const QString factors_file = m_dir.filePath("sizefactors.txt");
+        QFile file(factors_file);
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Text));
+        file.write(factors.join("\n").toUtf8());
+        file.close();
+        QVERIFY(data.parseSizeFactors(factors_file));
+    }
+    data.computeRenderingData(settings);
+
+    // every iteration changes the settings (or the genes) back and forth so the stages
+    // that depend on the change are computed again
+    const int n_changed_genes = std::max(1, data.genes().size() / 100);
+    bool toggle = false;
+    QBENCHMARK {
+        toggle = !toggle;
+        if (change == "thresholds") {
+            settings.ind_reads_threshold = toggle ? 2 : 0;
+        } else if (change == "normalization") {
+            settings.normalization_mode = toggle ? SettingsWidget::NormalizationMode::REL
+                                                 : SettingsWidget::NormalizationMode::TPM;
+        } else if (change == "genes") {
+            for (int i = 0; i < n_changed_genes; ++i) {
+                data.genes().at(i)->visible(!toggle);
+            }
+        } else if (change == "full") {
+            settings.size_factors = toggle;
+        }
+        data.computeRenderingData(settings);
+    }
+    QCOMPARE(data.renderingVisible().size(), data.spots().size());
+}
+
+void DataRenderingBenchmark::benchmarkComputeRenderingData_data()
+{
+    QTest::addColumn<QString>("change");
+
+    QTest::newRow("full") << QString("full");
+    QTest::newRow("thresholds") << QString("thresholds");
+    QTest::newRow("normalization") << QString("normalization");
+    QTest::newRow("genes") << QString("genes");
+    QTest::newRow("unchanged") << QString("unchanged");
+}
+
+void DataRenderingBenchmark::benchmarkFilterDataFrame()
+{
+    STData::STDataFrame data;
+    QBENCHMARK {
+        data = STData::filterDataFrame(m_frame, 2, 10, 5, 5);
+    }
+    QVERIFY(data.spots.size() <= m_frame.spots.size());
+}
+
+void DataRenderingBenchmark::benchmarkSliceDataFrameSpots()
+{
+    // every other spot
+    QList<QString> spots;
+    for (int i = 0; i < m_frame.spots.size(); i += 2) {
+        spots << m_frame.spots.at(i);
+    }
+    STData::STDataFrame data;
+    QBENCHMARK {
+        data = STData::sliceDataFrameSpots(m_frame, spots);
+    }
+    QCOMPARE(data.spots.size(), spots.size());
+}
+
+void DataRenderingBenchmark::benchmarkAggregate()
+{
+    QFETCH(int, datasets);
+    QFETCH(bool, sparse);
+    QList<STData::STDataFrame> frames;
+    for (int i = 0; i < datasets; ++i) {
+        frames << m_frame;
+    }
+    STData::STDataFrame data;
+    QBENCHMARK {
+        data = STData::aggregate(frames, sparse);
+    }
+    QCOMPARE(data.spots.size(), m_frame.spots.size() * datasets);
+}
+
+void DataRenderingBenchmark::benchmarkAggregate_data()
+{
+    QTest::addColumn<int>("datasets");
+    QTest::addColumn<bool>("sparse");
+
+    QTest::newRow("4_datasets") << 4 << false;
+    QTest::newRow("4_datasets_sparse") << 4 << true;
+}
+
+void DataRenderingBenchmark::benchmarkNormalizeCounts()
+{
+    QFETCH(int, normalization);
+    const auto mode = static_cast<SettingsWidget::NormalizationMode>(normalization);
+    STData::STDataFrame data;
+    QBENCHMARK {
+        data = STData::normalizeCounts(m_frame, mode);
+    }
+    QCOMPARE(data.spots.size(), m_frame.spots.size());
+}
+
+void DataRenderingBenchmark::benchmarkNormalizeCounts_data()
+{
+    QTest::addColumn<int>("normalization");
+
+    QTest::newRow("RAW") << int(SettingsWidget::NormalizationMode::RAW);
+    QTest::newRow("REL") << int(SettingsWidget::NormalizationMode::REL);
+    QTest::newRow("TPM") << int(SettingsWidget::NormalizationMode::TPM);
+}
+
+void DataRenderingBenchmark::benchmarkSelectSpots()
+{
+    QFETCH(double, fraction);
+    QFETCH(int, mode);
+    const QPainterPath path = lassoPath(m_data->getBorder(), fraction);
+    const SelectionEvent event(path, static_cast<SelectionEvent::SelectionMode>(mode));
+    QBENCHMARK {
+        m_data->selectSpots(event);
+    }
+    m_data->clearSelection();
+}
+
+void DataRenderingBenchmark::benchmarkSelectSpots_data()
+{
+    QTest::addColumn<double>("fraction");
+    QTest::addColumn<int>("mode");
+
+    QTest::newRow("small_lasso") << 0.05 << int(SelectionEvent::NewSelection);
+    QTest::newRow("large_lasso") << 0.6 << int(SelectionEvent::NewSelection);
+    QTest::newRow("large_lasso_include") << 0.6 << int(SelectionEvent::IncludeSelection);
+}
+
+void DataRenderingBenchmark::benchmarkCreateCMapColor()
+{
+    QFETCH(int, gradient);
+    const auto cmap = static_cast<Color::ColorGradients>(gradient);
+    // one color per spot as when rendering
+    const vec values = linspace<vec>(0.0, MAX_COUNT, m_n_spots);
+    QVector<QColor> colors(values.n_elem);
+    QBENCHMARK {
+        for (uword i = 0; i < values.n_elem; ++i) {
+            colors[i] = Color::createCMapColor(values[i], 0.0, MAX_COUNT, cmap);
+        }
+    }
+    QVERIFY(colors.first().isValid());
+}
+
+void DataRenderingBenchmark::benchmarkCreateCMapColor_data()
+{
+    QTest::addColumn<int>("gradient");
+
+    QTest::newRow("spectrum") << int(Color::ColorGradients::gpSpectrum);
+    QTest::newRow("hot") << int(Color::ColorGradients::gpHot);
+}
+
+void DataRenderingBenchmark::benchmarkGeneRendererDraw()
+{
+    QFETCH(bool, update);
+
+    // an offscreen context and framebuffer (no window is needed)
+    QSurfaceFormat format;
+    format.setVersion(2, 0);
+    QOpenGLContext context;
+    context.setFormat(format);
+    if (!context.create()) {
+        QSKIP("An OpenGL context could not be created");
+    }
+    QOffscreenSurface surface;
+    surface.setFormat(context.format());
+    surface.create();
+    if (!surface.isValid() || !context.makeCurrent(&surface)) {
+        QSKIP("The offscreen surface could not be used");
+    }
+    GraphicItemGL::QOpenGLFunctionsVersion functions;
+    if (!functions.initializeOpenGLFunctions()) {
+        QSKIP("OpenGL 2.0 functions are not available");
+    }
+
+    {
+        QOpenGLFramebufferObject framebuffer(RENDER_SIZE);
+        QVERIFY(framebuffer.bind());
+        QOpenGLPaintDevice device(RENDER_SIZE);
+        QPainter painter(&device);
+        // the spots fill the framebuffer
+        painter.setWindow(m_data->getBorder().adjusted(-1, -1, 1, 1).toAlignedRect());
+
+        SettingsWidget::Rendering settings = renderingSettings();
+        GeneRendererGL renderer(settings);
+        renderer.attachData(m_data);
+        renderer.slotUpdate();
+        // draw() is called through the base class as the view does
+        GraphicItemGL &item = renderer;
+        item.draw(functions, painter);
+        QBENCHMARK {
+            if (update) {
+                renderer.slotUpdate();
+            }
+            item.draw(functions, painter);
+            functions.glFinish();
+        }
+        painter.end();
+        framebuffer.release();
+    }
+    context.doneCurrent();
+}
+
+void DataRenderingBenchmark::benchmarkGeneRendererDraw_data()
+{
+    QTest::addColumn<bool>("update");
+
+    QTest::newRow("draw") << false;
+    QTest::newRow("update_and_draw") << true;
+}
+
+// Converts the results of the XML logger of QTest to JSON, the results of the benchmarks
+// are one object per benchmark (and data tag) with the value per iteration of its metric
+static QJsonArray benchmarkResults(const QString &xml_file)
+{
+    QJsonArray results;
+    QFile file(xml_file);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return results;
+    }
+    QXmlStreamReader xml(&file);
+    QString function;
+    while (!xml.atEnd()) {
+        xml.readNext();
+        if (!xml.isStartElement()) {
+            continue;
+        }
+        const QXmlStreamAttributes attributes = xml.attributes();
+        if (xml.name() == QLatin1String("TestFunction")) {
+            function = attributes.value("name").toString();
+        } else if (xml.name() == QLatin1String("BenchmarkResult")) {
+            QJsonObject result;
+            result["benchmark"] = function;
+            result["tag"] = attributes.value("tag").toString();
+            result["metric"] = attributes.value("metric").toString();
+            result["value"] = attributes.value("value").toDouble();
+            result["iterations"] = attributes.value("iterations").toInt();
+            results.append(result);
+        }
+    }
+    return results;
+}
+
+} // namespace unit //
+
+// The benchmarks are run with QTest (all the QTest options can be given, -iterations,
+// -minimumvalue, -tickcounter...) and the results are saved in a JSON file too.
+// The synthetic dataset is configured with --spots, --genes and --density
+int main(int argc, char **argv)
+{
+    // without a display the offscreen platform is used
+#if defined(Q_OS_UNIX) && !defined(Q_OS_MAC)
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")
+            && qEnvironmentVariableIsEmpty("DISPLAY")
+            && qEnvironmentVariableIsEmpty("WAYLAND_DISPLAY")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+#endif
+    QApplication app(argc, argv);
+
+    uword spots = 10000;
+    uword genes = 2000;
+    double density = 0.1;
+    QString json_file = "benchmarks.json";
+
+    // the options of the benchmark are removed from the options of QTest
+    const QStringList arguments = app.arguments();
+    QStringList args;
+    for (int i = 0; i < arguments.size(); ++i) {
+        const QString &arg = arguments.at(i);
+        const bool has_value = i + 1 < arguments.size();
+        if (arg == "--spots" && has_value) {
+            spots = arguments.at(++i).toULongLong();
+        } else if (arg == "--genes" && has_value) {
+            genes = arguments.at(++i).toULongLong();
+        } else if (arg == "--density" && has_value) {
+            density = arguments.at(++i).toDouble();
+        } else if (arg == "--json" && has_value) {
+            json_file = arguments.at(++i);
+        } else {
+            args << arg;
+        }
+    }
+    if (spots == 0 || genes == 0 || !(density > 0.0 && density <= 1.0)) {
+        qCritical("Invalid dataset: --spots and --genes must be positive and "
+                  "--density must be in (0, 1]");
+        return EXIT_FAILURE;
+    }
+
+    // the results are logged as text and XML (converted to JSON)
+    QTemporaryDir dir;
+    const QString xml_file = dir.filePath("benchmarks.xml");
+    args << "-o" << xml_file + ",xml" << "-o" << "-,txt";
+    unit::DataRenderingBenchmark benchmark(spots, genes, density);
+    const int failures = QTest::qExec(&benchmark, args);
+
+    QJsonObject dataset;
+    dataset["spots"] = static_cast<double>(spots);
+    dataset["genes"] = static_cast<double>(genes);
+    dataset["density"] = density;
+    QJsonObject system;
+    system["os"] = QSysInfo::prettyProductName();
+    system["cpu"] = QSysInfo::currentCpuArchitecture();
+    system["cores"] = QThread::idealThreadCount();
+    QJsonObject report;
+    report["version"] = QString("%1.%2.%3").arg(MAJOR).arg(MINOR).arg(PATCH);
+    report["qt"] = QString(qVersion());
+    report["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["system"] = system;
+    report["dataset"] = dataset;
+    report["failures"] = failures;
+    report["results"] = unit::benchmarkResults(xml_file);
+    QFile file(json_file);
+    if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(report).toJson()) < 0) {
+        qCritical("Error writing the results to %s", qPrintable(json_file));
+        return EXIT_FAILURE;
+    }
+    return failures;
+}
+
+#include "bench_datarendering.moc"
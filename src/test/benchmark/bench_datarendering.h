@@ -0,0 +1,67 @@
+#ifndef BENCH_DATARENDERING_H
+#define BENCH_DATARENDERING_H
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QTemporaryDir>
+
+#include "data/STData.h"
+
+namespace unit
+{
+
+// Benchmarks of the data and rendering hot paths with a synthetic dataset: the spots are
+// in a square grid and the counts are random with the given density (the fraction of
+// non zero counts)
+class DataRenderingBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    DataRenderingBenchmark(const uword spots,
+                           const uword genes,
+                           const double density,
+                           QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void benchmarkRead();
+    void benchmarkRead_data();
+    void benchmarkInit();
+    void benchmarkComputeRenderingData();
+    void benchmarkComputeRenderingData_data();
+    void benchmarkFilterDataFrame();
+    void benchmarkSliceDataFrameSpots();
+    void benchmarkAggregate();
+    void benchmarkAggregate_data();
+    void benchmarkNormalizeCounts();
+    void benchmarkNormalizeCounts_data();
+    void benchmarkSelectSpots();
+    void benchmarkSelectSpots_data();
+    void benchmarkCreateCMapColor();
+    void benchmarkCreateCMapColor_data();
+    void benchmarkGeneRendererDraw();
+    void benchmarkGeneRendererDraw_data();
+
+private:
+    // the rendering settings of the benchmarks (all the genes are shown)
+    SettingsWidget::Rendering renderingSettings() const;
+
+    const uword m_n_spots;
+    const uword m_n_genes;
+    const double m_density;
+
+    // the synthetic data frame and its files (matrix and binary formats)
+    STData::STDataFrame m_frame;
+    QTemporaryDir m_dir;
+    QString m_matrix_file;
+    QString m_binary_file;
+    // the synthetic dataset with its rendering data
+    QSharedPointer<STData> m_data;
+};
+
+} // namespace unit //
+
+#endif // BENCH_DATARENDERING_H
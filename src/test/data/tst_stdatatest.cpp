@@ -0,0 +1,560 @@
+#include <QtTest/QTest>
+#include <QTemporaryFile>
+
+#include "data/STData.h"
+#include "data/STDataBinary.h"
+#include "math/Common.h"
+#include "tst_stdatatest.h"
+
+namespace unit
+{
+
+// helper function to write a matrix to a temporary file
+static QString writeMatrix(QTemporaryFile &file, const QByteArray &content)
+{
+    if (!file.open()) {
+        return QString();
+    }
+    file.write(content);
+    file.close();
+    return file.fileName();
+}
+
+STDataTest::STDataTest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void STDataTest::initTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void STDataTest::cleanupTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void STDataTest::testRead()
+{
+    QTemporaryFile file;
+    const QString filename = writeMatrix(file,
+                                         "\tGeneA\tGeneB\tGeneC\n"
+                                         "1x1\t0\t2\t3.5\n"
+                                         "\n"
+                                         "2x1\t10\t0\t1e2\n"
+                                         "3x2\t0.25\t-1\t0\n");
+    QVERIFY(!filename.isEmpty());
+
+    const STData::STDataFrame data = STData::read(filename);
+    QCOMPARE(data.genes, QList<QString>() << "GeneA" << "GeneB" << "GeneC");
+    QCOMPARE(data.spots, QList<QString>() << "1x1" << "2x1" << "3x2");
+    QCOMPARE(data.counts.n_rows, uword(3));
+    QCOMPARE(data.counts.n_cols, uword(3));
+    QCOMPARE(data.counts(0, 2), 3.5);
+    QCOMPARE(data.counts(1, 0), 10.0);
+    QCOMPARE(data.counts(1, 2), 100.0);
+    QCOMPARE(data.counts(2, 0), 0.25);
+    QCOMPARE(data.counts(2, 1), -1.0);
+}
+
+void STDataTest::testReadWindowsLineEndings()
+{
+    QTemporaryFile file;
+    const QString filename = writeMatrix(file,
+                                         "\tGeneA\tGeneB\r\n"
+                                         "1x1\t1\t2\r\n"
+                                         "2x1\t3\t4\r\n");
+    QVERIFY(!filename.isEmpty());
+
+    const STData::STDataFrame data = STData::read(filename);
+    QCOMPARE(data.genes, QList<QString>() << "GeneA" << "GeneB");
+    QCOMPARE(data.spots, QList<QString>() << "1x1" << "2x1");
+    QCOMPARE(data.counts(1, 1), 4.0);
+}
+
+void STDataTest::testReadDuplicatedGenes()
+{
+    QTemporaryFile file;
+    const QString filename = writeMatrix(file,
+                                         "\tGeneA\tGeneA\n"
+                                         "1x1\t1\t2\n");
+    QVERIFY(!filename.isEmpty());
+    QVERIFY_EXCEPTION_THROWN(STData::read(filename), std::runtime_error);
+}
+
+void STDataTest::testReadInvalidMatrix()
+{
+    QFETCH(QByteArray, content);
+
+    QTemporaryFile file;
+    const QString filename = writeMatrix(file, content);
+    QVERIFY(!filename.isEmpty());
+    QVERIFY_EXCEPTION_THROWN(STData::read(filename), std::runtime_error);
+}
+
+void STDataTest::testReadInvalidMatrix_data()
+{
+    QTest::addColumn<QByteArray>("content");
+
+    QTest::newRow("empty") << QByteArray();
+    QTest::newRow("no_spots") << QByteArray("\tGeneA\tGeneB\n");
+    QTest::newRow("missing_values") << QByteArray("\tGeneA\tGeneB\n1x1\t1\n");
+    QTest::newRow("extra_values") << QByteArray("\tGeneA\tGeneB\n1x1\t1\t2\t3\n");
+    QTest::newRow("not_a_number") << QByteArray("\tGeneA\tGeneB\n1x1\t1\tNA1\n");
+}
+
+void STDataTest::testSparseStorage()
+{
+    STData::STDataFrame data;
+    data.counts = mat(100, 50, fill::zeros);
+    data.counts(0, 0) = 1.0;
+    data.counts(99, 49) = 2.0;
+    for (int i = 0; i < 100; ++i) {
+        data.spots.append(QString::number(i) + "x1");
+    }
+    for (int j = 0; j < 50; ++j) {
+        data.genes.append("Gene" + QString::number(j));
+    }
+
+    STData::optimizeStorage(data);
+    QVERIFY(data.is_sparse);
+    QCOMPARE(data.sp_counts.n_nonzero, uword(2));
+    QCOMPARE(accu(STData::computeRowSums(data)), 3.0);
+    QCOMPARE(accu(STData::computeNonZeroColumns(data)), uword(2));
+
+    QCOMPARE(STData::sparseCounts(data).n_nonzero, uword(2));
+    // the log of sparse counts keeps the zeros
+    STData::STDataFrame logged = data;
+    STData::logCounts(logged);
+    QVERIFY(logged.is_sparse);
+    QCOMPARE(logged.sp_counts.n_nonzero, uword(2));
+    QCOMPARE(double(logged.sp_counts(99, 49)), std::log(3.0));
+
+    STData::toDense(data);
+    QVERIFY(!data.is_sparse);
+    QCOMPARE(data.counts(99, 49), 2.0);
+    QCOMPARE(STData::sparseCounts(data).n_nonzero, uword(2));
+    STData::logCounts(data);
+    QCOMPARE(data.counts(99, 49), std::log(3.0));
+    QCOMPARE(data.counts(50, 20), 0.0);
+}
+
+void STDataTest::testFilterDataFrame()
+{
+    STData::STDataFrame dense;
+    dense.counts = mat(40, 30, fill::zeros);
+    for (uword i = 0; i < dense.counts.n_rows; ++i) {
+        dense.spots.append(QString::number(i) + "x1");
+        for (uword j = 0; j < dense.counts.n_cols; ++j) {
+            if ((i * 7 + j * 3) % 5 == 0) {
+                dense.counts(i, j) = (i + j) % 4;
+            }
+        }
+    }
+    for (uword j = 0; j < dense.counts.n_cols; ++j) {
+        dense.genes.append("Gene" + QString::number(j));
+    }
+    STData::STDataFrame sparse = dense;
+    STData::toSparse(sparse);
+
+    const auto filtered_dense = STData::filterDataFrame(dense, 1, 3, 1, 2);
+    const auto filtered_sparse = STData::filterDataFrame(sparse, 1, 3, 1, 2);
+    QVERIFY(filtered_sparse.is_sparse);
+    QCOMPARE(filtered_sparse.spots, filtered_dense.spots);
+    QCOMPARE(filtered_sparse.genes, filtered_dense.genes);
+    QVERIFY(approx_equal(STData::denseCounts(filtered_sparse),
+                         filtered_dense.counts, "absdiff", 1e-12));
+
+    const auto normalized_dense = STData::normalizeCounts(filtered_dense,
+                                                          SettingsWidget::NormalizationMode::TPM);
+    const auto normalized_sparse = STData::normalizeCounts(filtered_sparse,
+                                                           SettingsWidget::NormalizationMode::TPM);
+    QVERIFY(approx_equal(STData::denseCounts(normalized_sparse),
+                         normalized_dense.counts, "reldiff", 1e-9));
+}
+
+void STDataTest::testSliceDataFrame()
+{
+    QFETCH(bool, sparse);
+
+    STData::STDataFrame data;
+    data.counts = mat({{1, 0, 0, 2},
+                       {0, 0, 3, 0},
+                       {0, 4, 0, 0},
+                       {5, 0, 0, 0}});
+    data.spots << "1x1" << "2x1" << "3x1" << "4x1";
+    data.genes << "GeneA" << "GeneB" << "GeneC" << "GeneD";
+    if (sparse) {
+        STData::toSparse(data);
+    }
+
+    // the genes without counts in the spots are removed (and the missing spots ignored)
+    const STData::STDataFrame spots =
+            STData::sliceDataFrameSpots(data, QList<QString>() << "4x1" << "1x1" << "9x9");
+    QCOMPARE(spots.is_sparse, sparse);
+    QCOMPARE(spots.spots, QList<QString>() << "4x1" << "1x1");
+    QCOMPARE(spots.genes, QList<QString>() << "GeneA" << "GeneD");
+    QVERIFY(approx_equal(STData::denseCounts(spots), mat({{5, 0}, {1, 2}}), "absdiff", 0));
+
+    // the spots without counts in the genes are removed
+    const STData::STDataFrame genes =
+            STData::sliceDataFrameGenes(data, QList<QString>() << "GeneC" << "GeneA");
+    QCOMPARE(genes.spots, QList<QString>() << "1x1" << "2x1" << "4x1");
+    QCOMPARE(genes.genes, QList<QString>() << "GeneC" << "GeneA");
+    QVERIFY(approx_equal(STData::denseCounts(genes),
+                         mat({{0, 1}, {3, 0}, {0, 5}}), "absdiff", 0));
+
+    // slicing several lists at once gives the same data frames
+    const QList<QList<QString>> lists = QList<QList<QString>>()
+            << (QList<QString>() << "4x1" << "1x1" << "9x9")
+            << (QList<QString>() << "3x1")
+            << QList<QString>();
+    const QList<STData::STDataFrame> sliced = STData::sliceDataFrameSpots(data, lists);
+    QCOMPARE(sliced.size(), lists.size());
+    for (int i = 0; i < lists.size(); ++i) {
+        const STData::STDataFrame expected = STData::sliceDataFrameSpots(data, lists.at(i));
+        QCOMPARE(sliced.at(i).spots, expected.spots);
+        QCOMPARE(sliced.at(i).genes, expected.genes);
+        QVERIFY(approx_equal(STData::denseCounts(sliced.at(i)),
+                             STData::denseCounts(expected), "absdiff", 0));
+    }
+}
+
+void STDataTest::testSliceDataFrame_data()
+{
+    QTest::addColumn<bool>("sparse");
+
+    QTest::newRow("dense") << false;
+    QTest::newRow("sparse") << true;
+}
+
+void STDataTest::testAggregate()
+{
+    QFETCH(bool, sparse);
+
+    STData::STDataFrame first;
+    first.counts = mat({{1, 0, 2},
+                        {0, 3, 0}});
+    first.spots << "1x1" << "2x1";
+    first.genes << "GeneC" << "GeneA" << "GeneB";
+    STData::STDataFrame second;
+    second.counts = mat({{0, 4},
+                         {5, 0},
+                         {6, 7}});
+    second.spots << "1x1" << "3x1" << "4x1";
+    second.genes << "GeneD" << "GeneA";
+    STData::toSparse(second);
+    STData::STDataFrame third;
+    third.counts = mat(0, 1);
+    third.genes << "GeneE";
+
+    const STData::STDataFrame merged =
+            STData::aggregate(QList<STData::STDataFrame>() << first << second << third, sparse);
+    if (sparse) {
+        QVERIFY(merged.is_sparse);
+    }
+    QCOMPARE(merged.genes,
+             QList<QString>() << "GeneA" << "GeneB" << "GeneC" << "GeneD" << "GeneE");
+    QCOMPARE(merged.spots, QList<QString>() << "0_1x1" << "0_2x1"
+                                            << "1_1x1" << "1_3x1" << "1_4x1");
+    const mat expected = {{0, 2, 1, 0, 0},
+                          {3, 0, 0, 0, 0},
+                          {4, 0, 0, 0, 0},
+                          {0, 0, 0, 5, 0},
+                          {7, 0, 0, 6, 0}};
+    QVERIFY(approx_equal(STData::denseCounts(merged), expected, "absdiff", 0));
+}
+
+void STDataTest::testAggregate_data()
+{
+    QTest::addColumn<bool>("sparse");
+
+    QTest::newRow("dense") << false;
+    QTest::newRow("sparse") << true;
+}
+
+void STDataTest::testIncrementalRendering()
+{
+    QFETCH(int, density);
+    QFETCH(int, normalization);
+
+    // every fifth value is non zero with a density of 1 (sparse storage)
+    QByteArray content;
+    for (int j = 0; j < 20; ++j) {
+        content += "\tGene" + QByteArray::number(j);
+    }
+    content += "\n";
+    for (int i = 0; i < 30; ++i) {
+        content += QByteArray::number(i) + "x1";
+        for (int j = 0; j < 20; ++j) {
+            const int value = (i * 7 + j * 3) % 5 < density ? (i + j) % 6 : 0;
+            content += "\t" + QByteArray::number(value);
+        }
+        content += "\n";
+    }
+    QTemporaryFile file;
+    const QString filename = writeMatrix(file, content);
+    QVERIFY(!filename.isEmpty());
+
+    SettingsWidget::Rendering settings;
+    settings.reads_threshold = 2;
+    settings.genes_threshold = 1;
+    settings.spots_threshold = 1;
+    settings.ind_reads_threshold = 1;
+    settings.intensity = 1.0;
+    settings.size = 1.0;
+    settings.visual_mode = SettingsWidget::VisualMode::HeatMap;
+    settings.normalization_mode = static_cast<SettingsWidget::NormalizationMode>(normalization);
+    settings.visual_type_mode = SettingsWidget::VisualTypeMode::Reads;
+    settings.gene_cutoff = true;
+    settings.size_factors = false;
+
+    STData incremental;
+    incremental.init(filename);
+    for (const auto &gene : incremental.genes()) {
+        gene->visible(true);
+    }
+    incremental.computeRenderingData(settings);
+
+    // change some genes and thresholds after the first update
+    incremental.genes().at(3)->visible(false);
+    incremental.genes().at(5)->color(Qt::blue);
+    incremental.genes().at(7)->cut_off(2);
+    incremental.computeRenderingData(settings);
+    settings.reads_threshold = 4;
+    settings.visual_mode = SettingsWidget::VisualMode::DynamicRange;
+    incremental.computeRenderingData(settings);
+    const double legend_min = settings.legend_min;
+    const double legend_max = settings.legend_max;
+
+    // the same state computed at once
+    STData full;
+    full.init(filename);
+    for (const auto &gene : full.genes()) {
+        gene->visible(true);
+    }
+    full.genes().at(3)->visible(false);
+    full.genes().at(5)->color(Qt::blue);
+    full.genes().at(7)->cut_off(2);
+    full.computeRenderingData(settings);
+
+    QCOMPARE(incremental.renderingVisible(), full.renderingVisible());
+    QCOMPARE(incremental.renderingSelected(), full.renderingSelected());
+    QCOMPARE(legend_min, settings.legend_min);
+    QCOMPARE(legend_max, settings.legend_max);
+    for (int i = 0; i < full.spots().size(); ++i) {
+        if (full.renderingVisible().at(i)) {
+            QCOMPARE(incremental.renderingColors().at(i), full.renderingColors().at(i));
+            QCOMPARE(incremental.renderingValues().at(i), full.renderingValues().at(i));
+        }
+    }
+}
+
+void STDataTest::testIncrementalRendering_data()
+{
+    QTest::addColumn<int>("density");
+    QTest::addColumn<int>("normalization");
+
+    QTest::newRow("dense_raw") << 5 << int(SettingsWidget::NormalizationMode::RAW);
+    QTest::newRow("dense_rel") << 5 << int(SettingsWidget::NormalizationMode::REL);
+    QTest::newRow("sparse_raw") << 1 << int(SettingsWidget::NormalizationMode::RAW);
+    QTest::newRow("sparse_tpm") << 1 << int(SettingsWidget::NormalizationMode::TPM);
+}
+
+void STDataTest::testRenderingColors()
+{
+    QTemporaryFile file;
+    const QString filename = writeMatrix(file,
+                                         "\tGeneA\tGeneB\tGeneC\tGeneD\n"
+                                         "1x1\t1\t2\t3\t0\n"
+                                         "2x1\t0\t5\t1\t7\n"
+                                         "3x1\t4\t0\t0\t0\n");
+    QVERIFY(!filename.isEmpty());
+
+    SettingsWidget::Rendering settings;
+    settings.reads_threshold = 0;
+    settings.genes_threshold = 0;
+    settings.spots_threshold = 0;
+    settings.ind_reads_threshold = 0;
+    settings.intensity = 1.0;
+    settings.size = 1.0;
+    settings.visual_mode = SettingsWidget::VisualMode::Normal;
+    settings.normalization_mode = SettingsWidget::NormalizationMode::RAW;
+    settings.visual_type_mode = SettingsWidget::VisualTypeMode::Reads;
+    settings.gene_cutoff = true;
+    settings.size_factors = false;
+
+    STData data;
+    data.init(filename);
+    const QList<QColor> colors = QList<QColor>() << QColor(255, 0, 0) << QColor(10, 200, 30, 128)
+                                                 << QColor(0, 0, 255) << QColor(77, 77, 77);
+    for (int j = 0; j < data.genes().size(); ++j) {
+        data.genes().at(j)->visible(true);
+        data.genes().at(j)->color(colors.at(j));
+    }
+    data.genes().at(2)->cut_off(1);
+    data.computeRenderingData(settings);
+
+    // the colors of the genes (above the cut-off) blended in order
+    const mat counts = STData::denseCounts(data.data());
+    for (uword i = 0; i < counts.n_rows; ++i) {
+        QColor expected;
+        double num_genes = 0;
+        for (uword j = 0; j < counts.n_cols; ++j) {
+            const double value = counts(i, j);
+            if (value > 0 && value > data.genes().at(j)->cut_off()) {
+                ++num_genes;
+                expected = STMath::lerp(1.0 / num_genes, expected, colors.at(j));
+            }
+        }
+        QVERIFY(data.renderingVisible().at(i));
+        QCOMPARE(data.renderingColors().at(i), expected);
+    }
+}
+
+void STDataTest::testSelectSpots()
+{
+    // a grid of 10x10 spots, the last spot has no counts (it is not visible)
+    QByteArray content = "\tGeneA\tGeneB\tGeneC\n";
+    for (int x = 1; x <= 10; ++x) {
+        for (int y = 1; y <= 10; ++y) {
+            content += QByteArray::number(x) + "x" + QByteArray::number(y);
+            for (int j = 0; j < 3; ++j) {
+                const int value = x == 10 && y == 10 ? 0 : 1 + (x + y + j) % 4;
+                content += "\t" + QByteArray::number(value);
+            }
+            content += "\n";
+        }
+    }
+    QTemporaryFile file;
+    const QString filename = writeMatrix(file, content);
+    QVERIFY(!filename.isEmpty());
+
+    SettingsWidget::Rendering settings;
+    settings.reads_threshold = 0;
+    settings.genes_threshold = 0;
+    settings.spots_threshold = 0;
+    settings.ind_reads_threshold = 0;
+    settings.intensity = 1.0;
+    settings.size = 1.0;
+    settings.visual_mode = SettingsWidget::VisualMode::Normal;
+    settings.normalization_mode = SettingsWidget::NormalizationMode::RAW;
+    settings.visual_type_mode = SettingsWidget::VisualTypeMode::Reads;
+    settings.gene_cutoff = false;
+    settings.size_factors = false;
+
+    STData data;
+    data.init(filename);
+    for (const auto &gene : data.genes()) {
+        gene->visible(true);
+    }
+    data.computeRenderingData(settings);
+
+    QPainterPath rect;
+    rect.addRect(QRectF(2.5, 2.5, 4.0, 3.0));
+    QPainterPath lasso(QPointF(1.0, 1.0));
+    lasso.lineTo(9.5, 2.0);
+    lasso.lineTo(5.0, 10.5);
+    lasso.closeSubpath();
+    QPainterPath corner;
+    corner.addRect(QRectF(7.5, 7.5, 5.0, 5.0));
+    const QList<QPair<QPainterPath, SelectionEvent::SelectionMode>> selections =
+            QList<QPair<QPainterPath, SelectionEvent::SelectionMode>>()
+            << qMakePair(rect, SelectionEvent::NewSelection)
+            << qMakePair(lasso, SelectionEvent::IncludeSelection)
+            << qMakePair(rect, SelectionEvent::ExcludeSelection)
+            << qMakePair(corner, SelectionEvent::NewSelection);
+
+    QVector<bool> expected(data.spots().size(), false);
+    for (const auto &selection : selections) {
+        QVERIFY(data.selectSpots(SelectionEvent(selection.first, selection.second)));
+        for (int i = 0; i < data.spots().size(); ++i) {
+            const auto &coord = data.spots().at(i)->coordinates();
+            const bool inside = selection.first.contains(QPointF(coord.first, coord.second));
+            if (selection.second == SelectionEvent::NewSelection) {
+                expected[i] = inside;
+            } else if (inside) {
+                expected[i] = selection.second == SelectionEvent::IncludeSelection;
+            }
+            expected[i] = expected[i] && data.renderingVisible().at(i);
+        }
+        const QVector<bool> selected = data.renderingSelected();
+        QCOMPARE(selected, expected);
+
+        // the same selection as computed by computeRenderingData()
+        data.computeRenderingData(settings);
+        QCOMPARE(data.renderingSelected(), selected);
+    }
+
+    // clearing the selection of the genes needs computeRenderingData()
+    data.genes().at(0)->selected(true);
+    data.computeRenderingData(settings);
+    QVERIFY(!data.selectSpots(SelectionEvent(rect)));
+}
+
+void STDataTest::testBinaryFormat()
+{
+    QFETCH(bool, sparse);
+
+    STDataBinary::Content content;
+    STData::STDataFrame &data = content.data;
+    data.counts = mat(20, 10, fill::zeros);
+    data.counts(3, 4) = 5.0;
+    data.counts(19, 0) = 0.5;
+    data.counts(0, 9) = 12.0;
+    for (int i = 0; i < 20; ++i) {
+        data.spots.append(QString::number(i) + "x" + QString::number(i + 1));
+        content.coordinates.append(Spot::SpotType(i + 0.5, i + 1.5));
+    }
+    for (int j = 0; j < 10; ++j) {
+        data.genes.append("Gene" + QString::number(j));
+    }
+    content.size_factors = rowvec(20, fill::ones);
+    content.source_fingerprint = 42;
+    if (sparse) {
+        STData::toSparse(data);
+    }
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.close();
+    STDataBinary::write(file.fileName(), content);
+    QVERIFY(STDataBinary::isBinary(file.fileName()));
+
+    for (const bool map_counts : {false, true}) {
+        const STDataBinary::Content loaded = STDataBinary::read(file.fileName(), map_counts);
+        QCOMPARE(loaded.data.is_sparse, sparse);
+        QCOMPARE(loaded.data.genes, data.genes);
+        QCOMPARE(loaded.data.spots, data.spots);
+        QCOMPARE(loaded.coordinates, content.coordinates);
+        QCOMPARE(loaded.source_fingerprint, quint64(42));
+        QVERIFY(approx_equal(loaded.size_factors, content.size_factors, "absdiff", 0.0));
+        QVERIFY(approx_equal(STData::denseCounts(loaded.data),
+                             STData::denseCounts(data), "absdiff", 0.0));
+    }
+
+    // STData::read() detects the binary format
+    const STData::STDataFrame read_data = STData::read(file.fileName());
+    QCOMPARE(read_data.genes, data.genes);
+
+    // a corrupted file is rejected
+    QVERIFY(file.open());
+    file.seek(file.size() - 1);
+    file.write("x");
+    file.close();
+    QVERIFY_EXCEPTION_THROWN(STDataBinary::read(file.fileName()), std::runtime_error);
+}
+
+void STDataTest::testBinaryFormat_data()
+{
+    QTest::addColumn<bool>("sparse");
+
+    QTest::newRow("dense") << false;
+    QTest::newRow("sparse") << true;
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::STDataTest)
+#include "tst_stdatatest.moc"
@@ -0,0 +1,44 @@
+#ifndef TST_STDATATEST_H
+#define TST_STDATATEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class STDataTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit STDataTest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testRead();
+    void testReadWindowsLineEndings();
+    void testReadDuplicatedGenes();
+    void testReadInvalidMatrix();
+    void testReadInvalidMatrix_data();
+
+    void testSparseStorage();
+    void testFilterDataFrame();
+    void testSliceDataFrame();
+    void testSliceDataFrame_data();
+    void testAggregate();
+    void testAggregate_data();
+
+    void testIncrementalRendering();
+    void testIncrementalRendering_data();
+    void testRenderingColors();
+    void testSelectSpots();
+
+    void testBinaryFormat();
+    void testBinaryFormat_data();
+};
+
+} // namespace unit //
+
+#endif // TST_STDATATEST_H
@@ -0,0 +1,23 @@
+#include "simulateddata.h"
+
+#include <random>
+
+namespace unit
+{
+
+mat simulatedClusters(const uword clusters,
+                      const uword spots,
+                      const uword dims,
+                      const double shift)
+{
+    std::mt19937 generator(1);
+    std::normal_distribution<double> normal;
+    mat data(clusters * spots, dims);
+    data.imbue([&]() { return normal(generator); });
+    for (uword c = 0; c < clusters; ++c) {
+        data.rows(c * spots, (c + 1) * spots - 1).col(c) += shift;
+    }
+    return data;
+}
+
+} // namespace unit //
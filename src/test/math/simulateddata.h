@@ -0,0 +1,21 @@
+#ifndef SIMULATEDDATA_H
+#define SIMULATEDDATA_H
+
+#include <armadillo>
+
+using namespace arma;
+
+namespace unit
+{
+
+// Simulates well separated gaussian clusters for the tests (always the same data): the
+// spots of every cluster are consecutive rows and the cluster c is shifted by shift in
+// the dimension c (there must be at least as many dimensions as clusters)
+mat simulatedClusters(const uword clusters,
+                      const uword spots,
+                      const uword dims,
+                      const double shift);
+
+} // namespace unit //
+
+#endif // SIMULATEDDATA_H
@@ -0,0 +1,112 @@
+#include <QtTest/QTest>
+
+#include "math/Clustering.h"
+
+#include "simulateddata.h"
+#include "tst_clusteringtest.h"
+
+namespace unit
+{
+
+// the clusters, dimensions and separation of the simulated data
+static const uword CLUSTERS = 3;
+static const uword DIMS = 5;
+static const double SHIFT = 20.0;
+
+// helper function that returns true when the clusters are the simulated ones (the
+// clusters are numbered in the order of the spots)
+static bool sameClusters(const uvec &clusters, const uword spots)
+{
+    if (clusters.n_elem != CLUSTERS * spots) {
+        return false;
+    }
+    for (uword i = 0; i < clusters.n_elem; ++i) {
+        if (clusters[i] != i / spots) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ClusteringTest::ClusteringTest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void ClusteringTest::initTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void ClusteringTest::cleanupTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void ClusteringTest::testKMeans_data()
+{
+    QTest::addColumn<int>("spots");
+
+    QTest::newRow("lloyd") << 100;
+    QTest::newRow("mini_batch") << 4000;
+}
+
+void ClusteringTest::testKMeans()
+{
+    QFETCH(int, spots);
+
+    const mat data = simulatedClusters(CLUSTERS, spots, DIMS, SHIFT);
+    QVERIFY(sameClusters(Clustering::kmeans(data, CLUSTERS), spots));
+    QVERIFY(Clustering::kmeans(data.rows(0, 1), CLUSTERS).max() == 1);
+    QVERIFY(Clustering::kmeans(mat(0, DIMS), CLUSTERS).is_empty());
+}
+
+void ClusteringTest::testWard()
+{
+    const uword spots = 100;
+    const mat data = simulatedClusters(CLUSTERS, spots, DIMS, SHIFT);
+    QVERIFY(sameClusters(Clustering::ward(data, CLUSTERS), spots));
+    QVERIFY(Clustering::ward(data, 1).max() == 0);
+    QVERIFY(Clustering::ward(data, 2 * data.n_rows).max() == data.n_rows - 1);
+}
+
+void ClusteringTest::testWardTree()
+{
+    // cutree(hclust(dist(x), method="ward.D2"), k) in R
+    const mat data = vec({0.0, 1.0, 5.0, 6.0, 20.0});
+    QVERIFY(all(Clustering::ward(data, 2) == uvec({0, 0, 0, 0, 1})));
+    QVERIFY(all(Clustering::ward(data, 3) == uvec({0, 0, 1, 1, 2})));
+    QVERIFY(all(Clustering::ward(data, 4) == uvec({0, 0, 1, 2, 3})));
+}
+
+void ClusteringTest::testLouvain()
+{
+    // two cliques of 5 nodes joined by one edge
+    mat adjacency(10, 10, fill::zeros);
+    adjacency.submat(0, 0, 4, 4).ones();
+    adjacency.submat(5, 5, 9, 9).ones();
+    adjacency.diag().zeros();
+    adjacency(4, 5) = 1.0;
+    adjacency(5, 4) = 1.0;
+    const uvec communities = Clustering::louvain(sp_mat(adjacency));
+    QVERIFY(all(communities == uvec({0, 0, 0, 0, 0, 1, 1, 1, 1, 1})));
+
+    // a graph without edges
+    QVERIFY(all(Clustering::louvain(sp_mat(3, 3)) == uvec({0, 1, 2})));
+}
+
+void ClusteringTest::testGraphClusters()
+{
+    const uword spots = 100;
+    const mat data = simulatedClusters(CLUSTERS, spots, DIMS, SHIFT);
+    const sp_mat graph = Clustering::neighborsGraph(data, 10);
+    QVERIFY(graph.n_rows == data.n_rows);
+    QVERIFY(approx_equal(mat(graph), mat(graph.t()), "absdiff", 0.0));
+    QVERIFY(sameClusters(Clustering::graphClusters(data, CLUSTERS), spots));
+    QVERIFY(Clustering::estimateClusters(data) >= CLUSTERS);
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::ClusteringTest)
+#include "tst_clusteringtest.moc"
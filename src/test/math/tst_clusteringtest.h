@@ -0,0 +1,30 @@
+#ifndef TST_CLUSTERINGTEST_H
+#define TST_CLUSTERINGTEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class ClusteringTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ClusteringTest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testKMeans_data();
+    void testKMeans();
+    void testWard();
+    void testWardTree();
+    void testLouvain();
+    void testGraphClusters();
+};
+
+} // namespace unit //
+
+#endif // TST_CLUSTERINGTEST_H
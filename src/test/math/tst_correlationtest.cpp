@@ -0,0 +1,143 @@
+#include <QtTest/QTest>
+
+#include <random>
+
+#include "math/Correlation.h"
+
+#include "tst_correlationtest.h"
+
+Q_DECLARE_METATYPE(Correlation::Method)
+
+namespace unit
+{
+
+// helper function that simulates correlated columns with many ties (as counts)
+static mat simulatedCounts(const uword rows, const uword columns)
+{
+    std::mt19937 generator(1);
+    std::poisson_distribution<int> poisson(3.0);
+    mat counts(rows, columns);
+    counts.imbue([&]() { return poisson(generator); });
+    for (uword j = 1; j < columns; ++j) {
+        counts.col(j) += counts.col(j - 1);
+    }
+    return counts;
+}
+
+// helper function that computes Kendall's tau-b with every pair of values
+static double bruteForceKendall(const vec &a, const vec &b)
+{
+    const double n = a.n_elem;
+    double concordance = 0.0;
+    double ties_a = 0.0;
+    double ties_b = 0.0;
+    for (uword i = 0; i < a.n_elem; ++i) {
+        for (uword j = i + 1; j < a.n_elem; ++j) {
+            const double sign = (a[i] - a[j]) * (b[i] - b[j]);
+            concordance += sign > 0 ? 1.0 : (sign < 0 ? -1.0 : 0.0);
+            ties_a += a[i] == a[j] ? 1.0 : 0.0;
+            ties_b += b[i] == b[j] ? 1.0 : 0.0;
+        }
+    }
+    const double total = n * (n - 1) / 2;
+    return concordance / std::sqrt((total - ties_a) * (total - ties_b));
+}
+
+CorrelationTest::CorrelationTest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void CorrelationTest::initTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void CorrelationTest::cleanupTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void CorrelationTest::testPearson()
+{
+    const vec a = {1, 2, 3, 4, 5};
+    QVERIFY(Correlation::pearson(a, 2 * a + 1) == 1.0);
+    QVERIFY(Correlation::pearson(a, -a) == -1.0);
+    // cor(c(1, 2, 3, 4, 5), c(2, 1, 4, 3, 6)) in R
+    const vec b = {2, 1, 4, 3, 6};
+    QVERIFY(std::abs(Correlation::pearson(a, b) - 0.8552617) < 1e-6);
+    // the constant vectors and the vectors of different sizes have no correlation
+    QVERIFY(std::isnan(Correlation::pearson(a, vec(5, fill::ones))));
+    QVERIFY(std::isnan(Correlation::pearson(a, b.head(4))));
+}
+
+void CorrelationTest::testRanks()
+{
+    const vec values = {10, 30, 20, 20, 0};
+    const vec expected = {2, 5, 3.5, 3.5, 1};
+    QVERIFY(approx_equal(Correlation::ranks(values), expected, "absdiff", 1e-12));
+}
+
+void CorrelationTest::testSpearman()
+{
+    // monotonic relations have correlation 1
+    const vec a = {1, 2, 3, 4, 5};
+    QVERIFY(std::abs(Correlation::spearman(a, exp(a)) - 1.0) < 1e-12);
+    // cor(c(1, 2, 2, 3, 4), c(1, 3, 2, 2, 5), method="spearman") in R
+    const vec b = {1, 2, 2, 3, 4};
+    const vec c = {1, 3, 2, 2, 5};
+    QVERIFY(std::abs(Correlation::spearman(b, c) - 0.6578947) < 1e-6);
+}
+
+void CorrelationTest::testKendall()
+{
+    const vec a = {1, 2, 3, 4, 5};
+    QVERIFY(std::abs(Correlation::kendall(a, a) - 1.0) < 1e-12);
+    QVERIFY(std::abs(Correlation::kendall(a, -a) + 1.0) < 1e-12);
+    QVERIFY(std::isnan(Correlation::kendall(a, vec(5, fill::ones))));
+
+    // the merge sort counts the same pairs as every pair (with many ties)
+    const mat counts = simulatedCounts(500, 3);
+    for (uword j = 1; j < counts.n_cols; ++j) {
+        const double expected = bruteForceKendall(counts.col(0), counts.col(j));
+        QVERIFY(std::abs(Correlation::kendall(counts.col(0), counts.col(j)) - expected)
+                < 1e-12);
+    }
+}
+
+void CorrelationTest::testCorrelationMatrix_data()
+{
+    QTest::addColumn<Correlation::Method>("method");
+
+    QTest::newRow("pearson") << Correlation::Pearson;
+    QTest::newRow("spearman") << Correlation::Spearman;
+    QTest::newRow("kendall") << Correlation::Kendall;
+}
+
+void CorrelationTest::testCorrelationMatrix()
+{
+    QFETCH(Correlation::Method, method);
+
+    // more columns than a block and a constant column
+    mat counts = simulatedCounts(100, 300);
+    counts.col(7).fill(3);
+    const mat correlations = Correlation::correlationMatrix(counts, method);
+    QVERIFY(correlations.n_rows == counts.n_cols && correlations.n_cols == counts.n_cols);
+    for (const uword i : {0, 7, 100, 299}) {
+        for (const uword j : {0, 7, 255, 256, 299}) {
+            const double expected =
+                    Correlation::correlation(counts.col(i), counts.col(j), method);
+            if (std::isnan(expected)) {
+                QVERIFY(std::isnan(correlations(i, j)));
+            } else {
+                QVERIFY(std::abs(correlations(i, j) - expected) < 1e-10);
+            }
+        }
+    }
+    QVERIFY(correlations(0, 0) == 1.0);
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::CorrelationTest)
+#include "tst_correlationtest.moc"
@@ -0,0 +1,30 @@
+#ifndef TST_CORRELATIONTEST_H
+#define TST_CORRELATIONTEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class CorrelationTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CorrelationTest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testPearson();
+    void testRanks();
+    void testSpearman();
+    void testKendall();
+    void testCorrelationMatrix_data();
+    void testCorrelationMatrix();
+};
+
+} // namespace unit //
+
+#endif // TST_CORRELATIONTEST_H
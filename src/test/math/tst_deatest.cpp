@@ -0,0 +1,191 @@
+#include <QtTest/QTest>
+
+#include <random>
+
+#include "math/DEA.h"
+
+#include "tst_deatest.h"
+
+Q_DECLARE_METATYPE(DEA::Test)
+Q_DECLARE_METATYPE(DEA::MarkersTest)
+
+namespace unit
+{
+
+// the number of spots of each condition, genes and DE genes of the simulated counts
+static const uword SPOTS = 60;
+static const uword GENES = 200;
+static const uword DE_GENES = 20;
+
+// helper function that simulates negative binomial counts (dispersion 0.1), the
+// first DE_GENES genes have 4 times more counts in the condition A
+static mat simulatedCounts(std::vector<std::string> &condition)
+{
+    std::mt19937 generator(1);
+    mat counts(2 * SPOTS, GENES);
+    condition.clear();
+    for (uword i = 0; i < 2 * SPOTS; ++i) {
+        condition.push_back(i < SPOTS ? "A" : "B");
+    }
+    for (uword j = 0; j < GENES; ++j) {
+        for (uword i = 0; i < 2 * SPOTS; ++i) {
+            double mu = 5.0 + 2.0 * (j % 10);
+            if (j < DE_GENES && i < SPOTS) {
+                mu *= 4.0;
+            }
+            std::gamma_distribution<double> gamma(10.0, mu / 10.0);
+            std::poisson_distribution<int> poisson(gamma(generator));
+            counts(i, j) = poisson(generator);
+        }
+    }
+    return counts;
+}
+
+DEATest::DEATest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void DEATest::initTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void DEATest::cleanupTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void DEATest::testAdjustPValues()
+{
+    // the same as p.adjust(method="BH") in R
+    const vec adjusted = DEA::adjustPValues(vec({0.01, 0.04, 0.03, 0.2}));
+    QVERIFY(approx_equal(adjusted, vec({0.04, 0.16 / 3.0, 0.16 / 3.0, 0.2}), "reldiff", 1e-12));
+    QVERIFY(DEA::adjustPValues(vec()).is_empty());
+}
+
+void DEATest::testWilcoxon()
+{
+    // wilcox.test(c(1, 2, 3), c(4, 5, 6), exact=FALSE) in R
+    const mat counts = vec({1, 2, 3, 4, 5, 6});
+    mat results;
+    std::vector<std::string> rows;
+    std::vector<std::string> cols;
+    DEA::computeDEA(counts, rowvec(6, fill::ones), {"gene"}, {"A", "A", "A", "B", "B", "B"},
+                    DEA::Wilcoxon, results, rows, cols);
+    QVERIFY(rows.size() == 1);
+    QVERIFY(cols.size() == 6);
+    QVERIFY(results.n_rows == 1);
+    QVERIFY(std::abs(results(0, DEA::PValue) - 0.08085913) < 1e-7);
+    QVERIFY(std::abs(results(0, DEA::Statistic) + 4.0 / std::sqrt(5.25)) < 1e-12);
+    QVERIFY(std::abs(results(0, DEA::Log2FoldChange) + 1.0) < 1e-12);
+    QVERIFY(std::abs(results(0, DEA::BaseMean) - 3.5) < 1e-12);
+}
+
+void DEATest::testSimulatedCounts_data()
+{
+    QTest::addColumn<DEA::Test>("test");
+
+    QTest::newRow("wald") << DEA::NegativeBinomialWald;
+    QTest::newRow("lrt") << DEA::NegativeBinomialLRT;
+    QTest::newRow("wilcoxon") << DEA::Wilcoxon;
+}
+
+void DEATest::testSimulatedCounts()
+{
+    QFETCH(DEA::Test, test);
+
+    std::vector<std::string> condition;
+    const mat counts = simulatedCounts(condition);
+    std::vector<std::string> genes;
+    for (uword j = 0; j < GENES; ++j) {
+        genes.push_back("gene" + std::to_string(j));
+    }
+
+    mat results;
+    std::vector<std::string> rows;
+    std::vector<std::string> cols;
+    DEA::computeDEA(counts, rowvec(2 * SPOTS, fill::ones), genes, condition, test,
+                    results, rows, cols);
+    QCOMPARE(results.n_rows, GENES);
+    QCOMPARE(rows.size(), static_cast<size_t>(GENES));
+    QCOMPARE(cols.at(DEA::FDR), std::string("padj"));
+    QVERIFY(vec(results.col(DEA::FDR)).is_sorted());
+
+    uword false_positives = 0;
+    for (uword i = 0; i < results.n_rows; ++i) {
+        const uword gene = std::stoul(rows.at(i).substr(4));
+        const double fdr = results(i, DEA::FDR);
+        const double fold_change = results(i, DEA::Log2FoldChange);
+        if (gene < DE_GENES) {
+            QVERIFY(fdr < 0.01);
+            QVERIFY(fold_change > 1.0);
+        } else if (fdr < 0.05) {
+            ++false_positives;
+        }
+        // with equal size factors the fitted means are the means of the conditions
+        if (test != DEA::Wilcoxon) {
+            const double mean_a = mean(counts.col(gene).head(SPOTS));
+            const double mean_b = mean(counts.col(gene).tail(SPOTS));
+            QVERIFY(std::abs(fold_change - std::log2(mean_a / mean_b)) < 1e-6);
+        }
+    }
+    QVERIFY(false_positives <= (GENES - DE_GENES) / 20);
+}
+
+void DEATest::testMarkers_data()
+{
+    QTest::addColumn<DEA::MarkersTest>("test");
+
+    QTest::newRow("wilcoxon") << DEA::MarkersWilcoxon;
+    QTest::newRow("ttest") << DEA::MarkersTTest;
+}
+
+void DEATest::testMarkers()
+{
+    QFETCH(DEA::MarkersTest, test);
+
+    // 3 groups of spots where the gene i has 5 times more counts in the group i
+    const uword n_groups = 3;
+    const uword n_genes = 30;
+    std::mt19937 generator(1);
+    mat counts(n_groups * SPOTS, n_genes);
+    uvec groups(n_groups * SPOTS);
+    for (uword i = 0; i < counts.n_rows; ++i) {
+        groups[i] = i / SPOTS;
+        for (uword j = 0; j < n_genes; ++j) {
+            std::poisson_distribution<int> poisson(j == groups[i] ? 25.0 : 5.0);
+            counts(i, j) = poisson(generator);
+        }
+    }
+    std::vector<std::string> genes;
+    for (uword j = 0; j < n_genes; ++j) {
+        genes.push_back("gene" + std::to_string(j));
+    }
+
+    std::vector<mat> results;
+    std::vector<std::vector<std::string>> rows;
+    std::vector<std::string> cols;
+    DEA::computeMarkers(sp_mat(counts), genes, groups, n_groups, test, results, rows, cols);
+    QVERIFY(results.size() == n_groups);
+    QVERIFY(rows.size() == n_groups);
+    QCOMPARE(cols.at(DEA::Log2FoldChange), std::string("log2FoldChange"));
+    for (uword group = 0; group < n_groups; ++group) {
+        QCOMPARE(results[group].n_rows, n_genes);
+        QVERIFY(vec(results[group].col(DEA::FDR)).is_sorted());
+        // the marker of every group is ranked first
+        QCOMPARE(rows[group].front(), genes[group]);
+        QVERIFY(results[group](0, DEA::FDR) < 1e-6);
+        QVERIFY(results[group](0, DEA::Log2FoldChange) > 1.0);
+        QVERIFY(results[group](0, DEA::Statistic) > 0.0);
+    }
+
+    // a group without spots
+    DEA::computeMarkers(sp_mat(counts), genes, groups, n_groups + 1, test, results, rows, cols);
+    QVERIFY(results.empty());
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::DEATest)
+#include "tst_deatest.moc"
@@ -0,0 +1,30 @@
+#ifndef TST_DEATEST_H
+#define TST_DEATEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class DEATest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DEATest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testAdjustPValues();
+    void testWilcoxon();
+    void testSimulatedCounts_data();
+    void testSimulatedCounts();
+    void testMarkers_data();
+    void testMarkers();
+};
+
+} // namespace unit //
+
+#endif // TST_DEATEST_H
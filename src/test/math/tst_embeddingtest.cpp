@@ -0,0 +1,143 @@
+#include <QtTest/QTest>
+
+#include "math/Embedding.h"
+
+#include "simulateddata.h"
+#include "tst_embeddingtest.h"
+
+namespace unit
+{
+
+// the spots of each cluster, the dimensions and the separation of the simulated data
+// (two clusters, the first SPOTS spots are the first cluster)
+static const uword SPOTS = 100;
+static const uword DIMS = 10;
+static const double SHIFT = 20.0;
+
+// helper function that returns true when the nearest neighbor of every spot in the
+// embedding is in the same cluster
+static bool clustersSeparated(const mat &embedding)
+{
+    for (uword i = 0; i < embedding.n_rows; ++i) {
+        const vec distances = sum(square(embedding.each_row() - rowvec(embedding.row(i))), 1);
+        uword nearest = i == 0 ? 1 : 0;
+        for (uword j = 0; j < embedding.n_rows; ++j) {
+            if (j != i && distances[j] < distances[nearest]) {
+                nearest = j;
+            }
+        }
+        if ((i < SPOTS) != (nearest < SPOTS)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+EmbeddingTest::EmbeddingTest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void EmbeddingTest::initTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void EmbeddingTest::cleanupTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void EmbeddingTest::testUMAPCurve()
+{
+    // the same as find_ab_params(1.0, 0.1) in umap-learn
+    double a = 0.0;
+    double b = 0.0;
+    Embedding::fitUMAPCurve(0.1, a, b);
+    QVERIFY(std::abs(a - 1.577) < 1e-2);
+    QVERIFY(std::abs(b - 0.895) < 1e-2);
+}
+
+void EmbeddingTest::testFuzzyMemberships()
+{
+    // the strengths add up to log2(k + 1) as in umap-learn (the point itself excluded)
+    const uword k = 5;
+    const double distances[k] = {0.5, 0.5, 1.0, 1.5, 3.0};
+    double memberships[k];
+    Embedding::fuzzyMemberships(distances, k, 1.0, memberships);
+    double sum = 0.0;
+    for (uword r = 0; r < k; ++r) {
+        sum += memberships[r];
+    }
+    QVERIFY(std::abs(sum - std::log2(k + 1.0)) < 1e-4);
+    // the nearest neighbors have strength 1 and the strengths decrease with the distance
+    QCOMPARE(memberships[0], 1.0);
+    QCOMPARE(memberships[1], 1.0);
+    QVERIFY(memberships[2] < 1.0);
+    QVERIFY(memberships[3] < memberships[2]);
+    QVERIFY(memberships[4] < memberships[3]);
+}
+
+void EmbeddingTest::testClusters_data()
+{
+    QTest::addColumn<bool>("tsne");
+    QTest::addColumn<double>("theta");
+
+    QTest::newRow("tsne_exact") << true << 0.0;
+    QTest::newRow("tsne_barnes_hut") << true << 0.5;
+    QTest::newRow("umap") << false << 0.0;
+}
+
+void EmbeddingTest::testClusters()
+{
+    QFETCH(bool, tsne);
+    QFETCH(double, theta);
+
+    const mat data = simulatedClusters(2, SPOTS, DIMS, SHIFT);
+    const mat embedding = tsne ? Embedding::computeTSNE(data, 2, 30, theta, 500)
+                               : Embedding::computeUMAP(data, 2, 15, 0.1, 200);
+    QVERIFY(embedding.n_rows == data.n_rows);
+    QVERIFY(embedding.n_cols == 2);
+    QVERIFY(embedding.is_finite());
+    QVERIFY(clustersSeparated(embedding));
+
+    // the embeddings are always the same
+    const mat again = tsne ? Embedding::computeTSNE(data, 2, 30, theta, 500)
+                           : Embedding::computeUMAP(data, 2, 15, 0.1, 200);
+    QVERIFY(approx_equal(embedding, again, "absdiff", 1e-8));
+}
+
+void EmbeddingTest::testProgress()
+{
+    const mat data = simulatedClusters(2, SPOTS, DIMS, SHIFT);
+    std::vector<int> iterations;
+    const auto progress = [&](const int iteration, const mat &coordinates) {
+        iterations.push_back(iteration);
+        return coordinates.n_rows == data.n_rows && coordinates.n_cols == 2;
+    };
+    QVERIFY(!Embedding::computeTSNE(data, 2, 30, 0.5, 120, progress, 50).is_empty());
+    QVERIFY(iterations == std::vector<int>({50, 100, 120}));
+
+    // the embedding stops when the progress function returns false
+    iterations.clear();
+    const auto stop = [&](const int iteration, const mat &) {
+        iterations.push_back(iteration);
+        return false;
+    };
+    QVERIFY(Embedding::computeUMAP(data, 2, 15, 0.1, 200, stop, 10).is_empty());
+    QVERIFY(iterations == std::vector<int>({10}));
+}
+
+void EmbeddingTest::testFewSpots()
+{
+    // the perplexity and the neighbors are reduced
+    const mat data = simulatedClusters(2, SPOTS, DIMS, SHIFT).rows(SPOTS - 3, SPOTS + 2);
+    QVERIFY(Embedding::computeTSNE(data, 2, 30, 0.5, 100).is_finite());
+    QVERIFY(Embedding::computeUMAP(data, 2, 15, 0.1, 100).is_finite());
+    QVERIFY(Embedding::computeTSNE(data.rows(0, 0), 2, 30, 0.5, 100).n_rows == 1);
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::EmbeddingTest)
+#include "tst_embeddingtest.moc"
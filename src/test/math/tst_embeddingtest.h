@@ -0,0 +1,30 @@
+#ifndef TST_EMBEDDINGTEST_H
+#define TST_EMBEDDINGTEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class EmbeddingTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit EmbeddingTest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testUMAPCurve();
+    void testFuzzyMemberships();
+    void testClusters_data();
+    void testClusters();
+    void testProgress();
+    void testFewSpots();
+};
+
+} // namespace unit //
+
+#endif // TST_EMBEDDINGTEST_H
@@ -0,0 +1,166 @@
+#include <QtTest/QTest>
+
+#include <random>
+
+#include "math/Neighbors.h"
+
+#include "tst_neighborstest.h"
+
+namespace unit
+{
+
+// the dimensions (and the latent dimensions) of the simulated data and the neighbors
+static const uword DIMS = 10;
+static const uword LATENT_DIMS = 3;
+static const uword K = 10;
+
+// helper function that simulates spots close to a low dimensional space (as the
+// principal components of the expression)
+static mat simulatedSpots(const uword spots)
+{
+    std::mt19937 generator(1);
+    std::normal_distribution<double> normal;
+    mat latent(spots, LATENT_DIMS);
+    latent.imbue([&]() { return normal(generator); });
+    mat loadings(LATENT_DIMS, DIMS);
+    loadings.imbue([&]() { return normal(generator); });
+    mat noise(spots, DIMS);
+    noise.imbue([&]() { return 0.1 * normal(generator); });
+    return latent * loadings + noise;
+}
+
+// helper function that computes the nearest neighbors of every spot with two loops
+static umat bruteForceNeighbors(const mat &data, const uword k)
+{
+    umat indices(k, data.n_rows);
+    for (uword i = 0; i < data.n_rows; ++i) {
+        vec distances(data.n_rows);
+        for (uword j = 0; j < data.n_rows; ++j) {
+            distances[j] = norm(data.row(i) - data.row(j));
+        }
+        distances[i] = datum::inf;
+        const uvec order = stable_sort_index(distances);
+        indices.col(i) = order.head(k);
+    }
+    return indices;
+}
+
+// helper function that returns the fraction of the exact neighbors that were found
+static double recall(const umat &indices, const umat &exact)
+{
+    double found = 0.0;
+    for (uword i = 0; i < exact.n_cols; ++i) {
+        for (uword r = 0; r < exact.n_rows; ++r) {
+            found += any(indices.col(i) == exact(r, i)) ? 1.0 : 0.0;
+        }
+    }
+    return found / exact.n_elem;
+}
+
+NeighborsTest::NeighborsTest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void NeighborsTest::initTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void NeighborsTest::cleanupTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void NeighborsTest::testNearestNeighbors_data()
+{
+    QTest::addColumn<int>("spots");
+    QTest::addColumn<double>("min_recall");
+
+    QTest::newRow("exact") << 500 << 1.0;
+    QTest::newRow("index") << 6000 << 0.95;
+}
+
+void NeighborsTest::testNearestNeighbors()
+{
+    QFETCH(int, spots);
+    QFETCH(double, min_recall);
+
+    const mat data = simulatedSpots(spots);
+    umat indices;
+    mat distances;
+    Neighbors::nearestNeighbors(data, K, indices, distances);
+    QVERIFY(indices.n_rows == K && indices.n_cols == data.n_rows);
+    QVERIFY(distances.n_rows == K && distances.n_cols == data.n_rows);
+    QVERIFY(recall(indices, bruteForceNeighbors(data, K)) >= min_recall);
+    // the neighbors are sorted by distance and the spot is not its own neighbor
+    for (uword i = 0; i < data.n_rows; ++i) {
+        QVERIFY(all(diff(distances.col(i)) >= 0));
+        QVERIFY(!any(indices.col(i) == i));
+        QVERIFY(std::abs(distances(0, i) - norm(data.row(i) - data.row(indices(0, i))))
+                < 1e-8);
+    }
+}
+
+void NeighborsTest::testIndexNeighbors()
+{
+    const mat data = simulatedSpots(2000);
+    const Neighbors::Index index(data);
+    QVERIFY(index.size() == data.n_rows);
+    umat indices;
+    mat distances;
+    index.neighbors(K, indices, distances);
+    QVERIFY(indices.n_rows == K && indices.n_cols == data.n_rows);
+    QVERIFY(recall(indices, bruteForceNeighbors(data, K)) >= 0.95);
+
+    // the same trees are built every time
+    umat other_indices;
+    mat other_distances;
+    Neighbors::Index(data).neighbors(K, other_indices, other_distances);
+    QVERIFY(all(vectorise(indices == other_indices)));
+
+    // identical spots are split too
+    const Neighbors::Index same_index(mat(200, DIMS, fill::ones));
+    same_index.neighbors(K, indices, distances);
+    QVERIFY(indices.n_cols == 200);
+    QVERIFY(all(vectorise(distances) == 0));
+}
+
+void NeighborsTest::testIndexQuery()
+{
+    const mat data = simulatedSpots(2000);
+    const Neighbors::Index index(data);
+    uvec indices;
+    vec distances;
+
+    // a spot of the index is its own nearest spot
+    index.query(data.row(42), K + 1, indices, distances);
+    QVERIFY(indices.n_elem == K + 1 && distances.n_elem == K + 1);
+    QVERIFY(indices[0] == 42);
+    QVERIFY(distances[0] == 0);
+    QVERIFY(all(diff(distances) >= 0));
+
+    // all the spots are returned when there are less than k
+    const Neighbors::Index small_index(data.rows(0, 4));
+    small_index.query(data.row(0), K, indices, distances);
+    QVERIFY(indices.n_elem == 5);
+
+    // the point must have the dimensions of the index
+    index.query(rowvec(DIMS + 1, fill::zeros), K, indices, distances);
+    QVERIFY(indices.is_empty() && distances.is_empty());
+}
+
+void NeighborsTest::testEmptyIndex()
+{
+    const Neighbors::Index index;
+    QVERIFY(index.size() == 0);
+    uvec indices;
+    vec distances;
+    index.query(rowvec(DIMS, fill::zeros), K, indices, distances);
+    QVERIFY(indices.is_empty() && distances.is_empty());
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::NeighborsTest)
+#include "tst_neighborstest.moc"
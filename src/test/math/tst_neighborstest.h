@@ -0,0 +1,29 @@
+#ifndef TST_NEIGHBORSTEST_H
+#define TST_NEIGHBORSTEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class NeighborsTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit NeighborsTest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testNearestNeighbors_data();
+    void testNearestNeighbors();
+    void testIndexNeighbors();
+    void testIndexQuery();
+    void testEmptyIndex();
+};
+
+} // namespace unit //
+
+#endif // TST_NEIGHBORSTEST_H
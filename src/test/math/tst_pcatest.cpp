@@ -0,0 +1,138 @@
+#include <QtTest/QTest>
+
+#include <random>
+
+#include "math/PCA.h"
+
+#include "tst_pcatest.h"
+
+namespace unit
+{
+
+// the spots, genes and rank of the simulated data
+static const uword SPOTS = 200;
+static const uword GENES = 100;
+static const uword RANK = 5;
+
+// helper function that simulates non negative counts of low rank plus a little noise
+static mat simulatedCounts()
+{
+    std::mt19937 generator(1);
+    std::exponential_distribution<double> exponential(1.0);
+    std::normal_distribution<double> normal(0.0, 0.01);
+    mat factors(SPOTS, RANK);
+    mat loadings(RANK, GENES);
+    mat noise(SPOTS, GENES);
+    factors.imbue([&]() { return exponential(generator); });
+    loadings.imbue([&]() { return exponential(generator); });
+    noise.imbue([&]() { return normal(generator); });
+    return clamp(factors * loadings + noise, 0.0, datum::inf);
+}
+
+// the exact principal components (the same as prcomp in R)
+static void exactPCA(const mat &counts, const bool center, const bool scale,
+                     mat &scores, vec &sdev)
+{
+    mat x = counts;
+    if (center) {
+        x.each_row() -= mean(counts, 0);
+    }
+    if (scale) {
+        x.each_row() /= stddev(counts, 0, 0);
+    }
+    mat U;
+    vec s;
+    mat V;
+    svd_econ(U, s, V, x);
+    scores = U * diagmat(s);
+    sdev = s / std::sqrt(counts.n_rows - 1.0);
+}
+
+PCATest::PCATest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void PCATest::initTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void PCATest::cleanupTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void PCATest::testExact_data()
+{
+    QTest::addColumn<bool>("center");
+    QTest::addColumn<bool>("scale");
+
+    QTest::newRow("none") << false << false;
+    QTest::newRow("center") << true << false;
+    QTest::newRow("center_scale") << true << true;
+}
+
+void PCATest::testExact()
+{
+    QFETCH(bool, center);
+    QFETCH(bool, scale);
+
+    const mat counts = simulatedCounts();
+    mat scores;
+    vec sdev;
+    exactPCA(counts, center, scale, scores, sdev);
+
+    const PCA::Result result = PCA::compute(counts, RANK, center, scale);
+    QVERIFY(result.scores.n_rows == SPOTS);
+    QVERIFY(result.scores.n_cols == RANK);
+    QVERIFY(result.loadings.n_rows == GENES);
+    QVERIFY(result.loadings.n_cols == RANK);
+    QVERIFY(approx_equal(result.sdev, sdev.head(RANK), "reldiff", 1e-6));
+    for (uword j = 0; j < RANK; ++j) {
+        // the components are the same up to the sign
+        QVERIFY(approx_equal(abs(result.scores.col(j)), abs(scores.col(j)), "absdiff", 1e-6));
+        // the largest loading is positive
+        QVERIFY(result.loadings(abs(result.loadings.col(j)).index_max(), j) > 0.0);
+    }
+}
+
+void PCATest::testSparse()
+{
+    const mat counts = simulatedCounts();
+    const PCA::Result dense = PCA::compute(counts, RANK, true, true);
+    const PCA::Result sparse = PCA::compute(sp_mat(counts), RANK, true, true);
+    QVERIFY(approx_equal(dense.scores, sparse.scores, "absdiff", 1e-8));
+    QVERIFY(approx_equal(dense.loadings, sparse.loadings, "absdiff", 1e-8));
+    QVERIFY(approx_equal(dense.sdev, sparse.sdev, "absdiff", 1e-8));
+}
+
+void PCATest::testFewSpots()
+{
+    // two spots have only one component, the rest are zero
+    const mat counts = simulatedCounts().rows(0, 1);
+    const PCA::Result result = PCA::compute(counts, 2, true, false);
+    QVERIFY(result.scores.n_rows == 2);
+    QVERIFY(result.scores.n_cols == 2);
+    QVERIFY(std::abs(result.scores(0, 0) + result.scores(1, 0)) < 1e-8);
+    const double distance = norm(counts.row(0) - counts.row(1));
+    QVERIFY(std::abs(std::abs(result.scores(0, 0)) - distance / 2.0) < 1e-8);
+    QVERIFY(std::abs(result.scores(0, 1)) < 1e-8);
+    QVERIFY(std::abs(result.scores(1, 1)) < 1e-8);
+
+    // no spots
+    QVERIFY(PCA::compute(mat(0, GENES), 2, true, false).scores.n_cols == 2);
+}
+
+void PCATest::testProject()
+{
+    // the projection of the data are the scores
+    const mat counts = simulatedCounts();
+    const PCA::Result result = PCA::compute(counts, RANK, true, true);
+    QVERIFY(approx_equal(PCA::project(counts, result), result.scores, "absdiff", 1e-8));
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::PCATest)
+#include "tst_pcatest.moc"
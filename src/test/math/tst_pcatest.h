@@ -0,0 +1,29 @@
+#ifndef TST_PCATEST_H
+#define TST_PCATEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class PCATest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PCATest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testExact_data();
+    void testExact();
+    void testSparse();
+    void testFewSpots();
+    void testProject();
+};
+
+} // namespace unit //
+
+#endif // TST_PCATEST_H
@@ -0,0 +1,135 @@
+#include <QtTest/QTest>
+#include <QtConcurrent>
+
+#include <memory>
+#include <numeric>
+
+#include "math/RWorkerPool.h"
+
+#include "tst_rworkerpooltest.h"
+
+namespace unit
+{
+
+// the R processes of the tests
+static const unsigned WORKERS = 2;
+static std::unique_ptr<RWorkerPool> pool;
+
+RWorkerPoolTest::RWorkerPoolTest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void RWorkerPoolTest::initTestCase()
+{
+    pool.reset(new RWorkerPool(WORKERS));
+    QVERIFY(RWorkerPool::instancePtr() == pool.get());
+    QVERIFY(pool->state() == RWorkerPool::NotStarted);
+}
+
+void RWorkerPoolTest::cleanupTestCase()
+{
+    pool.reset();
+    QVERIFY(RWorkerPool::instancePtr() == nullptr);
+}
+
+void RWorkerPoolTest::testLazyStart()
+{
+    // the first job starts R and waits for it
+    RWorkerPool::Job job("result = 1 + 1;");
+    job.addMatrixOutput("result", "result");
+    QVERIFY2(pool->run(job), qPrintable(job.error()));
+    QVERIFY(job.matrix("result")(0, 0) == 2);
+    QVERIFY(pool->state() == RWorkerPool::Ready);
+}
+
+void RWorkerPoolTest::testMatrices()
+{
+    const mat counts = randu<mat>(50, 7);
+    RWorkerPool::Job job("result = t(counts) * 2;");
+    job.setMatrix("counts", counts);
+    job.addMatrixOutput("result", "result");
+    job.addMatrixOutput("sums", "colSums(counts)");
+    job.addMatrixOutput("empty", "matrix(0, 0, 3)");
+    QVERIFY2(pool->run(job), qPrintable(job.error()));
+    QVERIFY(approx_equal(job.matrix("result"), mat(counts.t() * 2), "absdiff", 1e-12));
+    QVERIFY(approx_equal(job.matrix("sums"), mat(sum(counts, 0).t()), "absdiff", 1e-12));
+    QVERIFY(job.matrix("empty").n_rows == 0 && job.matrix("empty").n_cols == 3);
+}
+
+void RWorkerPoolTest::testSparseMatrices()
+{
+    // the sparse matrices are not dense in R
+    const sp_mat counts = sprandu<sp_mat>(40, 9, 0.2);
+    RWorkerPool::Job job("dense = as.matrix(t(counts));");
+    job.setMatrix("counts", counts);
+    job.addStringsOutput("class", "class(counts)");
+    job.addMatrixOutput("dense", "dense");
+    job.addMatrixOutput("nonzeros", "length(counts@x)");
+    QVERIFY2(pool->run(job), qPrintable(job.error()));
+    QVERIFY(job.strings("class") == std::vector<std::string>({"dgCMatrix"}));
+    QVERIFY(approx_equal(job.matrix("dense"), mat(counts.t()), "absdiff", 1e-12));
+    QVERIFY(job.matrix("nonzeros")(0, 0) == counts.n_nonzero);
+
+    // a matrix without values
+    RWorkerPool::Job empty("total = sum(counts);");
+    empty.setMatrix("counts", sp_mat(5, 3));
+    empty.addMatrixOutput("total", "total");
+    QVERIFY2(pool->run(empty), qPrintable(empty.error()));
+    QVERIFY(empty.matrix("total")(0, 0) == 0);
+}
+
+void RWorkerPoolTest::testStrings()
+{
+    const std::vector<std::string> genes = {"Actb", "Gapdh", "", "G\xC3\xA8ne"};
+    RWorkerPool::Job job("counts = length(genes);");
+    job.setStrings("genes", genes);
+    job.addStringsOutput("genes", "rev(genes)");
+    job.addMatrixOutput("counts", "counts");
+    QVERIFY2(pool->run(job), qPrintable(job.error()));
+    const std::vector<std::string> expected(genes.rbegin(), genes.rend());
+    QVERIFY(job.strings("genes") == expected);
+    QVERIFY(job.matrix("counts")(0, 0) == genes.size());
+}
+
+void RWorkerPoolTest::testError()
+{
+    // the error of R is returned and the worker can run the next job
+    RWorkerPool::Job job("stop('invalid counts')");
+    job.addMatrixOutput("result", "1");
+    QVERIFY(!pool->run(job));
+    QVERIFY(job.error().contains("invalid counts"));
+    QVERIFY(job.matrix("result").is_empty());
+
+    // the variables of the jobs are not shared
+    RWorkerPool::Job first("value = 1;");
+    QVERIFY(pool->run(first));
+    RWorkerPool::Job second("found = exists('value', inherits=FALSE);");
+    second.addMatrixOutput("found", "found");
+    QVERIFY(pool->run(second));
+    QVERIFY(second.matrix("found")(0, 0) == 0);
+}
+
+void RWorkerPoolTest::testConcurrentJobs()
+{
+    // more jobs than workers from several threads
+    std::vector<uword> jobs(WORKERS * 4);
+    std::iota(jobs.begin(), jobs.end(), 0);
+    std::vector<double> results(jobs.size(), 0.0);
+    QtConcurrent::blockingMap(jobs, [&results](const uword i) {
+        RWorkerPool::Job job("Sys.sleep(0.1); result = sum(values);");
+        job.setMatrix("values", vec(i + 1, fill::ones));
+        job.addMatrixOutput("result", "result");
+        if (pool->run(job)) {
+            results[i] = job.matrix("result")(0, 0);
+        }
+    });
+    for (uword i = 0; i < jobs.size(); ++i) {
+        QVERIFY(results[i] == i + 1);
+    }
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::RWorkerPoolTest)
+#include "tst_rworkerpooltest.moc"
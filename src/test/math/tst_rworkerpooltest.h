@@ -0,0 +1,30 @@
+#ifndef TST_RWORKERPOOLTEST_H
+#define TST_RWORKERPOOLTEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class RWorkerPoolTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RWorkerPoolTest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testLazyStart();
+    void testMatrices();
+    void testSparseMatrices();
+    void testStrings();
+    void testError();
+    void testConcurrentJobs();
+};
+
+} // namespace unit //
+
+#endif // TST_RWORKERPOOLTEST_H
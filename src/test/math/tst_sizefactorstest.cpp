@@ -0,0 +1,108 @@
+#include <QtTest/QTest>
+
+#include "math/SizeFactors.h"
+
+#include "tst_sizefactorstest.h"
+
+namespace unit
+{
+
+// helper function that creates counts where every spot is a multiple of the same profile
+static mat scaledCounts(const rowvec &scales, const uword n_genes)
+{
+    mat counts(scales.n_elem, n_genes);
+    for (uword j = 0; j < n_genes; ++j) {
+        counts.col(j) = scales.t() * double(j % 7 + 1);
+    }
+    return counts;
+}
+
+SizeFactorsTest::SizeFactorsTest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void SizeFactorsTest::initTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void SizeFactorsTest::cleanupTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void SizeFactorsTest::testDESeqFactors()
+{
+    const rowvec scales = {1.0, 2.0, 4.0, 0.5};
+    const rowvec factors = SizeFactors::computeDESeqFactors(scaledCounts(scales, 20));
+    // the factors are the scales divided by their geometric mean
+    const rowvec expected = scales / std::exp(mean(log(scales)));
+    QVERIFY(approx_equal(factors, expected, "reldiff", 1e-12));
+}
+
+void SizeFactorsTest::testDESeqFactorsMissingGenes()
+{
+    const rowvec scales = {1.0, 3.0, 9.0};
+    mat counts = scaledCounts(scales, 10);
+    // genes not present in every spot are not used
+    counts(0, 2) = 0;
+    counts(1, 2) = 1000;
+    rowvec factors = SizeFactors::computeDESeqFactors(counts);
+    QVERIFY(approx_equal(factors, rowvec({1.0 / 3.0, 1.0, 3.0}), "reldiff", 1e-12));
+
+    // no genes are present in every spot
+    counts.row(0).zeros();
+    factors = SizeFactors::computeDESeqFactors(counts);
+    QVERIFY(approx_equal(factors, rowvec(3, fill::ones), "absdiff", 0.0));
+}
+
+void SizeFactorsTest::testScranFactors()
+{
+    rowvec scales(200);
+    for (uword i = 0; i < scales.n_elem; ++i) {
+        scales[i] = 1.0 + (i * 37 % 11);
+    }
+    const rowvec factors = SizeFactors::computeScranFactors(scaledCounts(scales, 50));
+    // with proportional spots the factors are proportional to the library sizes
+    QVERIFY(approx_equal(factors, scales / mean(scales), "reldiff", 1e-6));
+    QVERIFY(std::abs(mean(factors) - 1.0) < 1e-9);
+}
+
+void SizeFactorsTest::testScranFactorsFewSpots()
+{
+    // too few spots to make pools (library sizes are used) and spots without counts
+    mat counts = scaledCounts(rowvec({1.0, 3.0, 0.0}), 5);
+    const rowvec factors = SizeFactors::computeScranFactors(counts);
+    QVERIFY(approx_equal(factors, rowvec({0.5, 1.5, 1.0}), "reldiff", 1e-12));
+}
+
+void SizeFactorsTest::testSparseFactors()
+{
+    // sparse counts give the same factors as dense counts
+    arma_rng::set_seed(1);
+    sp_mat sp_counts = sprandu<sp_mat>(120, 300, 0.3);
+    sp_counts.transform([](const double value) { return std::ceil(value * 20.0); });
+    // some genes are present in every spot and some spots have no counts
+    for (uword j = 0; j < 5; ++j) {
+        for (uword i = 0; i < sp_counts.n_rows; ++i) {
+            sp_counts(i, j) = double(j + 1);
+        }
+    }
+    mat counts(sp_counts);
+    QVERIFY(approx_equal(SizeFactors::computeDESeqFactors(sp_counts),
+                         SizeFactors::computeDESeqFactors(counts), "reldiff", 1e-12));
+    sp_counts.row(7).zeros();
+    counts.row(7).zeros();
+    QVERIFY(approx_equal(SizeFactors::computeScranFactors(sp_counts),
+                         SizeFactors::computeScranFactors(counts), "reldiff", 1e-9));
+
+    // no genes are present in every spot
+    QVERIFY(approx_equal(SizeFactors::computeDESeqFactors(sp_counts),
+                         rowvec(120, fill::ones), "absdiff", 0.0));
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::SizeFactorsTest)
+#include "tst_sizefactorstest.moc"
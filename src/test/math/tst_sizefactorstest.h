@@ -0,0 +1,29 @@
+#ifndef TST_SIZEFACTORSTEST_H
+#define TST_SIZEFACTORSTEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class SizeFactorsTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SizeFactorsTest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testDESeqFactors();
+    void testDESeqFactorsMissingGenes();
+    void testScranFactors();
+    void testScranFactorsFewSpots();
+    void testSparseFactors();
+};
+
+} // namespace unit //
+
+#endif // TST_SIZEFACTORSTEST_H
@@ -0,0 +1,167 @@
+#include <QtTest/QTest>
+
+#include <algorithm>
+#include <random>
+
+#include "math/Spatial.h"
+
+#include "tst_spatialtest.h"
+
+namespace unit
+{
+
+// the side of the simulated array of spots
+static const uword SIDE = 20;
+
+// helper function that returns the coordinates of a square array of spots
+static mat arrayCoordinates(const uword side)
+{
+    mat coordinates(side * side, 2);
+    for (uword i = 0; i < side * side; ++i) {
+        coordinates(i, 0) = i % side;
+        coordinates(i, 1) = i / side;
+    }
+    return coordinates;
+}
+
+// helper function that simulates counts of the array with the same library size in every
+// spot, a gene high in the left half, a random gene and a constant gene
+static mat simulatedCounts(const uword side)
+{
+    std::mt19937 generator(1);
+    std::poisson_distribution<int> poisson(5.0);
+    mat counts(side * side, 4);
+    for (uword i = 0; i < side * side; ++i) {
+        counts(i, 0) = i % side < side / 2 ? 20 : 0;
+        counts(i, 1) = poisson(generator);
+        counts(i, 2) = 10;
+        counts(i, 3) = 100 - counts(i, 0) - counts(i, 1) - counts(i, 2);
+    }
+    return counts;
+}
+
+// helper function that computes Moran's I and Geary's C with dense matrices
+static void denseAutocorrelation(const vec &x, const mat &weights, double &I, double &C)
+{
+    const double n = x.n_elem;
+    const vec z = x - mean(x);
+    const double S0 = accu(weights);
+    I = n / S0 * as_scalar(z.t() * weights * z) / dot(z, z);
+    double differences = 0.0;
+    for (uword i = 0; i < x.n_elem; ++i) {
+        for (uword j = 0; j < x.n_elem; ++j) {
+            differences += weights(i, j) * (x[i] - x[j]) * (x[i] - x[j]);
+        }
+    }
+    C = (n - 1) * differences / (2 * S0 * dot(z, z));
+}
+
+SpatialTest::SpatialTest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void SpatialTest::initTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void SpatialTest::cleanupTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void SpatialTest::testRadiusGraph()
+{
+    const mat coordinates = arrayCoordinates(SIDE);
+    const mat graph(Spatial::radiusGraph(coordinates, 1.0));
+    QVERIFY(graph.n_rows == SIDE * SIDE && graph.n_cols == SIDE * SIDE);
+    QVERIFY(approx_equal(graph, graph.t(), "absdiff", 0));
+    QVERIFY(accu(graph.diag()) == 0);
+    // the spots have 4 neighbors (less in the borders)
+    QVERIFY(accu(graph) == 2 * 2 * SIDE * (SIDE - 1));
+    QVERIFY(accu(graph.col(SIDE + 1)) == 4);
+    QVERIFY(accu(graph.col(0)) == 2);
+    // and 8 with the diagonals
+    const mat diagonals(Spatial::radiusGraph(coordinates, 1.5));
+    QVERIFY(accu(diagonals.col(SIDE + 1)) == 8);
+    QVERIFY(accu(diagonals.col(0)) == 3);
+    QVERIFY(Spatial::radiusGraph(coordinates, 0).n_nonzero == 0);
+}
+
+void SpatialTest::testNearestNeighborsGraph()
+{
+    const mat coordinates = arrayCoordinates(SIDE);
+    const mat graph(Spatial::nearestNeighborsGraph(coordinates, 4));
+    QVERIFY(approx_equal(graph, graph.t(), "absdiff", 0));
+    QVERIFY(accu(graph.diag()) == 0);
+    QVERIFY(accu(graph == 1) == accu(graph != 0));
+    QVERIFY(all(sum(graph, 0) >= 4));
+    QVERIFY(Spatial::nearestNeighborsGraph(coordinates.rows(0, 2), 10).n_nonzero == 6);
+}
+
+void SpatialTest::testAutocorrelation()
+{
+    // a small random graph (not symmetric) and random counts
+    const uword n_spots = 30;
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<double> uniform;
+    mat weights(n_spots, n_spots);
+    weights.imbue([&]() { return uniform(generator) < 0.2 ? 1.0 : 0.0; });
+    weights.diag().zeros();
+    vec gene_counts(n_spots);
+    gene_counts.imbue([&]() { return std::floor(10 * uniform(generator)); });
+    const mat counts = join_rows(gene_counts, 50 - gene_counts);
+    const std::vector<std::string> genes = {"A", "B"};
+    mat results;
+    std::vector<std::string> rows;
+    std::vector<std::string> cols;
+    Spatial::computeSpatialGenes(sp_mat(counts), genes, sp_mat(weights), results, rows, cols);
+    QVERIFY(results.n_rows == 2 && cols.size() == results.n_cols);
+
+    // the library sizes are the same (the size factors are 1)
+    for (uword i = 0; i < rows.size(); ++i) {
+        const uword gene = rows[i] == "A" ? 0 : 1;
+        double I = 0.0;
+        double C = 0.0;
+        denseAutocorrelation(log(1 + counts.col(gene)), weights, I, C);
+        QVERIFY(std::abs(results(i, Spatial::MoransI) - I) < 1e-10);
+        QVERIFY(std::abs(results(i, Spatial::GearysC) - C) < 1e-10);
+        QVERIFY(results(i, Spatial::MoransIPValue) >= 0
+                && results(i, Spatial::MoransIPValue) <= 1);
+        QVERIFY(results(i, Spatial::FDR) >= results(i, Spatial::MoransIPValue));
+    }
+
+    // the weights must match the spots
+    Spatial::computeSpatialGenes(sp_mat(counts), genes, sp_mat(n_spots + 1, n_spots + 1),
+                                 results, rows, cols);
+    QVERIFY(results.is_empty() && rows.empty() && cols.empty());
+}
+
+void SpatialTest::testSpatialGenes()
+{
+    const mat coordinates = arrayCoordinates(SIDE);
+    const mat counts = simulatedCounts(SIDE);
+    const std::vector<std::string> genes = {"left", "random", "constant", "rest"};
+    mat results;
+    std::vector<std::string> rows;
+    std::vector<std::string> cols;
+    Spatial::computeSpatialGenes(sp_mat(counts), genes, Spatial::radiusGraph(coordinates, 1.5),
+                                 results, rows, cols);
+
+    // the constant gene is not tested and the left gene is the most spatially variable
+    QVERIFY(std::find(rows.begin(), rows.end(), "constant") == rows.end());
+    QVERIFY(rows.size() == 3 && rows.front() == "left");
+    QVERIFY(results(0, Spatial::MoransI) > 0.8);
+    QVERIFY(results(0, Spatial::GearysC) < 0.2);
+    QVERIFY(results(0, Spatial::FDR) < 1e-10);
+    QVERIFY(results(0, Spatial::GearysCPValue) < 1e-10);
+    const uword random = std::find(rows.begin(), rows.end(), "random") - rows.begin();
+    QVERIFY(std::abs(results(random, Spatial::MoransI)) < 0.2);
+    QVERIFY(results(random, Spatial::MoransIStatistic) < 4);
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::SpatialTest)
+#include "tst_spatialtest.moc"
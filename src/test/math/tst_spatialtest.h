@@ -0,0 +1,28 @@
+#ifndef TST_SPATIALTEST_H
+#define TST_SPATIALTEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class SpatialTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SpatialTest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testRadiusGraph();
+    void testNearestNeighborsGraph();
+    void testAutocorrelation();
+    void testSpatialGenes();
+};
+
+} // namespace unit //
+
+#endif // TST_SPATIALTEST_H
@@ -22,6 +22,8 @@
 #include "dialogs/SelectionDialog.h"
 #include "analysis/AnalysisQC.h"
 #include "analysis/AnalysisClustering.h"
+#include "analysis/AnalysisMarkers.h"
+#include "analysis/AnalysisSpatial.h"
 #include "SettingsWidget.h"
 #include "SettingsStyle.h"
 #include "color/HeatMap.h"
@@ -125,13 +127,12 @@ void CellViewPage::loadDataset(const Dataset &dataset)
     m_dataset = dataset;
 
     // create tiles textures from the image (async)
-    m_image->clearData();
-    const bool result = m_image->createTiles(dataset.imageFile());
-    slotImageLoaded(result);
-    //TODO OpenGL cannot create textures on a different thread (FIX THIS)
-    //QFutureWatcher<void> watcher;
-    //QFuture<void> future = m_image->createTextures(dataset.imageFile());
-    //watcher.setFuture(future);
+    // the image is placed as soon as its size is known so the spots can be rendered
+    // while the tiles are created and loaded (slotImageLoaded is called otherwise
+    // when the tiles are ready)
+    if (m_image->createTextures(dataset.imageFile())) {
+        slotImageLoaded(true);
+    }
 }
 
 void CellViewPage::slotImageLoaded(const bool loaded)
@@ -161,8 +162,6 @@ void CellViewPage::slotImageLoaded(const bool loaded)
             const float a32 = -a22;
             const float a33 = 1.0;
             alignment.setMatrix(a11, a12, a13, a21, a22, a23, a31, a32, a33);
-        } else if (m_image->scaled()) {
-            alignment *= QTransform::fromScale(0.5, 0.5);
         }
         qDebug() << "Setting alignment matrix to " << alignment;
         m_gene_plotter->setTransform(alignment);
@@ -265,6 +264,9 @@ void CellViewPage::createConnections()
     // show Clustering widget
     connect(m_ui->clustering, &QPushButton::clicked, this, &CellViewPage::slotClustering);
 
+    // show Spatial genes widget
+    connect(m_ui->spatialGenes, &QPushButton::clicked, this, &CellViewPage::slotSpatialGenes);
+
     // when the user change any gene
     connect(m_genes.data(),
             &GenesWidget::signalGenesUpdated,
@@ -295,8 +297,13 @@ void CellViewPage::createConnections()
     connect(m_clustering.data(), &AnalysisClustering::signalClusteringExportSelections,
             this, &CellViewPage::slotCreateClusteringSelections);
 
+    // when the user wants to find the marker genes of the clusters
+    connect(m_clustering.data(), &AnalysisClustering::signalClusteringMarkers,
+            this, &CellViewPage::slotClusteringMarkers);
+
     // when the image has been loaded
-    //connect(&m_watcher, &QFutureWatcher<void>::finished, this, &CellViewPage::slotImageLoaded);
+    connect(m_image.data(), &ImageTextureGL::signalImageLoaded,
+            this, &CellViewPage::slotImageLoaded);
 }
 
 
@@ -393,6 +400,21 @@ void CellViewPage::slotClustering()
     m_clustering->show();
 }
 
+void CellViewPage::slotSpatialGenes()
+{
+    // the coordinates of the spots (the spot objects are in the order of the data frame)
+    const auto &spots = m_dataset.data()->spots();
+    mat coordinates(spots.size(), 2);
+    for (int i = 0; i < spots.size(); ++i) {
+        const auto &coord = spots.at(i)->coordinates();
+        coordinates(i, 0) = coord.first;
+        coordinates(i, 1) = coord.second;
+    }
+    AnalysisSpatial *spatial =
+            new AnalysisSpatial(m_dataset.data()->data(), coordinates, this, Qt::Window);
+    spatial->show();
+}
+
 void CellViewPage::slotLoadSpotColorsFile()
 {
     const QString filename
@@ -540,15 +562,19 @@ void CellViewPage::slotCreateClusteringSelections()
 {
     // get the map of color -> spots
     const QMultiHash<unsigned, QString> colors_spot = m_clustering->getClustersSpot();
-    // get the data frame
-    auto data = m_dataset.data()->data();
-    for(const auto &color : colors_spot.uniqueKeys()) {
-        // get the spots for the color
-        const QList<QString> &color_spots = colors_spot.values(color);
-        // slice the data frame
-        STData::STDataFrame scliced_data = STData::sliceDataFrameSpots(data, color_spots);
+    const QList<unsigned> colors = colors_spot.uniqueKeys();
+    // get the spots for each color
+    QList<QList<QString>> colors_spots;
+    for (const auto &color : colors) {
+        colors_spots.append(colors_spot.values(color));
+    }
+    // slice the data frame for all the colors at once
+    const QList<STData::STDataFrame> scliced_datas =
+            STData::sliceDataFrameSpots(m_dataset.data()->data(), colors_spots);
+    for (int i = 0; i < colors.size(); ++i) {
+        const unsigned color = colors.at(i);
         // create selection object
-        UserSelection new_selection(scliced_data);
+        UserSelection new_selection(scliced_datas.at(i));
         // proposes as selection name as DATASET NAME + color + current timestamp
         new_selection.name(m_dataset.name() + "_" + QString::number(color) + "_"
                            + QDateTime::currentDateTimeUtc().toString());
@@ -558,6 +584,30 @@ void CellViewPage::slotCreateClusteringSelections()
     }
 }
 
+void CellViewPage::slotClusteringMarkers()
+{
+    // get the map of color -> spots
+    const QMultiHash<unsigned, QString> colors_spot = m_clustering->getClustersSpot();
+    QList<unsigned> colors = colors_spot.uniqueKeys();
+    if (colors.size() <= 1) {
+        return;
+    }
+    std::sort(colors.begin(), colors.end());
+    // get the spots and the name of each color
+    QList<QList<QString>> colors_spots;
+    QList<QString> names;
+    for (const auto &color : colors) {
+        colors_spots.append(colors_spot.values(color));
+        names.append(tr("Cluster %1").arg(color));
+    }
+    // slice the data frame for all the colors at once
+    const QList<STData::STDataFrame> scliced_datas =
+            STData::sliceDataFrameSpots(m_dataset.data()->data(), colors_spots);
+    // launch the markers widget
+    AnalysisMarkers *markersWidget = new AnalysisMarkers(scliced_datas, names, this, Qt::Window);
+    markersWidget->show();
+}
+
 void CellViewPage::slotCreateSelection()
 {
     // get the selected spots
@@ -571,7 +621,7 @@ void CellViewPage::slotCreateSelection()
         return;
     }
     // get the data frame
-    auto data = m_dataset.data()->data();
+    const auto &data = m_dataset.data()->data();
     // slice the data frame
     STData::STDataFrame scliced_data = STData::sliceDataFrameSpots(data, selected_spots);
     // create selection object
@@ -2,7 +2,6 @@
 #define CELLVIEWPAGE_H
 
 #include <QWidget>
-#include <QFutureWatcher>
 
 #include "data/Dataset.h"
 #include "data/UserSelection.h"
@@ -77,6 +76,9 @@ private slots:
     // user wants to perform spot clustering
     void slotClustering();
 
+    // user wants to find the spatially variable genes
+    void slotSpatialGenes();
+
     // user wants to load a file with spot colors
     void slotLoadSpotColorsFile();
 
@@ -92,6 +94,9 @@ private slots:
     // user wants to export the computed clusters as selections
     void slotCreateClusteringSelections();
 
+    // user wants to find the marker genes of the clusters (each one against the rest)
+    void slotClusteringMarkers();
+
     // user wants to create a selection
     void slotCreateSelection();
 
@@ -127,9 +132,6 @@ private:
     // the currently opened dataset
     Dataset m_dataset;
 
-    // watcher for the image loading
-    QFutureWatcher<void> m_watcher;
-
     Q_DISABLE_COPY(CellViewPage)
 };
 
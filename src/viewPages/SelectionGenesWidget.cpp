@@ -28,9 +28,10 @@ SelectionGenesWidget::SelectionGenesWidget(const UserSelection::STDataFrame &dat
     model->setHorizontalHeaderItem(0, new QStandardItem(QString("Gene")));
     model->setHorizontalHeaderItem(1, new QStandardItem(QString("Count")));
     // populate
-    for (uword i = 0; i < data.counts.n_cols; ++i) {
+    const rowvec gene_counts = STData::computeColumnSums(data);
+    for (uword i = 0; i < gene_counts.n_elem; ++i) {
         const QString gene = data.genes.at(i);
-        const float count = sum(data.counts.col(i));
+        const float count = gene_counts.at(i);
         const QString count_str = QString::number(count);
         QStandardItem *gene_item = new QStandardItem(gene);
         gene_item->setData(gene, Qt::UserRole);
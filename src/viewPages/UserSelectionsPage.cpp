@@ -11,10 +11,12 @@
 #include "model/UserSelectionsItemModel.h"
 #include "dialogs/EditSelectionDialog.h"
 #include "analysis/AnalysisDEA.h"
+#include "analysis/AnalysisMarkers.h"
 #include "analysis/AnalysisCorrelation.h"
 #include "analysis/AnalysisQC.h"
 #include "analysis/AnalysisScatter.h"
 #include "analysis/AnalysisPCA.h"
+#include "data/STDataBinary.h"
 #include "SettingsStyle.h"
 
 #include "ui_selectionsPage.h"
@@ -45,6 +47,8 @@ UserSelectionsPage::UserSelectionsPage(QWidget *parent)
             this, SLOT(slotEditSelection()));
     connect(m_ui->ddaAnalysis, &QPushButton::clicked,
             this, &UserSelectionsPage::slotPerformDEA);
+    connect(m_ui->markersAnalysis, &QPushButton::clicked,
+            this, &UserSelectionsPage::slotPerformMarkers);
     connect(m_ui->correlationAnalysis, &QPushButton::clicked,
             this, &UserSelectionsPage::slotPerformCorrelation);
     connect(m_ui->selections_tableView,
@@ -110,6 +114,7 @@ void UserSelectionsPage::clearControls()
     m_ui->scatter->setEnabled(false);
     m_ui->exportSelection->setEnabled(false);
     m_ui->ddaAnalysis->setEnabled(false);
+    m_ui->markersAnalysis->setEnabled(false);
     m_ui->editSelection->setEnabled(false);
     m_ui->showGenes->setEnabled(false);
     m_ui->showSpots->setEnabled(false);
@@ -135,6 +140,7 @@ void UserSelectionsPage::slotSelectionSelected(QModelIndex index)
     m_ui->exportSelection->setEnabled(enableSingle);
     m_ui->importSelection->setEnabled(enableSingle);
     m_ui->ddaAnalysis->setEnabled(enableDouble);
+    m_ui->markersAnalysis->setEnabled(enableMultiple);
     m_ui->qcAnalysis->setEnabled(enableSingle);
     m_ui->scatter->setEnabled(enableSingle);
     m_ui->editSelection->setEnabled(enableSingle);
@@ -232,15 +238,25 @@ void UserSelectionsPage::slotExportSelection(QModelIndex index)
 
 void UserSelectionsPage::exportSelection(const UserSelection &selection)
 {
+    const QString binary_filter = tr("Binary Files (*.%1)").arg(STDataBinary::SUFFIX);
+    QString selected_filter;
     QString filename = QFileDialog::getSaveFileName(this,
                                                     tr("Export Selection"),
                                                     QDir::homePath(),
-                                                    QString("%1").arg(tr("Text Files (*.tsv)")));
+                                                    QString("%1;;%2")
+                                                    .arg(tr("Text Files (*.tsv)"))
+                                                    .arg(binary_filter),
+                                                    &selected_filter);
     // early out
     if (filename.isEmpty()) {
         return;
     }
 
+    // the binary format is chosen by the suffix of the file
+    if (selected_filter == binary_filter && QFileInfo(filename).suffix().isEmpty()) {
+        filename += "." + STDataBinary::SUFFIX;
+    }
+
     const QFileInfo fileInfo(filename);
     const QFileInfo dirInfo(fileInfo.dir().canonicalPath());
     if (!fileInfo.exists() && !dirInfo.isWritable()) {
@@ -314,7 +330,8 @@ void UserSelectionsPage::slotImportSelection()
     QFileDialog dialog(this, tr("Import selection (can select multiple)"));
     dialog.setDirectory(QDir::homePath());
     dialog.setFileMode(QFileDialog::ExistingFiles);
-    dialog.setNameFilter(QString("%1").arg(tr("TSV Files (*.tsv)")));
+    dialog.setNameFilter(QString("%1 (*.tsv *.%2)").arg(tr("Data Files"))
+                         .arg(STDataBinary::SUFFIX));
     QStringList fileNames;
     if (dialog.exec()) {
         // get all the selected files and iterate
@@ -340,6 +357,7 @@ void UserSelectionsPage::slotImportSelection()
             } else {
                 try {
                     auto data = STData::read(filename);
+                    STData::optimizeStorage(data);
                     UserSelection new_selection;
                     new_selection.data(data);
                     new_selection.name(name);
@@ -385,6 +403,26 @@ void UserSelectionsPage::slotPerformDEA()
     deaWidget->show();
 }
 
+void UserSelectionsPage::slotPerformMarkers()
+{
+    const auto selected = m_ui->selections_tableView->userSelecionTableItemSelection();
+    const auto currentSelection = selectionsModel()->getSelections(selected);
+    if (currentSelection.size() <= 1) {
+        return;
+    }
+
+    QList<STData::STDataFrame> datasets;
+    QList<QString> names;
+    for (const auto &selection : currentSelection) {
+        datasets.append(selection.data());
+        names.append(selection.name());
+    }
+
+    // launch the markers widget
+    AnalysisMarkers *markersWidget = new AnalysisMarkers(datasets, names, this, Qt::Window);
+    markersWidget->show();
+}
+
 void UserSelectionsPage::slotPerformCorrelation()
 {
     const auto selected = m_ui->selections_tableView->userSelecionTableItemSelection();
@@ -477,7 +515,7 @@ void UserSelectionsPage::slotPCA()
 
     QList<STData::STDataFrame> datasets;
     QList<QString> names;
-    for (const auto selection : currentSelection) {
+    for (const auto &selection : currentSelection) {
         datasets.append(selection.data());
         names.append(selection.name());
     }
@@ -496,7 +534,7 @@ void UserSelectionsPage::slotMerge()
     }
 
     QList<STData::STDataFrame> datasets;
-    for (const auto selection : currentSelection) {
+    for (const auto &selection : currentSelection) {
         datasets.append(selection.data());
     }
 
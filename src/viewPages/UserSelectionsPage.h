@@ -54,6 +54,8 @@ private slots:
     // this slot will init and show the D.E.A. dialog (requires two selected
     // selections)
     void slotPerformDEA();
+    // slot to find the marker genes of several selections (each one against the rest)
+    void slotPerformMarkers();
     // slot to perform a correlation analysis between two selections
     void slotPerformCorrelation();
     // slot to show the aggregated gene counts of the selection in a table
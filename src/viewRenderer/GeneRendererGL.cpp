@@ -11,6 +11,19 @@
 
 #include "color/HeatMap.h"
 
+namespace
+{
+
+// The texture of the spots has a cell for each shape (disc, selection ring and
+// non-visible ring), the shapes have a margin in the cells for the mipmaps
+const int SHAPE_CELL_SIZE = 64;
+const float SHAPE_RADIUS = 28.0;
+const int SHAPE_DISC = 0;
+const int SHAPE_SELECTED = 1;
+const int SHAPE_NON_VISIBLE = 2;
+const int SHAPE_COUNT = 3;
+}
+
 // hash function for QColor for use in QSet / QHash
 QT_BEGIN_NAMESPACE
 uint qHash(const QColor &c)
@@ -23,6 +36,7 @@ GeneRendererGL::GeneRendererGL(SettingsWidget::Rendering &rendering_settings, QO
     : GraphicItemGL(parent)
     , m_rendering_settings(rendering_settings)
     , m_initialized(false)
+    , m_vertices_dirty(true)
 {
     setVisualOption(GraphicItemGL::Transformable, true);
     setVisualOption(GraphicItemGL::Visible, true);
@@ -49,6 +63,7 @@ void GeneRendererGL::slotUpdate()
 {
     if (m_initialized) {
         m_geneData->computeRenderingData(m_rendering_settings);
+        m_vertices_dirty = true;
     }
 }
 
@@ -56,17 +71,153 @@ void GeneRendererGL::attachData(QSharedPointer<STData> data)
 {
     m_geneData = data;
     m_initialized = true;
+    m_vertices_dirty = true;
     m_border = m_geneData->getBorder();
 }
 
 void GeneRendererGL::draw(QOpenGLFunctionsVersion &qopengl_functions, QPainter &painter)
 {
-    Q_UNUSED(qopengl_functions)
-
     if (!m_initialized) {
         return;
     }
 
+    if (m_spot_texture.isNull()) {
+        createSpotTexture();
+    }
+    if (!m_spot_texture->isCreated()) {
+        drawWithPainter(painter);
+        return;
+    }
+
+    if (m_vertices_dirty) {
+        updateVertexArrays();
+        m_vertices_dirty = false;
+    }
+
+    // the painter sets up the transformations for native painting
+    painter.beginNativePainting();
+    qopengl_functions.glEnable(GL_TEXTURE_2D);
+    qopengl_functions.glEnable(GL_BLEND);
+    qopengl_functions.glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    m_spot_texture->bind();
+    {
+        qopengl_functions.glVertexPointer(2, GL_FLOAT, 0, m_vertices.constData());
+        qopengl_functions.glTexCoordPointer(2, GL_FLOAT, 0, m_texture_coords.constData());
+        qopengl_functions.glColorPointer(4, GL_UNSIGNED_BYTE, 0, m_colors.constData());
+        qopengl_functions.glEnableClientState(GL_VERTEX_ARRAY);
+        qopengl_functions.glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        qopengl_functions.glEnableClientState(GL_COLOR_ARRAY);
+
+        qopengl_functions.glDrawArrays(GL_QUADS, 0, m_vertices.size() / 2);
+
+        qopengl_functions.glDisableClientState(GL_VERTEX_ARRAY);
+        qopengl_functions.glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        qopengl_functions.glDisableClientState(GL_COLOR_ARRAY);
+    }
+    m_spot_texture->release();
+    qopengl_functions.glDisable(GL_TEXTURE_2D);
+    painter.endNativePainting();
+}
+
+void GeneRendererGL::updateVertexArrays()
+{
+    const bool is_dynamic =
+            m_rendering_settings.visual_mode == SettingsWidget::VisualMode::DynamicRange;
+    const bool do_values = m_rendering_settings.visual_mode != SettingsWidget::VisualMode::Normal;
+
+    const auto &spots = m_geneData->spots();
+    const auto &visibles = m_geneData->renderingVisible();
+    const auto &colors = m_geneData->renderingColors();
+    const auto &selecteds = m_geneData->renderingSelected();
+    const auto &values = m_geneData->renderingValues();
+    const float size = m_rendering_settings.size / 2;
+    const double min_value = m_rendering_settings.legend_min;
+    const double max_value = m_rendering_settings.legend_max;
+    const float intensity = m_rendering_settings.intensity;
+
+    // The spots are circles of radius size centered in the middle of their rectangle
+    // (as the ellipses drawn with a pen of width size)
+    const float half_quad = size * (SHAPE_CELL_SIZE / 2) / SHAPE_RADIUS;
+    m_vertices.clear();
+    m_texture_coords.clear();
+    m_colors.clear();
+    m_vertices.reserve(spots.size() * 8);
+    m_texture_coords.reserve(spots.size() * 8);
+    m_colors.reserve(spots.size() * 16);
+    const auto add_quad = [&](const QPointF &center, const int shape, const QColor &color) {
+        const GLfloat x0 = center.x() - half_quad;
+        const GLfloat x1 = center.x() + half_quad;
+        const GLfloat y0 = center.y() - half_quad;
+        const GLfloat y1 = center.y() + half_quad;
+        const GLfloat s0 = static_cast<GLfloat>(shape) / SHAPE_COUNT;
+        const GLfloat s1 = static_cast<GLfloat>(shape + 1) / SHAPE_COUNT;
+        m_vertices << x0 << y0 << x1 << y0 << x1 << y1 << x0 << y1;
+        m_texture_coords << s0 << 0.0f << s1 << 0.0f << s1 << 1.0f << s0 << 1.0f;
+        for (int k = 0; k < 4; ++k) {
+            m_colors << color.red() << color.green() << color.blue() << color.alpha();
+        }
+    };
+
+    for (int i = 0; i < spots.size(); ++i) {
+        const auto spot = spots.at(i)->adj_coordinates();
+        const QPointF center(spot.first + size / 2, spot.second + size / 2);
+        if (visibles.at(i)) {
+            QColor color = colors.at(i);
+            if (do_values && !spots.at(i)->visible()) {
+                color = Color::adjustVisualMode(color, values.at(i), min_value,
+                                                max_value, m_rendering_settings.visual_mode);
+            }
+            if (!is_dynamic) {
+                color.setAlphaF(intensity);
+            }
+            add_quad(center, SHAPE_DISC, color);
+            if (selecteds.at(i)) {
+                add_quad(center, SHAPE_SELECTED, Qt::white);
+            }
+        } else {
+            add_quad(center, SHAPE_NON_VISIBLE, Qt::white);
+        }
+    }
+}
+
+void GeneRendererGL::createSpotTexture()
+{
+    // White shapes (the color of the spots is given by the vertices) with the same
+    // proportions as the ellipses drawn by drawWithPainter()
+    QImage image(SHAPE_CELL_SIZE * SHAPE_COUNT, SHAPE_CELL_SIZE, QImage::Format_ARGB32);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing, true);
+    const auto cell_center = [](const int shape) {
+        return QPointF(SHAPE_CELL_SIZE * (shape + 0.5), SHAPE_CELL_SIZE / 2.0);
+    };
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(Qt::white);
+    painter.drawEllipse(cell_center(SHAPE_DISC), SHAPE_RADIUS, SHAPE_RADIUS);
+    QPen pen(Qt::white);
+    painter.setBrush(Qt::NoBrush);
+    // the selection ring is drawn with a pen of size/4 and the non-visible ring
+    // with a pen of size/2 (the disc has a radius of size)
+    pen.setWidthF(SHAPE_RADIUS / 4);
+    painter.setPen(pen);
+    painter.drawEllipse(cell_center(SHAPE_SELECTED), SHAPE_RADIUS / 2, SHAPE_RADIUS / 2);
+    pen.setWidthF(SHAPE_RADIUS / 2);
+    painter.setPen(pen);
+    painter.drawEllipse(cell_center(SHAPE_NON_VISIBLE), SHAPE_RADIUS / 2, SHAPE_RADIUS / 2);
+    painter.end();
+
+    m_spot_texture.reset(new QOpenGLTexture(image));
+    if (m_spot_texture->isCreated()) {
+        m_spot_texture->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+        m_spot_texture->setMagnificationFilter(QOpenGLTexture::Linear);
+        m_spot_texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+    } else {
+        qDebug() << "The texture of the spots could not be created, using QPainter";
+    }
+}
+
+void GeneRendererGL::drawWithPainter(QPainter &painter)
+{
     const bool is_dynamic =
             m_rendering_settings.visual_mode == SettingsWidget::VisualMode::DynamicRange;
     const bool do_values = m_rendering_settings.visual_mode != SettingsWidget::VisualMode::Normal;
@@ -127,7 +278,12 @@ const QRectF GeneRendererGL::boundingRect() const
 
 void GeneRendererGL::setSelectionArea(const SelectionEvent &event)
 {
-    m_geneData->selectSpots(event);
-    slotUpdate();
+    // only the selection of the spots is updated unless the rendering data
+    // has to be computed again
+    if (m_geneData->selectSpots(event)) {
+        m_vertices_dirty = true;
+    } else {
+        slotUpdate();
+    }
     emit updated();
 }
@@ -4,6 +4,8 @@
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLBuffer>
+#include <QOpenGLTexture>
+#include <QScopedPointer>
 
 #include "data/STData.h"
 #include "viewPages/SettingsWidget.h"
@@ -15,6 +17,10 @@
 // It has some attributes and variables changeable by slots.
 // To clarify, by index(spot) we mean the physical spot in the array
 // and by feature we mean the gene-index combination
+// The spots are drawn in one batch: the vertex arrays (a textured quad per spot
+// and another one for the selection ring) are built when the data changes and
+// drawn with one OpenGL call. If the texture of the spots cannot be created
+// the spots are drawn one by one with QPainter.
 class GeneRendererGL : public GraphicItemGL
 {
     Q_OBJECT
@@ -48,6 +54,15 @@ private:
     // compiles and loads the shaders
     void setupShaders();
 
+    // builds the vertex arrays of the spots with the current rendering data
+    void updateVertexArrays();
+
+    // creates the texture with the shapes of the spots (disc and rings)
+    void createSpotTexture();
+
+    // draws the spots one by one with QPainter (used if the texture is not available)
+    void drawWithPainter(QPainter &painter);
+
     // bounding rect area
     QRectF m_border;
 
@@ -63,6 +78,17 @@ private:
     // true when the rendering data has been initialized
     bool m_initialized;
 
+    // vertex arrays of the spots (2 coordinates, 2 texture coordinates
+    // and 4 color components per vertex)
+    QVector<GLfloat> m_vertices;
+    QVector<GLfloat> m_texture_coords;
+    QVector<GLubyte> m_colors;
+    // true when the vertex arrays must be built again
+    bool m_vertices_dirty;
+
+    // texture with the shapes of the spots
+    QScopedPointer<QOpenGLTexture> m_spot_texture;
+
     Q_DISABLE_COPY(GeneRendererGL)
 };
 
@@ -5,18 +5,45 @@
 #include <QtConcurrent>
 #include <QFuture>
 #include <QByteArray>
-#include <QBuffer>
-#include <QApplication>
 #include <QImageReader>
+#include <QPainter>
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
 #include <cmath>
 
-static const int tile_width = 512;
-static const int tile_height = 512;
+// the maximum size of the textures of the tiles (in KB)
+static const int textures_budget = 256 * 1024;
+// the maximum number of tiles uploaded as textures in every frame
+static const int uploads_per_frame = 4;
+
+// the key of a tile (level, column and row) in the caches
+static quint64 tileKey(const int level, const int x, const int y)
+{
+    return (static_cast<quint64>(level) << 48) | (static_cast<quint64>(y) << 24)
+            | static_cast<quint64>(x);
+}
+
+static int tileLevel(const quint64 key)
+{
+    return static_cast<int>(key >> 48);
+}
+
+static int tileY(const quint64 key)
+{
+    return static_cast<int>((key >> 24) & 0xFFFFFF);
+}
+
+static int tileX(const quint64 key)
+{
+    return static_cast<int>(key & 0xFFFFFF);
+}
 
 ImageTextureGL::ImageTextureGL(QObject *parent)
     : GraphicItemGL(parent)
+    , m_textures(textures_budget)
+    , m_tiles_workers(0)
     , m_isInitialized(false)
-    , m_iscaled(false)
 {
     setVisualOption(GraphicItemGL::Transformable, true);
     setVisualOption(GraphicItemGL::Visible, true);
@@ -24,6 +51,12 @@ ImageTextureGL::ImageTextureGL(QObject *parent)
     setVisualOption(GraphicItemGL::Yinverted, false);
     setVisualOption(GraphicItemGL::Xinverted, false);
     setVisualOption(GraphicItemGL::RubberBandable, false);
+
+    // leave some threads for the rendering and the other computations
+    m_tiles_pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() / 2));
+
+    connect(&m_watcher_pyramid, &QFutureWatcher<bool>::finished,
+            this, &ImageTextureGL::slotTilesCreated);
 }
 
 ImageTextureGL::~ImageTextureGL()
@@ -33,148 +66,240 @@ ImageTextureGL::~ImageTextureGL()
 
 void ImageTextureGL::clearData()
 {
-    clearTextures();
-    m_textures_indices.clear();
-    m_texture_coords.clear();
-    m_isInitialized = false;
-}
-
-void ImageTextureGL::clearTextures()
-{
-    for (QOpenGLTexture *texture : m_textures) {
-        if (texture != nullptr) {
-            texture->destroy();
-        }
-        texture = nullptr;
+    // stop the workers (their pending results are discarded)
+    m_pyramid.cancel();
+    m_watcher_pyramid.waitForFinished();
+    m_watcher_pyramid.setFuture(QFuture<bool>());
+    {
+        QMutexLocker locker(&m_tiles_mutex);
+        m_requested_tiles.clear();
     }
+    m_tiles_pool.waitForDone();
+    m_loading_tiles.clear();
+    m_decoded_tiles.clear();
+
     m_textures.clear();
+    m_failed_tiles.clear();
+    m_pyramid.close();
+    m_bounds = QRectF();
+    m_isInitialized = false;
 }
 
 void ImageTextureGL::draw(QOpenGLFunctionsVersion &qopengl_functions, QPainter &painter)
 {
-    Q_UNUSED(painter);
-
     if (!m_isInitialized) {
         return;
     }
 
+    uploadTiles();
+
+    // the visible area of the image and the screen pixels for every image pixel
+    const QTransform transform = painter.worldTransform();
+    bool invertible = false;
+    const QTransform inverted = transform.inverted(&invertible);
+    if (!invertible) {
+        return;
+    }
+    const QRectF visible = inverted.mapRect(QRectF(painter.viewport())).intersected(m_bounds);
+    if (visible.isEmpty()) {
+        return;
+    }
+    const double scale = std::sqrt(std::fabs(transform.determinant()));
+
+    // the level with the lowest resolution that has at least one pixel for every
+    // screen pixel (the level with the lowest resolution is drawn first so there are
+    // no holes while the tiles are loaded)
+    const int lowest_level = m_pyramid.levels() - 1;
+    const int level =
+            qBound(0, static_cast<int>(std::floor(std::log2(1.0 / scale))), lowest_level);
+
+    static const GLfloat texture_coords[] = {0.0, 0.0, 1.0, 0.0, 1.0, 1.0, 0.0, 1.0};
+    QList<quint64> missing;
     qopengl_functions.glEnable(GL_TEXTURE_2D);
     {
-        qopengl_functions.glVertexPointer(2, GL_FLOAT, 0, m_textures_indices.constData());
-        qopengl_functions.glTexCoordPointer(2, GL_FLOAT, 0, m_texture_coords.constData());
+        qopengl_functions.glTexCoordPointer(2, GL_FLOAT, 0, texture_coords);
         qopengl_functions.glEnableClientState(GL_VERTEX_ARRAY);
         qopengl_functions.glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 
-        for (int i = 0; i < m_textures.size(); ++i) {
-            QOpenGLTexture *texture = m_textures[i];
-            Q_ASSERT(texture != nullptr);
-            texture->bind();
-            qopengl_functions.glDrawArrays(GL_TRIANGLE_FAN, i * 4, 4);
-            texture->release();
+        drawLevel(qopengl_functions, lowest_level, visible, missing);
+        if (level != lowest_level) {
+            drawLevel(qopengl_functions, level, visible, missing);
         }
 
         qopengl_functions.glDisableClientState(GL_VERTEX_ARRAY);
         qopengl_functions.glDisableClientState(GL_TEXTURE_COORD_ARRAY);
     }
     qopengl_functions.glDisable(GL_TEXTURE_2D);
-}
 
-QFuture<void> ImageTextureGL::createTextures(const QString &imagefile)
-{
-    return QtConcurrent::run(this, &ImageTextureGL::createTiles, imagefile);
+    requestTiles(missing);
 }
 
-void ImageTextureGL::createGrid(const QImage &image, const int offset)
+void ImageTextureGL::drawLevel(QOpenGLFunctionsVersion &qopengl_functions,
+                               const int level,
+                               const QRectF &area,
+                               QList<quint64> &missing)
 {
-    const QImage gray_scale = image.convertToFormat(QImage::Format_Grayscale8);
-    const int x_pixels = gray_scale.width();
-    const int y_pixels = gray_scale.height();
-    m_grid_points.clear();
-    for (int x = 0; x < x_pixels; x+=offset) {
-        for (int y = 0; y < y_pixels; y+=offset) {
-            const float value = gray_scale.pixelColor(x,y).valueF();
-            if (value > 0.5) {
-               m_grid_points.append(QPointF(x,y));
+    const QSize count = m_pyramid.tileCount(level);
+    const double tile_size = ImageTilePyramid::TILE_SIZE << level;
+    const int first_x = qBound(0, static_cast<int>(area.left() / tile_size), count.width() - 1);
+    const int last_x = qBound(0, static_cast<int>(area.right() / tile_size), count.width() - 1);
+    const int first_y = qBound(0, static_cast<int>(area.top() / tile_size), count.height() - 1);
+    const int last_y = qBound(0, static_cast<int>(area.bottom() / tile_size), count.height() - 1);
+
+    for (int y = first_y; y <= last_y; ++y) {
+        for (int x = first_x; x <= last_x; ++x) {
+            const quint64 key = tileKey(level, x, y);
+            QOpenGLTexture *texture = m_textures.object(key);
+            if (texture == nullptr) {
+                if (!m_failed_tiles.contains(key)) {
+                    missing.append(key);
+                }
+                continue;
             }
+            const QRect rect = m_pyramid.tileRect(level, x, y);
+            const GLfloat left = rect.left();
+            const GLfloat top = rect.top();
+            const GLfloat right = rect.left() + rect.width();
+            const GLfloat bottom = rect.top() + rect.height();
+            const GLfloat vertices[] = {left, top, right, top, right, bottom, left, bottom};
+            qopengl_functions.glVertexPointer(2, GL_FLOAT, 0, vertices);
+            texture->bind();
+            qopengl_functions.glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+            texture->release();
         }
     }
 }
 
-bool ImageTextureGL::createTiles(const QString &imagefile)
+void ImageTextureGL::uploadTiles()
 {
-    QGuiApplication::setOverrideCursor(Qt::WaitCursor);
-    // image buffer reader
-    QImageReader imageReader(imagefile);
-    // scale image to half for big images
-    QSize imageSize = imageReader.size();
-    if (imageSize.width() >= 10000 || imageSize.height() >= 10000) {
-        imageSize /= 2;
-        imageReader.setScaledSize(imageSize);
-        m_iscaled = true;
-    } else {
-        m_iscaled = false;
+    QHash<quint64, QImage> tiles;
+    bool pending = false;
+    {
+        QMutexLocker locker(&m_tiles_mutex);
+        auto it = m_decoded_tiles.begin();
+        while (it != m_decoded_tiles.end() && tiles.size() < uploads_per_frame) {
+            tiles.insert(it.key(), it.value());
+            it = m_decoded_tiles.erase(it);
+        }
+        pending = !m_decoded_tiles.isEmpty();
     }
-    // parse the image
-    QImage image;
-    const bool read_ok = imageReader.read(&image);
-    if (!read_ok) {
-        qDebug() << "Tissue image cannot be opened/read" << imageReader.errorString();
-        QGuiApplication::restoreOverrideCursor();
-        return false;
+
+    for (auto it = tiles.constBegin(); it != tiles.constEnd(); ++it) {
+        const QImage &image = it.value();
+        if (image.isNull()) {
+            m_failed_tiles.insert(it.key());
+            continue;
+        }
+        QOpenGLTexture *texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+        texture->setData(image);
+        texture->setMinificationFilter(QOpenGLTexture::LinearMipMapNearest);
+        texture->setMagnificationFilter(QOpenGLTexture::Linear);
+        texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+        // RGBA texture and its mipmaps, the least recently used textures are
+        // deleted when the budget is exceeded
+        const int cost = (image.width() * image.height() * 4 * 4 / 3) / 1024 + 1;
+        m_textures.insert(it.key(), texture, cost);
     }
 
-    m_bounds = image.rect();
+    // the rest of the tiles are uploaded in the next frames
+    if (pending) {
+        emit updated();
+    }
+}
 
-    // compute tiles size and numbers
-    const int width = imageSize.width();
-    const int height = imageSize.height();
-    const int xCount = std::ceil(width / static_cast<float>(tile_width));
-    const int yCount = std::ceil(height / static_cast<float>(tile_height));
-    const int count = xCount * yCount;
+void ImageTextureGL::requestTiles(const QList<quint64> &tiles)
+{
+    QMutexLocker locker(&m_tiles_mutex);
+    m_requested_tiles.clear();
+    for (const quint64 key : tiles) {
+        if (!m_loading_tiles.contains(key) && !m_decoded_tiles.contains(key)) {
+            m_requested_tiles.append(key);
+        }
+    }
+    while (m_tiles_workers < m_tiles_pool.maxThreadCount()
+           && m_tiles_workers < m_requested_tiles.size()) {
+        ++m_tiles_workers;
+        QtConcurrent::run(&m_tiles_pool, this, &ImageTextureGL::loadTilesAsync);
+    }
+}
 
-    // create tiles and their textures
-    for (int i = 0; i < count; ++i) {
+void ImageTextureGL::loadTilesAsync()
+{
+    forever {
+        quint64 key = 0;
+        {
+            QMutexLocker locker(&m_tiles_mutex);
+            if (m_requested_tiles.isEmpty()) {
+                --m_tiles_workers;
+                return;
+            }
+            key = m_requested_tiles.takeFirst();
+            m_loading_tiles.insert(key);
+        }
+        // converted here so the upload does not have to do it
+        const QImage image = m_pyramid.tile(tileLevel(key), tileX(key), tileY(key))
+                .convertToFormat(QImage::Format_RGBA8888);
+        {
+            QMutexLocker locker(&m_tiles_mutex);
+            m_loading_tiles.remove(key);
+            m_decoded_tiles.insert(key, image);
+        }
+        // to notify the rendering canvas (queued to the GUI thread)
+        emit updated();
+    }
+}
 
-        // texture sizes
-        const int x = tile_width * (i % xCount);
-        const int y = tile_height * (i / xCount);
-        const int texture_width = std::min(width - x, tile_width);
-        const int texture_height = std::min(height - y, tile_height);
+bool ImageTextureGL::createTextures(const QString &imagefile)
+{
+    clearData();
 
-        // create sub image and add texture
-        // TODO an ideal solution would  be to extract the clip rect part of the image
-        // from the imageReader to avoid loading the whole image into memory
-        // but the setClipRect option would only work one time, after calling read()
-        // the buffer is cleaned
-        addTexture(image.copy(x, y, texture_width, texture_height), x, y);
+    // the size is read from the header of the image (the image is not decoded)
+    const QSize size = QImageReader(imagefile).size();
+    if (size.isValid()) {
+        m_bounds = QRectF(QPointF(0.0, 0.0), size);
     }
 
-    QGuiApplication::restoreOverrideCursor();
-    m_isInitialized = true;
-    return true;
+    // the tiles are only generated the first time the image is opened
+    m_watcher_pyramid.setFuture(
+                QtConcurrent::run(&m_pyramid, &ImageTilePyramid::open, imagefile));
+    return m_bounds.isValid();
 }
 
-void ImageTextureGL::addTexture(const QImage &image, const int x, const int y)
+void ImageTextureGL::slotTilesCreated()
 {
-    const float width = static_cast<float>(image.width());
-    const float height = static_cast<float>(image.height());
-
-    m_textures_indices.append(QVector2D(x, y));
-    m_textures_indices.append(QVector2D(x + width, y));
-    m_textures_indices.append(QVector2D(x + width, y + height));
-    m_textures_indices.append(QVector2D(x, y + height));
+    // the creation was canceled by clearData()
+    if (m_watcher_pyramid.isCanceled()) {
+        return;
+    }
 
-    m_texture_coords.append(QVector2D(0.0, 0.0));
-    m_texture_coords.append(QVector2D(1.0, 0.0));
-    m_texture_coords.append(QVector2D(1.0, 1.0));
-    m_texture_coords.append(QVector2D(0.0, 1.0));
+    const bool loaded = m_watcher_pyramid.result();
+    const bool placed = m_bounds.isValid();
+    if (loaded) {
+        m_bounds = QRectF(QPointF(0.0, 0.0), m_pyramid.size());
+        m_isInitialized = true;
+        emit updated();
+    } else {
+        qDebug() << "Tissue image tiles cannot be created";
+    }
+    if (!loaded || !placed) {
+        emit signalImageLoaded(loaded);
+    }
+}
 
-    QOpenGLTexture *texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
-    texture->setData(image);
-    texture->setMinificationFilter(QOpenGLTexture::LinearMipMapNearest);
-    texture->setMagnificationFilter(QOpenGLTexture::Linear);
-    texture->setWrapMode(QOpenGLTexture::ClampToEdge);
-    m_textures.append(texture);
+void ImageTextureGL::createGrid(const QImage &image, const int offset)
+{
+    const QImage gray_scale = image.convertToFormat(QImage::Format_Grayscale8);
+    const int x_pixels = gray_scale.width();
+    const int y_pixels = gray_scale.height();
+    m_grid_points.clear();
+    for (int x = 0; x < x_pixels; x+=offset) {
+        for (int y = 0; y < y_pixels; y+=offset) {
+            const float value = gray_scale.pixelColor(x,y).valueF();
+            if (value > 0.5) {
+               m_grid_points.append(QPointF(x,y));
+            }
+        }
+    }
 }
 
 const QList<QPointF>& ImageTextureGL::getGrid() const
@@ -191,8 +316,3 @@ void ImageTextureGL::setSelectionArea(const SelectionEvent &event)
 {
     Q_UNUSED(event)
 }
-
-bool ImageTextureGL::scaled() const
-{
-    return m_iscaled;
-}
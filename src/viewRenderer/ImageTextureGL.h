@@ -2,16 +2,26 @@
 #define IMAGETEXTUREGL_H
 
 #include "GraphicItemGL.h"
+#include "ImageTilePyramid.h"
 #include <QVector2D>
-#include <QFuture>
+#include <QFutureWatcher>
+#include <QThreadPool>
+#include <QMutex>
+#include <QCache>
+#include <QHash>
+#include <QSet>
+#include <QImage>
 
-class QImage;
 class QOpenGLTexture;
 class QByteArray;
 
 // This class represents a tiled image to be rendered using textures. This class
 // is used to render the cell tissue image which has a high resolution
-// The tiling and creation of the textures is performed concurrently
+// The image is split into a pyramid of tiles (ImageTilePyramid) and only the tiles
+// of the visible area are loaded, at the resolution of the current zoom level.
+// The textures of the tiles are kept up to a memory budget (least recently used first)
+// The tiles are created and decoded in worker threads and the decoded tiles are
+// uploaded as textures in the OpenGL thread (a few in every frame)
 class ImageTextureGL : public GraphicItemGL
 {
     Q_OBJECT
@@ -20,9 +30,11 @@ public:
     explicit ImageTextureGL(QObject *parent = 0);
     virtual ~ImageTextureGL();
 
-    // this function will split the image into small textures of fixed size in an asynchronous way
-    // using createTiles and returning the future object
-    QFuture<void> createTextures(const QString &imagefile);
+    // this function will split the image into tiles of fixed size (or use the tiles
+    // from a previous time) in an asynchronous way, signalImageLoaded() is emitted
+    // when it is done. The size of the image is read first so the image can be placed
+    // before the tiles are ready, returns true if the size is known (boundingRect())
+    bool createTextures(const QString &imagefile);
 
     // will remove and destroy all textures
     void clearData();
@@ -30,43 +42,66 @@ public:
     // return the total size of the image as a QRectF
     const QRectF boundingRect() const override;
 
-    // will split the image given as input into small textures of fixed size
-    // returns true if the parsing and creation of tiles was correct
-    bool createTiles(const QString &imagefile);
-
     // return a grid of points computed from the image (inside the tissue)
     const QList<QPointF>& getGrid() const;
 
-    // true if the image has been scaled down
-    bool scaled() const;
-
 public slots:
 
+signals:
+    // emitted when the tiles are ready (loaded is false if the image cannot be read)
+    // it is only emitted when loaded is true if the size of the image was not known
+    // when createTextures() was called
+    void signalImageLoaded(const bool loaded);
+
 protected:
 
     void draw(QOpenGLFunctionsVersion &qopengl_functions, QPainter &painter) override;
     void setSelectionArea(const SelectionEvent &event);
 
+private slots:
+
+    // the creation of the tiles has finished
+    void slotTilesCreated();
+
 private:
 
     // internal function to create a grid of of the image (inside tissue)
     void createGrid(const QImage &image, const int offset);
 
-    // internal functions to create a texture from an image and add it to the
-    // rendering list
-    void addTexture(const QImage &image, const int x = 0, const int y = 0);
-
-    // internal function to remove and clean textures
-    void clearTextures();
-    void clearNodes();
-
-    QVector<QOpenGLTexture *> m_textures;
-    QVector<QVector2D> m_textures_indices;
-    QVector<QVector2D> m_texture_coords;
+    // internal function to draw the tiles of a level that intersect the given area
+    // the tiles that do not have a texture yet are added to missing
+    void drawLevel(QOpenGLFunctionsVersion &qopengl_functions,
+                   const int level,
+                   const QRectF &area,
+                   QList<quint64> &missing);
+
+    // internal function to create the textures of some of the decoded tiles
+    void uploadTiles();
+
+    // internal function to replace the tiles to be decoded (in order of priority)
+    // by the given tiles and start the workers if needed
+    void requestTiles(const QList<quint64> &tiles);
+
+    // internal function (run in the workers) to decode the requested tiles
+    void loadTilesAsync();
+
+    ImageTilePyramid m_pyramid;
+    QFutureWatcher<bool> m_watcher_pyramid;
+    // the textures of the loaded tiles (the cost is the size in KB)
+    QCache<quint64, QOpenGLTexture> m_textures;
+    // the tiles that could not be read (they are not requested again)
+    QSet<quint64> m_failed_tiles;
+    // the workers to decode tiles and the tiles requested, being decoded and
+    // decoded (waiting to be uploaded), shared with the workers
+    QThreadPool m_tiles_pool;
+    QMutex m_tiles_mutex;
+    QList<quint64> m_requested_tiles;
+    QSet<quint64> m_loading_tiles;
+    QHash<quint64, QImage> m_decoded_tiles;
+    int m_tiles_workers;
     QRectF m_bounds;
     bool m_isInitialized;
     QList<QPointF> m_grid_points;
-    bool m_iscaled;
 
     Q_DISABLE_COPY(ImageTextureGL)
 };
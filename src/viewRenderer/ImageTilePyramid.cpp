@@ -0,0 +1,315 @@
+#include "ImageTilePyramid.h"
+
+#include <QImage>
+#include <QImageReader>
+#include <QPainter>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QStandardPaths>
+#include <QtConcurrent>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <vector>
+
+#include "data/STDataBinary.h"
+
+namespace
+{
+
+// the version of the cache format (tiles generated with a different version are not used)
+const int PYRAMID_VERSION = 1;
+// the file with the description of the pyramid (it is written after all the tiles)
+const char *PYRAMID_FILE = "pyramid.txt";
+// the format and quality of the tiles
+const char *TILE_FORMAT = "jpg";
+const int TILE_QUALITY = 90;
+// the maximum size of the strips of the image that are decoded at once
+const qint64 MAX_STRIP_BYTES = 128 * 1024 * 1024;
+}
+
+const int ImageTilePyramid::TILE_SIZE;
+
+ImageTilePyramid::ImageTilePyramid()
+    : m_levels(0)
+    , m_canceled(false)
+{
+}
+
+ImageTilePyramid::~ImageTilePyramid()
+{
+}
+
+bool ImageTilePyramid::open(const QString &imagefile)
+{
+    m_dir.clear();
+    m_size = QSize();
+    m_levels = 0;
+    const QFileInfo info(imagefile);
+    if (!info.exists()) {
+        qDebug() << "Tissue image does not exist" << imagefile;
+        return false;
+    }
+
+    const quint64 fingerprint = STDataBinary::fingerprint(QStringList() << imagefile);
+    m_dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/tiles/"
+            + QString::number(fingerprint, 16);
+    if (load(fingerprint)) {
+        qDebug() << "Tissue image tiles loaded from" << m_dir;
+        return true;
+    }
+
+    qDebug() << "Generating tissue image tiles in" << m_dir;
+    if (!generate(imagefile, fingerprint)) {
+        if (m_canceled) {
+            qDebug() << "Generation of tissue image tiles canceled";
+        }
+        QDir(m_dir).removeRecursively();
+        m_dir.clear();
+        m_size = QSize();
+        m_levels = 0;
+        return false;
+    }
+    return true;
+}
+
+void ImageTilePyramid::close()
+{
+    m_dir.clear();
+    m_size = QSize();
+    m_levels = 0;
+    m_canceled = false;
+}
+
+void ImageTilePyramid::cancel()
+{
+    m_canceled = true;
+}
+
+bool ImageTilePyramid::isOpen() const
+{
+    return m_levels > 0;
+}
+
+const QSize ImageTilePyramid::size() const
+{
+    return m_size;
+}
+
+int ImageTilePyramid::levels() const
+{
+    return m_levels;
+}
+
+const QSize ImageTilePyramid::levelSize(const int level) const
+{
+    const int scale = 1 << level;
+    return QSize((m_size.width() + scale - 1) / scale, (m_size.height() + scale - 1) / scale);
+}
+
+const QSize ImageTilePyramid::tileCount(const int level) const
+{
+    const QSize size = levelSize(level);
+    return QSize((size.width() + TILE_SIZE - 1) / TILE_SIZE,
+                 (size.height() + TILE_SIZE - 1) / TILE_SIZE);
+}
+
+const QRect ImageTilePyramid::tileRect(const int level, const int x, const int y) const
+{
+    const int size = TILE_SIZE << level;
+    return QRect(x * size, y * size, size, size).intersected(QRect(QPoint(0, 0), m_size));
+}
+
+const QString ImageTilePyramid::tilePath(const int level, const int x, const int y) const
+{
+    return QString("%1/%2/%3_%4.%5").arg(m_dir).arg(level).arg(x).arg(y).arg(TILE_FORMAT);
+}
+
+QImage ImageTilePyramid::tile(const int level, const int x, const int y) const
+{
+    QImage image;
+    QImageReader reader(tilePath(level, x, y), TILE_FORMAT);
+    if (!reader.read(&image)) {
+        qDebug() << "Tissue image tile cannot be read" << level << x << y
+                 << reader.errorString();
+    }
+    return image;
+}
+
+bool ImageTilePyramid::load(const quint64 fingerprint)
+{
+    QFile file(m_dir + "/" + PYRAMID_FILE);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+    QTextStream stream(&file);
+    int version = 0;
+    quint64 file_fingerprint = 0;
+    int width = 0;
+    int height = 0;
+    int tile_size = 0;
+    int levels = 0;
+    stream >> version >> file_fingerprint >> width >> height >> tile_size >> levels;
+    if (stream.status() != QTextStream::Ok || version != PYRAMID_VERSION
+            || file_fingerprint != fingerprint || tile_size != TILE_SIZE || levels <= 0) {
+        return false;
+    }
+    m_size = QSize(width, height);
+    m_levels = levels;
+    return true;
+}
+
+bool ImageTilePyramid::generate(const QString &imagefile, const quint64 fingerprint)
+{
+    QDir(m_dir).removeRecursively();
+    if (!generateBaseLevel(imagefile)) {
+        return false;
+    }
+
+    // every level halves the previous one until the image fits in one tile
+    m_levels = 1;
+    while (tileCount(m_levels - 1) != QSize(1, 1)) {
+        if (m_canceled || !generateLevel(m_levels)) {
+            return false;
+        }
+        ++m_levels;
+    }
+
+    QFile file(m_dir + "/" + PYRAMID_FILE);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qDebug() << "Tissue image tiles description cannot be written" << file.errorString();
+        return false;
+    }
+    QTextStream stream(&file);
+    stream << PYRAMID_VERSION << " " << fingerprint << " " << m_size.width() << " "
+           << m_size.height() << " " << TILE_SIZE << " " << m_levels << "\n";
+    stream.flush();
+    return stream.status() == QTextStream::Ok;
+}
+
+bool ImageTilePyramid::generateBaseLevel(const QString &imagefile)
+{
+    if (!QDir().mkpath(m_dir + "/0")) {
+        qDebug() << "Tissue image tiles directory cannot be created" << m_dir;
+        return false;
+    }
+
+    // Saves the tiles of a strip of the image (the strip starts at the row of tiles first_row)
+    const auto save_tiles = [this](const QImage &strip, const int first_row) {
+        const int columns = (strip.width() + TILE_SIZE - 1) / TILE_SIZE;
+        const int rows = (strip.height() + TILE_SIZE - 1) / TILE_SIZE;
+        std::vector<int> tiles(columns * rows);
+        std::iota(tiles.begin(), tiles.end(), 0);
+        std::atomic<bool> saved(true);
+        QtConcurrent::blockingMap(tiles, [&](const int index) {
+            if (m_canceled) {
+                saved = false;
+                return;
+            }
+            const int x = index % columns;
+            const int y = index / columns;
+            const QImage tile_image =
+                    strip.copy(x * TILE_SIZE, y * TILE_SIZE,
+                               std::min(TILE_SIZE, strip.width() - x * TILE_SIZE),
+                               std::min(TILE_SIZE, strip.height() - y * TILE_SIZE));
+            if (!tile_image.save(tilePath(0, x, first_row + y), TILE_FORMAT, TILE_QUALITY)) {
+                saved = false;
+            }
+        });
+        if (!saved) {
+            qDebug() << "Tissue image tiles cannot be saved in" << m_dir;
+        }
+        return saved.load();
+    };
+
+    QImageReader reader(imagefile);
+    m_size = reader.size();
+    const qint64 image_bytes = static_cast<qint64>(m_size.width()) * m_size.height() * 4;
+    const bool use_strips = m_size.isValid() && image_bytes > MAX_STRIP_BYTES
+            && reader.supportsOption(QImageIOHandler::ClipRect);
+
+    // small images (or formats that cannot be decoded by parts) are decoded at once
+    if (!use_strips) {
+        QImage image;
+        if (!reader.read(&image)) {
+            qDebug() << "Tissue image cannot be opened/read" << reader.errorString();
+            return false;
+        }
+        m_size = image.size();
+        return save_tiles(image, 0);
+    }
+
+    // big images are decoded in strips of rows of tiles (the reader has to be created
+    // again for every strip as the clip rect can only be used once)
+    const qint64 row_bytes = static_cast<qint64>(m_size.width()) * TILE_SIZE * 4;
+    const int strip_rows =
+            static_cast<int>(std::max<qint64>(1, MAX_STRIP_BYTES / row_bytes)) * TILE_SIZE;
+    for (int y = 0; y < m_size.height(); y += strip_rows) {
+        const QRect clip(0, y, m_size.width(), std::min(strip_rows, m_size.height() - y));
+        QImageReader strip_reader(imagefile);
+        strip_reader.setClipRect(clip);
+        QImage strip;
+        if (!strip_reader.read(&strip) || strip.size() != clip.size()) {
+            qDebug() << "Tissue image cannot be opened/read" << strip_reader.errorString();
+            return false;
+        }
+        if (m_canceled || !save_tiles(strip, y / TILE_SIZE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ImageTilePyramid::generateLevel(const int level)
+{
+    if (!QDir().mkpath(m_dir + "/" + QString::number(level))) {
+        qDebug() << "Tissue image tiles directory cannot be created" << m_dir;
+        return false;
+    }
+
+    // every tile is made from (up to) 4 tiles of the previous level scaled to half
+    const QSize count = tileCount(level);
+    const QSize previous_count = tileCount(level - 1);
+    const QSize size = levelSize(level);
+    const QRect previous_rect(QPoint(0, 0), levelSize(level - 1));
+    std::vector<int> tiles(count.width() * count.height());
+    std::iota(tiles.begin(), tiles.end(), 0);
+    std::atomic<bool> saved(true);
+    QtConcurrent::blockingMap(tiles, [&](const int index) {
+        if (m_canceled) {
+            saved = false;
+            return;
+        }
+        const int x = index % count.width();
+        const int y = index / count.width();
+        const QRect area = QRect(2 * x * TILE_SIZE, 2 * y * TILE_SIZE,
+                                 2 * TILE_SIZE, 2 * TILE_SIZE).intersected(previous_rect);
+        QImage source(area.size(), QImage::Format_RGB32);
+        source.fill(Qt::white);
+        QPainter painter(&source);
+        for (int j = 2 * y; j < std::min(2 * y + 2, previous_count.height()); ++j) {
+            for (int i = 2 * x; i < std::min(2 * x + 2, previous_count.width()); ++i) {
+                const QImage part = tile(level - 1, i, j);
+                if (part.isNull()) {
+                    saved = false;
+                }
+                painter.drawImage((i - 2 * x) * TILE_SIZE, (j - 2 * y) * TILE_SIZE, part);
+            }
+        }
+        painter.end();
+        const QSize tile_size(std::min(TILE_SIZE, size.width() - x * TILE_SIZE),
+                              std::min(TILE_SIZE, size.height() - y * TILE_SIZE));
+        const QImage tile_image =
+                source.scaled(tile_size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        if (!tile_image.save(tilePath(level, x, y), TILE_FORMAT, TILE_QUALITY)) {
+            saved = false;
+        }
+    });
+    if (!saved) {
+        qDebug() << "Tissue image tiles cannot be created for level" << level;
+    }
+    return saved.load();
+}
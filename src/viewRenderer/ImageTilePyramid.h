@@ -0,0 +1,74 @@
+#ifndef IMAGETILEPYRAMID_H
+#define IMAGETILEPYRAMID_H
+
+#include <QString>
+#include <QSize>
+#include <QRect>
+#include <atomic>
+
+class QImage;
+
+// ImageTilePyramid splits an image into tiles of fixed size at several resolutions
+// (level 0 is the full resolution and every level halves the previous one until the
+// image fits in one tile). The tiles are generated once and saved in the cache
+// directory of the application so the image does not have to be decoded again.
+// Big images are decoded in strips so the whole image is never loaded into memory.
+// Reading tiles (tile()) does not change the pyramid so it can be done from
+// several threads once the pyramid is open. The generation can be canceled from
+// another thread (cancel()).
+class ImageTilePyramid
+{
+
+public:
+    // the width and height of the tiles (the tiles of the borders can be smaller)
+    static const int TILE_SIZE = 512;
+
+    ImageTilePyramid();
+    ~ImageTilePyramid();
+
+    // Opens the pyramid of the image, the tiles are generated if they are not
+    // in the cache or the image has changed since they were generated.
+    // Returns false if the image cannot be read or the tiles cannot be saved
+    bool open(const QString &imagefile);
+    void close();
+    bool isOpen() const;
+
+    // Stops the generation of the tiles (open() returns false), it has effect
+    // until the pyramid is closed
+    void cancel();
+
+    // the size of the image (full resolution)
+    const QSize size() const;
+    // the number of levels of the pyramid
+    int levels() const;
+    // the number of tiles of a level (columns and rows)
+    const QSize tileCount(const int level) const;
+    // the area of the image (in full resolution coordinates) covered by a tile
+    const QRect tileRect(const int level, const int x, const int y) const;
+
+    // Reads a tile from the cache (returns a null image if it cannot be read)
+    QImage tile(const int level, const int x, const int y) const;
+
+private:
+    // the size of a level in pixels
+    const QSize levelSize(const int level) const;
+    // the file of a tile in the cache directory
+    const QString tilePath(const int level, const int x, const int y) const;
+
+    // loads the description of the pyramid from the cache directory
+    // returns false if it does not exist or it was created from a different image
+    bool load(const quint64 fingerprint);
+    // generates the tiles of all the levels and saves the description of the pyramid
+    bool generate(const QString &imagefile, const quint64 fingerprint);
+    bool generateBaseLevel(const QString &imagefile);
+    bool generateLevel(const int level);
+
+    QString m_dir;
+    QSize m_size;
+    int m_levels;
+    std::atomic<bool> m_canceled;
+
+    Q_DISABLE_COPY(ImageTilePyramid)
+};
+
+#endif // IMAGETILEPYRAMID_H